@@ -326,3 +326,26 @@ ERR_STRDUP:
 ERR_INVALID_PARAMETER:
     return false;
 }
+
+bool address_get_cached_hostname(const address_t * address, char ** phostname)
+{
+#ifdef USE_CACHE
+    const void * data;
+
+    if (cache_ip_hostname && map_find(cache_ip_hostname, address, &data)) {
+        return (*phostname = strdup(data)) != NULL;
+    }
+#endif
+    return false;
+}
+
+bool address_set_cached_hostname(const address_t * address, const char * hostname)
+{
+#ifdef USE_CACHE
+    if (cache_ip_hostname) {
+        map_update(cache_ip_hostname, address, hostname);
+        return true;
+    }
+#endif
+    return false;
+}
@@ -175,4 +175,25 @@ int address_to_string(const address_t * addr, char ** pbuffer);
 
 bool address_resolv(const address_t * address, char ** phostname, int mask_cache);
 
+/**
+ * \brief Retrieve the hostname of an address from the DNS cache, without
+ *    performing any DNS lookup.
+ * \param address An address_t instance.
+ * \param phostname Points to a char * updated to point to a copy of the
+ *    cached hostname, which must be freed once it is no more used.
+ * \return true iif the address is cached.
+ */
+
+bool address_get_cached_hostname(const address_t * address, char ** phostname);
+
+/**
+ * \brief Store the hostname of an address in the DNS cache
+ *    (see resolver.h).
+ * \param address An address_t instance.
+ * \param hostname The corresponding hostname.
+ * \return true iif successful.
+ */
+
+bool address_set_cached_hostname(const address_t * address, const char * hostname);
+
 #endif 
@@ -72,6 +72,9 @@ algorithm_instance_t * algorithm_instance_create(
     instance->events     = dynarray_create();
     instance->caller     = NULL;
     instance->loop       = loop;
+    instance->is_ready   = false;
+    instance->ready_prev = NULL;
+    instance->ready_next = NULL;
     return instance;
 }
 
@@ -140,7 +143,7 @@ void pt_throw(
         if (instance) {
             // Enqueue an algorithm event
             dynarray_push_element(instance->events, event);
-            eventfd_write(instance->loop->eventfd_algorithm, 1);
+            pt_loop_ready_push(instance->loop, instance);
         } else if (loop) {
             // Enqueue an user event
             dynarray_push_element(loop->events_user, event);
@@ -239,6 +242,11 @@ void pt_del_instance(
     algorithm_instance_t * instance
 ) {
     pt_algorithm_instance_del(loop, instance);
+    pt_loop_ready_remove(loop, instance);
+
+    // Otherwise, the replies and the timeouts of its probes would be
+    // raised to the released instance.
+    network_cancel_probes(loop->network, instance);
     algorithm_instance_free(instance);
 }
 
@@ -7,6 +7,7 @@
  */
 
 #include <search.h>     // VISIT
+#include <stdbool.h>    // bool
 
 #include "probe.h"      // probe_t
 #include "event.h"      // event_t
@@ -58,6 +59,9 @@ typedef struct algorithm_instance_s {
     dynarray_t                  * events;     /**< An array of events received by the algorithm */
     struct algorithm_instance_s * caller;     /**< Reference to the entity that called the algorithm (NULL if called by user program) */
     struct pt_loop_s            * loop;       /**< Pointer to a library context */
+    bool                          is_ready;   /**< true iif this instance is in the ready list of its loop */
+    struct algorithm_instance_s * ready_prev; /**< Previous instance in the ready list of the loop */
+    struct algorithm_instance_s * ready_next; /**< Next instance in the ready list of the loop */
 } algorithm_instance_t;
 
 //--------------------------------------------------------------------
@@ -186,7 +190,8 @@ algorithm_instance_t * pt_add_instance(
 
 /**
  * \brief Unregister an algorithm instance from the pt_loop.
- *    Data related to the instance is NOT freed.
+ *    Data related to the instance is NOT freed. Its pending probes
+ *    are cancelled (see network_cancel_probes).
  * \param loop The libparistraceroute loop.
  * \param instance The algorithm instance.
  */
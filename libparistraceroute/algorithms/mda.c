@@ -4,6 +4,7 @@
 #include <stdlib.h>        // malloc, free
 #include <stdbool.h>       // bool
 #include <limits.h>        // INT_MAX
+#include <errno.h>         // EINVAL
 
 #include "../algorithm.h"  // algorithm_t
 #include "../common.h"     // MAX, ELEMENT_FREE
@@ -11,21 +12,8 @@
 #include "../pt_loop.h"    // pt_send_probe
 #include "../lattice.h"    // LATTICE_*
 #include "../probe.h"      // probe_t
-
-//---------------------------------------------------------------------------
-// Private structures
-//---------------------------------------------------------------------------
-
-typedef struct {
-    address_t     * address;
-    lattice_elt_t * result;
-} mda_address_t;
-
-typedef struct {
-    uint8_t         ttl;
-    uintmax_t       flow_id;
-    lattice_elt_t * result;
-} mda_search_data_t;
+#include "../hop_cache.h"  // hop_cache_*
+#include "../stop_set.h"   // stop_set_*
 
 //---------------------------------------------------------------------------
 // Options supported by mda.
@@ -33,13 +21,15 @@ typedef struct {
 //---------------------------------------------------------------------------
 
 static unsigned mda_values[10] = OPTIONS_MDA_BOUND_MAXBRANCH;
+static int      mda_pipeline_depth[3] = OPTIONS_MDA_PIPELINE_DEPTH;
 
 // MDA options
 // TODO: Can only pass integer values for confidence (thus cannot, for
 // example, measure confidence of 99.9999%). Expand functionality.
 static option_t mda_opt_specs[] = {
-    // action           short long          metavar                          help    variable
-    {opt_store_int_3,   "B",  "--mda",      "bound,max_branch,max_children", HELP_B, mda_values},
+    // action           short      long             metavar                          help               variable
+    {opt_store_int_3,   "B",       "--mda",          "bound,max_branch,max_children", HELP_B,            mda_values},
+    {opt_store_int_lim, OPT_NO_SF, "--mda-pipeline", "DEPTH",                         HELP_mda_pipeline, mda_pipeline_depth},
     END_OPT_SPECS
     // {opt_store_int, OPT_NO_SF, "confidence", "PERCENTAGE", "level of confidence", 0},
     // per dest
@@ -67,11 +57,16 @@ unsigned options_mda_get_is_set() {
     return mda_values[9];
 }
 
+unsigned options_mda_get_pipeline_depth() {
+    return mda_pipeline_depth[0];
+}
+
 void options_mda_init(mda_options_t * mda_options)
 {
-    mda_options->bound        = options_mda_get_bound();
-    mda_options->max_branch   = options_mda_get_max_branch();
-    mda_options->max_children = options_mda_get_max_children();
+    mda_options->bound          = options_mda_get_bound();
+    mda_options->max_branch     = options_mda_get_max_branch();
+    mda_options->max_children   = options_mda_get_max_children();
+    mda_options->pipeline_depth = options_mda_get_pipeline_depth();
 }
 
 inline mda_options_t mda_get_default_options() {
@@ -80,7 +75,8 @@ inline mda_options_t mda_get_default_options() {
          .traceroute_options = traceroute_get_default_options(),
          .bound              = 95,
          .max_branch         = 16,
-         .max_children       = 128
+         .max_children       = 128,
+         .pipeline_depth     = 0
     };
 
     return mda_options;
@@ -170,6 +166,123 @@ ERR_LINK:
  * is done, its siblings are complete.
  */
 
+/**
+ * \brief Set the TTL and the flow identifier of a probe.
+ * \param mda_data Data attached to this instance of MDA.
+ * \param probe A probe cloned from the skeleton.
+ * \param ttl The TTL of the probe.
+ * \param flow_id The flow identifier (casted into a uint16_t).
+ * \return true iif successful.
+ */
+
+static inline bool mda_set_probe_fields(mda_data_t * mda_data, probe_t * probe, uint8_t ttl, uintmax_t flow_id)
+{
+    uint16_t flow_id_u16 = flow_id;
+
+    return probe_accessor_write(&mda_data->ttl_accessor,     probe, &ttl)
+        && probe_accessor_write(&mda_data->flow_id_accessor, probe, &flow_id_u16);
+}
+
+/**
+ * \brief Send a probe, or answer it from the hop cache if a previous
+ *    instance has already sent the same (ttl, flow_id) from this source.
+ * \param mda_data Data attached to this instance of MDA.
+ * \param probe A probe whose TTL and flow identifier are set.
+ * \param ttl The TTL of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \return true iif successful.
+ */
+
+static bool mda_send_probe(mda_data_t * mda_data, probe_t * probe, uint8_t ttl, uintmax_t flow_id)
+{
+    const hop_cache_entry_t * entry;
+
+    if (mda_data->hop_cache_max_age > 0
+    && ttl <= mda_data->hop_cache_max_ttl
+    && (entry = hop_cache_find(&mda_data->src_ip, flow_id, ttl, mda_data->hop_cache_max_age))
+    ) {
+        return hop_cache_replay(mda_data->loop, probe, entry);
+    }
+    return pt_send_probe(mda_data->loop, probe);
+}
+
+/**
+ * \brief Retrieve the lowest TTL at which an interface has been seen.
+ * \param interface An interface.
+ * \return The lowest TTL of interface->ttl_set.
+ */
+
+static uint8_t mda_interface_get_min_ttl(const mda_interface_t * interface)
+{
+    size_t  i;
+    uint8_t ttl = interface->ttl_set[0];
+
+    for (i = 1; i < interface->num_ttls; i++) {
+        if (interface->ttl_set[i] < ttl) ttl = interface->ttl_set[i];
+    }
+    return ttl;
+}
+
+/**
+ * \brief Test whether an interface belongs to the global stop set, i.e.
+ *    whether its next hops have already been discovered by a previous
+ *    instance towards the same destination prefix (Doubletree).
+ *    The interfaces discovered backward are always enumerated, so that
+ *    they are linked to the interfaces found at start_ttl.
+ * \param interface An interface.
+ * \param mda_data Data attached to this instance of MDA.
+ * \return true iif the next hops of this interface must not be enumerated.
+ */
+
+static inline bool mda_interface_is_stopped(const mda_interface_t * interface, const mda_data_t * mda_data)
+{
+    return mda_data->use_stop_set
+        && interface->address
+        && mda_interface_get_min_ttl(interface) >= mda_data->start_ttl
+        && stop_set_contains(mda_data->loop->stop_set, interface->address, mda_data->dst_ip);
+}
+
+/**
+ * \brief Test whether the next hops of an interface are enumerated,
+ *    i.e. whether mda_enumerate() will send no more probe from it.
+ * \param elt The lattice node of the interface.
+ * \param mda_data Data attached to this instance of MDA.
+ * \return true iif enumeration is complete.
+ */
+
+static bool mda_interface_is_enumerated(const lattice_elt_t * elt, const mda_data_t * mda_data)
+{
+    const mda_interface_t * interface = lattice_elt_get_data(elt);
+    int                     to_send;
+
+    to_send = bound_get_nk(mda_data->bound, MAX(lattice_elt_get_num_next(elt) + 1, 2)) - interface->sent;
+    if ((to_send <= 0) && (interface->sent == interface->received + interface->timeout)) {
+        return true;
+    }
+
+    if (interface->address && (address_compare(interface->address, mda_data->dst_ip) == 0)) {
+        return interface->sent == interface->received;
+    }
+
+    return mda_interface_is_stopped(interface, mda_data);
+}
+
+/**
+ * \brief Test whether an interface lies beyond the frontier, i.e. whether
+ *    some interfaces at a lower TTL are still being enumerated.
+ *    Such an interface is only explored in pipelined mode and only
+ *    through the flows known to reach it (see mda_enumerate).
+ * \param interface An interface.
+ * \param mda_data Data attached to this instance of MDA.
+ * \return true iif the interface is explored speculatively.
+ */
+
+static inline bool mda_interface_is_speculative(const mda_interface_t * interface, const mda_data_t * mda_data)
+{
+    return mda_data->pipeline_depth > 0
+        && mda_interface_get_min_ttl(interface) > mda_data->frontier_ttl;
+}
+
 /**
  * \brief Discover next hops of a given IP hop.
  * \param elt The current IP hop.
@@ -180,7 +293,7 @@ ERR_LINK:
 static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data)
 {
     mda_interface_t * interface = lattice_elt_get_data(elt);
-    mda_ttl_flow_t  * mda_ttl_flow;
+    size_t            flow_index;
     /* Number of interfaces at the same TTL */
     size_t    num_nexthops = 0;
     probe_t * probe;
@@ -211,12 +324,22 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
         return (interface->sent == interface->received) ? LATTICE_DONE : LATTICE_CONTINUE;
     }
 
+    if (mda_interface_is_stopped(interface, mda_data)) {
+        return LATTICE_DONE;
+    }
+
     // 1) Ensure we have enough flow_ids to enumerate interfaces
 
     /* How many interfaces at current ttl */
     // Only if the previous is done enumerating
     num_siblings = lattice_elt_get_num_siblings(elt);
-    if (num_siblings > 1) {
+    if (mda_interface_is_speculative(interface, mda_data)) {
+        // The previous hops are still being enumerated, so the flows
+        // reaching this interface are not all known yet: only the flows
+        // already observed at this interface are used, and no new flow
+        // is forged until this hop reaches the frontier.
+        num_flows_avail = mda_interface_get_num_flows(interface, MDA_FLOW_AVAILABLE);
+    } else if (num_siblings > 1) {
         /* There are many interfaces at this TTL, we must ensure we have enough
          * flows available at the current ttl */
 
@@ -235,12 +358,16 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
                  * flight for each interface ? or multiply the number of probes in
                  * flight by the number of interface (might overestimate ?)*/
                 ttl = interface->ttl_set[i % interface->num_ttls]; // Vary ttl over all possible
-                probe = probe_dup(mda_data->skel);
+                if (!(probe = probe_pool_get(mda_data->probe_pool))) {
+                    goto ERR_PROBE_DUP;
+                }
                 flow_id = ++mda_data->last_flow_id;
-                mda_interface_add_flow_id(interface, ttl, flow_id, MDA_FLOW_TESTING); // TODO control returned value
-                // I16 casts flow_id into a uint16_t before memcpy
-                probe_set_fields(probe, I8("ttl", ttl), I16("flow_id", flow_id), NULL); // TODO control returned value, free fields
-                pt_send_probe(mda_data->loop, probe); // TODO control returned value
+                mda_interface_add_flow_id(mda_data, interface, ttl, flow_id, MDA_FLOW_TESTING); // TODO control returned value
+                if (!mda_set_probe_fields(mda_data, probe, ttl, flow_id)) {
+                    probe_free(probe);
+                    goto ERR_SET_PROBE_FIELDS;
+                }
+                mda_send_probe(mda_data, probe, ttl, flow_id); // TODO control returned value
             }
         }
     } else {
@@ -260,26 +387,29 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
     for (i = 0; i < num_flows_avail; i++) {
         // Get a new ttl flow_id tuple to send, or break/return
         // TODO manage properly break/return
-        mda_ttl_flow = mda_interface_get_available_flow_id(interface, num_siblings, mda_data);
-        if (!mda_ttl_flow) {
+        if (!mda_interface_get_available_flow_id(interface, num_siblings, mda_data, &flow_index)) {
             fprintf(stderr, "Not enough flows found reaching: ");
             address_dump(interface->address);
             break;
         }
         
-        flow_id = mda_ttl_flow->mda_flow->flow_id;
-        ttl     = mda_ttl_flow->ttl;
+        flow_id = mda_interface_get_flow_id(interface, flow_index);
+        ttl     = mda_interface_get_flow_ttl(interface, flow_index);
         // Send corresponding probe with ttl + 1
-        if (!(probe = probe_dup(mda_data->skel))) {
+        if (!(probe = probe_pool_get(mda_data->probe_pool))) {
             goto ERR_PROBE_DUP;
         }
-        probe_set_fields(probe, I16("flow_id", flow_id), I8("ttl", ttl + 1), NULL); // TODO control returned value, free fields
-        pt_send_probe(mda_data->loop, probe);
+        if (!mda_set_probe_fields(mda_data, probe, ttl + 1, flow_id)) {
+            probe_free(probe);
+            goto ERR_SET_PROBE_FIELDS;
+        }
+        mda_send_probe(mda_data, probe, ttl + 1, flow_id);
         interface->sent++;
     }
 
     return LATTICE_INTERRUPT_NEXT; // OK, but enumeration not complete, interrupt walk
 
+ERR_SET_PROBE_FIELDS:
 ERR_PROBE_DUP:
     return LATTICE_ERROR;
 }
@@ -336,6 +466,102 @@ static int mda_classify(lattice_elt_t * elt, mda_data_t * data)
 // Callbacks lattice_walk
 //---------------------------------------------------------------------------
 
+static lattice_return_t mda_search_frontier(lattice_elt_t * elt, void * data)
+{
+    mda_data_t * mda_data = data;
+    uint8_t      ttl;
+
+    if (!mda_interface_is_enumerated(elt, mda_data)) {
+        ttl = mda_interface_get_min_ttl(lattice_elt_get_data(elt));
+        if (ttl < mda_data->frontier_ttl) mda_data->frontier_ttl = ttl;
+    }
+    return LATTICE_CONTINUE;
+}
+
+/**
+ * \brief Insert an interface in the Doubletree stop sets.
+ * \param elt The lattice node of the interface.
+ * \param data Data attached to this instance of MDA.
+ * \return LATTICE_CONTINUE
+ */
+
+static lattice_return_t mda_update_stop_set(lattice_elt_t * elt, void * data)
+{
+    mda_data_t            * mda_data = data;
+    const mda_interface_t * interface = lattice_elt_get_data(elt);
+
+    if (interface->address) {
+        stop_set_insert(mda_data->loop->stop_set, interface->address, NULL);
+        stop_set_insert(mda_data->loop->stop_set, interface->address, mda_data->dst_ip);
+    }
+    return LATTICE_CONTINUE;
+}
+
+/**
+ * \brief Doubletree: once the interfaces reachable from the dummy root
+ *    are enumerated, replace this root by a new one, one hop backward,
+ *    so that the next walks discover the interfaces at the previous TTL
+ *    and link them to the interfaces already discovered. Probing
+ *    backward stops at min_ttl or at a TTL where an interface of the
+ *    local stop set (i.e. already discovered by any instance) has been
+ *    reached.
+ * \param mda_data Data attached to this instance of MDA.
+ * \param options The traceroute options passed to mda.
+ * \return true iif a new backward step has started.
+ */
+
+static bool mda_probe_backward(mda_data_t * mda_data, const traceroute_options_t * options)
+{
+    mda_interface_t       * root;
+    const mda_interface_t * interface;
+    lattice_elt_t         * root_elt;
+    dynarray_t            * roots = mda_data->lattice->roots;
+    size_t                  i, num_elts;
+
+    if (!mda_data->use_stop_set || mda_data->first_ttl <= options->min_ttl) {
+        return false;
+    }
+
+    // The interfaces found at start_ttl are checked against the global stop set
+    if (mda_data->first_ttl < mda_data->start_ttl) {
+        num_elts = lattice_elt_get_num_next(mda_data->root);
+        for (i = 0; i < num_elts; i++) {
+            interface = lattice_elt_get_data(dynarray_get_ith_element(mda_data->root->next, i));
+            if (interface->address && stop_set_contains(mda_data->loop->stop_set, interface->address, NULL)) {
+                return false;
+            }
+        }
+    }
+
+    // The former root is only detached from the lattice, since pending
+    // MDA_NEW_LINK events may still refer to it: it is released along
+    // with mda_data. Its next hops are now reached through the
+    // interfaces discovered at first_ttl - 1.
+    if (!dynarray_push_element(mda_data->former_roots, mda_data->root)) goto ERR_PUSH_FORMER_ROOT;
+
+    if (!(root = mda_interface_create(NULL))) goto ERR_INTERFACE_CREATE;
+    root->ttl_set[0] = mda_data->first_ttl - 2;
+    if (!(root_elt = mda_data_add_interface(mda_data, NULL, root))) goto ERR_LATTICE_ADD_ELEMENT;
+
+    num_elts = dynarray_get_size(roots);
+    for (i = 0; i < num_elts; i++) {
+        if (dynarray_get_ith_element(roots, i) == mda_data->root) {
+            dynarray_del_ith_element(roots, i, NULL);
+            break;
+        }
+    }
+    mda_data->root = root_elt;
+    mda_data->first_ttl--;
+    return true;
+
+ERR_LATTICE_ADD_ELEMENT:
+    mda_interface_free(root);
+ERR_INTERFACE_CREATE:
+    dynarray_del_ith_element(mda_data->former_roots, dynarray_get_size(mda_data->former_roots) - 1, NULL);
+ERR_PUSH_FORMER_ROOT:
+    return false;
+}
+
 static lattice_return_t mda_process_interface(lattice_elt_t * elt, void * data)
 {
     mda_data_t       * mda_data = data;
@@ -367,6 +593,18 @@ static lattice_return_t mda_process_interface(lattice_elt_t * elt, void * data)
         goto ERR_CLASSIFY;
     }
 
+    // 3) Pipelining:
+    //
+    //    The next hops of an incomplete interface are processed as well,
+    //    as long as they lie within pipeline_depth hops of the frontier.
+
+    if (ret == LATTICE_INTERRUPT_NEXT
+    &&  mda_interface_get_min_ttl(lattice_elt_get_data(elt)) < mda_data->frontier_ttl + mda_data->pipeline_depth
+    ) {
+        mda_data->is_pending = true;
+        ret = LATTICE_CONTINUE;
+    }
+
     return ret;
 
 ERR_FIND_NEXT_HOPS:
@@ -374,111 +612,77 @@ ERR_CLASSIFY:
     return LATTICE_ERROR;
 }
 
-static lattice_return_t mda_search_source(lattice_elt_t * elt, void * data)
-{
-    mda_interface_t   * interface = lattice_elt_get_data(elt);
-    mda_search_data_t * search    = data;
-    mda_flow_t        * mda_flow;
-    mda_ttl_flow_t    * mda_ttl_flow;
-    size_t              i, j, size;
-    uint8_t             ttl;
-
-    for (i = 0; i < interface->num_ttls; ++i) {
-        ttl = interface->ttl_set[i];
-        if (ttl == search->ttl) {
-            size = dynarray_get_size(interface->ttl_flows);
-            for (j = 0; j < size; j++) {
-                mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, j);
-                mda_flow = mda_ttl_flow->mda_flow;
-                if ((mda_flow->flow_id == search->flow_id) 
-                && (mda_ttl_flow->ttl == search->ttl)
-                &&  (mda_flow->state != MDA_FLOW_TESTING)) {
-                    search->result = elt;
-                    return LATTICE_INTERRUPT_ALL;
-                }
-            }
+//---------------------------------------------------------------------------
+// Flow lookups (see mda_data_get_ttl_flows)
+//---------------------------------------------------------------------------
 
-            /**
-             * Note: Awkward check is needed because in the case of nodes with
-             * multiple ttl_set, it is possible for a pair of nodes to have the
-             * same ttl while simultaneously being in a parent/child
-             * relationship. Thus, if the parent is searched unsuccessfuly at
-             * the correct ttl, we still must search the child as it could
-             * have both the correct ttl and the correct flow_id. - T.D.
-             */
-            if (interface->num_ttls == 1) {
-                return LATTICE_INTERRUPT_NEXT; // don't process children
-            }
-        }
-    }
-    return LATTICE_CONTINUE; // continue until we reach the right ttl
-}
+/**
+ * \brief Search the interface from which a probe has been forwarded.
+ * \param data The data of the mda instance.
+ * \param ttl The TTL of this interface (i.e. the TTL of the probe - 1).
+ * \param flow_id The flow identifier of the probe.
+ * \return The lattice node of the corresponding interface, NULL if
+ *    not found.
+ */
 
-static lattice_return_t mda_delete_flow(lattice_elt_t * elt, void * data)
+static lattice_elt_t * mda_search_source(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
 {
-    mda_interface_t    * interface = lattice_elt_get_data(elt);
-    mda_search_data_t  * search    = data;
-    mda_flow_t         * mda_flow;
-    mda_ttl_flow_t     * mda_ttl_flow;
-    size_t               i, j, size;
-    uint8_t              ttl;
-
-    for (i = 0; i < interface->num_ttls; ++i) {
-        ttl = interface->ttl_set[i];
-        if (ttl == search->ttl) {
-            size = dynarray_get_size(interface->ttl_flows);
-            for (j = 0; j < size; j++) {
-                mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, j);
-                mda_flow     = mda_ttl_flow->mda_flow;
-                if ((mda_flow->flow_id == search->flow_id) && (mda_flow->state == MDA_FLOW_TESTING)) {
-                    dynarray_del_ith_element(interface->ttl_flows, j, (ELEMENT_FREE) mda_ttl_flow_free);
-                    return LATTICE_INTERRUPT_ALL;
-                }
-            }
-            return LATTICE_INTERRUPT_NEXT; // don't process children
+    const mda_ttl_flow_entry_t * entry;
+
+    for (entry = mda_data_get_ttl_flows(data, ttl, flow_id); entry; entry = entry->next) {
+        if (mda_interface_get_flow_state(entry->interface, entry->index) != MDA_FLOW_TESTING
+        &&  mda_interface_has_ttl(entry->interface, ttl)) {
+            return entry->interface->elt;
         }
     }
-    return LATTICE_CONTINUE; // continue until we reach the right ttl
+    return NULL;
 }
 
-static lattice_return_t mda_timeout_flow(lattice_elt_t * elt, void * data)
+/**
+ * \brief Delete a flow which was being tested at a given TTL.
+ * \param data The data of the mda instance.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier.
+ * \return true iif a flow has been deleted.
+ */
+
+static bool mda_delete_flow(mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
 {
-    mda_interface_t    * interface = lattice_elt_get_data(elt);
-    mda_search_data_t  * search    = data;
-    mda_flow_t         * mda_flow;
-    mda_ttl_flow_t     * mda_ttl_flow;
-    size_t               i, j, size;
-    uint8_t              ttl;
-
-    for (i = 0; i < interface->num_ttls; ++i) {
-        ttl = interface->ttl_set[i];
-
-        if (ttl == search->ttl) {
-            size = dynarray_get_size(interface->ttl_flows);
-            for (j = 0; j < size; j++) {
-                mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, j);
-                mda_flow     = mda_ttl_flow->mda_flow;
-                if ((mda_flow->flow_id == search->flow_id) && (mda_flow->state == MDA_FLOW_UNAVAILABLE)) {
-                    mda_flow->state = MDA_FLOW_TIMEOUT;
-                    return LATTICE_INTERRUPT_ALL;
-                }
-            }
-            return LATTICE_INTERRUPT_NEXT; // don't process children
+    mda_ttl_flow_entry_t * entry;
+
+    for (entry = mda_data_get_ttl_flows(data, ttl, flow_id); entry; entry = entry->next) {
+        if (mda_interface_get_flow_state(entry->interface, entry->index) == MDA_FLOW_TESTING
+        &&  mda_interface_has_ttl(entry->interface, ttl)) {
+            return mda_interface_del_flow(data, entry->interface, entry->index);
         }
     }
-    return LATTICE_CONTINUE; // continue until we reach the right ttl
+    return false;
 }
 
-static lattice_return_t mda_search_interface(lattice_elt_t * elt, void * data)
-{
-    mda_interface_t * interface = lattice_elt_get_data(elt);
-    mda_address_t   * search    = data;
+/**
+ * \brief Mark as timed out a flow used to discover the next hops of
+ *    an interface.
+ * \param data The data of the mda instance.
+ * \param interface The interface carrying the flow. Pass NULL to
+ *    consider every interface.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier.
+ * \return true iif a flow has been updated.
+ */
 
-    if (interface->address && address_compare(interface->address, search->address) == 0) {
-        search->result = elt;
-        return LATTICE_INTERRUPT_ALL;
+static bool mda_timeout_flow(mda_data_t * data, const mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id)
+{
+    mda_ttl_flow_entry_t * entry;
+
+    for (entry = mda_data_get_ttl_flows(data, ttl, flow_id); entry; entry = entry->next) {
+        if ((!interface || entry->interface == interface)
+        &&  mda_interface_get_flow_state(entry->interface, entry->index) == MDA_FLOW_UNAVAILABLE
+        &&  mda_interface_has_ttl(entry->interface, ttl)) {
+            mda_interface_set_flow_state(entry->interface, entry->index, MDA_FLOW_TIMEOUT);
+            return true;
+        }
     }
-    return LATTICE_CONTINUE;
+    return false;
 }
 
 //---------------------------------------------------------------------------
@@ -489,14 +693,16 @@ static lattice_return_t mda_search_interface(lattice_elt_t * elt, void * data)
  * \brief Process ALGORITHM_INIT nested events handled by an mda algorithm instance.
  * \param loop The main loop.
  * \param event (Unused) you could pass NULL.
- * \param pdata The data related to this algorithm instance.
+ * \param pdata The data related to this algorithm instance. It is only
+ *    set once the initialization has succeeded, and left to NULL otherwise.
  * \param skel The probe skeleton.
  * \param options The options passed to mda.
  */
 
 static void mda_handler_init(pt_loop_t * loop, event_t * event, mda_data_t ** pdata, probe_t * skel, const mda_options_t * options)
 {
-    mda_data_t * data;
+    mda_data_t      * data;
+    mda_interface_t * root;
 
     /*
     // DEBUG
@@ -511,6 +717,11 @@ static void mda_handler_init(pt_loop_t * loop, event_t * event, mda_data_t ** pd
     );
     */
 
+    // Probes are cloned from the skeleton and then only their TTL and flow
+    // identifier are altered, so the skeleton (source IP, length...) is
+    // finalized once.
+    if (!probe_update_fields(skel))                     goto ERR_PROBE_UPDATE_FIELDS;
+
     // Create local data structure
     if (!(data = mda_data_create()))                    goto ERR_MDA_DATA_CREATE;
     if (!(probe_extract(skel, "dst_ip", data->dst_ip))) goto ERR_EXTRACT_DST_IP;
@@ -518,21 +729,40 @@ static void mda_handler_init(pt_loop_t * loop, event_t * event, mda_data_t ** pd
     // Initialize algorithm's data
     data->skel = skel;
     data->loop = loop;
-    *pdata = data;
+    data->pipeline_depth = options->pipeline_depth;
+    data->use_stop_set = options->traceroute_options.start_ttl > 0;
+    data->start_ttl = options->traceroute_options.start_ttl;
+    data->first_ttl = options->traceroute_options.start_ttl;
+    if (options->traceroute_options.hop_cache_max_age > 0
+    &&  probe_extract(skel, "src_ip", &data->src_ip)) {
+        data->hop_cache_max_age = options->traceroute_options.hop_cache_max_age;
+        data->hop_cache_max_ttl = options->traceroute_options.hop_cache_max_ttl;
+    }
+    if (!(data->probe_pool = probe_pool_create(skel, PROBE_POOL_DEFAULT_SIZE))) goto ERR_PROBE_POOL_CREATE;
 
     // Create a dummy first hop, root of a lattice of discovered interfaces:
     // - not a tree since some interfaces might have several predecessors (diamonds)
     // - we assume the initial hop is not a load balancer
-    if (!lattice_add_element(data->lattice, NULL, mda_interface_create(NULL))) {
+    // In Doubletree mode, the first probes are sent at start_ttl, then
+    // backward (see mda_probe_backward).
+    if (!(root = mda_interface_create(NULL)))           goto ERR_INTERFACE_CREATE;
+    if (options->traceroute_options.start_ttl > 0) {
+        root->ttl_set[0] = options->traceroute_options.start_ttl - 1;
+    }
+    if (!(data->root = mda_data_add_interface(data, NULL, root))) {
         goto ERR_LATTICE_ADD_ELEMENT;
     }
 
+    *pdata = data;
     return;
 
 ERR_LATTICE_ADD_ELEMENT:
+ERR_INTERFACE_CREATE:
+ERR_PROBE_POOL_CREATE:
 ERR_EXTRACT_DST_IP:
     mda_data_free(data);
 ERR_MDA_DATA_CREATE:
+ERR_PROBE_UPDATE_FIELDS:
     return;
 }
 
@@ -553,22 +783,17 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
                      * dest_elt;
     mda_interface_t  * source_interface,
                      * dest_interface;
-    mda_search_data_t  search_ttl_flow;
-    mda_address_t      search_interface;
-    mda_ttl_flow_t   * mda_ttl_flow;
-    mda_flow_t       * mda_flow;
     address_t          addr;
     uint16_t           flow_id_u16;
     uint8_t            ttl, src_ttl;
-    int                ret;
     size_t             i, j;
 
     probe = ((const probe_reply_t *) event->data)->probe;
     reply = ((const probe_reply_t *) event->data)->reply;
 
-    if (!(probe_extract(probe, "ttl",     &ttl)))         goto ERR_EXTRACT_TTL;
-    if (!(probe_extract(probe, "flow_id", &flow_id_u16))) goto ERR_EXTRACT_FLOW_ID;
-    if (!(probe_extract(reply, "src_ip",  &addr)))        goto ERR_EXTRACT_SRC_IP;
+    if (!(probe_accessor_extract(&data->ttl_accessor,     probe, &ttl)))         goto ERR_EXTRACT_TTL;
+    if (!(probe_accessor_extract(&data->flow_id_accessor, probe, &flow_id_u16))) goto ERR_EXTRACT_FLOW_ID;
+    if (!(probe_accessor_extract(&data->src_ip_accessor,  reply, &addr)))        goto ERR_EXTRACT_SRC_IP;
 
     //printf("Probe reply received: %hhu %s [%ju]\n", ttl, addr, flow_id_u16);
 
@@ -579,18 +804,15 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
      *  - probe->flow_id : disambiguate between several possible
      *      interfaces at the same ttl, since one flow_id will typically
      *      pass though one only.
-     *  The corresponding addr is searched thanks to
-     *  mda_interface_find_rec, recursively from the root interface
+     *  The corresponding interface is retrieved thanks to the
+     *  (ttl, flow_id) index of the mda data.
      *
-     *  destination: reply->src_ip
+     *  destination: reply->src_ip, retrieved thanks to the address
+     *  index of the mda data.
      */
 
-    search_interface.address = &addr;
-    search_interface.result = NULL;
-    ret = lattice_walk(data->lattice, mda_search_interface, &search_interface, LATTICE_WALK_DFS);
-    if (ret == LATTICE_INTERRUPT_ALL) {
+    if ((dest_elt = mda_data_find_interface(data, &addr))) {
         // Destination found
-        dest_elt = search_interface.result;
         dest_interface = lattice_elt_get_data(dest_elt);
     } else {
         dest_elt = NULL;
@@ -599,13 +821,8 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
                                        // create technically makes first ttl 0, this overwrites).
     }
 
-    search_ttl_flow.ttl = ttl - 1;
-    search_ttl_flow.flow_id = flow_id_u16;
-    search_ttl_flow.result = NULL;
-    ret = lattice_walk(data->lattice, mda_search_source, &search_ttl_flow, LATTICE_WALK_DFS);
-    if (ret == LATTICE_INTERRUPT_ALL) {
+    if ((source_elt = mda_search_source(data, ttl - 1, flow_id_u16))) {
         // Found
-        source_elt = search_ttl_flow.result;
         source_interface = lattice_elt_get_data(source_elt);
 
         if (dest_elt) {
@@ -647,7 +864,7 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
              */
 
         } else {
-            if (!lattice_add_element(data->lattice, source_elt, dest_interface)) {
+            if (!mda_data_add_interface(data, source_elt, dest_interface)) {
                 goto ERR_LATTICE_ADD_ELEMENT;
             }
         }
@@ -662,31 +879,25 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
         }
     }
 
-    // Insert flow in the right interface
-    if (!(mda_flow = mda_flow_create(flow_id_u16, MDA_FLOW_AVAILABLE))) {
-        goto ERR_MDA_FLOW_CREATE;
-    }
-
-    if (!(mda_ttl_flow = mda_ttl_flow_create(ttl, mda_flow))) {
-        goto ERR_MDA_TTL_FLOW_CREATE;
+    // Share this reply with the next instances, unless it is specific to this destination
+    if (data->hop_cache_max_age > 0
+    &&  ttl <= data->hop_cache_max_ttl
+    &&  address_compare(&addr, data->dst_ip) != 0
+    ) {
+        hop_cache_insert(&data->src_ip, flow_id_u16, ttl, probe, reply);
     }
 
-    if (!dynarray_push_element(dest_interface->ttl_flows, mda_ttl_flow)) {
-        goto ERR_DYNARRAY_PUSH_ELEMENT;
+    // Insert flow in the right interface
+    if (!mda_interface_add_flow_id(data, dest_interface, ttl, flow_id_u16, MDA_FLOW_AVAILABLE)) {
+        goto ERR_ADD_FLOW_ID;
     }
 
     // Delete flow in all siblings. Right?
-    search_ttl_flow.ttl = ttl;
-    search_ttl_flow.flow_id = flow_id_u16;
-    search_ttl_flow.result = NULL;
-    lattice_walk(data->lattice, mda_delete_flow, &search_ttl_flow, LATTICE_WALK_DFS);
+    mda_delete_flow(data, ttl, flow_id_u16);
 
     return;
 
-ERR_DYNARRAY_PUSH_ELEMENT:
-    mda_flow_free(mda_flow);
-ERR_MDA_TTL_FLOW_CREATE:
-ERR_MDA_FLOW_CREATE:
+ERR_ADD_FLOW_ID:
 ERR_MDA_EVENT_NEW_LINK:
 ERR_LATTICE_ADD_ELEMENT:
 ERR_LATTICE_CONNECT:
@@ -701,32 +912,22 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
     probe_t               * probe;
     lattice_elt_t         * source_elt;
     mda_interface_t       * source_interface;
-    mda_search_data_t       search_ttl_flow;
     uint16_t                flow_id_u16 = 0;
     uint8_t                 ttl;
-    int                     ret;
     size_t                  i, num_next;
 
     probe = event->data;
 
-    if (!(probe_extract(probe, "ttl",     &ttl)))     goto ERR_EXTRACT_TTL;
-    if (!(probe_extract(probe, "flow_id", &flow_id_u16))) goto ERR_EXTRACT_FLOW_ID;
+    if (!(probe_accessor_extract(&data->ttl_accessor,     probe, &ttl)))         goto ERR_EXTRACT_TTL;
+    if (!(probe_accessor_extract(&data->flow_id_accessor, probe, &flow_id_u16))) goto ERR_EXTRACT_FLOW_ID;
 
-    search_ttl_flow.ttl = ttl - 1;
-    search_ttl_flow.flow_id = flow_id_u16;
-    search_ttl_flow.result = NULL;
-    ret = lattice_walk(data->lattice, mda_search_source, &search_ttl_flow, LATTICE_WALK_DFS);
-    if (ret == LATTICE_INTERRUPT_ALL) {
+    if ((source_elt = mda_search_source(data, ttl - 1, flow_id_u16))) {
         // Found
-        source_elt = search_ttl_flow.result;
         source_interface = lattice_elt_get_data(source_elt);
         source_interface->timeout++;
 
         // Mark the flow as timeout
-        search_ttl_flow.ttl = ttl - 1;
-        search_ttl_flow.flow_id = flow_id_u16;
-        search_ttl_flow.result = NULL;
-        mda_timeout_flow(source_elt, &search_ttl_flow);
+        mda_timeout_flow(data, source_interface, ttl - 1, flow_id_u16);
 
         if (source_interface->timeout == source_interface->sent) { // XXX to_send ??
             // All timeouts, we need to add a star interface, and start a new
@@ -739,7 +940,7 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
 
                 new_iface->num_stars = source_interface->num_stars + 1;
 
-                if (!lattice_add_element(data->lattice, source_elt, new_iface)) {
+                if (!mda_data_add_interface(data, source_elt, new_iface)) {
                     goto ERROR;
                 }
 
@@ -763,13 +964,8 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
         }
 
     } else {
-        // Delete flow in all siblings
-        search_ttl_flow.ttl = ttl;
-        search_ttl_flow.flow_id = flow_id_u16;
-        search_ttl_flow.result = NULL;
-
         // Mark the flow as timeout
-        lattice_walk(data->lattice, mda_timeout_flow, &search_ttl_flow, LATTICE_WALK_DFS);
+        mda_timeout_flow(data, NULL, ttl, flow_id_u16);
     }
 
     return;
@@ -802,33 +998,61 @@ int mda_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t * skel
     switch (event->type) {
         case ALGORITHM_INIT:
             mda_handler_init(loop, event, (mda_data_t **) pdata, skel, options);
-            data = *pdata;
+            if (!(data = *pdata)) {
+                fprintf(stderr, "mda_handler: cannot initialize mda\n");
+                pt_raise_error(loop);
+                return EINVAL;
+            }
             break;
         case PROBE_REPLY:
-            data = *pdata;
+            // Ignore the events received after a failed initialization
+            if (!data) return 0;
             mda_handler_reply(loop, event, data, skel, options);
             break;
         case PROBE_TIMEOUT:
-            data = *pdata;
+            if (!data) return 0;
             mda_handler_timeout(loop, event, data, skel, options);
             break;
         case ALGORITHM_TERM:
-            fprintf(stderr, "event not yet handled\n");
-            // We should release the memory here
+            // The caller allows us to free mda's data
+            mda_data_free(data);
+            *pdata = NULL;
             pt_raise_terminated(loop);
-            break;
+            return 0;
         default:
             fprintf(stderr, "mda_handler: ignoring unhandled event (type = %d)\n", event->type);
             return 0;
     }
 
-    // Process available interfaces
-    switch (lattice_walk(data->lattice, mda_process_interface, data, LATTICE_WALK_DFS)) {
-        case LATTICE_ERROR:
-            fprintf(stderr, "mda_handler: LATTICE_ERROR\n");
-            return -1;
-        case LATTICE_DONE:  break;
-        default:            return 0;
+    // Doubletree: walk again each time the root is replaced one hop backward
+    do {
+        // In pipelined mode, locate the first incomplete hop
+        if (data->pipeline_depth > 0) {
+            data->frontier_ttl = UINT8_MAX;
+            if (lattice_walk(data->lattice, mda_search_frontier, data, LATTICE_WALK_BFS) == LATTICE_ERROR) {
+                fprintf(stderr, "mda_handler: LATTICE_ERROR\n");
+                return -1;
+            }
+        }
+
+        // Process available interfaces
+        data->is_pending = false;
+        switch (lattice_walk(data->lattice, mda_process_interface, data, LATTICE_WALK_DFS)) {
+            case LATTICE_ERROR:
+                fprintf(stderr, "mda_handler: LATTICE_ERROR\n");
+                return -1;
+            case LATTICE_DONE:
+                // Some interfaces let the walk reach their next hops although
+                // they are not complete.
+                if (data->is_pending) return 0;
+                break;
+            default:            return 0;
+        }
+    } while (mda_probe_backward(data, &options->traceroute_options));
+
+    // Share the discovered interfaces with the next Doubletree instances
+    if (data->use_stop_set) {
+        lattice_walk(data->lattice, mda_update_stop_set, data, LATTICE_WALK_BFS);
     }
 
     pt_raise_terminated(loop);
@@ -10,15 +10,20 @@
 
 //mda command line help messages
 #define HELP_B "Multipath tracing  bound: an upper bound on the probability that multipath tracing will fail to find all of the paths (default 0.05) max_branch: the maximum number of branching points that can be encountered for the bound still to hold (default 5)"
+#define HELP_mda_pipeline "Number of hops beyond the first incomplete hop that multipath tracing may explore at the same time (default 0: hop-by-hop)"
 
 //                                   def1 min1 max1 def2 min2 max2     def3  min3 max3     mda_enabled
 #define OPTIONS_MDA_BOUND_MAXBRANCH {95,  0,   100, 5,   1,   INT_MAX, 128,  1,   INT_MAX, 0}
 
+//                                   def min max
+#define OPTIONS_MDA_PIPELINE_DEPTH  {0,  0,  255}
+
 typedef struct {
     traceroute_options_t traceroute_options;
     unsigned             bound;
     unsigned             max_branch;
     unsigned             max_children;
+    unsigned             pipeline_depth; /**< Number of hops explored beyond the first incomplete hop (0: lock-step) */
 } mda_options_t;
 
 typedef enum {
@@ -35,6 +40,7 @@ typedef struct {
 unsigned options_mda_get_bound();
 unsigned options_mda_get_max_branch();
 unsigned options_mda_get_is_set();
+unsigned options_mda_get_pipeline_depth();
 
 const option_t * mda_get_options();
 
@@ -52,6 +58,15 @@ mda_options_t mda_get_default_options();
 
 void options_mda_init(mda_options_t * mda_options);
 
+/**
+ * \brief Retrieve the stopping points related to some mda options
+ *    (see bound_cache_get).
+ * \param mda_options The mda options.
+ * \return The corresponding bound_t instance, NULL in case of failure.
+ */
+
+const bound_t * mda_options_get_bound(const mda_options_t * mda_options);
+
 /**
  * \brief Default mda handler.
  * \param loop The main loop.
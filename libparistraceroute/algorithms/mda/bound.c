@@ -6,14 +6,21 @@
  * Detailed explanation can be found at www.paris-traceroute.net/publications.
  */
 
+#include "../../use.h"
+
 #include <stdbool.h> // bool
-#include <stdio.h>   // fprintf, sscanf
+#include <stdint.h>  // uint32_t
+#include <stdio.h>   // fprintf, sscanf, fopen
 #include <stdlib.h>  // malloc, calloc, free
-#include <string.h>  // memset
+#include <string.h>  // memset, memcmp
 #include <math.h>    // pow
+#include <sys/stat.h> // fstat
 
 #include "bound.h"
 
+// Magic number starting a file generated by bound_cache_save
+#define BOUND_FILE_MAGIC "PTBOUND1"
+
 // We condiser a set of diagonal vectors (indexed by i) made of several cells (indexed by j)
 #define PROBA_HOR(i, j)    ((long double)(j) / (i))              // Probability to follow a horizontal transition
 #define PROBA_VER(i, j)    ((long double)((i) - (j) + 1) / (i)) // Probability to follow a vertical transition
@@ -308,7 +315,7 @@ void bound_build(bound_t * bound, size_t end)
         fprintf(stderr, "Provided bound struct contained null values or was itself null\n");
 }
 
-size_t bound_get_nk(bound_t * bound, size_t k)
+size_t bound_get_nk(const bound_t * bound, size_t k)
 {
     size_t ret = 0;
 
@@ -324,6 +331,8 @@ void bound_failure_dump(bound_t * bound)
 {
     size_t i;
 
+    if (!bound->pr_failure) return;
+
     printf("Expected failure:\n");
     for (i = 0; i <= bound->max_n; ++i) {
         printf("%zu - %Lf\n", i, bound->pr_failure[i]);    
@@ -350,20 +359,199 @@ void bound_free(bound_t * bound)
     }
 }
 
-int main(int argc, const char * argv[]) {
-    long double confidence;
-    size_t      interfaces;
-    size_t      max_branch;
-
-//    sscanf(argv[1], "%Lf", &confidence);
-//    sscanf(argv[2], "%d", &interfaces);
-    confidence = .05;
-    interfaces = 16;
-    max_branch = 1;
-    bound_t * bound = bound_create(confidence, interfaces, max_branch);
-    bound_dump(bound);
-    bound_failure_dump(bound);
+//--------------------------------------------------------------------------
+// Process-wide cache of stopping points
+//--------------------------------------------------------------------------
+
+typedef struct bound_cache_entry_s {
+    bound_t                    * bound; /**< Cached stopping points */
+    struct bound_cache_entry_s * next;  /**< Next cached entry */
+} bound_cache_entry_t;
+
+static bound_cache_entry_t * s_bound_cache = NULL;
+
+#ifdef USE_BOUND_CACHE_FILE
+static bool s_bound_cache_file_loaded = false;
+#endif
+
+static void __bound_cache_free() __attribute__((destructor));
+
+static void __bound_cache_free() {
+    bound_cache_entry_t * entry,
+                        * next;
+
+    for (entry = s_bound_cache; entry; entry = next) {
+        next = entry->next;
+        bound_free(entry->bound);
+        free(entry);
+    }
+    s_bound_cache = NULL;
+}
+
+/**
+ * \brief Search a bound_t instance in the cache.
+ * \param confidence The confidence at each branching point
+ *    (see node_confidence).
+ * \param max_n Max assumed branching at an interface.
+ * \return The corresponding bound_t instance if any, NULL otherwise.
+ */
+
+static bound_t * bound_cache_find(double confidence, size_t max_n)
+{
+    bound_cache_entry_t * entry;
+
+    for (entry = s_bound_cache; entry; entry = entry->next) {
+        if (entry->bound->confidence == confidence && entry->bound->max_n == max_n) {
+            return entry->bound;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Store a bound_t instance in the cache, which becomes
+ *    responsible for releasing it.
+ * \param bound The bound_t instance.
+ * \return true iif successful.
+ */
+
+static bool bound_cache_insert(bound_t * bound)
+{
+    bound_cache_entry_t * entry;
+
+    if (!(entry = malloc(sizeof(bound_cache_entry_t)))) return false;
+    entry->bound  = bound;
+    entry->next   = s_bound_cache;
+    s_bound_cache = entry;
+    return true;
+}
+
+const bound_t * bound_cache_get(double confidence, size_t max_interfaces, size_t max_branch)
+{
+    bound_t * bound;
+
+#ifdef USE_BOUND_CACHE_FILE
+    if (!s_bound_cache_file_loaded) {
+        s_bound_cache_file_loaded = true;
+        bound_cache_load(BOUND_CACHE_FILENAME);
+    }
+#endif
+
+    if (!(bound = bound_cache_find(node_confidence(confidence, max_branch), max_interfaces))) {
+        if (!(bound = bound_create(confidence, max_interfaces, max_branch))) goto ERR_BOUND_CREATE;
+        if (!bound_cache_insert(bound))                                      goto ERR_BOUND_CACHE_INSERT;
+    }
+    return bound;
+
+ERR_BOUND_CACHE_INSERT:
+    bound_free(bound);
+ERR_BOUND_CREATE:
+    return NULL;
+}
+
+bool bound_cache_load(const char * filename)
+{
+    FILE      * file;
+    struct stat st;
+    char        magic[sizeof(BOUND_FILE_MAGIC) - 1];
+    uint32_t    num_tables, max_n, nk;
+    double      confidence;
+    bound_t   * bound = NULL;
+    size_t      i, k, table_size, offset;
+
+    if (!(file = fopen(filename, "rb"))) goto ERR_FOPEN;
+    if (fstat(fileno(file), &st) == -1)  goto ERR_HEADER;
+
+    if (fread(magic, sizeof(magic), 1, file) != 1
+    ||  memcmp(magic, BOUND_FILE_MAGIC, sizeof(magic)) != 0
+    ||  fread(&num_tables, sizeof(uint32_t), 1, file) != 1) {
+        goto ERR_HEADER;
+    }
+
+    for (i = 0; i < num_tables; i++) {
+        if (fread(&confidence, sizeof(double), 1, file) != 1
+        ||  fread(&max_n, sizeof(uint32_t), 1, file) != 1) {
+            goto ERR_TABLE;
+        }
+
+        // Check max_n against the size of the file before allocating the table
+        offset     = ftell(file);
+        table_size = (max_n + 1) * sizeof(uint32_t);
+        if (!(confidence > 0 && confidence < 1)
+        ||  max_n > BOUND_CACHE_MAX_N
+        ||  offset + table_size > (size_t) st.st_size) {
+            goto ERR_TABLE;
+        }
+
+        if (!(bound = calloc(1, sizeof(bound_t))))                     goto ERR_BOUND_MALLOC;
+        bound->confidence = confidence;
+        bound->max_n      = max_n;
+        if (!(bound->nk_table = malloc((max_n + 1) * sizeof(size_t)))) goto ERR_NK_TABLE_MALLOC;
+
+        for (k = 0; k <= max_n; k++) {
+            if (fread(&nk, sizeof(uint32_t), 1, file) != 1) goto ERR_NK;
+            bound->nk_table[k] = nk;
+        }
+
+        // Tables computed or loaded previously are kept
+        if (bound_cache_find(confidence, max_n)) {
+            bound_free(bound);
+        } else if (!bound_cache_insert(bound)) {
+            goto ERR_BOUND_CACHE_INSERT;
+        }
+        bound = NULL;
+    }
+
+    fclose(file);
+    return true;
+
+ERR_BOUND_CACHE_INSERT:
+ERR_NK:
+ERR_NK_TABLE_MALLOC:
     bound_free(bound);
-    return 0;
+ERR_BOUND_MALLOC:
+ERR_TABLE:
+ERR_HEADER:
+    fprintf(stderr, "bound_cache_load: invalid file %s\n", filename);
+    fclose(file);
+ERR_FOPEN:
+    return false;
 }
 
+bool bound_cache_save(const char * filename)
+{
+    FILE                * file;
+    bound_cache_entry_t * entry;
+    uint32_t              num_tables = 0, max_n, nk;
+    size_t                k;
+
+    if (!(file = fopen(filename, "wb"))) goto ERR_FOPEN;
+
+    for (entry = s_bound_cache; entry; entry = entry->next) {
+        num_tables++;
+    }
+
+    if (fwrite(BOUND_FILE_MAGIC, sizeof(BOUND_FILE_MAGIC) - 1, 1, file) != 1
+    ||  fwrite(&num_tables, sizeof(uint32_t), 1, file) != 1) {
+        goto ERR_FWRITE;
+    }
+
+    for (entry = s_bound_cache; entry; entry = entry->next) {
+        max_n = entry->bound->max_n;
+        if (fwrite(&entry->bound->confidence, sizeof(double), 1, file) != 1
+        ||  fwrite(&max_n, sizeof(uint32_t), 1, file) != 1) {
+            goto ERR_FWRITE;
+        }
+        for (k = 0; k <= max_n; k++) {
+            nk = entry->bound->nk_table[k];
+            if (fwrite(&nk, sizeof(uint32_t), 1, file) != 1) goto ERR_FWRITE;
+        }
+    }
+
+    return fclose(file) == 0;
+
+ERR_FWRITE:
+    fclose(file);
+ERR_FOPEN:
+    return false;
+}
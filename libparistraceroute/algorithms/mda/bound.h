@@ -2,6 +2,19 @@
 #define WORKSHOP_BOUND_H
 
 #include <stddef.h>
+#include <stdbool.h> // bool
+
+// File storing precomputed stopping points (see bound_cache_save). It is
+// defined by Makefile.am as $(pkgdatadir)/mda_bound.bin, where the
+// stopping points of the default mda options are installed, unless
+// configure has been run with --disable-mda-bound-file or cross-compiles.
+#ifndef BOUND_CACHE_FILENAME
+#    define BOUND_CACHE_FILENAME "mda_bound.bin"
+#endif
+
+// Maximum branching (max_n) of the tables loaded by bound_cache_load
+#define BOUND_CACHE_MAX_N 65535
+
 /**
  * bound.h
  * Author: Thomas Delacour
@@ -25,7 +38,9 @@ typedef struct {
 
 /** 
  * \struct bound_t
- * \brief Structure used to store data relevant to bound
+ * \brief Structure used to store data relevant to bound. A bound_t
+ *    loaded from a file (see bound_cache_load) only stores its
+ *    stopping points (pk_table, pr_failure and state are NULL).
  */
 
 typedef struct {
@@ -65,7 +80,7 @@ void bound_build(bound_t * bound, size_t end);
  * \return Associated stopping point (probes to send)
  */
 
-size_t bound_get_nk(bound_t * bound, size_t k);
+size_t bound_get_nk(const bound_t * bound, size_t k);
 
 /**
  * \brief Print all true failure probabilities
@@ -88,4 +103,44 @@ void bound_dump(bound_t * bound);
 
 void bound_free(bound_t * bound);
 
+//--------------------------------------------------------------------------
+// Process-wide cache of stopping points
+//--------------------------------------------------------------------------
+
+/**
+ * \brief Retrieve the stopping points related to a given confidence
+ *    and branching. They are computed the first time they are
+ *    requested and then shared by all the callers, so that starting
+ *    an MDA instance does not recompute (nor allocate) them.
+ *    If USE_BOUND_CACHE_FILE is defined, BOUND_CACHE_FILENAME is
+ *    loaded (if it exists) on the first call.
+ * \param confidence User-specified failure confidence
+ * \param max_interfaces User-specified max branching at an interface
+ * \param max_branch User-specified max number of branching points in network
+ * \return The corresponding bound_t instance (which must not be
+ *    altered nor freed), NULL in case of failure.
+ */
+
+const bound_t * bound_cache_get(double confidence, size_t max_interfaces, size_t max_branch);
+
+/**
+ * \brief Load in the cache the stopping points stored in a file
+ *    generated by bound_cache_save. The file is rejected if it is
+ *    truncated or if a table exceeds BOUND_CACHE_MAX_N.
+ * \param filename Path of the file.
+ * \return true iif successful.
+ */
+
+bool bound_cache_load(const char * filename);
+
+/**
+ * \brief Save every stopping points stored in the cache in a binary
+ *    file (host endianness), which can then be shipped along with the
+ *    library and loaded by bound_cache_load.
+ * \param filename Path of the file.
+ * \return true iif successful.
+ */
+
+bool bound_cache_save(const char * filename);
+
 #endif
@@ -0,0 +1,41 @@
+/**
+ * bound_generate.c
+ * Description: Compute the stopping points related to the default mda
+ * options and save them in the file passed in parameter (see
+ * bound_cache_save). This file is installed as BOUND_CACHE_FILENAME,
+ * so that mda does not compute them if USE_BOUND_CACHE_FILE is defined.
+ * The stopping points related to other options are still computed
+ * when needed.
+ */
+
+#include <stdio.h>   // fprintf
+#include <stdlib.h>  // EXIT_SUCCESS, EXIT_FAILURE
+
+#include "bound.h"
+#include "../mda.h"  // mda_options_t
+
+int main(int argc, char ** argv) {
+    mda_options_t mda_options = mda_get_default_options();
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s FILENAME\n", argv[0]);
+        goto ERR_USAGE;
+    }
+
+    if (!mda_options_get_bound(&mda_options)) {
+        fprintf(stderr, "%s: cannot compute the stopping points\n", argv[0]);
+        goto ERR_BOUND;
+    }
+
+    if (!bound_cache_save(argv[1])) {
+        perror(argv[1]);
+        goto ERR_BOUND_CACHE_SAVE;
+    }
+
+    return EXIT_SUCCESS;
+
+ERR_BOUND_CACHE_SAVE:
+ERR_BOUND:
+ERR_USAGE:
+    return EXIT_FAILURE;
+}
@@ -1,13 +1,80 @@
 #include <stdlib.h>
+#include <string.h>         // memset, memcmp
 #include "data.h"
 #include "interface.h"
 #include "../mda.h"
 
 #define PERCENT_TO_INVERSE_DECIMAL(X) ((double)(100 - (X)) / 100.0)
 
+//---------------------------------------------------------------------------
+// Indexes
+//---------------------------------------------------------------------------
+
+static size_t mda_address_entry_hash(const mda_address_entry_t * entry) {
+    return hash_bytes(&entry->address, sizeof(address_t));
+}
+
+static int mda_address_entry_compare(const mda_address_entry_t * entry1, const mda_address_entry_t * entry2) {
+    return memcmp(&entry1->address, &entry2->address, sizeof(address_t));
+}
+
+/**
+ * \brief Prepare the key of a mda_address_entry_t.
+ * \param entry The entry we're initializing.
+ * \param address The address of an interface.
+ */
+
+static void mda_address_entry_init(mda_address_entry_t * entry, const address_t * address) {
+    memset(entry, 0, sizeof(mda_address_entry_t));
+    entry->address.family = address->family;
+    memcpy(&entry->address.ip, &address->ip, address_get_size(address));
+}
+
+static size_t mda_ttl_flow_entry_hash(const mda_ttl_flow_entry_t * entry) {
+    return hash_bytes(&entry->key, sizeof(entry->key));
+}
+
+static int mda_ttl_flow_entry_compare(const mda_ttl_flow_entry_t * entry1, const mda_ttl_flow_entry_t * entry2) {
+    return memcmp(&entry1->key, &entry2->key, sizeof(entry1->key));
+}
+
+/**
+ * \brief Release a chain of mda_ttl_flow_entry_t.
+ * \param entry The first entry of the chain.
+ */
+
+static void mda_ttl_flow_entry_free(mda_ttl_flow_entry_t * entry) {
+    mda_ttl_flow_entry_t * next;
+
+    for (; entry; entry = next) {
+        next = entry->next;
+        free(entry);
+    }
+}
+
+/**
+ * \brief Prepare the key of a mda_ttl_flow_entry_t.
+ * \param entry The entry we're initializing.
+ * \param ttl The TTL of a flow.
+ * \param flow_id The flow identifier.
+ */
+
+static void mda_ttl_flow_entry_init(mda_ttl_flow_entry_t * entry, uint8_t ttl, uintmax_t flow_id) {
+    memset(entry, 0, sizeof(mda_ttl_flow_entry_t));
+    entry->key.ttl     = ttl;
+    entry->key.flow_id = flow_id;
+}
+
+const bound_t * mda_options_get_bound(const mda_options_t * mda_options) {
+    return bound_cache_get(
+        PERCENT_TO_INVERSE_DECIMAL(mda_options->bound),
+        mda_options->max_children,
+        mda_options->max_branch
+    );
+}
+
 mda_data_t * mda_data_create()
 {
-    double        failure;
     mda_data_t  * data;
     mda_options_t mda_options = mda_get_default_options();
 
@@ -23,22 +90,37 @@ mda_data_t * mda_data_create()
         goto ERR_ADDRESS_CREATE;
     }
 
+    if (!(data->interfaces = hashtable_create(mda_address_entry_hash, free, mda_address_entry_compare))) {
+        goto ERR_INTERFACES_CREATE;
+    }
+
+    if (!(data->ttl_flows = hashtable_create(mda_ttl_flow_entry_hash, mda_ttl_flow_entry_free, mda_ttl_flow_entry_compare))) {
+        goto ERR_TTL_FLOWS_CREATE;
+    }
+
+    if (!(data->former_roots = dynarray_create())) {
+        goto ERR_FORMER_ROOTS_CREATE;
+    }
+
     // Options
     options_mda_init(&mda_options);
 
-    failure = PERCENT_TO_INVERSE_DECIMAL(mda_options.bound);
-
-    if (!(data->bound = bound_create(
-        failure, 
-        mda_options.max_children, 
-        mda_options.max_branch
-    ))) {
+    if (!(data->bound = mda_options_get_bound(&mda_options))) {
         goto ERR_BOUND_CREATE;
     }
 
+    probe_accessor_init(&data->ttl_accessor,     "ttl");
+    probe_accessor_init(&data->flow_id_accessor, "flow_id");
+    probe_accessor_init(&data->src_ip_accessor,  "src_ip");
     return data;
 
 ERR_BOUND_CREATE:
+    dynarray_free(data->former_roots, NULL);
+ERR_FORMER_ROOTS_CREATE:
+    hashtable_free(data->ttl_flows);
+ERR_TTL_FLOWS_CREATE:
+    hashtable_free(data->interfaces);
+ERR_INTERFACES_CREATE:
     address_free(data->dst_ip); 
 ERR_ADDRESS_CREATE:
     lattice_free(data->lattice, (ELEMENT_FREE) mda_interface_free);
@@ -48,12 +130,151 @@ ERR_MALLOC:
     return NULL;
 }
 
+/**
+ * \brief Release a root detached from the lattice by mda_probe_backward.
+ * \param elt The lattice node of this root.
+ */
+
+static void mda_former_root_free(lattice_elt_t * elt)
+{
+    mda_interface_free(lattice_elt_get_data(elt));
+    lattice_elt_free(elt);
+}
+
 void mda_data_free(mda_data_t * data)
 {
     if (data) {
+        dynarray_free(data->former_roots, (ELEMENT_FREE) mda_former_root_free);
         lattice_free(data->lattice, (ELEMENT_FREE) mda_interface_free);
+        hashtable_free(data->ttl_flows);
+        hashtable_free(data->interfaces);
         address_free(data->dst_ip);
+        probe_pool_free(data->probe_pool);
         free(data);
     }
 }
 
+
+lattice_elt_t * mda_data_add_interface(mda_data_t * data, lattice_elt_t * predecessor, mda_interface_t * interface)
+{
+    lattice_elt_t       * elt;
+    mda_address_entry_t * entry;
+    size_t                i, num_ttl_flows;
+
+    if (!(elt = lattice_add_element(data->lattice, predecessor, interface))) {
+        goto ERR_LATTICE_ADD_ELEMENT;
+    }
+    interface->elt = elt;
+
+    // Interfaces having no address (stars, root) are never searched
+    if (interface->address) {
+        if (!(entry = malloc(sizeof(mda_address_entry_t)))) goto ERR_MALLOC;
+        mda_address_entry_init(entry, interface->address);
+        entry->elt = elt;
+        if (!hashtable_insert(data->interfaces, entry)) {
+            free(entry);
+        }
+    }
+
+    num_ttl_flows = interface->flows.num_flows;
+    for (i = 0; i < num_ttl_flows; i++) {
+        if (!mda_data_index_ttl_flow(data, interface, i)) {
+            goto ERR_INDEX_TTL_FLOW;
+        }
+    }
+
+    return elt;
+
+    // If the interface has been added in the lattice, it is released
+    // along with the lattice.
+ERR_INDEX_TTL_FLOW:
+ERR_MALLOC:
+ERR_LATTICE_ADD_ELEMENT:
+    return NULL;
+}
+
+lattice_elt_t * mda_data_find_interface(const mda_data_t * data, const address_t * address)
+{
+    mda_address_entry_t query,
+                      * entry;
+
+    mda_address_entry_init(&query, address);
+    return (entry = hashtable_find(data->interfaces, &query)) ? entry->elt : NULL;
+}
+
+bool mda_data_index_ttl_flow(mda_data_t * data, mda_interface_t * interface, size_t i)
+{
+    mda_ttl_flow_entry_t * entry,
+                         * head,
+                         * last;
+
+    // Flows of an interface which does not belong to the lattice are
+    // never searched.
+    if (!interface->elt) return true;
+
+    if (!(entry = malloc(sizeof(mda_ttl_flow_entry_t)))) goto ERR_MALLOC;
+    mda_ttl_flow_entry_init(entry, mda_interface_get_flow_ttl(interface, i), mda_interface_get_flow_id(interface, i));
+    entry->interface = interface;
+    entry->index     = i;
+
+    // Chain this entry after the ones having the same key (if any)
+    if ((head = hashtable_find(data->ttl_flows, entry))) {
+        for (last = head; last->next; last = last->next);
+        last->next = entry;
+    } else if (!hashtable_insert(data->ttl_flows, entry)) {
+        goto ERR_HASHTABLE_INSERT;
+    }
+    return true;
+
+ERR_HASHTABLE_INSERT:
+    free(entry);
+ERR_MALLOC:
+    return false;
+}
+
+void mda_data_unindex_ttl_flow(mda_data_t * data, const mda_interface_t * interface, size_t i)
+{
+    mda_ttl_flow_entry_t   query,
+                         * head,
+                         * entry,
+                        ** pentry;
+
+    mda_ttl_flow_entry_init(&query, mda_interface_get_flow_ttl(interface, i), mda_interface_get_flow_id(interface, i));
+    if (!(head = hashtable_find(data->ttl_flows, &query))) return;
+
+    for (pentry = &head; (entry = *pentry); pentry = &entry->next) {
+        if (entry->interface == interface && entry->index == i) break;
+    }
+    if (!entry) return;
+
+    if (entry == head) {
+        // The head is the element stored in the hashtable
+        hashtable_take(data->ttl_flows, head);
+        if (head->next) hashtable_insert(data->ttl_flows, head->next);
+    } else {
+        *pentry = entry->next;
+    }
+    free(entry);
+}
+
+void mda_data_reindex_ttl_flow(mda_data_t * data, const mda_interface_t * interface, size_t from, size_t to)
+{
+    mda_ttl_flow_entry_t   query,
+                         * entry;
+
+    mda_ttl_flow_entry_init(&query, mda_interface_get_flow_ttl(interface, to), mda_interface_get_flow_id(interface, to));
+    for (entry = hashtable_find(data->ttl_flows, &query); entry; entry = entry->next) {
+        if (entry->interface == interface && entry->index == from) {
+            entry->index = to;
+            break;
+        }
+    }
+}
+
+mda_ttl_flow_entry_t * mda_data_get_ttl_flows(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
+{
+    mda_ttl_flow_entry_t query;
+
+    mda_ttl_flow_entry_init(&query, ttl, flow_id);
+    return hashtable_find(data->ttl_flows, &query);
+}
@@ -1,19 +1,76 @@
 #ifndef MDA_DATA_H
 #define MDA_DATA_H
 
+#include <stdbool.h>        // bool
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint8_t, uintmax_t
+
 #include "bound.h"          // bound_t
 #include "../../address.h"  // address_t
+#include "../../containers/hashtable.h" // hashtable_t
+#include "../../dynarray.h" // dynarray_t
 #include "../../lattice.h"  // lattice_t
 #include "../../pt_loop.h"  // pt_loop_t
 #include "../../probe.h"    // probe_t
+#include "../../probe_pool.h" // probe_pool_t
+#include "../../probe_accessor.h" // probe_accessor_t
+
+// Do not include "interface.h" to avoid mutual inclusion
+struct mda_interface_s;
+
+/**
+ * \brief Entry of mda_data_t.interfaces. address must be the first
+ *    member, so that an address can be used for lookups. This
+ *    structure is memset to 0 before being filled since it is hashed
+ *    and compared bytewise.
+ */
+
+typedef struct {
+    address_t       address; /**< Address of the interface */
+    lattice_elt_t * elt;     /**< Lattice node storing this interface */
+} mda_address_entry_t;
+
+/**
+ * \brief Entry of mda_data_t.ttl_flows. Several interfaces may carry
+ *    a flow having the same (ttl, flow_id): such entries are chained.
+ *    This structure is memset to 0 before being filled since its key
+ *    is hashed and compared bytewise.
+ */
+
+typedef struct mda_ttl_flow_entry_s {
+    struct {
+        uintmax_t flow_id;                      /**< Flow identifier */
+        uint8_t   ttl;                          /**< TTL of the flow */
+    } key;
+    struct mda_interface_s      * interface;    /**< Interface carrying this flow */
+    size_t                        index;        /**< Index of the flow in interface->flows */
+    struct mda_ttl_flow_entry_s * next;         /**< Next entry having the same key */
+} mda_ttl_flow_entry_t;
 
 typedef struct {
     lattice_t    * lattice;      /**< Root of the lattice storing the interfaces */
+    hashtable_t  * interfaces;   /**< Maps the address of each interface to its lattice node (mda_address_entry_t) */
+    hashtable_t  * ttl_flows;    /**< Maps each (ttl, flow_id) to the flows of the lattice interfaces (mda_ttl_flow_entry_t) */
     uintmax_t      last_flow_id;
     address_t    * dst_ip;       /**< Destination IP */
     pt_loop_t    * loop;         /**< Main loop */
     probe_t      * skel;         /**< Probe skeleton */
-    bound_t      * bound;        /**< Bound on probes to send */
+    const bound_t * bound;       /**< Bound on probes to send (shared, see bound_cache_get) */
+    probe_pool_t * probe_pool;   /**< Pool used to clone the probe skeleton */
+    probe_accessor_t ttl_accessor;     /**< Precompiled "ttl" field of the probes */
+    probe_accessor_t flow_id_accessor; /**< Precompiled "flow_id" field of the probes */
+    probe_accessor_t src_ip_accessor;  /**< Precompiled "src_ip" field of the replies */
+    uint8_t        pipeline_depth; /**< Number of hops explored beyond frontier_ttl (0: lock-step) */
+    uint8_t        frontier_ttl;   /**< Lowest TTL of an interface whose next hops are not enumerated yet */
+    bool           is_pending;     /**< Set during a walk if an incomplete interface let the walk go on */
+    unsigned       hop_cache_max_age; /**< Maximum age (in seconds) of the replies reused from the hop cache (0: disabled) */
+    uint8_t        hop_cache_max_ttl; /**< Maximum TTL of the replies reused from (and stored in) the hop cache */
+    address_t      src_ip;         /**< Source of the probes (hop cache key) */
+    bool           use_stop_set;   /**< True iif the interfaces of the Doubletree stop set are not enumerated */
+    lattice_elt_t * root;          /**< Dummy first hop, replaced backward by Doubletree (see mda_probe_backward) */
+    dynarray_t   * former_roots;   /**< Roots detached from the lattice by mda_probe_backward, released by mda_data_free */
+    uint8_t        start_ttl;      /**< Doubletree: TTL of the first probes (0: disabled) */
+    uint8_t        first_ttl;      /**< Doubletree: lowest TTL probed so far */
 } mda_data_t;
 
 /**
@@ -30,5 +87,67 @@ mda_data_t * mda_data_create();
 
 void mda_data_free(mda_data_t * data);
 
+/**
+ * \brief Add an interface in the lattice and index it.
+ * \param data A mda_data_t instance.
+ * \param predecessor The lattice node preceding this interface
+ *    (NULL if this interface is a root).
+ * \param interface The interface we're adding. Its flows are indexed
+ *    once it is added.
+ * \return The lattice node storing this interface, NULL in case of
+ *    failure.
+ */
+
+lattice_elt_t * mda_data_add_interface(mda_data_t * data, lattice_elt_t * predecessor, struct mda_interface_s * interface);
+
+/**
+ * \brief Search the lattice node storing an interface.
+ * \param data A mda_data_t instance.
+ * \param address The address of the interface.
+ * \return The corresponding lattice node if found, NULL otherwise.
+ */
+
+lattice_elt_t * mda_data_find_interface(const mda_data_t * data, const address_t * address);
+
+/**
+ * \brief Index a flow carried by an interface of the lattice.
+ * \param data A mda_data_t instance.
+ * \param interface The interface carrying this flow.
+ * \param i The index of the flow in interface->flows.
+ * \return true iif successful.
+ */
+
+bool mda_data_index_ttl_flow(mda_data_t * data, struct mda_interface_s * interface, size_t i);
+
+/**
+ * \brief Remove a flow from the index. The flow is not deleted.
+ * \param data A mda_data_t instance.
+ * \param interface The interface carrying this flow.
+ * \param i The index of the flow in interface->flows.
+ */
+
+void mda_data_unindex_ttl_flow(mda_data_t * data, const struct mda_interface_s * interface, size_t i);
+
+/**
+ * \brief Update the index once a flow has been moved in interface->flows.
+ * \param data A mda_data_t instance.
+ * \param interface The interface carrying this flow.
+ * \param from The previous index of the flow.
+ * \param to The new index of the flow, where it is already stored.
+ */
+
+void mda_data_reindex_ttl_flow(mda_data_t * data, const struct mda_interface_s * interface, size_t from, size_t to);
+
+/**
+ * \brief Retrieve the flows having a given (ttl, flow_id).
+ * \param data A mda_data_t instance.
+ * \param ttl The TTL of the flows.
+ * \param flow_id The flow identifier.
+ * \return The first corresponding entry (see mda_ttl_flow_entry_t.next),
+ *    NULL if there is no such flow.
+ */
+
+mda_ttl_flow_entry_t * mda_data_get_ttl_flows(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id);
+
 #endif
 
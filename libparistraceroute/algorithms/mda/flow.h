@@ -4,6 +4,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/**
+ * States of a flow, to be used within MDA link discovery
+ * (see mda_flow_table_t).
+ */
+
 typedef enum {
     MDA_FLOW_AVAILABLE,
     MDA_FLOW_UNAVAILABLE,
@@ -11,36 +16,15 @@ typedef enum {
     MDA_FLOW_TIMEOUT
 } mda_flow_state_t;
 
-/**
- * A structure containing flow information, to be used within MDA link discovery
- */
-
-typedef struct {
-    uintmax_t        flow_id; /**< Flow identifier            */
-    mda_flow_state_t state;   /**< Current state of this flow */
-} mda_flow_t;
-
-/**
- * \brief Allocate a mda_data_t structure
- * \param flow_id Flow identifier related to this flow
- * \param state Current state of this flow
- * \return A pointer to the mda_data_t structure, NULL otherwise
- */
-
-mda_flow_t * mda_flow_create(uintmax_t flow_id, mda_flow_state_t state);
-
-/**
- * \brief Release a mda_data_t structure from the memory
- * \param mda_flow A pointer to the mda_data_t instance
- */
-
-void mda_flow_free(mda_flow_t * mda_flow);
+// Number of values of mda_flow_state_t
+#define MDA_FLOW_NUM_STATES (MDA_FLOW_TIMEOUT + 1)
 
 /**
  * \brief Convert a flow state in its corresponding character output.
- * \param mda_flow A pointer to the mda_data_t instance.
+ * \param state A flow state.
  * \return The corresponding caractère, 'E' in case of failure.
  */
-char mda_flow_state_to_char(const mda_flow_t * mda_flow);
+
+char mda_flow_state_to_char(mda_flow_state_t state);
 
 #endif
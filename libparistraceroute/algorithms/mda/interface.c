@@ -2,10 +2,13 @@
 
 #include <stdlib.h>         // free
 #include <stdio.h>          // printf
-#include <string.h>         // strdup
+#include <string.h>         // memchr, memset
 
 #include "../../common.h"   // ELEMENT_FREE 
 
+// Initial number of flows allocated in a mda_flow_table_t
+#define MDA_FLOW_TABLE_INIT_SIZE 8
+
 mda_interface_t * mda_interface_create(const address_t * address)
 {
     mda_interface_t * mda_interface;
@@ -20,18 +23,12 @@ mda_interface_t * mda_interface_create(const address_t * address)
         }
     }
 
-    if (!(mda_interface->ttl_flows = dynarray_create())) {
-        goto ERR_FLOWS;
-    }
-
     memset(mda_interface->ttl_set, 0, MAX_TTLS);
     mda_interface->num_ttls = 1;
 
     mda_interface->type = MDA_LB_TYPE_UNKNOWN;
     return mda_interface;
 
-ERR_FLOWS:
-    if (mda_interface->address) address_free(mda_interface->address);
 ERR_ADDRESS:
     free(mda_interface);
 ERR_INTERFACE:
@@ -41,72 +38,145 @@ ERR_INTERFACE:
 void mda_interface_free(mda_interface_t * interface)
 {
     if (interface) {
-        dynarray_free(interface->ttl_flows, (ELEMENT_FREE) mda_ttl_flow_free);
+        free(interface->flows.flow_ids);
+        free(interface->flows.ttls);
+        free(interface->flows.states);
         if (interface->address) address_free(interface->address);
         free(interface);
     }
 }
 
-bool mda_interface_add_flow_id(mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state)
+/**
+ * \brief Ensure a flow table can store one more flow.
+ * \param flows The flow table.
+ * \return true iif successful.
+ */
+
+static bool mda_flow_table_reserve(mda_flow_table_t * flows)
 {
-    mda_flow_t     * mda_flow;
-    mda_ttl_flow_t * mda_ttl_flow;
+    size_t      max_flows;
+    uintmax_t * flow_ids;
+    uint8_t   * ttls,
+              * states;
 
-    if (!(mda_flow = mda_flow_create(flow_id, state))) {
-        goto ERR_MDA_FLOW_CREATE;
-    }
+    if (flows->num_flows < flows->max_flows) return true;
+
+    max_flows = flows->max_flows ? 2 * flows->max_flows : MDA_FLOW_TABLE_INIT_SIZE;
+
+    // Each array is updated as soon as it is reallocated, so that the
+    // table remains consistent if a subsequent realloc fails.
+    if (!(flow_ids = realloc(flows->flow_ids, max_flows * sizeof(uintmax_t)))) goto ERR_REALLOC;
+    flows->flow_ids = flow_ids;
+    if (!(ttls = realloc(flows->ttls, max_flows * sizeof(uint8_t))))           goto ERR_REALLOC;
+    flows->ttls = ttls;
+    if (!(states = realloc(flows->states, max_flows * sizeof(uint8_t))))       goto ERR_REALLOC;
+    flows->states = states;
 
-    if (!(mda_ttl_flow = mda_ttl_flow_create(ttl, mda_flow))) {
-        goto ERR_TTL_FLOW_CREATE;
+    flows->max_flows = max_flows;
+    return true;
+
+ERR_REALLOC:
+    return false;
+}
+
+bool mda_interface_add_flow_id(mda_data_t * data, mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state)
+{
+    mda_flow_table_t * flows = &interface->flows;
+    size_t             i;
+
+    if (!mda_flow_table_reserve(flows)) {
+        goto ERR_FLOW_TABLE_RESERVE;
     }
 
-    if (!(dynarray_push_element(interface->ttl_flows, mda_ttl_flow))) {
-        goto ERR_DYNARRAY_PUSH_ELEMENT;
+    i = flows->num_flows;
+    flows->flow_ids[i] = flow_id;
+    flows->ttls[i]     = ttl;
+    flows->states[i]   = state;
+
+    if (!mda_data_index_ttl_flow(data, interface, i)) {
+        goto ERR_INDEX_TTL_FLOW;
     }
 
+    flows->num_flows++;
+    flows->num_flows_per_state[state]++;
     return true;
 
-ERR_DYNARRAY_PUSH_ELEMENT:
-    mda_ttl_flow_free(mda_ttl_flow);
-ERR_TTL_FLOW_CREATE:
-    mda_flow_free(mda_flow);
-ERR_MDA_FLOW_CREATE:
+ERR_INDEX_TTL_FLOW:
+ERR_FLOW_TABLE_RESERVE:
     return false;
 }
 
-size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_state_t state)
+bool mda_interface_del_flow(mda_data_t * data, mda_interface_t * interface, size_t i)
 {
-    const mda_ttl_flow_t * mda_ttl_flow;
-    size_t                 i,
-                           num_flows = dynarray_get_size(interface->ttl_flows),
-                           num_flows_with_state = 0;
-
-    for (i = 0; i < num_flows; i++) {
-        mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, i);
-        if (mda_ttl_flow->mda_flow->state == state) {
-            num_flows_with_state++;
-        }
+    mda_flow_table_t * flows = &interface->flows;
+    size_t             last;
+
+    if (i >= flows->num_flows) return false;
+
+    mda_data_unindex_ttl_flow(data, interface, i);
+    flows->num_flows_per_state[flows->states[i]]--;
+
+    // Move the last flow in the hole
+    last = --flows->num_flows;
+    if (i != last) {
+        flows->flow_ids[i] = flows->flow_ids[last];
+        flows->ttls[i]     = flows->ttls[last];
+        flows->states[i]   = flows->states[last];
+        mda_data_reindex_ttl_flow(data, interface, last, i);
     }
+    return true;
+}
+
+inline uintmax_t mda_interface_get_flow_id(const mda_interface_t * interface, size_t i) {
+    return interface->flows.flow_ids[i];
+}
+
+inline uint8_t mda_interface_get_flow_ttl(const mda_interface_t * interface, size_t i) {
+    return interface->flows.ttls[i];
+}
+
+inline mda_flow_state_t mda_interface_get_flow_state(const mda_interface_t * interface, size_t i) {
+    return interface->flows.states[i];
+}
+
+void mda_interface_set_flow_state(mda_interface_t * interface, size_t i, mda_flow_state_t state)
+{
+    mda_flow_table_t * flows = &interface->flows;
+
+    flows->num_flows_per_state[flows->states[i]]--;
+    flows->num_flows_per_state[state]++;
+    flows->states[i] = state;
+}
 
-    return num_flows_with_state;
+bool mda_interface_has_ttl(const mda_interface_t * interface, uint8_t ttl)
+{
+    size_t i;
+
+    for (i = 0; i < interface->num_ttls; i++) {
+        if (interface->ttl_set[i] == ttl) return true;
+    }
+    return false;
 }
 
-mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface, size_t num_siblings, mda_data_t * data)
+size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_state_t state)
 {
-    uintmax_t        flow_id;
-    mda_ttl_flow_t * mda_ttl_flow;
-    mda_flow_t *     mda_flow;
-    size_t           i, size = dynarray_get_size(interface->ttl_flows);
-    uint8_t          ttl;
+    return state < MDA_FLOW_NUM_STATES ? interface->flows.num_flows_per_state[state] : 0;
+}
+
+bool mda_interface_get_available_flow_id(mda_interface_t * interface, size_t num_siblings, mda_data_t * data, size_t * pi)
+{
+    mda_flow_table_t * flows = &interface->flows;
+    const uint8_t    * state;
+    uintmax_t          flow_id;
+    uint8_t            ttl;
 
     // Search in the flow list for the first available one
-    for (i = 0; i < size; i++) {
-        mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, i);
-        mda_flow = mda_ttl_flow->mda_flow;
-        if (mda_flow->state == MDA_FLOW_AVAILABLE) {
-            mda_flow->state = MDA_FLOW_UNAVAILABLE;
-            return mda_ttl_flow;
-        }
+    if (flows->num_flows_per_state[MDA_FLOW_AVAILABLE] > 0
+    && (state = memchr(flows->states, MDA_FLOW_AVAILABLE, flows->num_flows))
+    ) {
+        *pi = state - flows->states;
+        mda_interface_set_flow_state(interface, *pi, MDA_FLOW_UNAVAILABLE);
+        return true;
     }
 
     // TODO the num ttl_set restriction could be a problem
@@ -118,33 +188,30 @@ mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface
 
         flow_id = ++data->last_flow_id; // mda_interface_get_new_flow_id(interface, data);
         ttl = interface->ttl_set[interface->num_ttls - 1];
-        if (!mda_interface_add_flow_id(interface, ttl, flow_id, MDA_FLOW_UNAVAILABLE)) {
-            return NULL; // error adding flow id to the list
+        if (!mda_interface_add_flow_id(data, interface, ttl, flow_id, MDA_FLOW_UNAVAILABLE)) {
+            return false; // error adding flow id to the list
         }
-        return dynarray_get_ith_element(interface->ttl_flows, size);
+        *pi = flows->num_flows - 1;
+        return true;
     }
 
-    return NULL;
+    return false;
 }
 
 static void flow_dump(const mda_interface_t * interface)
 {
-    const  mda_flow_t * mda_flow;
-    const  mda_ttl_flow_t * mda_ttl_flow;
-    size_t              i, size;
+    size_t i, size;
 
     if(!interface) {
         printf("(null)");
     } else {
-        size = dynarray_get_size(interface->ttl_flows);
+        size = interface->flows.num_flows;
         for (i = 0; i < size; i++) {
-            mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, i);
-            mda_flow = mda_ttl_flow->mda_flow;
             printf(
                 " %d%c%ju%c",
-                mda_ttl_flow->ttl,
-                mda_flow_state_to_char(mda_flow),
-                mda_flow->flow_id,
+                interface->flows.ttls[i],
+                mda_flow_state_to_char(interface->flows.states[i]),
+                interface->flows.flow_ids[i],
                 i + 1 < size ? ',' : ' '
             );
         }
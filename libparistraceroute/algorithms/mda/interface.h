@@ -3,13 +3,16 @@
 
 #include <stdbool.h>        // bool
 #include <stddef.h>         // size_t
+#include <stdint.h>         // uint8_t, uintmax_t
 
 #include "data.h"           // mda_data_t
 #include "flow.h"           // mda_flow_state_t
-#include "ttl_flow.h"       // mda_ttl_flow_t
 #include "../../address.h"  // address_t
 #include "../../dynarray.h" // dynarray_t
 
+#define MAX_TTLS 5 // Max ttls we assume can be associated with this interface
+                   // TODO Avoid hardcoding
+
 typedef enum {
     MDA_LB_TYPE_UNKNOWN,             /**< IP hop state not yet classified  */
     MDA_LB_TYPE_IN_PROGRESS,         /**< IP hop not yet classified        */
@@ -20,24 +23,40 @@ typedef enum {
     MDA_LB_TYPE_PDLB                 /**< Per destination load balancer    */
 } mda_lb_type_t;
 
+/**
+ * \brief Flows (ttl-flow_id tuples) related to an IP hop. They are stored
+ *    as parallel arrays so that they can be scanned without any pointer
+ *    chasing, and the number of flows in each state is maintained so that
+ *    it is retrieved in O(1).
+ *    A flow is identified by its index in these arrays. Deleting a flow
+ *    moves the last flow at its index (see mda_interface_del_flow).
+ */
+
 typedef struct {
+    uintmax_t   * flow_ids;          /**< Identifier of each flow */
+    uint8_t     * ttls;              /**< TTL of each flow */
+    uint8_t     * states;            /**< State of each flow (mda_flow_state_t) */
+    size_t        num_flows;         /**< Number of flows */
+    size_t        max_flows;         /**< Number of flows that can be stored without reallocating the arrays */
+    size_t        num_flows_per_state[MDA_FLOW_NUM_STATES]; /**< Number of flows in each state */
+} mda_flow_table_t;
+
+typedef struct mda_interface_s {
     address_t   * address;           /**< Interface attached to this hop   */
     size_t        sent,              /**< Number of probes to discover its next hops */
                   received,         
                   timeout,
                   num_stars;         /**< Number of timeout for this hop          */
-    dynarray_t  * ttl_flows;         /**< ttl-flow_id tuples related to this hop  */
+    mda_flow_table_t flows;          /**< ttl-flow_id tuples related to this hop  */
     uint8_t       ttl_set[MAX_TTLS]; /**< The set of ttls that can reach this hop. 
                                           This structure is used to improve 
                                           efficiency later in the code.           */ 
     size_t        num_ttls;          /**< Number of ttls contained in this hop    */
     bool          enumeration_done;
     mda_lb_type_t type;              /**< Type of load balancer            */
+    lattice_elt_t * elt;             /**< Lattice node storing this hop (NULL if not yet added, see mda_data_add_interface) */
 } mda_interface_t;
 
-
-void mda_ttl_flow_free(mda_ttl_flow_t * mda_ttl_flow);
-
 /**
  * \brief Allocate a new mda_interface_t instance, which corresponds to
  *    an IP hop discovered by mda.
@@ -56,16 +75,77 @@ mda_interface_t * mda_interface_create(const address_t * address);
 void mda_interface_free(mda_interface_t * interface);
 
 /**
- * \brief Allocate and attach a new mda_flow_t instance to a given
- *    mda_interface_t instance.
+ * \brief Attach a new flow to a given mda_interface_t instance.
+ * \param data The mda_data_t instance indexing the flows.
+ * \param interface The interface carrying the new flow.
+ * \param ttl The TTL of the new flow.
  * \param flow_id The new flow id.
  * \param flow_state The flow state.
+ * \return true iif successful.
  */
 
-bool mda_interface_add_flow_id(mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state);
+bool mda_interface_add_flow_id(mda_data_t * data, mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state);
+
+/**
+ * \brief Detach a flow from a mda_interface_t instance. The last flow
+ *    of this interface is moved at index i.
+ * \param data The mda_data_t instance indexing the flows.
+ * \param interface The interface carrying the flow.
+ * \param i The index of the flow we're deleting.
+ * \return true iif successful.
+ */
+
+bool mda_interface_del_flow(mda_data_t * data, mda_interface_t * interface, size_t i);
+
+/**
+ * \brief Retrieve the identifier of a flow.
+ * \param interface The interface carrying the flow.
+ * \param i The index of the flow (less than interface->flows.num_flows).
+ * \return The corresponding flow identifier.
+ */
+
+uintmax_t mda_interface_get_flow_id(const mda_interface_t * interface, size_t i);
+
+/**
+ * \brief Retrieve the TTL of a flow.
+ * \param interface The interface carrying the flow.
+ * \param i The index of the flow (less than interface->flows.num_flows).
+ * \return The corresponding TTL.
+ */
+
+uint8_t mda_interface_get_flow_ttl(const mda_interface_t * interface, size_t i);
+
+/**
+ * \brief Retrieve the state of a flow.
+ * \param interface The interface carrying the flow.
+ * \param i The index of the flow (less than interface->flows.num_flows).
+ * \return The corresponding state.
+ */
+
+mda_flow_state_t mda_interface_get_flow_state(const mda_interface_t * interface, size_t i);
+
+/**
+ * \brief Update the state of a flow.
+ * \param interface The interface carrying the flow.
+ * \param i The index of the flow (less than interface->flows.num_flows).
+ * \param state The new state.
+ */
+
+void mda_interface_set_flow_state(mda_interface_t * interface, size_t i, mda_flow_state_t state);
+
+/**
+ * \brief Test whether a TTL belongs to the TTLs that can reach a
+ *    given interface.
+ * \param interface An IP hop discovered by mda.
+ * \param ttl A TTL.
+ * \return true iif ttl belongs to interface->ttl_set.
+ */
+
+bool mda_interface_has_ttl(const mda_interface_t * interface, uint8_t ttl);
 
 /**
  * \brief Retrieve the number of flows having a given state.
+ * \param interface An IP hop discovered by mda.
  * \param state The flow state. This is a value among {MDA_FLOW_AVAILABLE,
  *    MDA_FLOW_UNAVAILABLE, MDA_FLOW_TESTING, MDA_FLOW_TIMEOUT}.
  * \return The corresponding number of flows.
@@ -83,16 +163,17 @@ size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_s
 //uintmax_t mda_interface_get_new_flow_id(mda_interface_t *interface);
 
 /**
- * \brief Retrieve an available flow id.
+ * \brief Retrieve an available flow and mark it as unavailable.
  * \param interface An IP hop discovered by mda.
  * \param num_siblings The number of interface hops discovered by mda at
  *    this TTL.
  * \param data A mda_data_t instance which stores the last used flow id.
  *    This last ID is updated.
- * \return A flow-id > 0 if successful, 0 otherwise.
+ * \param pi Pass a pointer in which the index of the flow is written.
+ * \return true iif successful.
  */
 
-mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface, size_t num_siblings, mda_data_t * data);
+bool mda_interface_get_available_flow_id(mda_interface_t * interface, size_t num_siblings, mda_data_t * data, size_t * pi);
 
 /**
  * \brief Print to the standard output the flow related to a given
@@ -5,6 +5,7 @@
 #include <stdio.h>              // fprintf
 #include <string.h>             // memset()
 #include <math.h>               // abs(), ceil()
+#include <sys/time.h>           // gettimeofday
 #include "os/netinet/ip_icmp.h" // icmpv4 constants
 #include "os/netinet/icmp6.h"   // icmpv6 constants
 
@@ -12,7 +13,7 @@
 #include "../event.h"
 #include "../algorithm.h"
 #include "../address.h"         // address_resolv
-#include "../common.h"          // get_timestamp
+#include "../common.h"          // MIN
 #include "../network.h"         // options_network_get_timeout
 
 //-----------------------------------------------------------------
@@ -206,207 +207,155 @@ void ping_dump_statistics(ping_data_t * ping_data) {
 
 /**
  * \brief check whether the algorithm has encountered a "network unreachable" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool destination_network_unreachable(const probe_t * reply) {
-    bool    ret = false;
-    uint8_t code, type, version;
-
-    if (probe_extract(reply, "version", &version)
-     && probe_extract(reply, "code",    &code)
-     && probe_extract(reply, "type",    &type)
-    ) {
-        switch (version){
-            case 4:
-                ret = (type == ICMP_UNREACH && code == ICMP_UNREACH_HOST);
-                break;
-            case 6:
-                ret = (type == ICMP6_DST_UNREACH && code == ICMP6_DST_UNREACH_ADDR);
-                break;
-            default:
-                fprintf(stderr, "destination_network_unreachable: invalid version = %d\n", version);
-                break;
-        }
+static bool destination_network_unreachable(uint8_t version, uint8_t type, uint8_t code) {
+    bool ret = false;
+
+    switch (version){
+        case 4:
+            ret = (type == ICMP_UNREACH && code == ICMP_UNREACH_HOST);
+            break;
+        case 6:
+            ret = (type == ICMP6_DST_UNREACH && code == ICMP6_DST_UNREACH_ADDR);
+            break;
+        default:
+            fprintf(stderr, "destination_network_unreachable: invalid version = %d\n", version);
+            break;
     }
     return ret;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "host unreachable" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool destination_host_unreachable(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-    if (probe_extract(reply, "version", &version)
-     && probe_extract(reply, "code",    &code)
-     && probe_extract(reply, "type",    &type)
-    ) {
-        if (version == 4) {
-            return (type == ICMP_UNREACH) && (code == ICMP_UNREACH_NET);
-        } else {
-            return (type == ICMP6_DST_UNREACH) && (code == ICMP6_DST_UNREACH_NOROUTE);
-        }
+static bool destination_host_unreachable(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_UNREACH) && (code == ICMP_UNREACH_NET);
+    } else {
+        return (type == ICMP6_DST_UNREACH) && (code == ICMP6_DST_UNREACH_NOROUTE);
     }
-    return false;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "network unreachable" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool destination_port_unreachable(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-    if (probe_extract(reply, "version", &version) && probe_extract(reply, "code", &code)
-        && probe_extract(reply, "type", &type)) {
-
-        if (version == 4) {
-            return (type == ICMP_UNREACH) && (code == ICMP_UNREACH_PORT);
-        } else {
-            return (type == ICMP6_DST_UNREACH) && (code == ICMP6_DST_UNREACH_NOPORT);
-        }
+static bool destination_port_unreachable(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_UNREACH) && (code == ICMP_UNREACH_PORT);
+    } else {
+        return (type == ICMP6_DST_UNREACH) && (code == ICMP6_DST_UNREACH_NOPORT);
     }
-    return false;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "protocol unreachable" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool destination_protocol_unreachable(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-    if (probe_extract(reply, "version", &version) && probe_extract(reply, "code", &code)
-        && probe_extract(reply, "type", &type)) {
-
-        if (version == 4) {
-            return (type == ICMP_UNREACH) && (code == ICMP_UNREACH_PROTOCOL);
-        } else {
-            return (type == ICMP6_PARAM_PROB) && (code == ICMP6_PARAMPROB_NEXTHEADER);
-        }
+static bool destination_protocol_unreachable(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_UNREACH) && (code == ICMP_UNREACH_PROTOCOL);
+    } else {
+        return (type == ICMP6_PARAM_PROB) && (code == ICMP6_PARAMPROB_NEXTHEADER);
     }
-    return false;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "ttl exceeded" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool ttl_exceeded(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-    if (probe_extract(reply, "version", &version) && probe_extract(reply, "code", &code)
-        && probe_extract(reply, "type", &type)) {
-
-        if (version == 4) {
-            return (type == ICMP_TIMXCEED) && (code == ICMP_TIMXCEED_INTRANS);
-        } else {
-            return (type == ICMP6_TIME_EXCEEDED) && (code == ICMP6_TIME_EXCEED_TRANSIT);
-        }
+static bool ttl_exceeded(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_TIMXCEED) && (code == ICMP_TIMXCEED_INTRANS);
+    } else {
+        return (type == ICMP6_TIME_EXCEEDED) && (code == ICMP6_TIME_EXCEED_TRANSIT);
     }
-    return false;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "fragment reassembly time exceeded" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool fragment_reassembly_time_exceeded(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-    if (probe_extract(reply, "version", &version) && probe_extract(reply, "code", &code)
-        && probe_extract(reply, "type", &type)) {
-
-        if (version == 4) {
-            return (type == ICMP_TIMXCEED) && (code == ICMP_TIMXCEED_REASS);
-        } else {
-            return (type == ICMP6_TIME_EXCEEDED) && (code == ICMP6_TIME_EXCEED_REASSEMBLY);
-        }
+static bool fragment_reassembly_time_exceeded(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_TIMXCEED) && (code == ICMP_TIMXCEED_REASS);
+    } else {
+        return (type == ICMP6_TIME_EXCEEDED) && (code == ICMP6_TIME_EXCEED_REASSEMBLY);
     }
-    return false;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "redirect" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool redirect(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-    if (probe_extract(reply, "version", &version) && probe_extract(reply, "code", &code)
-        && probe_extract(reply, "type", &type)) {
-
-        if (version == 4) {
-            return (type == ICMP_REDIRECT) && (code == ICMP_REDIRECT_NET);
-        } else {
-            return (type == ND_REDIRECT);
-        }
+static bool redirect(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_REDIRECT) && (code == ICMP_REDIRECT_NET);
+    } else {
+        return (type == ND_REDIRECT);
     }
-    return false;
 }
 
 /**
  * \brief check whether the algorithm has encountered a "parameter" problem
- * \param reply the probe to analyse
+ * \param version The IP version of the reply
+ * \param type The ICMP type of the reply
+ * \param code The ICMP code of the reply
  * \return true if this error has occured, false otherwise
  */
 
-static bool parameter_problem(const probe_t *reply) {
-    uint8_t version = 0,
-            code    = 0,
-            type    = 0;
-
-   if (probe_extract(reply, "version", &version) && probe_extract(reply, "code", &code)
-       && probe_extract(reply, "type", &type)) {
-
-        if (version == 4) {
-            return (type == ICMP_PARAMPROB);
-        } else {
-            return (type == ICMP6_PARAM_PROB ) && ((code == ICMP6_PARAMPROB_HEADER)
-                || (code == ICMP6_PARAMPROB_OPTION));
-        }
+static bool parameter_problem(uint8_t version, uint8_t type, uint8_t code) {
+    if (version == 4) {
+        return (type == ICMP_PARAMPROB);
+    } else {
+        return (type == ICMP6_PARAM_PROB ) && ((code == ICMP6_PARAMPROB_HEADER)
+            || (code == ICMP6_PARAMPROB_OPTION));
     }
-    return false;
 }
 
 /**
  * \brief Check whether the destination is reached.
+ * \param ping_data Data attached to this instance of ping algorithm
  * \param dst_addr The destination address of this ping instance.
+ * \param reply The reply we have received.
  * \return true iif the destination is reached.
  */
 
-static inline bool destination_reached(const address_t * dst_addr, const probe_t * reply) {
+static inline bool destination_reached(ping_data_t * ping_data, const address_t * dst_addr, const probe_t * reply) {
     bool        ret = false;
     address_t   discovered_addr;
 
-    if (probe_extract(reply, "src_ip", &discovered_addr)) {
+    if (probe_accessor_extract(&ping_data->src_ip_accessor, reply, &discovered_addr)) {
         ret = (address_compare(dst_addr, &discovered_addr) == 0);
     }
     return ret;
@@ -453,17 +402,27 @@ static double * double_dup(double * double_to_duplicate) {
 
 /**
  * \brief Allocate a ping_data_t instance
+ * \param probe_skel The probe skeleton used to craft the probe packets
  * \return The newly allocated ping_data_t instance,
  *    NULL in case of failure
  */
 
-static ping_data_t * ping_data_create() {
+static ping_data_t * ping_data_create(const probe_t * probe_skel) {
     ping_data_t * ping_data;
 
     if (!(ping_data = calloc(1, sizeof(ping_data_t))))    goto ERR_MALLOC;
     if (!(ping_data->rtt_results = dynarray_create()))    goto ERR_RTT_RESULTS;
+    if (!(ping_data->probe_pool = probe_pool_create(probe_skel, PROBE_POOL_DEFAULT_SIZE))) {
+        goto ERR_PROBE_POOL;
+    }
+    probe_accessor_init(&ping_data->version_accessor, "version");
+    probe_accessor_init(&ping_data->type_accessor,    "type");
+    probe_accessor_init(&ping_data->code_accessor,    "code");
+    probe_accessor_init(&ping_data->src_ip_accessor,  "src_ip");
     return ping_data;
 
+ERR_PROBE_POOL:
+    dynarray_free(ping_data->rtt_results, NULL);
 ERR_RTT_RESULTS:
     free(ping_data);
 ERR_MALLOC:
@@ -495,6 +454,7 @@ static ping_data_t * ping_data_dup(ping_data_t * ping_data) {
     new_ping_data->num_probes_in_flight = ping_data->num_probes_in_flight;
     new_ping_data->start_time = ping_data->start_time;
     new_ping_data->last_time = ping_data->last_time;
+    new_ping_data->probe_pool = NULL;
 
     return new_ping_data;
 }
@@ -509,6 +469,7 @@ static void ping_data_free(ping_data_t * ping_data) {
         if (ping_data->rtt_results) {
             dynarray_free(ping_data->rtt_results, (ELEMENT_FREE) double_free);
         }
+        probe_pool_free(ping_data->probe_pool);
         free(ping_data);
     }
 }
@@ -546,13 +507,11 @@ static inline void discovered_ip_dump(const probe_t * reply, bool do_resolv) {
 }
 
 static inline void delay_dump(const probe_t * probe, const probe_t * reply) {
-    double send_time = probe_get_sending_time(probe),
-           recv_time = probe_get_recv_time(reply);
-    printf("%.2lf ms", 1000 * (recv_time - send_time));
+    printf("%.2lf ms", 1000 * probe_get_rtt(probe, reply));
 }
 
 static inline double delay_get(const probe_t * probe, const probe_t * reply) {
-    return 1000 * (probe_get_recv_time(reply) - probe_get_sending_time(probe));
+    return 1000 * probe_get_rtt(probe, reply);
 }
 
 void ping_handler(
@@ -565,6 +524,7 @@ void ping_handler(
     const probe_t * reply;
     double        * delay;
     const char    * error;
+    struct timeval  now;
 
     switch (ping_event->type) {
         case PING_PROBE_REPLY:
@@ -577,7 +537,9 @@ void ping_handler(
 
                 if (ping_options->show_timestamp) {
                     // Option -D enabled
-                    printf("[%lf] ",get_timestamp());
+                    // get_timestamp() is monotonic, print the wall-clock time
+                    gettimeofday(&now, NULL);
+                    printf("[%lf] ", now.tv_sec + now.tv_usec / 1000000.0);
                 }
 
                 printf("%zu bytes from ", probe_get_size(reply));
@@ -666,14 +628,14 @@ void ping_handler(
 /**
  * \brief Send a ping probe packet
  * \param loop The main loop
- * \param pnum_sent The address of the current the sequence number
+ * \param ping_data Data attached to this instance of ping algorithm
  * \param probe_skel The probe skeleton used to craft the probe packet
  * \param ttl The TTL that we set for this packet
  */
 
 static bool send_ping_probe(
     pt_loop_t     * loop,
-    size_t        * pnum_sent,
+    ping_data_t   * ping_data,
     const probe_t * probe_skel,
     size_t          i
 ) {
@@ -682,15 +644,14 @@ static bool send_ping_probe(
 
     // a probe must never be altered, otherwise the network layer may
     // manage corrupted probes.
-    if (!(probe = probe_dup(probe_skel))) goto ERR_PROBE_DUP;
+    if (!(probe = probe_pool_get(ping_data->probe_pool))) goto ERR_PROBE_DUP;
     if (probe_get_delay(probe) != DELAY_BEST_EFFORT) {
         delay = i * probe_get_delay(probe_skel);
         probe_set_delay(probe, DOUBLE("delay", delay));
     }
 
-    probe_set_fields(probe, NULL); // set source ip
-
-    ++(*pnum_sent);
+    // The probe skeleton has been finalized in ALGORITHM_INIT.
+    ++(ping_data->num_sent);
     return pt_send_probe(loop, probe);
 
 ERR_PROBE_DUP:
@@ -701,8 +662,7 @@ ERR_PROBE_DUP:
 /**
  * \brief Send n ping probes toward a destination with a given TTL
  * \param loop The paris traceroute loop
- * \param pnum_sent The address of the current the sequence number
- *    ping measurements.
+ * \param ping_data Data attached to this instance of ping algorithm
  * \param probe_skel The probe skeleton used to craft the probe packet
  * \param num_probes The amount of probe to send
  * \return true if successful
@@ -710,13 +670,13 @@ ERR_PROBE_DUP:
 
 bool send_ping_probes(
     pt_loop_t     * loop,
-    size_t        * pnum_sent,
+    ping_data_t   * ping_data,
     probe_t       * probe_skel,
     size_t          num_probes
 ) {
     size_t i;
     for (i = 0; i < num_probes; ++i) {
-        if (!(send_ping_probe(loop, pnum_sent, probe_skel, i + 1))) {
+        if (!(send_ping_probe(loop, ping_data, probe_skel, i + 1))) {
             return false;
         }
     }
@@ -745,6 +705,7 @@ int ping_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t
     size_t                 num_probes_to_send  = 0;        // the number of probes to send
     double                 num_max_probes_to_schedule = 0; // the maximum number of probes to schedule at the same time
     bool                   has_terminated = false;         // Indicates whether the algorithm has terminated or not
+    uint8_t                version, type, code;            // Fields of the ICMP reply
 
     switch (event->type) {
         case ALGORITHM_INIT:
@@ -754,8 +715,14 @@ int ping_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t
                 errno = EINVAL;
                 goto FAILURE;
             }
+            // Probes are cloned from the skeleton as is, so the skeleton
+            // (source IP, length...) is finalized once.
+            if (!probe_update_fields(probe_skel)) {
+                goto FAILURE;
+            }
+
             // Allocate structure storing current state information and update *pdata
-            if (!(data = ping_data_create())) {
+            if (!(data = ping_data_create(probe_skel))) {
                 goto FAILURE;
             }
             *pdata = data;
@@ -772,28 +739,33 @@ int ping_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t
 
             ++(data->num_replies);
             --(data->num_probes_in_flight);
-            data->last_time = reply->recv_time;
+            data->last_time = probe_get_recv_time(reply);
 
             // Notify the caller we've got a response
-            if (destination_reached(options->dst_addr, reply)) {
+            if (destination_reached(data, options->dst_addr, reply)) {
                 pt_raise_event(loop, event_create(PING_PROBE_REPLY, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
             } else {
                 ++(data->num_losses);
-                if (destination_network_unreachable(reply)) {
+                if (!(probe_accessor_extract(&data->version_accessor, reply, &version)
+                   && probe_accessor_extract(&data->type_accessor,    reply, &type)
+                   && probe_accessor_extract(&data->code_accessor,    reply, &code))
+                ) {
+                    pt_raise_event(loop, event_create(PING_GEN_ERROR, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
+                } else if (destination_network_unreachable(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_DST_NET_UNREACHABLE, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (destination_host_unreachable(reply)) {
+                } else if (destination_host_unreachable(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_DST_HOST_UNREACHABLE, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (destination_protocol_unreachable(reply)) {
+                } else if (destination_protocol_unreachable(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_DST_PROT_UNREACHABLE, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (destination_port_unreachable(reply)) {
+                } else if (destination_port_unreachable(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_DST_PORT_UNREACHABLE, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (ttl_exceeded(reply)) {
+                } else if (ttl_exceeded(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_TTL_EXCEEDED_TRANSIT, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (fragment_reassembly_time_exceeded(reply)) {
+                } else if (fragment_reassembly_time_exceeded(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_TIME_EXCEEDED_REASSEMBLY, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (redirect(reply)) {
+                } else if (redirect(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_REDIRECT, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
-                } else if (parameter_problem(reply)) {
+                } else if (parameter_problem(version, type, code)) {
                     pt_raise_event(loop, event_create(PING_PARAMETER_PROBLEM, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
                 } else {
                     pt_raise_event(loop, event_create(PING_GEN_ERROR, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
@@ -810,7 +782,7 @@ int ping_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t
             ++(data->num_replies);
             ++(data->num_losses);
             --(data->num_probes_in_flight);
-            data->last_time = probe->sending_time + network_get_timeout(loop->network);
+            data->last_time = probe_get_sending_time(probe) + network_get_timeout(loop->network);
 
             // Notify the caller we've got a probe timeout
             pt_raise_event(loop, event_create(PING_TIMEOUT, probe, NULL, (ELEMENT_FREE) probe_free));
@@ -841,12 +813,12 @@ int ping_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t
 
     // If this corresponds to the 1st probe
     if ((event->type == PROBE_REPLY || event->type == PROBE_TIMEOUT) && data->num_replies == 1) {
-        data->start_time = probe->sending_time;
+        data->start_time = probe_get_sending_time(probe);
     }
 
     // check if we can send another probe or if we have already sent the maximum number of probes
     if (num_probes_to_send > 0) {
-        send_ping_probes(loop, &data->num_sent, probe_skel, num_probes_to_send);
+        send_ping_probes(loop, data, probe_skel, num_probes_to_send);
         data->num_probes_in_flight += num_probes_to_send;
     } else {
         if (data->num_probes_in_flight == 0) { // we've recieved a response from all the probes we sent
@@ -9,6 +9,8 @@
 #include "../address.h"  // address_t
 #include "../pt_loop.h"  // pt_loop_t
 #include "../dynarray.h" // dynarray_t
+#include "../probe_pool.h" // probe_pool_t
+#include "../probe_accessor.h" // probe_accessor_t
 #include "../options.h"  // option_t
 
 #define OPTIONS_PING_MAX_TTL_DEFAULT                  255
@@ -96,8 +98,13 @@ typedef struct {
     size_t       num_probes_in_flight; /**< The number of probes which haven't provoked a reply so far */
     dynarray_t * rtt_results;          /**< RTTs in order to be able to compute statistics */
     size_t       num_sent;             /**< The number of probes sent (== the sequence number of the next probe packet) */
-    double       start_time;           /**< The date at which ping starts measurement (in microsecond) */
-    double       last_time;            /**< The date at which the last reply or timeout have been handled (in microsecond) */
+    double       start_time;           /**< The date at which ping starts measurement (in seconds) */
+    double       last_time;            /**< The date at which the last reply or timeout have been handled (in seconds) */
+    probe_pool_t * probe_pool;         /**< Pool used to clone the probe skeleton */
+    probe_accessor_t version_accessor; /**< Precompiled "version" field of the replies */
+    probe_accessor_t type_accessor;    /**< Precompiled "type" field of the replies */
+    probe_accessor_t code_accessor;    /**< Precompiled "code" field of the replies */
+    probe_accessor_t src_ip_accessor;  /**< Precompiled "src_ip" field of the replies */
 } ping_data_t;
 
 /**
@@ -8,8 +8,10 @@
 #include "../probe.h"
 #include "../event.h"
 #include "../algorithm.h"
-#include "../address.h"  // address_resolv
-#include "../whois.h"	 // whois_get_asn
+#include "../address.h"  // address_get_cached_hostname
+#include "../whois.h"	 // whois_get_asn, whois_load_asn_table
+#include "../hop_cache.h" // hop_cache_*
+#include "../stop_set.h"  // stop_set_*
 
 //-----------------------------------------------------------------
 // Traceroute options
@@ -22,6 +24,10 @@ static unsigned max_undiscovered[3] = OPTIONS_TRACEROUTE_MAX_UNDISCOVERED;
 static unsigned num_queries[3]      = OPTIONS_TRACEROUTE_NUM_QUERIES;
 static bool     do_resolv           = OPTIONS_TRACEROUTE_DO_RESOLV_DEFAULT;
 static bool     resolv_asn          = OPTIONS_TRACEROUTE_RESOLV_ASN_DEFAULT;
+static unsigned hop_cache_max_age[3] = OPTIONS_TRACEROUTE_HOP_CACHE_MAX_AGE;
+static unsigned hop_cache_max_ttl[3] = OPTIONS_TRACEROUTE_HOP_CACHE_MAX_TTL;
+static unsigned start_ttl[3]        = OPTIONS_TRACEROUTE_START_TTL;
+static struct opt_str asn_table     = {NULL, 0};
 
 static option_t traceroute_options[] = {
     // action           short long                  metavar             help    data
@@ -31,6 +37,10 @@ static option_t traceroute_options[] = {
     {opt_store_0,       "n",  OPT_NO_LF,            OPT_NO_METAVAR,     TRACEROUTE_HELP_n, &do_resolv},
     {opt_store_int_lim, "q",  "--num-queries",      "NUM_QUERIES",      TRACEROUTE_HELP_q, num_queries},
     {opt_store_int_lim, "M",  "--max-undiscovered", "MAX_UNDISCOVERED", TRACEROUTE_HELP_M, max_undiscovered},
+    {opt_store_int_lim, OPT_NO_SF, "--hop-cache",   "MAX_AGE",          TRACEROUTE_HELP_hop_cache, hop_cache_max_age},
+    {opt_store_int_lim, OPT_NO_SF, "--max-cached-ttl", "MAX_TTL",       TRACEROUTE_HELP_max_cached_ttl, hop_cache_max_ttl},
+    {opt_store_int_lim, OPT_NO_SF, "--start-ttl",   "START_TTL",        TRACEROUTE_HELP_start_ttl, start_ttl},
+    {opt_store_str,     OPT_NO_SF, "--asn-table",   "FILE",             TRACEROUTE_HELP_asn_table, &asn_table},
     END_OPT_SPECS
 };
 
@@ -58,6 +68,22 @@ bool options_traceroute_get_resolv_asn() {
     return resolv_asn;
 }
 
+unsigned options_traceroute_get_hop_cache_max_age() {
+    return hop_cache_max_age[0];
+}
+
+uint8_t options_traceroute_get_hop_cache_max_ttl() {
+    return hop_cache_max_ttl[0];
+}
+
+uint8_t options_traceroute_get_start_ttl() {
+    return start_ttl[0];
+}
+
+const char * options_traceroute_get_asn_table() {
+    return asn_table.s;
+}
+
 const option_t * traceroute_get_options() {
     return traceroute_options;
 }
@@ -71,6 +97,17 @@ void options_traceroute_init(traceroute_options_t * traceroute_options, address_
     traceroute_options->dst_addr         = address;
     traceroute_options->do_resolv        = options_traceroute_get_do_resolv();
     traceroute_options->resolv_asn       = options_traceroute_get_resolv_asn();
+    traceroute_options->hop_cache_max_age = options_traceroute_get_hop_cache_max_age();
+    traceroute_options->hop_cache_max_ttl = options_traceroute_get_hop_cache_max_ttl();
+    traceroute_options->start_ttl        = options_traceroute_get_start_ttl();
+
+    // AS lookups are performed offline if a prefix-to-AS table is provided
+    if (options_traceroute_get_asn_table()) {
+        traceroute_options->resolv_asn = true;
+        if (!whois_load_asn_table(options_traceroute_get_asn_table())) {
+            fprintf(stderr, "Cannot load %s, AS lookups will rely on whois\n", options_traceroute_get_asn_table());
+        }
+    }
 }
 
 inline traceroute_options_t traceroute_get_default_options() {
@@ -82,27 +119,147 @@ inline traceroute_options_t traceroute_get_default_options() {
         .dst_addr         = NULL,
         .do_resolv        = OPTIONS_TRACEROUTE_DO_RESOLV_DEFAULT,
         .resolv_asn       = OPTIONS_TRACEROUTE_RESOLV_ASN_DEFAULT,
+        .hop_cache_max_age = OPTIONS_TRACEROUTE_HOP_CACHE_MAX_AGE_DEFAULT,
+        .hop_cache_max_ttl = OPTIONS_TRACEROUTE_HOP_CACHE_MAX_TTL_DEFAULT,
+        .start_ttl        = OPTIONS_TRACEROUTE_START_TTL_DEFAULT,
     };
     return traceroute_options;
 };
 
+//-----------------------------------------------------------------
+// Hops buffered by traceroute_handler
+//-----------------------------------------------------------------
+
+/**
+ * \brief A hop printed by traceroute_handler while the name of its
+ *    address is resolved (see pt_resolve), or while Doubletree may still
+ *    discover a previous hop. Its text is buffered and the hostname is
+ *    inserted at hostname_offset once available.
+ */
+
+typedef struct hop_line_s {
+    uint8_t     ttl;             /**< TTL of the hop */
+    char      * buffer;          /**< Text of the hop */
+    size_t      size;            /**< Size of the text */
+    FILE      * stream;          /**< Stream writing in buffer (NULL once the hop is complete) */
+    bool        has_address;     /**< True iif a hostname must be inserted */
+    address_t   address;         /**< Address whose name is inserted */
+    long        hostname_offset; /**< Where the hostname is inserted */
+} hop_line_t;
+
+static void hop_line_free(hop_line_t * line) {
+    if (line) {
+        if (line->stream) fclose(line->stream);
+        free(line->buffer);
+        free(line);
+    }
+}
+
+static void address_fprint(FILE * out, const address_t * address) {
+    char * buffer;
+
+    if (address_to_string(address, &buffer) == 0) {
+        fprintf(out, "%s", buffer);
+        free(buffer);
+    } else {
+        fprintf(out, "???");
+    }
+}
+
+/**
+ * \brief Complete the current hop of a traceroute instance (if it is
+ *    buffered) and insert it in its buffered hops, which are sorted by
+ *    TTL since Doubletree discovers the first hops last.
+ * \param traceroute_data Data related to this instance of traceroute.
+ */
+
+static void hop_line_push(traceroute_data_t * traceroute_data)
+{
+    hop_line_t  * line = traceroute_data->cur_hop_line;
+    void       ** lines;
+    size_t        i;
+
+    if (line) {
+        fclose(line->stream);
+        line->stream = NULL;
+        traceroute_data->cur_hop_line = NULL;
+        if (!dynarray_push_element(traceroute_data->hop_lines, line)) {
+            hop_line_free(line);
+            return;
+        }
+
+        lines = dynarray_get_elements(traceroute_data->hop_lines);
+        for (i = dynarray_get_size(traceroute_data->hop_lines) - 1; i > 0 && ((hop_line_t *) lines[i - 1])->ttl > line->ttl; i--) {
+            lines[i] = lines[i - 1];
+        }
+        lines[i] = line;
+    }
+}
+
+/**
+ * \brief Print the buffered hops of a traceroute instance, in order.
+ *    Nothing is printed while they are deferred (see traceroute_data_t).
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \param wait_hostname Pass true to stop at the first hop whose hostname
+ *    is not yet resolved, false to print its address instead.
+ * \return The number of hops still buffered.
+ */
+
+static size_t hop_lines_print(traceroute_data_t * traceroute_data, bool wait_hostname)
+{
+    hop_line_t * line;
+    char       * hostname = NULL;
+
+    while (!traceroute_data->defer_hop_lines && dynarray_get_size(traceroute_data->hop_lines)) {
+        line = dynarray_get_ith_element(traceroute_data->hop_lines, 0);
+        if (line->has_address && !address_get_cached_hostname(&line->address, &hostname) && wait_hostname) break;
+
+        fwrite(line->buffer, 1, line->hostname_offset, stdout);
+        if (hostname) {
+            printf("%s", hostname);
+            free(hostname);
+            hostname = NULL;
+        } else if (line->has_address) {
+            address_fprint(stdout, &line->address);
+        }
+        fwrite(line->buffer + line->hostname_offset, 1, line->size - line->hostname_offset, stdout);
+        dynarray_del_ith_element(traceroute_data->hop_lines, 0, (ELEMENT_FREE) hop_line_free);
+    }
+    fflush(stdout);
+    return dynarray_get_size(traceroute_data->hop_lines);
+}
+
 //-----------------------------------------------------------------
 // Traceroute algorithm's data
 //-----------------------------------------------------------------
 
 /**
  * \brief Allocate a traceroute_data_t instance
+ * \param probe_skel The probe skeleton used to craft the probe packets
  * \return The newly allocated traceroute_data_t instance,
  *    NULL in case of failure
  */
 
-static traceroute_data_t * traceroute_data_create() {
+static traceroute_data_t * traceroute_data_create(const probe_t * probe_skel) {
     traceroute_data_t * traceroute_data;
 
     if (!(traceroute_data = calloc(1, sizeof(traceroute_data_t)))) goto ERR_MALLOC;
     if (!(traceroute_data->probes = dynarray_create()))            goto ERR_PROBES;
+    if (!(traceroute_data->discovered = dynarray_create()))        goto ERR_DISCOVERED;
+    if (!(traceroute_data->hop_lines = dynarray_create()))         goto ERR_HOP_LINES;
+    if (!(traceroute_data->probe_pool = probe_pool_create(probe_skel, PROBE_POOL_DEFAULT_SIZE))) {
+        goto ERR_PROBE_POOL;
+    }
+    probe_accessor_init(&traceroute_data->ttl_accessor, "ttl");
+    probe_accessor_init(&traceroute_data->src_ip_accessor, "src_ip");
     return traceroute_data;
 
+ERR_PROBE_POOL:
+    dynarray_free(traceroute_data->hop_lines, NULL);
+ERR_HOP_LINES:
+    dynarray_free(traceroute_data->discovered, NULL);
+ERR_DISCOVERED:
+    dynarray_free(traceroute_data->probes, NULL);
 ERR_PROBES:
     free(traceroute_data);
 ERR_MALLOC:
@@ -110,16 +267,24 @@ ERR_MALLOC:
 }
 
 /**
- * \brief Release a traceroute_data_t instance from the memory
+ * \brief Release a traceroute_data_t instance from the memory. The hops
+ *    still buffered by traceroute_handler are printed beforehand, with
+ *    their address if their hostname is not yet resolved.
  * \param traceroute_data The traceroute_data_t instance we want to release.
  */
 
 static void traceroute_data_free(traceroute_data_t * traceroute_data) {
     if (traceroute_data) {
+        hop_line_push(traceroute_data);
+        traceroute_data->defer_hop_lines = false;
+        hop_lines_print(traceroute_data, false);
+        dynarray_free(traceroute_data->hop_lines, NULL);
         if (traceroute_data->probes) {
             // TODO this will provoke a double free
             // dynarray_free(traceroute_data->probes, (ELEMENT_FREE) probe_free);
         }
+        dynarray_free(traceroute_data->discovered, (ELEMENT_FREE) address_free);
+        probe_pool_free(traceroute_data->probe_pool);
         free(traceroute_data);
     }
 }
@@ -128,58 +293,148 @@ static void traceroute_data_free(traceroute_data_t * traceroute_data) {
 // Traceroute default handler
 //-----------------------------------------------------------------
 
-static inline void ttl_dump(const probe_t * probe) {
+/**
+ * \brief Start buffering the current hop of a traceroute instance.
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \return true iif successful.
+ */
+
+static bool hop_line_open(traceroute_data_t * traceroute_data)
+{
+    hop_line_t * line;
+
+    if (traceroute_data->cur_hop_line) return true;
+    if (!(line = calloc(1, sizeof(hop_line_t))))                      goto ERR_CALLOC;
+    if (!(line->stream = open_memstream(&line->buffer, &line->size))) goto ERR_OPEN_MEMSTREAM;
+    line->ttl = UINT8_MAX; // A line without TTL (e.g. the blank line ending the hops) is printed last
+    traceroute_data->cur_hop_line = line;
+    return true;
+
+ERR_OPEN_MEMSTREAM:
+    free(line);
+ERR_CALLOC:
+    return false;
+}
+
+/**
+ * \brief Complete the current hop of a traceroute instance, and print
+ *    its buffered hops that can be.
+ * \param traceroute_data Data related to this instance of traceroute.
+ */
+
+static void hop_line_close(traceroute_data_t * traceroute_data)
+{
+    hop_line_push(traceroute_data);
+    hop_lines_print(traceroute_data, true);
+}
+
+size_t traceroute_handler_flush(traceroute_data_t * traceroute_data, bool has_terminated)
+{
+    // Every hop is now known
+    if (has_terminated) {
+        hop_line_push(traceroute_data);
+        traceroute_data->defer_hop_lines = false;
+    }
+    return hop_lines_print(traceroute_data, true);
+}
+
+/**
+ * \brief Retrieve where traceroute_handler must print the current hop.
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \return The corresponding stream.
+ */
+
+static inline FILE * hop_line_get_stream(const traceroute_data_t * traceroute_data) {
+    return traceroute_data->cur_hop_line ? traceroute_data->cur_hop_line->stream : stdout;
+}
+
+static inline void ttl_dump(traceroute_data_t * traceroute_data, const probe_t * probe) {
     uint8_t ttl;
-    if (probe_extract(probe, "ttl", &ttl)) printf("%2d ", ttl);
+
+    if (probe_extract(probe, "ttl", &ttl)) {
+        fprintf(hop_line_get_stream(traceroute_data), "%2d ", ttl);
+        if (traceroute_data->cur_hop_line) traceroute_data->cur_hop_line->ttl = ttl;
+    }
 }
 
-static inline void discovered_ip_dump(const probe_t * reply, bool do_resolv, bool resolv_asn) {
+/**
+ * \brief Buffer the current hop if the name of the discovered address
+ *    is not yet known, and start resolving it.
+ * \param loop The main loop.
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \param reply The first reply of the hop.
+ * \param do_resolv Pass false if names are not resolved.
+ */
+
+static void hop_line_prepare(pt_loop_t * loop, traceroute_data_t * traceroute_data, const probe_t * reply, bool do_resolv) {
     address_t   discovered_addr;
     char      * discovered_hostname;
 
+    if (!do_resolv || !probe_extract(reply, "src_ip", &discovered_addr)) return;
+
+    if (address_get_cached_hostname(&discovered_addr, &discovered_hostname)) {
+        free(discovered_hostname);
+    } else if (pt_resolve(loop, &discovered_addr) && hop_line_open(traceroute_data)) {
+        traceroute_data->cur_hop_line->has_address = true;
+        traceroute_data->cur_hop_line->address = discovered_addr;
+    }
+}
+
+static inline void discovered_ip_dump(FILE * out, traceroute_data_t * traceroute_data, const probe_t * reply, bool do_resolv, bool resolv_asn) {
+    hop_line_t * line = traceroute_data->cur_hop_line;
+    address_t    discovered_addr;
+    char       * discovered_hostname;
+
     if (probe_extract(reply, "src_ip", &discovered_addr)) {
-        printf(" ");
+        fprintf(out, " ");
         if (do_resolv) {
-            if (address_resolv(&discovered_addr, &discovered_hostname, CACHE_ENABLED)) {
-                printf("%s", discovered_hostname);
+            if (line && line->has_address) {
+                // The hostname is inserted once resolved, see traceroute_handler_flush
+                line->hostname_offset = ftell(out);
+            } else if (address_get_cached_hostname(&discovered_addr, &discovered_hostname)) {
+                fprintf(out, "%s", discovered_hostname);
                 free(discovered_hostname);
             } else {
-                address_dump(&discovered_addr);
+                address_fprint(out, &discovered_addr);
             }
-            printf(" (");
+            fprintf(out, " (");
         }
 
-        address_dump(&discovered_addr);
+        address_fprint(out, &discovered_addr);
 
         if (do_resolv) {
-            printf(")");
+            fprintf(out, ")");
         }
 
 		if (resolv_asn) {
 			uint32_t asn = 0;
 			bool found = whois_get_asn(&discovered_addr, &asn, CACHE_ENABLED);
 			if (found) {
-				printf(" [AS%u]", asn);
+				fprintf(out, " [AS%u]", asn);
 			}
 		}
     }
 }
 
-static inline void delay_dump(const probe_t * probe, const probe_t * reply) {
-    double send_time = probe_get_sending_time(probe),
-           recv_time = probe_get_recv_time(reply);
-    printf("  %-5.3lfms  ", 1000 * (recv_time - send_time));
+static inline void delay_dump(FILE * out, const probe_t * probe, const probe_t * reply) {
+    fprintf(out, "  %-5.3lfms  ", 1000 * probe_get_rtt(probe, reply));
 }
 
 void traceroute_handler(
     pt_loop_t                  * loop,
     traceroute_event_t         * traceroute_event,
     const traceroute_options_t * traceroute_options,
-    const traceroute_data_t    * traceroute_data
+    traceroute_data_t          * traceroute_data
 ) {
     const probe_t * probe;
     const probe_t * reply;
-    static size_t   num_probes_printed = 0;
+    FILE          * out;
+
+    // Hops are printed in order: buffer this one if a previous hop is
+    // waiting for its hostname, or may still be discovered.
+    if (traceroute_data->defer_hop_lines || dynarray_get_size(traceroute_data->hop_lines)) {
+        hop_line_open(traceroute_data);
+    }
 
     switch (traceroute_event->type) {
         case TRACEROUTE_PROBE_REPLY:
@@ -189,29 +444,31 @@ void traceroute_handler(
             reply = ((const probe_reply_t *) traceroute_event->data)->reply;
 
             // Print TTL and discovered IP if this is the first probe related to this TTL
-            if (num_probes_printed % traceroute_options->num_probes == 0) {
-                ttl_dump(probe);
-                discovered_ip_dump(reply, traceroute_options->do_resolv, traceroute_options->resolv_asn);
+            if (traceroute_data->num_probes_printed % traceroute_options->num_probes == 0) {
+                hop_line_prepare(loop, traceroute_data, reply, traceroute_options->do_resolv);
+                ttl_dump(traceroute_data, probe);
+                discovered_ip_dump(hop_line_get_stream(traceroute_data), traceroute_data, reply, traceroute_options->do_resolv, traceroute_options->resolv_asn);
             }
 
             // Print delay
-            delay_dump(probe, reply);
-            fflush(stdout);
-            num_probes_printed++;
+            out = hop_line_get_stream(traceroute_data);
+            delay_dump(out, probe, reply);
+            fflush(out);
+            traceroute_data->num_probes_printed++;
             break;
 
         case TRACEROUTE_STAR:
             probe = (const probe_t *) traceroute_event->data;
-            if (num_probes_printed % traceroute_options->num_probes == 0) {
-                ttl_dump(probe);
+            if (traceroute_data->num_probes_printed % traceroute_options->num_probes == 0) {
+                ttl_dump(traceroute_data, probe);
             }
-            printf(" *");
-            num_probes_printed++;
+            fprintf(hop_line_get_stream(traceroute_data), " *");
+            traceroute_data->num_probes_printed++;
             break;
 
         case TRACEROUTE_ICMP_ERROR:
-            printf(" !");
-            num_probes_printed++;
+            fprintf(hop_line_get_stream(traceroute_data), " !");
+            traceroute_data->num_probes_printed++;
             break;
 
         case TRACEROUTE_DESTINATION_REACHED:
@@ -221,8 +478,9 @@ void traceroute_handler(
             break;
     }
 
-    if (num_probes_printed % traceroute_options->num_probes == 0) {
-        printf("\n");
+    if (traceroute_data->num_probes_printed % traceroute_options->num_probes == 0) {
+        fprintf(hop_line_get_stream(traceroute_data), "\n");
+        hop_line_close(traceroute_data);
     }
 }
 
@@ -233,15 +491,17 @@ void traceroute_handler(
 
 /**
  * \brief Check whether the destination is reached.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
  * \param dst_addr The destination address of this traceroute instance.
+ * \param reply The reply we have received.
  * \return true iif the destination is reached.
  */
 
-static inline bool destination_reached(const address_t * dst_addr, const probe_t * reply) {
+static inline bool destination_reached(traceroute_data_t * traceroute_data, const address_t * dst_addr, const probe_t * reply) {
     bool        ret = false;
     address_t   discovered_addr;
 
-    if (probe_extract(reply, "src_ip", &discovered_addr)) {
+    if (probe_accessor_extract(&traceroute_data->src_ip_accessor, reply, &discovered_addr)) {
         ret = (address_compare(dst_addr, &discovered_addr) == 0);
     }
     return ret;
@@ -251,29 +511,41 @@ static inline bool destination_reached(const address_t * dst_addr, const probe_t
  * \brief Send a traceroute probe packet
  * \param loop The main loop
  * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param options Options of this instance (hop cache settings)
  * \param probe_skel The probe skeleton used to craft the probe packet
  * \param ttl The TTL that we set for this packet
  */
 
 static bool send_traceroute_probe(
-    pt_loop_t         * loop,
-    traceroute_data_t * traceroute_data,
-    const probe_t     * probe_skel,
-    uint8_t             ttl,
-    size_t              i
+    pt_loop_t                  * loop,
+    traceroute_data_t          * traceroute_data,
+    const traceroute_options_t * options,
+    const probe_t              * probe_skel,
+    uint8_t                      ttl,
+    size_t                       i
 ) {
-    probe_t * probe;
-    double    delay;
+    probe_t                 * probe;
+    double                    delay;
+    const hop_cache_entry_t * entry;
+
     // a probe must never be altered, otherwise the network layer may
     // manage corrupted probes.
-    if (!(probe = probe_dup(probe_skel)))                       goto ERR_PROBE_DUP;
+    if (!(probe = probe_pool_get(traceroute_data->probe_pool))) goto ERR_PROBE_DUP;
     if (probe_get_delay(probe) != DELAY_BEST_EFFORT) {
         delay = i * probe_get_delay(probe_skel);
         probe_set_delay(probe, DOUBLE("delay", delay));
     }
-    if (!probe_set_fields(probe, I8("ttl", ttl), NULL))         goto ERR_PROBE_SET_FIELDS;
+    if (!probe_accessor_write(&traceroute_data->ttl_accessor, probe, &ttl)) goto ERR_PROBE_SET_FIELDS;
     if (!dynarray_push_element(traceroute_data->probes, probe)) goto ERR_PROBE_PUSH_ELEMENT;
 
+    // This hop has already been discovered by a previous instance
+    if (traceroute_data->use_hop_cache
+    && ttl <= options->hop_cache_max_ttl
+    && (entry = hop_cache_find(&traceroute_data->src_ip, traceroute_data->flow_id, ttl, options->hop_cache_max_age))
+    ) {
+        return hop_cache_replay(loop, probe, entry);
+    }
+
     return pt_send_probe(loop, probe);
 
 ERR_PROBE_PUSH_ELEMENT:
@@ -312,29 +584,52 @@ ERR_PROBE_DUP:
 /**
  * \brief Send n traceroute probes toward a destination with a given TTL
  * \param pt_loop The paris traceroute loop
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param options Options of this instance (options->num_probes probes are sent)
  * \param probe_skel The probe skeleton used to craft the probe packet
- * \param num_probes The amount of probe to send
  * \param ttl Time To Live related to our probe
  * \return true if successful
  */
 
 bool send_traceroute_probes(
-    pt_loop_t         * loop,
-    traceroute_data_t * traceroute_data,
-    probe_t           * probe_skel,
-    size_t              num_probes,
-    uint8_t             ttl
+    pt_loop_t                  * loop,
+    traceroute_data_t          * traceroute_data,
+    const traceroute_options_t * options,
+    probe_t                    * probe_skel,
+    uint8_t                      ttl
 ) {
     size_t i;
 
-    for (i = 0; i < num_probes; ++i) {
-        if (!(send_traceroute_probe(loop, traceroute_data, probe_skel, ttl, i + 1))) {
+    for (i = 0; i < options->num_probes; ++i) {
+        if (!(send_traceroute_probe(loop, traceroute_data, options, probe_skel, ttl, i + 1))) {
             return false;
         }
     }
     return true;
 }
 
+/**
+ * \brief Insert the hops discovered by Doubletree in the stop sets.
+ * \param loop The main loop
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param options Options of this instance
+ */
+
+static void traceroute_update_stop_set(
+    pt_loop_t                  * loop,
+    traceroute_data_t          * traceroute_data,
+    const traceroute_options_t * options
+) {
+    size_t            i, num_discovered = dynarray_get_size(traceroute_data->discovered);
+    const address_t * address;
+
+    for (i = 0; i < num_discovered; i++) {
+        address = dynarray_get_ith_element(traceroute_data->discovered, i);
+        stop_set_insert(loop->stop_set, address, NULL);
+        stop_set_insert(loop->stop_set, address, options->dst_addr);
+    }
+}
+
 /**
  * \brief Handle events to a traceroute algorithm instance
  * \param loop The main loop
@@ -355,23 +650,40 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
     traceroute_options_t * options = opts;  // Options passed to this instance
     bool                   discover_next_hop = false;
     bool                   has_terminated = false;
+    bool                   is_done = false; // No more probes to send
+    address_t              discovered_addr; // Address of the current hop
+    uint8_t                ttl;             // TTL of the probe
 
     switch (event->type) {
 
         case ALGORITHM_INIT:
             // Check options
-            if (!options || options->min_ttl > options->max_ttl) {
+            if (!options || options->min_ttl > options->max_ttl
+            || (options->start_ttl && (options->start_ttl < options->min_ttl || options->start_ttl > options->max_ttl))
+            ) {
                 fprintf(stderr, "Invalid traceroute options\n");
                 errno = EINVAL;
                 goto FAILURE;
             }
 
+            // Probes are cloned from the skeleton and then only their TTL is
+            // altered, so the skeleton (source IP, length...) is finalized once.
+            if (!probe_update_fields(probe_skel)) {
+                goto FAILURE;
+            }
+
             // Allocate structure storing current state information and update *pdata
-            if (!(data = traceroute_data_create())) {
+            if (!(data = traceroute_data_create(probe_skel))) {
                 goto FAILURE;
             }
             *pdata = data;
-            data->ttl = options->min_ttl;
+            data->ttl = options->start_ttl ? options->start_ttl : options->min_ttl;
+            data->defer_hop_lines = options->start_ttl > options->min_ttl;
+
+            // The hop cache is keyed by the source and the flow of the probes
+            data->use_hop_cache = options->hop_cache_max_age > 0
+                && probe_extract(probe_skel, "src_ip", &data->src_ip)
+                && probe_extract(probe_skel, "flow_id", &data->flow_id);
             break;
 
         case PROBE_REPLY:
@@ -383,7 +695,23 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
             data->num_stars = 0;
             data->num_undiscovered = 0;
             ++(data->num_replies);
-            data->destination_reached |= destination_reached(options->dst_addr, reply);
+            data->destination_reached |= destination_reached(data, options->dst_addr, reply);
+
+            // Doubletree: check whether this hop is already known. Probing
+            // forward relies on the global stop set, backward on the local one.
+            if (options->start_ttl && probe_accessor_extract(&data->src_ip_accessor, reply, &discovered_addr)) {
+                data->stop_set_reached |= stop_set_contains(loop->stop_set, &discovered_addr, data->is_backward ? NULL : options->dst_addr);
+                dynarray_push_element(data->discovered, address_dup(&discovered_addr));
+            }
+
+            // Share this hop with the next instances, unless it is specific to this destination
+            if (data->use_hop_cache
+            && !destination_reached(data, options->dst_addr, reply)
+            &&  probe_accessor_extract(&data->ttl_accessor, probe_reply->probe, &ttl)
+            &&  ttl <= options->hop_cache_max_ttl
+            ) {
+                hop_cache_insert(&data->src_ip, data->flow_id, ttl, probe_reply->probe, reply);
+            }
 
             // Notify the caller we've discovered an IP address
             pt_raise_event(loop, event_create(TRACEROUTE_PROBE_REPLY, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
@@ -421,35 +749,62 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
 
     // Explore next hop
     if ((data->num_replies % options->num_probes) == 0) {
-        if (data->destination_reached) {
+        if (data->is_backward) {
+            // Doubletree: probe backward until reaching min_ttl or a known hop
+            if (data->stop_set_reached) {
+                pt_raise_event(loop, event_create(TRACEROUTE_STOP_SET_REACHED, NULL, NULL, NULL));
+                is_done = true;
+            } else if (data->ttl < options->min_ttl) {
+                is_done = true;
+            } else discover_next_hop = true;
+        } else if (data->destination_reached) {
             // We've reached the destination
             pt_raise_event(loop, event_create(TRACEROUTE_DESTINATION_REACHED, NULL, NULL, NULL));
-            pt_raise_terminated(loop);
+            is_done = true;
+        } else if (data->stop_set_reached) {
+            // Doubletree: the next hops have already been discovered towards this destination prefix
+            pt_raise_event(loop, event_create(TRACEROUTE_STOP_SET_REACHED, NULL, NULL, NULL));
+            is_done = true;
         } else if (data->ttl > options->max_ttl) {
             // We've reached the maximum TTL
             pt_raise_event(loop, event_create(TRACEROUTE_MAX_TTL_REACHED, NULL, NULL, NULL));
-            pt_raise_terminated(loop);
+            is_done = true;
         } else if (data->num_stars == options->num_probes) {
             // We've only discovered stars for the current hop
             ++(data->num_undiscovered);
             if (data->num_undiscovered == options->max_undiscovered) {
                 // We've only discovered stars for the last "max_undiscovered" hops, so give up
                 pt_raise_event(loop, event_create(TRACEROUTE_TOO_MANY_STARS, NULL, NULL, NULL));
-                pt_raise_terminated(loop);
+                is_done = true;
             } else {
                 // Skip this hop and explore the next one
                 discover_next_hop = true;
             }
         } else discover_next_hop = true;
 
+        // Doubletree: once done forward, probe backward from start_ttl - 1
+        if (is_done && !data->is_backward && options->start_ttl > options->min_ttl) {
+            data->is_backward      = true;
+            data->stop_set_reached = false;
+            data->ttl              = options->start_ttl - 1;
+            is_done                = false;
+            discover_next_hop      = true;
+        }
+
+        if (is_done) {
+            traceroute_update_stop_set(loop, data, options);
+            pt_raise_terminated(loop);
+        }
+
         if (discover_next_hop) {
             data->num_stars = 0;
 
             // Discover the next hop
-            if (!send_traceroute_probes(loop, data, probe_skel, options->num_probes, data->ttl)) {
+            if (!send_traceroute_probes(loop, data, options, probe_skel, data->ttl)) {
                 goto FAILURE;
             }
-            (data->ttl)++;
+            if (data->is_backward) (data->ttl)--;
+            else                   (data->ttl)++;
         }
 
     }
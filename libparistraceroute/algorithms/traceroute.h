@@ -8,7 +8,10 @@
 #include "../address.h"  // address_t
 #include "../pt_loop.h"  // pt_loop_t
 #include "../dynarray.h" // dynarray_t
+#include "../probe_pool.h" // probe_pool_t
+#include "../probe_accessor.h" // probe_accessor_t
 #include "../options.h"  // option_t
+#include "../asn_table.h" // ASN_TABLE_INDEX_SUFFIX
 
 #define OPTIONS_TRACEROUTE_MIN_TTL_DEFAULT            1
 #define OPTIONS_TRACEROUTE_MAX_TTL_DEFAULT            30
@@ -16,11 +19,17 @@
 #define OPTIONS_TRACEROUTE_NUM_QUERIES_DEFAULT        3
 #define OPTIONS_TRACEROUTE_DO_RESOLV_DEFAULT          true
 #define OPTIONS_TRACEROUTE_RESOLV_ASN_DEFAULT         false
+#define OPTIONS_TRACEROUTE_HOP_CACHE_MAX_AGE_DEFAULT  0
+#define OPTIONS_TRACEROUTE_HOP_CACHE_MAX_TTL_DEFAULT  1
+#define OPTIONS_TRACEROUTE_START_TTL_DEFAULT          0
 
 #define OPTIONS_TRACEROUTE_MIN_TTL          {OPTIONS_TRACEROUTE_MIN_TTL_DEFAULT,          1, 255}
 #define OPTIONS_TRACEROUTE_MAX_TTL          {OPTIONS_TRACEROUTE_MAX_TTL_DEFAULT,          1, 255}
 #define OPTIONS_TRACEROUTE_MAX_UNDISCOVERED {OPTIONS_TRACEROUTE_MAX_UNDISCOVERED_DEFAULT, 1, 255}
 #define OPTIONS_TRACEROUTE_NUM_QUERIES      {OPTIONS_TRACEROUTE_NUM_QUERIES_DEFAULT,      1, 255}
+#define OPTIONS_TRACEROUTE_HOP_CACHE_MAX_AGE {OPTIONS_TRACEROUTE_HOP_CACHE_MAX_AGE_DEFAULT, 0, 86400}
+#define OPTIONS_TRACEROUTE_HOP_CACHE_MAX_TTL {OPTIONS_TRACEROUTE_HOP_CACHE_MAX_TTL_DEFAULT, 1, 255}
+#define OPTIONS_TRACEROUTE_START_TTL        {OPTIONS_TRACEROUTE_START_TTL_DEFAULT,        0, 255}
 
 #define TRACEROUTE_HELP_A "Perform AS path lookups in routing registries and print results directly after the corresponding addresses."
 #define TRACEROUTE_HELP_f "Start from the MIN_TTL hop (instead from 1), MIN_TTL must be between 1 and 255."
@@ -28,6 +37,10 @@
 #define TRACEROUTE_HELP_n "Do not resolve IP addresses to their domain names"
 #define TRACEROUTE_HELP_q "Set the number of probes per hop (default: 3)."
 #define TRACEROUTE_HELP_M "Set the maximum number of consecutive unresponsive hops which causes the program to abort (default 3)."
+#define TRACEROUTE_HELP_start_ttl "Doubletree: start from the START_TTL hop, probe forward until reaching a hop already discovered towards the same destination prefix, then backward until reaching a hop already discovered. Default is 0 (disabled)."
+#define TRACEROUTE_HELP_asn_table "Perform the AS lookups (implies -A) in this prefix-to-AS table (lines \"PREFIX/LEN ASN\" or \"PREFIX LEN ASN\"), whois is only queried for the addresses it does not cover. Its compiled form is stored in FILE" ASN_TABLE_INDEX_SUFFIX "."
+#define TRACEROUTE_HELP_hop_cache "Reuse the hops discovered by the previous instances of this process (same source, flow and TTL) if they are at most MAX_AGE seconds old. Default is 0 (disabled)."
+#define TRACEROUTE_HELP_max_cached_ttl "Only reuse the cached hops whose TTL is at most MAX_TTL. The hop cache ignores the destination of the probes, so MAX_TTL must not exceed the number of hops shared by the paths towards every destination (e.g. the access network of the vantage point). Beyond this depth, a trace would silently report the hops of another path. Default is 1, the only hop (gateway) shared by every path whatever the network: set MAX_TTL to the depth of the access network to skip it entirely."
 
 // Get the different values of traceroute options
 uint8_t options_traceroute_get_min_ttl();
@@ -36,6 +49,10 @@ uint8_t options_traceroute_get_num_queries();
 uint8_t options_traceroute_get_max_undiscovered();
 bool    options_traceroute_get_do_resolv();
 bool    options_traceroute_get_resolv_asn();
+unsigned options_traceroute_get_hop_cache_max_age();
+uint8_t options_traceroute_get_hop_cache_max_ttl();
+uint8_t options_traceroute_get_start_ttl();
+const char * options_traceroute_get_asn_table();
 
 /*
  * Principle: (from man page)
@@ -63,6 +80,13 @@ bool    options_traceroute_get_resolv_asn();
  *                 EXIT
  *             cur_ttl += 1
  *             SEND
+ *
+ * If start_ttl is set, traceroute behaves like Doubletree: it starts at
+ * start_ttl and probes forward until it also reaches a hop of the global
+ * stop set (hops already discovered towards the same destination prefix).
+ * It then probes backward from start_ttl - 1 until it reaches min_ttl or
+ * a hop of the local stop set (hops already discovered). The stop sets
+ * (see pt_loop_t.stop_set) are updated once the instance has terminated.
  */
 
 //--------------------------------------------------------------------
@@ -77,6 +101,9 @@ typedef struct {
     const address_t * dst_addr;         /**< The target IP. */
     bool              do_resolv;        /**< Resolv each discovered IP hop. */
     bool              resolv_asn;       /**< Perform AS path lookups for each discovered IP hop. */
+    unsigned          hop_cache_max_age; /**< Maximum age (in seconds) of the hops reused from the hop cache (0: disabled). */
+    uint8_t           hop_cache_max_ttl; /**< Maximum TTL of the hops reused from (and stored in) the hop cache. */
+    uint8_t           start_ttl;        /**< TTL from which Doubletree probes forward and backward (0: disabled). */
 } traceroute_options_t;
 
 const option_t * traceroute_get_options();
@@ -97,7 +124,8 @@ typedef enum {
     TRACEROUTE_ICMP_ERROR,          // | probe_t *       | The probe which has provoked the ICMP error
     TRACEROUTE_STAR,                // | probe_t *       | The probe which has been lost
     TRACEROUTE_MAX_TTL_REACHED,     // | NULL            | N/A
-    TRACEROUTE_TOO_MANY_STARS       // | NULL            | N/A
+    TRACEROUTE_TOO_MANY_STARS,      // | NULL            | N/A
+    TRACEROUTE_STOP_SET_REACHED     // | NULL            | N/A (Doubletree: a known hop has been reached)
 } traceroute_event_type_t;
 
 // TODO since this structure should exactly match with a standard event_t, define a macro allowing to define custom events
@@ -116,6 +144,19 @@ typedef struct {
     size_t        num_undiscovered;    /**< Number of consecutive undiscovered hops  */
     size_t        num_stars;           /**< Number of probe lost for the current hop */
     dynarray_t  * probes;              /**< Probe instances allocated by traceroute  */
+    probe_pool_t * probe_pool;         /**< Pool used to clone the probe skeleton    */
+    probe_accessor_t ttl_accessor;     /**< Precompiled "ttl" field of the probes    */
+    probe_accessor_t src_ip_accessor;  /**< Precompiled "src_ip" field of the replies */
+    bool          use_hop_cache;       /**< True iif the probes are answered from the hop cache when possible */
+    address_t     src_ip;              /**< Source of the probes (hop cache key) */
+    uint16_t      flow_id;             /**< Flow identifier of the probes (hop cache key) */
+    bool          is_backward;         /**< True iif Doubletree is probing backward */
+    bool          stop_set_reached;    /**< True iif a hop of the stop set has been reached for the current TTL */
+    dynarray_t  * discovered;          /**< Addresses discovered by Doubletree (address_t *) */
+    dynarray_t  * hop_lines;           /**< Complete hops buffered by traceroute_handler (see traceroute_handler_flush) */
+    struct hop_line_s * cur_hop_line;  /**< Hop being buffered by traceroute_handler, NULL if it is printed on stdout */
+    size_t        num_probes_printed;  /**< Number of probes printed by traceroute_handler */
+    bool          defer_hop_lines;     /**< True iif the hops are printed once all of them are known (Doubletree probes backward, or the caller runs several instances) */
 } traceroute_data_t;
 
 //-----------------------------------------------------------------
@@ -134,7 +175,25 @@ void traceroute_handler(
     pt_loop_t                  * loop,
     traceroute_event_t         * traceroute_event,
     const traceroute_options_t * traceroute_options,
-    const traceroute_data_t    * traceroute_data
+    traceroute_data_t          * traceroute_data
 );
 
+/**
+ * \brief Print, sorted by TTL, the hops of a traceroute instance buffered
+ *    by traceroute_handler whose hostname is now resolved. It must be
+ *    called once the user handler receives the ALGORITHM_HAS_TERMINATED
+ *    event of this instance (Doubletree prints its hops at this point)
+ *    and, if names are resolved (see traceroute_options_t.do_resolv),
+ *    whenever it receives a NAME_RESOLVED event. The instance should not
+ *    be stopped until it returns 0: otherwise, the remaining hops are
+ *    printed with their address once its data is released (see
+ *    pt_stop_instance).
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \param has_terminated Pass true if the ALGORITHM_HAS_TERMINATED event
+ *    of this instance has been received.
+ * \return The number of hops still waiting for their hostname.
+ */
+
+size_t traceroute_handler_flush(traceroute_data_t * traceroute_data, bool has_terminated);
+
 #endif
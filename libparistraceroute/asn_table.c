@@ -0,0 +1,494 @@
+#include "use.h"
+#include "config.h"
+
+#include <ctype.h>              // isdigit
+#include <fcntl.h>              // open
+#include <stdio.h>              // fopen, fgets
+#include <stdlib.h>             // malloc, realloc, free, strtoul, mkstemp
+#include <string.h>             // memset, memcpy, strchr
+#include <unistd.h>             // close, unlink
+#include <arpa/inet.h>          // inet_pton
+#include <sys/mman.h>           // mmap, munmap
+#include <sys/stat.h>           // stat, fstat
+
+#include "asn_table.h"
+
+#define ASN_TABLE_MAGIC      "PTASNTBL"
+#define ASN_TABLE_BYTE_ORDER 0x01020304
+#define ASN_TABLE_ROOT_IPV4  0
+#define ASN_TABLE_ROOT_IPV6  1
+#define ASN_TABLE_TMP_SUFFIX ".XXXXXX" // See asn_table_save
+
+/**
+ * \brief Header of a compiled table, followed by its nodes.
+ */
+
+typedef struct {
+    char     magic[8];      /**< ASN_TABLE_MAGIC */
+    uint32_t byte_order;    /**< ASN_TABLE_BYTE_ORDER, in the byte order of the writer */
+    uint32_t num_nodes;     /**< Number of nodes */
+    uint32_t roots[2];      /**< Roots of the IPv4 and IPv6 tries */
+    uint32_t padding[2];
+} asn_table_header_t;
+
+//---------------------------------------------------------------------------
+// Bit strings
+//---------------------------------------------------------------------------
+
+static inline unsigned get_bit(const uint8_t * bytes, size_t i) {
+    return (bytes[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/**
+ * \brief Compute the length of the common prefix of two bit strings.
+ * \param x A bit string.
+ * \param y A bit string.
+ * \param max_len The maximum number of bits compared.
+ * \return The number of leading bits shared by x and y.
+ */
+
+static size_t common_prefix_len(const uint8_t * x, const uint8_t * y, size_t max_len)
+{
+    size_t  i = 0;
+    uint8_t diff;
+
+    while (i < max_len && x[i / 8] == y[i / 8]) i += 8;
+    if (i < max_len) {
+        for (diff = x[i / 8] ^ y[i / 8]; !(diff & 0x80); diff <<= 1) i++;
+    }
+    return i < max_len ? i : max_len;
+}
+
+static inline unsigned asn_table_get_root(int family) {
+    return family == AF_INET6 ? ASN_TABLE_ROOT_IPV6 : ASN_TABLE_ROOT_IPV4;
+}
+
+static inline size_t family_get_num_bits(int family) {
+    return family == AF_INET6 ? 128 : 32;
+}
+
+//---------------------------------------------------------------------------
+// Trie
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Allocate a node.
+ * \param asn_table An asn_table_t instance.
+ * \param prefix The prefix of the node.
+ * \param prefix_len The length of the prefix.
+ * \param asn The ASN of the node (0 if none).
+ * \return The index of the node, 0 in case of failure.
+ *    Pointers to the previous nodes may be invalidated.
+ */
+
+static uint32_t asn_table_node_create(asn_table_t * asn_table, const uint8_t * prefix, uint8_t prefix_len, uint32_t asn)
+{
+    asn_table_node_t * nodes,
+                     * node;
+    uint32_t           max_nodes;
+    size_t             num_bytes = (prefix_len + 7) / 8;
+
+    if (asn_table->num_nodes >= asn_table->max_nodes) {
+        max_nodes = asn_table->max_nodes ? 2 * asn_table->max_nodes : 1024;
+        if (!(nodes = realloc(asn_table->nodes, max_nodes * sizeof(asn_table_node_t)))) return 0;
+        asn_table->nodes     = nodes;
+        asn_table->max_nodes = max_nodes;
+    }
+
+    node = &asn_table->nodes[asn_table->num_nodes];
+    memset(node, 0, sizeof(asn_table_node_t));
+    memcpy(node->prefix, prefix, num_bytes);
+    if (prefix_len % 8) node->prefix[num_bytes - 1] &= 0xff << (8 - prefix_len % 8);
+    node->prefix_len = prefix_len;
+    node->asn        = asn;
+    return asn_table->num_nodes++;
+}
+
+asn_table_t * asn_table_create()
+{
+    asn_table_t * asn_table;
+    uint8_t       empty[16];
+
+    if (!(asn_table = calloc(1, sizeof(asn_table_t)))) goto ERR_CALLOC;
+
+    // nodes[0] stands for "no child", then come the roots (prefix_len = 0)
+    memset(empty, 0, sizeof(empty));
+    asn_table->num_nodes = 1;
+    if (!(asn_table->roots[ASN_TABLE_ROOT_IPV4] = asn_table_node_create(asn_table, empty, 0, 0))) goto ERR_NODE_CREATE;
+    if (!(asn_table->roots[ASN_TABLE_ROOT_IPV6] = asn_table_node_create(asn_table, empty, 0, 0))) goto ERR_NODE_CREATE;
+    memset(&asn_table->nodes[0], 0, sizeof(asn_table_node_t));
+    return asn_table;
+
+ERR_NODE_CREATE:
+    free(asn_table->nodes);
+    free(asn_table);
+ERR_CALLOC:
+    return NULL;
+}
+
+void asn_table_free(asn_table_t * asn_table)
+{
+    if (asn_table) {
+        if (asn_table->mapping) {
+            munmap(asn_table->mapping, asn_table->mapping_size);
+        } else {
+            free(asn_table->nodes);
+        }
+        free(asn_table);
+    }
+}
+
+bool asn_table_insert(asn_table_t * asn_table, const address_t * prefix, uint8_t prefix_len, uint32_t asn)
+{
+    const uint8_t * bits = (const uint8_t *) &prefix->ip;
+    uint32_t        i, child, mid, leaf;
+    unsigned        bit;
+    size_t          len;
+
+    // A mapped table is read-only
+    if (asn_table->mapping || !asn || prefix_len > family_get_num_bits(prefix->family)) return false;
+
+    // Invariant: the prefix starts with the prefix of nodes[i]
+    i = asn_table->roots[asn_table_get_root(prefix->family)];
+    for (;;) {
+        if (asn_table->nodes[i].prefix_len == prefix_len) {
+            asn_table->nodes[i].asn = asn;
+            return true;
+        }
+
+        bit   = get_bit(bits, asn_table->nodes[i].prefix_len);
+        child = asn_table->nodes[i].children[bit];
+
+        if (!child) {
+            if (!(leaf = asn_table_node_create(asn_table, bits, prefix_len, asn))) return false;
+            asn_table->nodes[i].children[bit] = leaf;
+            return true;
+        }
+
+        len = common_prefix_len(
+            bits, asn_table->nodes[child].prefix,
+            prefix_len < asn_table->nodes[child].prefix_len ? prefix_len : asn_table->nodes[child].prefix_len
+        );
+        if (len == asn_table->nodes[child].prefix_len) {
+            i = child;
+            continue;
+        }
+
+        // The prefix diverges from the child (or is shorter): insert a
+        // node for their common prefix between nodes[i] and the child.
+        if (!(mid = asn_table_node_create(asn_table, bits, len, len == prefix_len ? asn : 0))) return false;
+        asn_table->nodes[mid].children[get_bit(asn_table->nodes[child].prefix, len)] = child;
+        asn_table->nodes[i].children[bit] = mid;
+
+        if (len < prefix_len) {
+            if (!(leaf = asn_table_node_create(asn_table, bits, prefix_len, asn))) return false;
+            asn_table->nodes[mid].children[get_bit(bits, len)] = leaf;
+        }
+        return true;
+    }
+}
+
+bool asn_table_lookup(const asn_table_t * asn_table, const address_t * address, uint32_t * asn)
+{
+    const uint8_t          * bits = (const uint8_t *) &address->ip;
+    const asn_table_node_t * node;
+    size_t                   num_bits = family_get_num_bits(address->family);
+    uint32_t                 i = asn_table->roots[asn_table_get_root(address->family)];
+    bool                     found = false;
+
+    while (i) {
+        node = &asn_table->nodes[i];
+        if (common_prefix_len(bits, node->prefix, node->prefix_len) < node->prefix_len) break;
+        if (node->asn) {
+            *asn  = node->asn;
+            found = true;
+        }
+        if (node->prefix_len == num_bits) break;
+        i = node->children[get_bit(bits, node->prefix_len)];
+    }
+    return found;
+}
+
+inline size_t asn_table_get_num_nodes(const asn_table_t * asn_table) {
+    return asn_table->num_nodes - 1;
+}
+
+//---------------------------------------------------------------------------
+// Dumps
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Parse a line of a prefix-to-AS dump.
+ * \param line The line.
+ * \param prefix The address_t receiving the prefix.
+ * \param prefix_len The address of an uint8_t receiving the length of the prefix.
+ * \param asn The address of an uint32_t receiving the ASN.
+ * \return true iif the line defines a prefix.
+ */
+
+static bool asn_table_parse_line(char * line, address_t * prefix, uint8_t * prefix_len, uint32_t * asn)
+{
+    char          field1[64], field2[64], field3[64];
+    char        * slash, * len_str, * asn_str;
+    unsigned long len;
+    int           num_fields;
+
+    if (line[0] == '#') return false;
+    if ((num_fields = sscanf(line, "%63s %63s %63s", field1, field2, field3)) < 2) return false;
+
+    if ((slash = strchr(field1, '/'))) {
+        *slash  = '\0';
+        len_str = slash + 1;
+        asn_str = field2;
+    } else if (num_fields == 3) {
+        len_str = field2;
+        asn_str = field3;
+    } else {
+        return false;
+    }
+
+    memset(prefix, 0, sizeof(address_t));
+    prefix->family = strchr(field1, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(prefix->family, field1, &prefix->ip) != 1) return false;
+
+    len = strtoul(len_str, NULL, 10);
+    if (len > family_get_num_bits(prefix->family)) return false;
+    *prefix_len = len;
+
+    // Multi-origin prefixes ("2200_3215") and AS sets ("{2200,3215}"): keep the first AS
+    while (*asn_str && !isdigit(*asn_str)) asn_str++;
+    return (*asn = strtoul(asn_str, NULL, 10)) != 0;
+}
+
+asn_table_t * asn_table_load(const char * filename)
+{
+    FILE        * file;
+    asn_table_t * asn_table;
+    char          line[256];
+    address_t     prefix;
+    uint8_t       prefix_len;
+    uint32_t      asn;
+
+    if (!(file = fopen(filename, "r"))) {
+        perror(filename);
+        goto ERR_FOPEN;
+    }
+    if (!(asn_table = asn_table_create())) goto ERR_ASN_TABLE_CREATE;
+
+    while (fgets(line, sizeof(line), file)) {
+        if (asn_table_parse_line(line, &prefix, &prefix_len, &asn)
+        && !asn_table_insert(asn_table, &prefix, prefix_len, asn)) {
+            goto ERR_ASN_TABLE_INSERT;
+        }
+    }
+
+    fclose(file);
+    return asn_table;
+
+ERR_ASN_TABLE_INSERT:
+    asn_table_free(asn_table);
+ERR_ASN_TABLE_CREATE:
+    fclose(file);
+ERR_FOPEN:
+    return NULL;
+}
+
+//---------------------------------------------------------------------------
+// Compiled tables
+//---------------------------------------------------------------------------
+
+bool asn_table_save(const asn_table_t * asn_table, const char * filename)
+{
+    FILE               * file;
+    asn_table_header_t   header;
+    char               * tmp_filename;
+    int                  fd;
+
+    memset(&header, 0, sizeof(asn_table_header_t));
+    memcpy(header.magic, ASN_TABLE_MAGIC, sizeof(header.magic));
+    header.byte_order = ASN_TABLE_BYTE_ORDER;
+    header.num_nodes  = asn_table->num_nodes;
+    header.roots[ASN_TABLE_ROOT_IPV4] = asn_table->roots[ASN_TABLE_ROOT_IPV4];
+    header.roots[ASN_TABLE_ROOT_IPV6] = asn_table->roots[ASN_TABLE_ROOT_IPV6];
+
+    // The table is written in a temporary file, which then replaces the
+    // previous one. Rewriting a file in place would crash (SIGBUS) the
+    // processes which have mapped it.
+    if (!(tmp_filename = malloc(strlen(filename) + sizeof(ASN_TABLE_TMP_SUFFIX)))) goto ERR_MALLOC;
+    strcpy(tmp_filename, filename);
+    strcat(tmp_filename, ASN_TABLE_TMP_SUFFIX);
+
+    if ((fd = mkstemp(tmp_filename)) == -1) goto ERR_MKSTEMP;
+    if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1) goto ERR_FCHMOD;
+    if (!(file = fdopen(fd, "w")))                                 goto ERR_FDOPEN;
+    if (fwrite(&header, sizeof(asn_table_header_t), 1, file) != 1) goto ERR_FWRITE;
+    if (fwrite(asn_table->nodes, sizeof(asn_table_node_t), asn_table->num_nodes, file) != asn_table->num_nodes) {
+        goto ERR_FWRITE;
+    }
+    if (fclose(file) != 0)                                         goto ERR_FCLOSE;
+    if (rename(tmp_filename, filename) == -1)                      goto ERR_FCLOSE;
+    free(tmp_filename);
+    return true;
+
+ERR_FWRITE:
+    fclose(file);
+    goto ERR_FCLOSE;
+ERR_FDOPEN:
+ERR_FCHMOD:
+    close(fd);
+ERR_FCLOSE:
+    unlink(tmp_filename);
+ERR_MKSTEMP:
+    free(tmp_filename);
+ERR_MALLOC:
+    return false;
+}
+
+/**
+ * \brief Check the trie of a mapped table, so that a corrupt file cannot
+ *    cause out-of-bounds reads (or endless loops) in asn_table_lookup.
+ *    Each reachable node must have a valid prefix_len, and each of its
+ *    children must be a valid node having a longer prefix.
+ * \param nodes The nodes of the table.
+ * \param num_nodes The number of nodes (including nodes[0]).
+ * \param root The index of the root of the trie.
+ * \param num_bits The number of bits of the addresses stored in the trie.
+ * \param stack A preallocated array of num_nodes indexes.
+ * \param visited A preallocated array of num_nodes booleans, set to false.
+ * \return true iif the trie is valid.
+ */
+
+static bool asn_table_check_trie(
+    const asn_table_node_t * nodes,
+    uint32_t                 num_nodes,
+    uint32_t                 root,
+    size_t                   num_bits,
+    uint32_t               * stack,
+    bool                   * visited
+) {
+    const asn_table_node_t * node;
+    size_t                   num_pending = 0;
+    uint32_t                 child;
+    unsigned                 bit;
+
+    if (!root || root >= num_nodes) return false;
+    stack[num_pending++] = root;
+    visited[root] = true;
+
+    while (num_pending) {
+        node = &nodes[stack[--num_pending]];
+        if (node->prefix_len > num_bits) return false;
+
+        for (bit = 0; bit < 2; bit++) {
+            child = node->children[bit];
+            if (!child) continue;
+            if (child >= num_nodes || nodes[child].prefix_len <= node->prefix_len) return false;
+            if (!visited[child]) {
+                visited[child] = true;
+                stack[num_pending++] = child;
+            }
+        }
+    }
+    return true;
+}
+
+asn_table_t * asn_table_map(const char * filename)
+{
+    int                        fd;
+    struct stat                st;
+    void                     * mapping;
+    const asn_table_header_t * header;
+    const asn_table_node_t   * nodes;
+    asn_table_t              * asn_table;
+    uint32_t                 * stack;
+    bool                     * visited;
+    bool                       is_valid;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)             goto ERR_OPEN;
+    if (fstat(fd, &st) == -1)                              goto ERR_FSTAT;
+    if ((size_t) st.st_size < sizeof(asn_table_header_t))  goto ERR_INVALID_FILE;
+    if ((mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) goto ERR_MMAP;
+
+    // Check whether this file is a compiled table which can be read as is
+    header = mapping;
+    if (memcmp(header->magic, ASN_TABLE_MAGIC, sizeof(header->magic)) != 0
+    ||  header->byte_order != ASN_TABLE_BYTE_ORDER
+    ||  header->num_nodes <= header->roots[ASN_TABLE_ROOT_IPV4]
+    ||  header->num_nodes <= header->roots[ASN_TABLE_ROOT_IPV6]
+    ||  (size_t) st.st_size != sizeof(asn_table_header_t) + header->num_nodes * sizeof(asn_table_node_t)
+    ) {
+        goto ERR_INVALID_HEADER;
+    }
+
+    // Check the tries, which are trusted by asn_table_lookup
+    nodes = (const asn_table_node_t *) (header + 1);
+    if (!(stack = malloc(header->num_nodes * sizeof(uint32_t))))   goto ERR_MALLOC;
+    if (!(visited = calloc(header->num_nodes, sizeof(bool))))      goto ERR_CALLOC_VISITED;
+    is_valid = asn_table_check_trie(nodes, header->num_nodes, header->roots[ASN_TABLE_ROOT_IPV4], 32, stack, visited);
+    memset(visited, 0, header->num_nodes * sizeof(bool));
+    is_valid = is_valid
+        && asn_table_check_trie(nodes, header->num_nodes, header->roots[ASN_TABLE_ROOT_IPV6], 128, stack, visited);
+    free(visited);
+    free(stack);
+    if (!is_valid) goto ERR_INVALID_TRIE;
+
+    if (!(asn_table = calloc(1, sizeof(asn_table_t))))     goto ERR_CALLOC;
+    asn_table->nodes        = (asn_table_node_t *) nodes;
+    asn_table->num_nodes    = header->num_nodes;
+    asn_table->max_nodes    = header->num_nodes;
+    asn_table->roots[ASN_TABLE_ROOT_IPV4] = header->roots[ASN_TABLE_ROOT_IPV4];
+    asn_table->roots[ASN_TABLE_ROOT_IPV6] = header->roots[ASN_TABLE_ROOT_IPV6];
+    asn_table->mapping      = mapping;
+    asn_table->mapping_size = st.st_size;
+    close(fd);
+    return asn_table;
+
+ERR_CALLOC_VISITED:
+    free(stack);
+ERR_CALLOC:
+ERR_MALLOC:
+ERR_INVALID_TRIE:
+ERR_INVALID_HEADER:
+    munmap(mapping, st.st_size);
+ERR_MMAP:
+ERR_INVALID_FILE:
+ERR_FSTAT:
+    close(fd);
+ERR_OPEN:
+    return NULL;
+}
+
+asn_table_t * asn_table_open(const char * filename)
+{
+    asn_table_t * asn_table;
+    char        * index_filename;
+    struct stat   st, st_index;
+
+    // filename is already compiled
+    if ((asn_table = asn_table_map(filename))) return asn_table;
+
+    if (!(index_filename = malloc(strlen(filename) + sizeof(ASN_TABLE_INDEX_SUFFIX)))) goto ERR_MALLOC;
+    strcpy(index_filename, filename);
+    strcat(index_filename, ASN_TABLE_INDEX_SUFFIX);
+
+    // Map the compiled form of the dump if it is up-to-date, otherwise
+    // load the dump and try to compile it for the next time.
+    if (stat(filename, &st) == 0
+    &&  stat(index_filename, &st_index) == 0
+    &&  st_index.st_mtime >= st.st_mtime
+    &&  (asn_table = asn_table_map(index_filename))
+    ) {
+        free(index_filename);
+        return asn_table;
+    }
+
+    if ((asn_table = asn_table_load(filename))) {
+        asn_table_save(asn_table, index_filename);
+    }
+
+    free(index_filename);
+    return asn_table;
+
+ERR_MALLOC:
+    return NULL;
+}
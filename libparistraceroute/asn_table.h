@@ -0,0 +1,138 @@
+#ifndef ASN_TABLE_H
+#define ASN_TABLE_H
+
+/**
+ * \file asn_table.h
+ * \brief Offline IP-to-ASN lookups (longest prefix match).
+ *
+ * An asn_table_t maps IPv4 and IPv6 prefixes to their origin AS. It is
+ * loaded from a prefix-to-AS dump (e.g. derived from RouteViews RIBs),
+ * where each line is either:
+ *
+ *    PREFIX/LEN ASN      (e.g. "193.51.160.0/19 2200")
+ *    PREFIX LEN ASN      (e.g. "193.51.160.0 19 2200", CAIDA pfx2as)
+ *
+ * Lines starting with '#' are ignored. If a prefix is originated by
+ * several AS ("2200_3215", "{2200,3215}"), the first one is kept.
+ *
+ * The prefixes are stored in a path-compressed binary trie (Patricia
+ * trie), whose nodes are laid out in a single array and refer to each
+ * other by index. The trie can thus be saved as is (asn_table_save) and
+ * memory-mapped later (asn_table_map), without any parsing. The saved
+ * form is only meant to be read back on the same architecture.
+ */
+
+#include <stdbool.h>            // bool
+#include <stddef.h>             // size_t
+#include <stdint.h>             // uint*_t
+
+#include "address.h"            // address_t
+
+// Suffix of the compiled form of a dump (see asn_table_open)
+#define ASN_TABLE_INDEX_SUFFIX ".idx"
+
+/**
+ * \brief Node of the trie. A node matches the addresses starting with
+ *    the prefix_len first bits of prefix.
+ */
+
+typedef struct {
+    uint32_t children[2];  /**< Index of the children (next bit 0 or 1), 0 if none */
+    uint32_t asn;          /**< Origin AS of this prefix, 0 if it is not in the dump */
+    uint8_t  prefix_len;   /**< Length of the prefix (in bits) */
+    uint8_t  padding[3];
+    uint8_t  prefix[16];   /**< Prefix (the following bits are set to 0) */
+} asn_table_node_t;
+
+typedef struct {
+    asn_table_node_t * nodes;        /**< Nodes (nodes[0] is unused) */
+    uint32_t           num_nodes;    /**< Number of nodes, including nodes[0] */
+    uint32_t           max_nodes;    /**< Number of allocated nodes */
+    uint32_t           roots[2];     /**< Roots of the IPv4 and IPv6 tries */
+    void             * mapping;      /**< The mapped file, NULL if nodes is allocated */
+    size_t             mapping_size; /**< Size of the mapped file */
+} asn_table_t;
+
+/**
+ * \brief Create an empty table.
+ * \return The newly created table, NULL otherwise.
+ */
+
+asn_table_t * asn_table_create();
+
+/**
+ * \brief Release a table from the memory (or unmap it).
+ * \param asn_table An asn_table_t instance.
+ */
+
+void asn_table_free(asn_table_t * asn_table);
+
+/**
+ * \brief Insert a prefix in a table. If the prefix is already stored,
+ *    its ASN is replaced.
+ * \param asn_table A table created by asn_table_create or asn_table_load.
+ * \param prefix The prefix.
+ * \param prefix_len The length of the prefix (in bits).
+ * \param asn The origin AS of the prefix (must not be 0).
+ * \return true iif successful.
+ */
+
+bool asn_table_insert(asn_table_t * asn_table, const address_t * prefix, uint8_t prefix_len, uint32_t asn);
+
+/**
+ * \brief Find the origin AS of an address (longest prefix match).
+ * \param asn_table An asn_table_t instance.
+ * \param address The queried address.
+ * \param asn The address of an uint32_t, where the ASN will be written
+ *    (iff successful).
+ * \return true iif a prefix covers this address.
+ */
+
+bool asn_table_lookup(const asn_table_t * asn_table, const address_t * address, uint32_t * asn);
+
+/**
+ * \brief Load a prefix-to-AS dump.
+ * \param filename The path of the dump.
+ * \return The corresponding table, NULL otherwise.
+ */
+
+asn_table_t * asn_table_load(const char * filename);
+
+/**
+ * \brief Save a table in its compiled form. The file is replaced
+ *    atomically, so the processes which have mapped it are not disturbed.
+ * \param asn_table An asn_table_t instance.
+ * \param filename The path of the output file.
+ * \return true iif successful.
+ */
+
+bool asn_table_save(const asn_table_t * asn_table, const char * filename);
+
+/**
+ * \brief Map a table saved by asn_table_save. The resulting table is
+ *    read-only. The file is rejected if it is truncated or corrupt.
+ * \param filename The path of the compiled table.
+ * \return The corresponding table, NULL otherwise.
+ */
+
+asn_table_t * asn_table_map(const char * filename);
+
+/**
+ * \brief Open a table, either compiled or not. The compiled form of a
+ *    dump is stored next to it (ASN_TABLE_INDEX_SUFFIX) the first time
+ *    it is loaded, and mapped instead of it as long as it is up-to-date.
+ * \param filename The path of a dump or of a compiled table.
+ * \return The corresponding table, NULL otherwise.
+ */
+
+asn_table_t * asn_table_open(const char * filename);
+
+/**
+ * \brief Retrieve the number of nodes of a table.
+ * \param asn_table An asn_table_t instance.
+ * \return The number of nodes of its tries.
+ */
+
+size_t asn_table_get_num_nodes(const asn_table_t * asn_table);
+
+#endif
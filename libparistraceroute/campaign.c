@@ -0,0 +1,230 @@
+#include "config.h"
+
+#include <stdlib.h>             // malloc, free
+#include <string.h>             // memcpy, strspn, strcspn
+#include <ctype.h>              // isspace
+
+#include "campaign.h"
+#include "common.h"             // ELEMENT_FREE
+#include "field.h"              // ADDRESS
+#include "algorithms/traceroute.h" // traceroute_options_t
+
+/**
+ * \brief Instance started by a campaign towards a given destination.
+ */
+
+typedef struct {
+    algorithm_instance_t * instance; /**< The running instance */
+    probe_t              * skel;     /**< Its probe skeleton */
+    void                 * options;  /**< Its options */
+} campaign_job_t;
+
+static void campaign_job_free(campaign_job_t * job) {
+    if (job) {
+        probe_free(job->skel);
+        free(job->options);
+        free(job);
+    }
+}
+
+/**
+ * \brief Start an instance towards a destination.
+ * \param campaign A campaign_t instance.
+ * \param dst_addr The destination. It must remain valid while the
+ *    instance is running.
+ * \return true iif successful.
+ */
+
+static bool campaign_start_job(campaign_t * campaign, const address_t * dst_addr)
+{
+    campaign_job_t * job;
+    field_t        * field;
+    bool             ret;
+
+    if (!(job = calloc(1, sizeof(campaign_job_t))))           goto ERR_CALLOC;
+    if (!(job->skel = probe_dup(campaign->skel)))             goto ERR_PROBE_DUP;
+
+    if (!(field = ADDRESS("dst_ip", dst_addr)))               goto ERR_FIELD_CREATE;
+    ret = probe_set_field(job->skel, field);
+    field_free(field);
+    if (!ret)                                                 goto ERR_PROBE_SET_FIELD;
+
+    if (!(job->options = malloc(campaign->options_size)))     goto ERR_MALLOC_OPTIONS;
+    memcpy(job->options, campaign->options, campaign->options_size);
+    ((traceroute_options_t *) job->options)->dst_addr = dst_addr;
+
+    if (!(job->instance = pt_add_instance(campaign->loop, campaign->algorithm_name, job->options, job->skel))) {
+        goto ERR_ADD_INSTANCE;
+    }
+
+    if (!dynarray_push_element(campaign->jobs, job))          goto ERR_PUSH_JOB;
+    return true;
+
+ERR_PUSH_JOB:
+    pt_del_instance(campaign->loop, job->instance);
+ERR_ADD_INSTANCE:
+ERR_MALLOC_OPTIONS:
+ERR_PROBE_SET_FIELD:
+ERR_FIELD_CREATE:
+ERR_PROBE_DUP:
+    campaign_job_free(job);
+ERR_CALLOC:
+    return false;
+}
+
+/**
+ * \brief Start instances until max_instances are running or every
+ *    destination has been started. Terminate the loop once the campaign
+ *    is over.
+ * \param campaign A campaign_t instance.
+ */
+
+static void campaign_fill(campaign_t * campaign)
+{
+    const address_t * dst_addr;
+    char            * dst_str;
+    size_t            num_destinations = dynarray_get_size(campaign->destinations);
+
+    while (campaign->next_destination < num_destinations
+       &&  dynarray_get_size(campaign->jobs) < campaign->max_instances
+    ) {
+        dst_addr = dynarray_get_ith_element(campaign->destinations, campaign->next_destination++);
+        if (!campaign_start_job(campaign, dst_addr)) {
+            if (address_to_string(dst_addr, &dst_str) == 0) {
+                fprintf(stderr, "campaign: Can't start %s towards %s\n", campaign->algorithm_name, dst_str);
+                free(dst_str);
+            } else {
+                fprintf(stderr, "campaign: Can't start %s towards ???\n", campaign->algorithm_name);
+            }
+            campaign->num_failed++;
+        }
+    }
+
+    if (campaign_is_done(campaign)) {
+        pt_loop_terminate(campaign->loop);
+    }
+}
+
+campaign_t * campaign_create(
+    pt_loop_t     * loop,
+    const char    * algorithm_name,
+    const void    * options,
+    size_t          options_size,
+    const probe_t * skel,
+    size_t          max_instances
+) {
+    campaign_t * campaign;
+
+    if (!(campaign = calloc(1, sizeof(campaign_t))))         goto ERR_CALLOC;
+    if (!(campaign->skel = probe_dup(skel)))                 goto ERR_PROBE_DUP;
+    if (!(campaign->options = malloc(options_size)))         goto ERR_MALLOC_OPTIONS;
+    if (!(campaign->destinations = dynarray_create()))       goto ERR_DESTINATIONS;
+    if (!(campaign->jobs = dynarray_create()))               goto ERR_JOBS;
+
+    memcpy(campaign->options, options, options_size);
+    campaign->loop           = loop;
+    campaign->algorithm_name = algorithm_name;
+    campaign->options_size   = options_size;
+    campaign->max_instances  = max_instances > 0 ? max_instances : 1;
+    return campaign;
+
+ERR_JOBS:
+    dynarray_free(campaign->destinations, NULL);
+ERR_DESTINATIONS:
+    free(campaign->options);
+ERR_MALLOC_OPTIONS:
+    probe_free(campaign->skel);
+ERR_PROBE_DUP:
+    free(campaign);
+ERR_CALLOC:
+    return NULL;
+}
+
+void campaign_free(campaign_t * campaign)
+{
+    if (campaign) {
+        dynarray_free(campaign->jobs, (ELEMENT_FREE) campaign_job_free);
+        dynarray_free(campaign->destinations, (ELEMENT_FREE) address_free);
+        free(campaign->options);
+        probe_free(campaign->skel);
+        free(campaign);
+    }
+}
+
+bool campaign_add_destination(campaign_t * campaign, const address_t * address)
+{
+    address_t * dst_addr;
+
+    if (!(dst_addr = address_dup(address))) goto ERR_ADDRESS_DUP;
+    if (!dynarray_push_element(campaign->destinations, dst_addr)) goto ERR_PUSH_ELEMENT;
+    return true;
+
+ERR_PUSH_ELEMENT:
+    address_free(dst_addr);
+ERR_ADDRESS_DUP:
+    return false;
+}
+
+size_t campaign_load_destinations(campaign_t * campaign, FILE * file, int family)
+{
+    char      * line = NULL,
+              * destination;
+    size_t      line_size = 0,
+                length,
+                num_destinations = 0;
+    address_t   address;
+
+    while (getline(&line, &line_size, file) != -1) {
+        // Trim the line
+        destination = line + strspn(line, " \t");
+        length = strcspn(destination, "#\r\n");
+        while (length > 0 && isspace((unsigned char) destination[length - 1])) length--;
+        destination[length] = '\0';
+        if (length == 0) continue;
+
+        if (address_from_string(family, destination, &address) != 0) {
+            fprintf(stderr, "campaign: Invalid destination %s\n", destination);
+            continue;
+        }
+
+        if (campaign_add_destination(campaign, &address)) {
+            num_destinations++;
+        }
+    }
+
+    free(line);
+    return num_destinations;
+}
+
+bool campaign_start(campaign_t * campaign)
+{
+    campaign_fill(campaign);
+    return campaign->num_failed == 0;
+}
+
+bool campaign_handle_terminated(campaign_t * campaign, algorithm_instance_t * instance)
+{
+    campaign_job_t * job;
+    size_t           i, num_jobs = dynarray_get_size(campaign->jobs);
+
+    for (i = 0; i < num_jobs; i++) {
+        job = dynarray_get_ith_element(campaign->jobs, i);
+        if (job->instance == instance) {
+            pt_del_instance(campaign->loop, instance);
+            dynarray_del_ith_element(campaign->jobs, i, (ELEMENT_FREE) campaign_job_free);
+            campaign->num_done++;
+            campaign_fill(campaign);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline size_t campaign_get_num_running(const campaign_t * campaign) {
+    return dynarray_get_size(campaign->jobs);
+}
+
+inline bool campaign_is_done(const campaign_t * campaign) {
+    return campaign->next_destination == dynarray_get_size(campaign->destinations)
+        && dynarray_get_size(campaign->jobs) == 0;
+}
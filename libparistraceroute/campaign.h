@@ -0,0 +1,139 @@
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+/**
+ * \file campaign.h
+ * \brief Run an algorithm (e.g. "mda", "traceroute") towards many
+ *    destinations using a single pt_loop_t.
+ *
+ * A campaign stores a list of destinations and keeps at most
+ * max_instances algorithm instances running at the same time: whenever
+ * an instance terminates, the campaign starts an instance towards the
+ * next destination. Every instance shares the network layer of the loop,
+ * so the probes-per-second budget of this loop (see network_set_max_pps)
+ * is global to the campaign.
+ *
+ * Each instance receives its own copy of the probe skeleton and of the
+ * algorithm options, in which the destination is set. The algorithm
+ * options must begin with a traceroute_options_t structure (this is the
+ * case of traceroute_options_t and mda_options_t).
+ *
+ * The user handler of the loop must call campaign_handle_terminated()
+ * whenever it receives an ALGORITHM_HAS_TERMINATED event.
+ */
+
+#include <stdbool.h>        // bool
+#include <stddef.h>         // size_t
+#include <stdio.h>          // FILE
+
+#include "address.h"        // address_t
+#include "algorithm.h"      // algorithm_instance_t
+#include "dynarray.h"       // dynarray_t
+#include "probe.h"          // probe_t
+#include "pt_loop.h"        // pt_loop_t
+
+typedef struct {
+    pt_loop_t   * loop;             /**< The loop running the instances */
+    const char  * algorithm_name;   /**< Name of the algorithm run towards each destination */
+    probe_t     * skel;             /**< Probe skeleton (its destination is overwritten) */
+    void        * options;          /**< Algorithm options (its destination is overwritten) */
+    size_t        options_size;     /**< Size of the algorithm options */
+    size_t        max_instances;    /**< Maximum number of instances running at the same time */
+    dynarray_t  * destinations;     /**< Destinations of the campaign (address_t *) */
+    size_t        next_destination; /**< Index of the next destination to start */
+    dynarray_t  * jobs;             /**< Running instances (campaign_job_t *) */
+    size_t        num_done;         /**< Number of terminated instances */
+    size_t        num_failed;       /**< Number of destinations for which no instance could be started */
+} campaign_t;
+
+/**
+ * \brief Create a campaign.
+ * \param loop The libparistraceroute loop.
+ * \param algorithm_name The name of the algorithm (e.g. "mda").
+ * \param options The options of the algorithm. They are copied.
+ * \param options_size The size of the options (e.g. sizeof(mda_options_t)).
+ * \param skel The probe skeleton. It is duplicated.
+ * \param max_instances The maximum number of instances running at the
+ *    same time (must be greater than 0).
+ * \return The newly created campaign, NULL otherwise.
+ */
+
+campaign_t * campaign_create(
+    pt_loop_t     * loop,
+    const char    * algorithm_name,
+    const void    * options,
+    size_t          options_size,
+    const probe_t * skel,
+    size_t          max_instances
+);
+
+/**
+ * \brief Release a campaign from the memory. The instances which are
+ *    still running are released by pt_loop_free(), but their options
+ *    and probe skeleton are released by this function.
+ * \param campaign A campaign_t instance.
+ */
+
+void campaign_free(campaign_t * campaign);
+
+/**
+ * \brief Append a destination to a campaign.
+ * \param campaign A campaign_t instance.
+ * \param address The destination. It is duplicated.
+ * \return true iif successful.
+ */
+
+bool campaign_add_destination(campaign_t * campaign, const address_t * address);
+
+/**
+ * \brief Append the destinations listed in a file (one IP address or
+ *    hostname per line). Blank lines and lines starting with '#' are
+ *    ignored. Invalid destinations are reported on the standard error
+ *    and skipped.
+ * \param campaign A campaign_t instance.
+ * \param file The file listing the destinations.
+ * \param family The address family of the destinations (AF_INET or
+ *    AF_INET6). It must match the probe skeleton.
+ * \return The number of destinations appended.
+ */
+
+size_t campaign_load_destinations(campaign_t * campaign, FILE * file, int family);
+
+/**
+ * \brief Start the first instances of a campaign. If there is no
+ *    destination, the loop is terminated.
+ * \param campaign A campaign_t instance.
+ * \return true iif every instance could be started.
+ */
+
+bool campaign_start(campaign_t * campaign);
+
+/**
+ * \brief Unregister a terminated instance, and start the next
+ *    destinations. The loop is terminated once every destination
+ *    has been processed. The data of the instance must be released
+ *    by the caller beforehand (see pt_stop_instance).
+ * \param campaign A campaign_t instance.
+ * \param instance The instance which has raised ALGORITHM_HAS_TERMINATED.
+ * \return true iif this instance belongs to the campaign.
+ */
+
+bool campaign_handle_terminated(campaign_t * campaign, algorithm_instance_t * instance);
+
+/**
+ * \brief Retrieve the number of instances currently running.
+ * \param campaign A campaign_t instance.
+ * \return The corresponding number of instances.
+ */
+
+size_t campaign_get_num_running(const campaign_t * campaign);
+
+/**
+ * \brief Test whether every destination of a campaign has been processed.
+ * \param campaign A campaign_t instance.
+ * \return true iif the campaign is over.
+ */
+
+bool campaign_is_done(const campaign_t * campaign);
+
+#endif
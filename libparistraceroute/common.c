@@ -2,21 +2,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/time.h>
 
 #include "common.h"
-
-// Note: for measuring intervals !
-//#include <time.h>
-//struct timespec ts;
-//clock_gettime(CLOCK_MONOTONIC, &ts);
+#include "timestamp.h"
 
 double get_timestamp()
 {
-    struct timeval tim;
-    
-    gettimeofday(&tim, NULL);
-    return tim.tv_sec + (tim.tv_usec / 1000000.0);
+    return timestamp_to_seconds(timestamp_now());
 }
 
 void print_indent(unsigned int indent)
@@ -25,6 +25,12 @@
 
 #define ELEMENT_COMPARE int (*)(const void *, const void *)
 
+/**
+ * \brief Type related to a *_hash() function
+ */
+
+#define ELEMENT_HASH size_t (*)(const void *)
+
 /**
  * \brief Macro returning the minimal value of two elements
  * \param x The left operand
@@ -44,7 +50,9 @@
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
 /**
- * \return The current timestamp (in seconds)
+ * \return The current timestamp (in seconds). It is read from a
+ *    monotonic clock (see timestamp.h) and is thus only meant to
+ *    measure durations, not to be printed as a date.
  */
 
 double get_timestamp();
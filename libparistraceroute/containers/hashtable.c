@@ -0,0 +1,195 @@
+#include "config.h"
+
+#include <stdlib.h>     // malloc, calloc, free
+#include <assert.h>     // assert
+
+#include "hashtable.h"
+
+#define HASHTABLE_DEFAULT_NUM_BUCKETS 64
+
+// The table is resized once it contains more than
+// HASHTABLE_MAX_LOAD_FACTOR elements per bucket on average.
+#define HASHTABLE_MAX_LOAD_FACTOR 1
+
+static inline size_t hashtable_get_bucket(const hashtable_t * hashtable, size_t hash) {
+    return hash & (hashtable->num_buckets - 1);
+}
+
+/**
+ * \brief Double the number of buckets of a hashtable_t instance
+ *    and redispatch its elements.
+ * \param hashtable A hashtable_t instance.
+ * \return true iif successful. If the resize fails, the hashtable
+ *    is left unchanged (and remains usable).
+ */
+
+static bool hashtable_resize(hashtable_t * hashtable) {
+    size_t              i, j, num_buckets = 2 * hashtable->num_buckets;
+    hashtable_cell_t ** buckets,
+                      * cell,
+                      * next;
+
+    if (!(buckets = calloc(num_buckets, sizeof(hashtable_cell_t *)))) goto ERR_CALLOC;
+
+    for (i = 0; i < hashtable->num_buckets; i++) {
+        for (cell = hashtable->buckets[i]; cell; cell = next) {
+            next = cell->next;
+            j = cell->hash & (num_buckets - 1);
+            cell->next = buckets[j];
+            buckets[j] = cell;
+        }
+    }
+
+    free(hashtable->buckets);
+    hashtable->buckets = buckets;
+    hashtable->num_buckets = num_buckets;
+    return true;
+
+ERR_CALLOC:
+    return false;
+}
+
+/**
+ * \brief Search the cell storing a given element.
+ * \param hashtable A hashtable_t instance.
+ * \param element The element we're looking for.
+ * \param hash The hash of element.
+ * \return The address of the pointer referencing the matching
+ *    cell if found, NULL otherwise.
+ */
+
+static hashtable_cell_t ** hashtable_find_cell(const hashtable_t * hashtable, const void * element, size_t hash) {
+    hashtable_cell_t ** pcell;
+
+    for (pcell = &hashtable->buckets[hashtable_get_bucket(hashtable, hash)]; *pcell; pcell = &(*pcell)->next) {
+        if ((*pcell)->hash == hash && hashtable->compare((*pcell)->element, element) == 0) {
+            return pcell;
+        }
+    }
+
+    return NULL;
+}
+
+hashtable_t * hashtable_create_impl(
+    size_t (*element_hash)(const void * element),
+    void   (*element_free)(void * element),
+    int    (*element_compare)(const void * element1, const void * element2)
+) {
+    hashtable_t * hashtable;
+
+    assert(element_hash);
+    assert(element_compare);
+
+    if (!(hashtable = malloc(sizeof(hashtable_t)))) goto ERR_MALLOC;
+    if (!(hashtable->buckets = calloc(HASHTABLE_DEFAULT_NUM_BUCKETS, sizeof(hashtable_cell_t *)))) goto ERR_CALLOC;
+
+    hashtable->num_buckets = HASHTABLE_DEFAULT_NUM_BUCKETS;
+    hashtable->size        = 0;
+    hashtable->hash        = element_hash;
+    hashtable->free        = element_free;
+    hashtable->compare     = element_compare;
+    return hashtable;
+
+ERR_CALLOC:
+    free(hashtable);
+ERR_MALLOC:
+    return NULL;
+}
+
+void hashtable_clear(hashtable_t * hashtable) {
+    size_t             i;
+    hashtable_cell_t * cell,
+                     * next;
+
+    for (i = 0; i < hashtable->num_buckets; i++) {
+        for (cell = hashtable->buckets[i]; cell; cell = next) {
+            next = cell->next;
+            if (hashtable->free) hashtable->free(cell->element);
+            free(cell);
+        }
+        hashtable->buckets[i] = NULL;
+    }
+    hashtable->size = 0;
+}
+
+void hashtable_free(hashtable_t * hashtable) {
+    if (hashtable) {
+        hashtable_clear(hashtable);
+        free(hashtable->buckets);
+        free(hashtable);
+    }
+}
+
+size_t hashtable_get_size(const hashtable_t * hashtable) {
+    return hashtable->size;
+}
+
+void * hashtable_find(const hashtable_t * hashtable, const void * element) {
+    hashtable_cell_t ** pcell = hashtable_find_cell(hashtable, element, hashtable->hash(element));
+    return pcell ? (*pcell)->element : NULL;
+}
+
+bool hashtable_insert(hashtable_t * hashtable, void * element) {
+    size_t             hash = hashtable->hash(element),
+                       i;
+    hashtable_cell_t * cell;
+
+    if (hashtable_find_cell(hashtable, element, hash)) goto ERR_ALREADY_INSERTED;
+    if (!(cell = malloc(sizeof(hashtable_cell_t))))    goto ERR_MALLOC;
+
+    // A failing resize only degrades performance.
+    if (hashtable->size >= HASHTABLE_MAX_LOAD_FACTOR * hashtable->num_buckets) {
+        hashtable_resize(hashtable);
+    }
+
+    i = hashtable_get_bucket(hashtable, hash);
+    cell->element = element;
+    cell->hash    = hash;
+    cell->next    = hashtable->buckets[i];
+    hashtable->buckets[i] = cell;
+    hashtable->size++;
+    return true;
+
+ERR_MALLOC:
+ERR_ALREADY_INSERTED:
+    return false;
+}
+
+void * hashtable_take(hashtable_t * hashtable, const void * element) {
+    hashtable_cell_t ** pcell,
+                      * cell;
+    void              * ret = NULL;
+
+    if ((pcell = hashtable_find_cell(hashtable, element, hashtable->hash(element)))) {
+        cell   = *pcell;
+        ret    = cell->element;
+        *pcell = cell->next;
+        free(cell);
+        hashtable->size--;
+    }
+
+    return ret;
+}
+
+bool hashtable_erase(hashtable_t * hashtable, const void * element) {
+    void * element_to_delete;
+
+    if ((element_to_delete = hashtable_take(hashtable, element))) {
+        if (hashtable->free) hashtable->free(element_to_delete);
+    }
+
+    return element_to_delete != NULL;
+}
+
+size_t hash_bytes(const void * bytes, size_t num_bytes) {
+    const uint8_t * p = bytes;
+    size_t          i;
+    uint32_t        hash = 2166136261u;
+
+    for (i = 0; i < num_bytes; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
@@ -0,0 +1,134 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint*_t
+
+#include "common.h"  // ELEMENT_*
+
+/**
+ * hashtable_t stores a set of elements in a chained hash table.
+ * Unlike set_t, lookups, insertions and deletions are O(1) on
+ * average, which matters for structures queried once per packet
+ * (e.g. the flying probes of the network layer).
+ *
+ * The hashtable only stores references to the inserted elements.
+ * Elements are released by the element_free callback (if any) when
+ * they are erased or when the hashtable is freed.
+ */
+
+typedef struct hashtable_cell_s {
+    void                    * element; /**< The stored element */
+    size_t                    hash;    /**< Cached hash of element */
+    struct hashtable_cell_s * next;    /**< Next cell in this bucket */
+} hashtable_cell_t;
+
+typedef struct {
+    hashtable_cell_t ** buckets;       /**< Array of num_buckets chained lists */
+    size_t              num_buckets;   /**< Always a power of 2 */
+    size_t              size;          /**< Number of stored elements */
+    size_t (*hash)(const void * element);
+    void   (*free)(void * element);
+    int    (*compare)(const void * element1, const void * element2);
+} hashtable_t;
+
+/**
+ * \brief Create a hashtable_t instance.
+ * \param element_hash Callback used to hash an element (mandatory).
+ *    Two elements equal according to element_compare must have the
+ *    same hash.
+ * \param element_free Callback used to free element (may be set to NULL).
+ *    If NULL, the hashtable does not release references that it contains.
+ * \param element_compare Callback used to compare elements (mandatory).
+ *    It must return 0 iif both elements are equal.
+ * \return The newly allocated hashtable_t instance, NULL otherwise.
+ */
+
+hashtable_t * hashtable_create_impl(
+    size_t (*element_hash)(const void * element),
+    void   (*element_free)(void * element),
+    int    (*element_compare)(const void * element1, const void * element2)
+);
+
+#define hashtable_create(hash, free, compare) hashtable_create_impl(\
+    (ELEMENT_HASH) hash, \
+    (ELEMENT_FREE) free, \
+    (ELEMENT_COMPARE) compare \
+)
+
+/**
+ * \brief Release a hashtable_t instance from the memory.
+ * \param hashtable A hashtable_t instance.
+ */
+
+void hashtable_free(hashtable_t * hashtable);
+
+/**
+ * \brief Retrieve the number of elements stored in a hashtable_t instance.
+ * \param hashtable A hashtable_t instance.
+ * \return The number of elements.
+ */
+
+size_t hashtable_get_size(const hashtable_t * hashtable);
+
+/**
+ * \brief Search an element stored in a hashtable_t instance.
+ * \param hashtable A hashtable_t instance.
+ * \param element The element we're looking for (only the fields
+ *    involved in the hash and compare callbacks have to be set).
+ * \return The stored element if found, NULL otherwise.
+ */
+
+void * hashtable_find(const hashtable_t * hashtable, const void * element);
+
+/**
+ * \brief Insert an element in a hashtable_t instance if it does
+ *    not already belong to the hashtable.
+ * \param hashtable A hashtable_t instance.
+ * \param element The element that must be added.
+ * \return true if successfully inserted. If an equal element is
+ *    already stored, it returns false.
+ */
+
+bool hashtable_insert(hashtable_t * hashtable, void * element);
+
+/**
+ * \brief Remove an element from a hashtable_t instance without
+ *    releasing it.
+ * \param hashtable A hashtable_t instance.
+ * \param element The element we want to remove.
+ * \return The removed element if found, NULL otherwise.
+ */
+
+void * hashtable_take(hashtable_t * hashtable, const void * element);
+
+/**
+ * \brief Erase an element from a hashtable_t instance. The
+ *    element is released using the element_free callback.
+ * \param hashtable A hashtable_t instance.
+ * \param element The element we want to remove.
+ * \return true if an element has been successfully removed.
+ */
+
+bool hashtable_erase(hashtable_t * hashtable, const void * element);
+
+/**
+ * \brief Remove every element stored in a hashtable_t instance.
+ *    Elements are released using the element_free callback.
+ * \param hashtable A hashtable_t instance.
+ */
+
+void hashtable_clear(hashtable_t * hashtable);
+
+/**
+ * \brief Hash a sequence of bytes (FNV-1a). This is a convenient
+ *    helper to write element_hash callbacks.
+ * \param bytes The bytes to hash.
+ * \param num_bytes The number of bytes to hash.
+ * \return The corresponding hash.
+ */
+
+size_t hash_bytes(const void * bytes, size_t num_bytes);
+
+#endif
@@ -28,6 +28,10 @@ typedef enum {
     PROBE_REPLY,               /**< A reply has been sniffed           */
     PROBE_TIMEOUT,             /**< No reply sniffed for a given probe */
 
+    // Events raised by the resolver
+    // Such events are dispatched to the user handler
+    NAME_RESOLVED,             /**< A reverse DNS lookup has completed (see pt_resolve) */
+
     // Events handled the algorithm layer
     ALGORITHM_INIT,            /**< An algorithm can start             */
     ALGORITHM_TERM,            /**< An algorithm must terminate        */
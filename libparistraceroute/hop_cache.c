@@ -0,0 +1,140 @@
+#include "config.h"
+
+#include <stdlib.h>             // malloc, free
+#include <string.h>             // memset, memcpy, memcmp
+
+#include "hop_cache.h"
+#include "algorithm.h"          // pt_throw
+#include "timestamp.h"          // timestamp_now
+#include "event.h"              // event_create
+#include "containers/hashtable.h"
+
+// Cached replies (hop_cache_entry_t)
+static hashtable_t * s_hop_cache = NULL;
+
+static size_t hop_cache_entry_hash(const hop_cache_entry_t * entry) {
+    return hash_bytes(&entry->key, sizeof(entry->key));
+}
+
+static int hop_cache_entry_compare(const hop_cache_entry_t * entry1, const hop_cache_entry_t * entry2) {
+    return memcmp(&entry1->key, &entry2->key, sizeof(entry1->key));
+}
+
+static void hop_cache_entry_free(hop_cache_entry_t * entry) {
+    if (entry) {
+        probe_free(entry->reply);
+        free(entry);
+    }
+}
+
+/**
+ * \brief Prepare the key of a hop_cache_entry_t.
+ * \param entry The entry we're initializing.
+ * \param src_ip The source of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \param ttl The TTL of the probe.
+ */
+
+static void hop_cache_entry_init(hop_cache_entry_t * entry, const address_t * src_ip, uint16_t flow_id, uint8_t ttl) {
+    memset(entry, 0, sizeof(hop_cache_entry_t));
+    entry->key.src_ip.family = src_ip->family;
+    memcpy(&entry->key.src_ip.ip, &src_ip->ip, address_get_size(src_ip));
+    entry->key.flow_id = flow_id;
+    entry->key.ttl     = ttl;
+}
+
+static void __hop_cache_free() __attribute__((destructor));
+
+static void __hop_cache_free() {
+    hashtable_free(s_hop_cache);
+    s_hop_cache = NULL;
+}
+
+bool hop_cache_insert(const address_t * src_ip, uint16_t flow_id, uint8_t ttl, const probe_t * probe, const probe_t * reply)
+{
+    hop_cache_entry_t   key,
+                      * entry;
+    probe_t           * reply_dup;
+
+    if (!s_hop_cache) {
+        if (!(s_hop_cache = hashtable_create(hop_cache_entry_hash, hop_cache_entry_free, hop_cache_entry_compare))) {
+            goto ERR_HASHTABLE_CREATE;
+        }
+    }
+
+    hop_cache_entry_init(&key, src_ip, flow_id, ttl);
+    if ((entry = hashtable_find(s_hop_cache, &key))) {
+        // Replayed replies carry the timestamp of the cached reply
+        if (probe_get_recv_timestamp(entry->reply) >= probe_get_recv_timestamp(reply)) {
+            return true;
+        }
+
+        if (!(reply_dup = probe_dup(reply))) goto ERR_PROBE_DUP;
+        probe_free(entry->reply);
+        entry->reply        = reply_dup;
+        entry->sending_time = probe_get_sending_timestamp(probe);
+        return true;
+    }
+
+    if (!(entry = malloc(sizeof(hop_cache_entry_t))))     goto ERR_MALLOC;
+    memcpy(entry, &key, sizeof(hop_cache_entry_t));
+    if (!(entry->reply = probe_dup(reply)))               goto ERR_PROBE_DUP_ENTRY;
+    entry->sending_time = probe_get_sending_timestamp(probe);
+    if (!hashtable_insert(s_hop_cache, entry))            goto ERR_HASHTABLE_INSERT;
+    return true;
+
+ERR_HASHTABLE_INSERT:
+    probe_free(entry->reply);
+ERR_PROBE_DUP_ENTRY:
+    free(entry);
+ERR_MALLOC:
+ERR_PROBE_DUP:
+ERR_HASHTABLE_CREATE:
+    return false;
+}
+
+const hop_cache_entry_t * hop_cache_find(const address_t * src_ip, uint16_t flow_id, uint8_t ttl, double max_age)
+{
+    hop_cache_entry_t   key,
+                      * entry;
+
+    if (!s_hop_cache) return NULL;
+
+    hop_cache_entry_init(&key, src_ip, flow_id, ttl);
+    if (!(entry = hashtable_find(s_hop_cache, &key))) return NULL;
+
+    if (timestamp_diff(probe_get_recv_timestamp(entry->reply), timestamp_now()) > max_age) {
+        hashtable_erase(s_hop_cache, entry);
+        return NULL;
+    }
+    return entry;
+}
+
+bool hop_cache_replay(pt_loop_t * loop, probe_t * probe, const hop_cache_entry_t * entry)
+{
+    probe_t       * reply;
+    probe_reply_t * probe_reply;
+
+    if (!(reply = probe_dup(entry->reply)))       goto ERR_PROBE_DUP;
+    if (!(probe_reply = probe_reply_create()))    goto ERR_PROBE_REPLY_CREATE;
+
+    // The probe and its reply keep the timestamps of the cached exchange,
+    // so that the delays remain meaningful and the entry is not refreshed.
+    probe_set_caller(probe, loop->cur_instance);
+    probe_set_sending_timestamp(probe, entry->sending_time);
+    probe_reply_set_probe(probe_reply, probe);
+    probe_reply_set_reply(probe_reply, reply);
+
+    // Like network_process_recvq, notify the instance which has built the probe
+    pt_throw(NULL, loop->cur_instance, event_create(PROBE_REPLY, probe_reply, NULL, NULL));
+    return true;
+
+ERR_PROBE_REPLY_CREATE:
+    probe_free(reply);
+ERR_PROBE_DUP:
+    return false;
+}
+
+void hop_cache_clear() {
+    if (s_hop_cache) hashtable_clear(s_hop_cache);
+}
@@ -0,0 +1,95 @@
+#ifndef HOP_CACHE_H
+#define HOP_CACHE_H
+
+/**
+ * \file hop_cache.h
+ * \brief Process-wide cache of the hops discovered by the algorithm
+ *    instances (traceroute, mda...).
+ *
+ * When many destinations are probed from the same vantage point, the
+ * first hops (and their load balancers) are typically shared by every
+ * path. The hop cache stores, for each (source, flow identifier, TTL),
+ * the last reply received by any instance. An instance about to send
+ * a probe whose (source, flow identifier, TTL) is cached may replay the
+ * cached reply instead (see hop_cache_replay), so that the shared path
+ * prefix is probed once.
+ *
+ * The destination of the probes is not part of the key: the cache
+ * assumes that a flow follows the same path up to a given TTL whatever
+ * its destination. This only holds for the near side of the paths, so
+ * the callers only insert and look up the TTLs up to a bound which does
+ * not exceed the hops shared by every destination (see the --max-cached-ttl
+ * option of traceroute). The depth of this shared prefix depends on the
+ * vantage point and cannot be inferred by the cache, so this bound
+ * defaults to the first hop, which is always shared. Replies sent by the destination itself must not
+ * be cached either. Cached replies older than the max_age passed to
+ * hop_cache_find() are ignored, so that routing changes are eventually
+ * discovered.
+ */
+
+#include <stdbool.h>        // bool
+#include <stdint.h>         // uint8_t, uint16_t
+
+#include "address.h"        // address_t
+#include "probe.h"          // probe_t
+#include "pt_loop.h"        // pt_loop_t
+
+/**
+ * \brief Entry of the hop cache. This structure is memset to 0 before
+ *    being filled since its key is hashed and compared bytewise.
+ */
+
+typedef struct {
+    struct {
+        address_t src_ip;       /**< Source of the probe */
+        uint16_t  flow_id;      /**< Flow identifier of the probe */
+        uint8_t   ttl;          /**< TTL of the probe */
+    } key;
+    probe_t     * reply;        /**< Cached reply (its recv_time is the timestamp of the entry) */
+    timestamp_t   sending_time; /**< Sending time of the probe which has triggered this reply */
+} hop_cache_entry_t;
+
+/**
+ * \brief Store a reply in the hop cache. A cached reply is only
+ *    replaced by a more recent one, so replaying a reply does not
+ *    refresh its entry.
+ * \param src_ip The source of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \param ttl The TTL of the probe.
+ * \param probe The probe.
+ * \param reply The reply. It is duplicated.
+ * \return true iif successful.
+ */
+
+bool hop_cache_insert(const address_t * src_ip, uint16_t flow_id, uint8_t ttl, const probe_t * probe, const probe_t * reply);
+
+/**
+ * \brief Search a reply in the hop cache. Stale entries are removed.
+ * \param src_ip The source of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \param ttl The TTL of the probe.
+ * \param max_age The maximum age (in seconds) of the cached reply.
+ * \return The corresponding entry, NULL if not found or stale.
+ */
+
+const hop_cache_entry_t * hop_cache_find(const address_t * src_ip, uint16_t flow_id, uint8_t ttl, double max_age);
+
+/**
+ * \brief Answer a probe using a cached reply instead of sending it.
+ *    The current instance receives a PROBE_REPLY event carrying the
+ *    probe and a copy of the cached reply, as if it had been sent.
+ * \param loop The libparistraceroute loop.
+ * \param probe The probe which is not sent.
+ * \param entry The entry returned by hop_cache_find().
+ * \return true iif successful.
+ */
+
+bool hop_cache_replay(pt_loop_t * loop, probe_t * probe, const hop_cache_entry_t * entry);
+
+/**
+ * \brief Remove every entry from the hop cache.
+ */
+
+void hop_cache_clear();
+
+#endif
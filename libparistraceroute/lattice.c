@@ -3,7 +3,6 @@
 #include <stdlib.h>  // malloc, free...
 #include <stddef.h>  // size_t
 #include <stdbool.h> // bool
-#include <stdio.h>   // fprintf
 
 #include "lattice.h"
 
@@ -19,7 +18,11 @@ lattice_elt_t * lattice_elt_create(void * data)
     if (!(elt->next = dynarray_create()))           goto ERR_DYNARRAY_CREATE;
     if (!(elt->siblings = dynarray_create()))       goto ERR_DYNARRAY_CREATE2;
     if (!dynarray_push_element(elt->siblings, elt)) goto ERR_DYNARRAY_PUSH_ELEMENT;
-    elt->data = data;
+    elt->data        = data;
+    elt->epoch       = 0;
+    elt->walk_result = LATTICE_DONE;
+    elt->is_on_path  = false;
+    elt->is_reached  = false;
 
     return elt;
 
@@ -89,28 +92,41 @@ void lattice_set_cmp(lattice_t * lattice, int (*cmp)(const void * x, const void
 static lattice_return_t lattice_walk_dfs_rec(
     lattice_elt_t * elt, 
     lattice_return_t (* visitor)(lattice_elt_t *, void *),
-    void          * data
+    void          * data,
+    uint64_t        epoch
 ) {
     lattice_elt_t    * elt_iter;
     unsigned int       i, num_next;
     lattice_return_t   ret;
     bool               done = true;
 
+    // This node (and thus its successors) has already been walked
+    // through another path. If it is still being walked, we followed a
+    // cycle: its result is not known yet, but it will account for the
+    // nodes of this cycle, which are its successors.
+    if (elt->epoch == epoch) {
+        return elt->is_on_path ? LATTICE_DONE : elt->walk_result;
+    }
+    elt->epoch       = epoch;
+    elt->walk_result = LATTICE_CONTINUE;
+    elt->is_on_path  = false;
+
     // Process the current node...
     ret = visitor(elt, data);
     switch (ret) {
         case LATTICE_DONE:           break;
         case LATTICE_CONTINUE:       break;
-        case LATTICE_INTERRUPT_NEXT: return LATTICE_CONTINUE;
+        case LATTICE_INTERRUPT_NEXT: elt->walk_result = LATTICE_CONTINUE; return LATTICE_CONTINUE;
         case LATTICE_INTERRUPT_ALL:  return LATTICE_INTERRUPT_ALL;
         default:                     return LATTICE_ERROR;
     }
 
     // ... then recurse on next ones 
+    elt->is_on_path = true;
     num_next = dynarray_get_size(elt->next);
     for (i = 0; i < num_next; i++) {
         elt_iter = dynarray_get_ith_element(elt->next, i);
-        ret = lattice_walk_dfs_rec(elt_iter, visitor, data);
+        ret = lattice_walk_dfs_rec(elt_iter, visitor, data, epoch);
         switch (ret) {
             case LATTICE_DONE:           break;
             case LATTICE_CONTINUE:       done = false; break;// continue the for
@@ -118,8 +134,10 @@ static lattice_return_t lattice_walk_dfs_rec(
             default:                     return LATTICE_ERROR;
         }
     }
+    elt->is_on_path = false;
 
-    return done ? LATTICE_DONE : LATTICE_CONTINUE;
+    elt->walk_result = done ? LATTICE_DONE : LATTICE_CONTINUE;
+    return elt->walk_result;
 }
 
 static lattice_return_t lattice_walk_dfs(
@@ -131,12 +149,13 @@ static lattice_return_t lattice_walk_dfs(
     size_t           i, num_roots;
     lattice_return_t ret;
     bool             done = true;
+    uint64_t         epoch = ++lattice->epoch;
     
     // Process all roots
     num_roots = dynarray_get_size(lattice->roots);
     for (i = 0; i < num_roots; i++) {
         root = dynarray_get_ith_element(lattice->roots, i);
-        ret = lattice_walk_dfs_rec(root, visitor, data);
+        ret = lattice_walk_dfs_rec(root, visitor, data, epoch);
         switch (ret) {
             case LATTICE_DONE:           break;
             case LATTICE_CONTINUE:       done = false; break;// continue the for
@@ -148,6 +167,147 @@ static lattice_return_t lattice_walk_dfs(
     return done ? LATTICE_DONE : LATTICE_CONTINUE;
 }
 
+static lattice_return_t lattice_walk_bfs(
+    lattice_t * lattice,
+    lattice_return_t (* visitor)(lattice_elt_t *, void *),
+    void      * data
+) {
+    lattice_elt_t  * elt,
+                   * elt_iter;
+    dynarray_t     * fifo;
+    size_t           i, j, num_roots, num_next;
+    lattice_return_t ret = LATTICE_DONE;
+    bool             done = true;
+    uint64_t         epoch = ++lattice->epoch;
+
+    if (!(fifo = dynarray_create())) goto ERR_DYNARRAY_CREATE;
+
+    // A node is marked when it is enqueued, so it is enqueued once.
+    num_roots = dynarray_get_size(lattice->roots);
+    for (i = 0; i < num_roots; i++) {
+        elt = dynarray_get_ith_element(lattice->roots, i);
+        if (elt->epoch == epoch) continue;
+        elt->epoch = epoch;
+        if (!dynarray_push_element(fifo, elt)) goto ERR_DYNARRAY_PUSH_ELEMENT;
+    }
+
+    // fifo is never shrinked: i is the index of its head.
+    for (i = 0; i < dynarray_get_size(fifo); i++) {
+        elt = dynarray_get_ith_element(fifo, i);
+        switch (visitor(elt, data)) {
+            case LATTICE_DONE:           break;
+            case LATTICE_CONTINUE:       break;
+            case LATTICE_INTERRUPT_NEXT: done = false; continue;
+            case LATTICE_INTERRUPT_ALL:  ret = LATTICE_INTERRUPT_ALL; goto INTERRUPT;
+            default:                     goto ERR_VISITOR;
+        }
+
+        num_next = dynarray_get_size(elt->next);
+        for (j = 0; j < num_next; j++) {
+            elt_iter = dynarray_get_ith_element(elt->next, j);
+            if (elt_iter->epoch == epoch) continue;
+            elt_iter->epoch = epoch;
+            if (!dynarray_push_element(fifo, elt_iter)) goto ERR_DYNARRAY_PUSH_ELEMENT;
+        }
+    }
+
+    ret = done ? LATTICE_DONE : LATTICE_CONTINUE;
+INTERRUPT:
+    dynarray_free(fifo, NULL);
+    return ret;
+
+ERR_VISITOR:
+ERR_DYNARRAY_PUSH_ELEMENT:
+    dynarray_free(fifo, NULL);
+ERR_DYNARRAY_CREATE:
+    return LATTICE_ERROR;
+}
+
+/**
+ * \brief Append to a dynarray the nodes reachable from a given node and
+ *    not yet visited during the current walk, in DFS postorder. An edge
+ *    leading to a node being explored (back-edge) is skipped, so cycles
+ *    are broken. The scratch data of the topological walk is reset.
+ * \param elt The node from which the DFS starts.
+ * \param epoch The epoch of the current walk.
+ * \param postorder The dynarray storing the nodes in postorder.
+ * \return true iif successful.
+ */
+
+static bool lattice_postorder_rec(lattice_elt_t * elt, uint64_t epoch, dynarray_t * postorder)
+{
+    size_t i, num_next;
+
+    if (elt->epoch == epoch) return true;
+    elt->epoch      = epoch;
+    elt->is_reached = false;
+
+    num_next = dynarray_get_size(elt->next);
+    for (i = 0; i < num_next; i++) {
+        if (!lattice_postorder_rec(dynarray_get_ith_element(elt->next, i), epoch, postorder)) {
+            return false;
+        }
+    }
+    return dynarray_push_element(postorder, elt);
+}
+
+static lattice_return_t lattice_walk_topological(
+    lattice_t * lattice,
+    lattice_return_t (* visitor)(lattice_elt_t *, void *),
+    void      * data
+) {
+    lattice_elt_t  * elt;
+    dynarray_t     * postorder;
+    size_t           i, j, num_roots, num_next;
+    lattice_return_t ret = LATTICE_DONE;
+    bool             done = true;
+    uint64_t         epoch = ++lattice->epoch;
+
+    if (!(postorder = dynarray_create())) goto ERR_DYNARRAY_CREATE;
+
+    num_roots = dynarray_get_size(lattice->roots);
+    for (i = 0; i < num_roots; i++) {
+        elt = dynarray_get_ith_element(lattice->roots, i);
+        if (!lattice_postorder_rec(elt, epoch, postorder)) goto ERR_POSTORDER;
+    }
+    for (i = 0; i < num_roots; i++) {
+        elt = dynarray_get_ith_element(lattice->roots, i);
+        elt->is_reached = true;
+    }
+
+    // In reverse postorder, a node comes after all its predecessors, except
+    // the ones reaching it through a back-edge. Nodes whose every visited
+    // predecessor returned LATTICE_INTERRUPT_NEXT are not visited.
+    for (i = dynarray_get_size(postorder); i > 0; i--) {
+        elt = dynarray_get_ith_element(postorder, i - 1);
+        if (!elt->is_reached) continue;
+
+        switch (visitor(elt, data)) {
+            case LATTICE_DONE:           break;
+            case LATTICE_CONTINUE:       break;
+            case LATTICE_INTERRUPT_NEXT: done = false; continue;
+            case LATTICE_INTERRUPT_ALL:  ret = LATTICE_INTERRUPT_ALL; goto INTERRUPT;
+            default:                     goto ERR_VISITOR;
+        }
+
+        num_next = dynarray_get_size(elt->next);
+        for (j = 0; j < num_next; j++) {
+            ((lattice_elt_t *) dynarray_get_ith_element(elt->next, j))->is_reached = true;
+        }
+    }
+
+    ret = done ? LATTICE_DONE : LATTICE_CONTINUE;
+INTERRUPT:
+    dynarray_free(postorder, NULL);
+    return ret;
+
+ERR_VISITOR:
+ERR_POSTORDER:
+    dynarray_free(postorder, NULL);
+ERR_DYNARRAY_CREATE:
+    return LATTICE_ERROR;
+}
+
 lattice_return_t lattice_walk(
     lattice_t         * lattice,
     lattice_return_t (* visitor)(lattice_elt_t *, void * data),
@@ -158,8 +318,9 @@ lattice_return_t lattice_walk(
         case LATTICE_WALK_DFS:
             return lattice_walk_dfs(lattice, visitor, data);
         case LATTICE_WALK_BFS:
-            fprintf(stderr, "lattice_walk: walk = LATTICE_WALK_BFS not yet implemented\n");
-            break;
+            return lattice_walk_bfs(lattice, visitor, data);
+        case LATTICE_WALK_TOPOLOGICAL:
+            return lattice_walk_topological(lattice, visitor, data);
         default:
             break;
     }
@@ -205,7 +366,7 @@ static void * lattice_find(lattice_t * lattice, void * data)
 }
 */
 
-bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data)
+lattice_elt_t * lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data)
 {
     lattice_elt_t * elt;
    
@@ -223,13 +384,13 @@ bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void
         }
     }
 
-    return true;
+    return elt;
 
 ERR_LATTICE_CONNECT:
 ERR_DYNARRAY_PUSH_ELEMENT:
     lattice_elt_free(elt);
 ERR_LATTICE_ELT_CREATE:
-    return false;
+    return NULL;
 }
 
 bool lattice_connect(lattice_t * lattice, lattice_elt_t * u, lattice_elt_t * v)
@@ -293,5 +454,5 @@ static lattice_return_t lattice_element_dump(lattice_elt_t * elt, void * data) {
 }
 
 void lattice_dump(lattice_t * lattice, void (*element_dump)(const void *)) {
-    lattice_walk(lattice, lattice_element_dump, element_dump, LATTICE_WALK_DFS);
+    lattice_walk(lattice, lattice_element_dump, element_dump, LATTICE_WALK_TOPOLOGICAL);
 }
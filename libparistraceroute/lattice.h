@@ -1,6 +1,9 @@
 #ifndef STRUCTURE_LATTICE_H
 #define STRUCTURE_LATTICE_H
 
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // bool
+
 #include "dynarray.h"
 
 typedef enum {
@@ -12,8 +15,9 @@ typedef enum {
 } lattice_return_t;
 
 typedef enum {
-    LATTICE_WALK_DFS,
-    LATTICE_WALK_BFS
+    LATTICE_WALK_DFS,        /**< Depth first search (pre-order) */
+    LATTICE_WALK_BFS,        /**< Breadth first search */
+    LATTICE_WALK_TOPOLOGICAL /**< A node is visited after all its visited predecessors (except along a cycle) */
 } lattice_walk_t;
 
 //---------------------------------------------------------------------------
@@ -21,9 +25,15 @@ typedef enum {
 //---------------------------------------------------------------------------
 
 typedef struct {
-    dynarray_t * next;     /**< Successors of this node */
-    dynarray_t * siblings; /**< Sibling elements (element having the same depth from the root) */
-    void       * data;     /**< Data stored in this node */
+    dynarray_t       * next;        /**< Successors of this node */
+    dynarray_t       * siblings;    /**< Sibling elements (element having the same depth from the root) */
+    void             * data;        /**< Data stored in this node */
+
+    // Scratch data used by lattice_walk
+    uint64_t           epoch;       /**< Walk which has visited this node (see lattice_t.epoch) */
+    lattice_return_t   walk_result; /**< Result of the walk of this node and its successors (DFS) */
+    bool               is_on_path;  /**< true iif the DFS is walking through the successors of this node */
+    bool               is_reached;  /**< true iif a predecessor let the walk reach this node (topological walk) */
 } lattice_elt_t;
 
 /**
@@ -52,6 +62,7 @@ typedef struct {
     //lattice_elt_t *root;
     dynarray_t * roots;
     int       (* cmp)(const void *, const void *);
+    uint64_t     epoch;  /**< Incremented by each walk, so that a node is visited at most once per walk */
 } lattice_t;
 
 /**
@@ -91,6 +102,28 @@ size_t lattice_elt_get_num_siblings(const lattice_elt_t * elt);
 
 //void lattice_set_cmp(lattice_t * lattice, int (*cmp)(const void *, const void *));
 
+/**
+ * \brief Walk through a lattice. Each node is visited at most once,
+ *    even if it can be reached through several paths, so the walk is
+ *    in O(V + E).
+ * \param lattice A lattice_t instance.
+ * \param visitor A function called for each visited node. It returns:
+ *    - LATTICE_DONE or LATTICE_CONTINUE to walk through its successors,
+ *    - LATTICE_INTERRUPT_NEXT to skip its successors (they may still be
+ *      reached through another predecessor),
+ *    - LATTICE_INTERRUPT_ALL to stop the walk,
+ *    - LATTICE_ERROR to abort the walk.
+ *    With LATTICE_WALK_TOPOLOGICAL, the nodes are visited in the reverse
+ *    postorder of a DFS. If the lattice contains a cycle (e.g. a route
+ *    loops), the edge closing it is ignored, so the nodes of the cycle
+ *    are visited once, in the order the DFS entered them.
+ * \param data This address is passed to each call of visitor.
+ * \param walk The order in which the nodes are visited.
+ * \return LATTICE_CONTINUE if a visited node returned
+ *    LATTICE_INTERRUPT_NEXT, LATTICE_INTERRUPT_ALL if the walk has been
+ *    stopped, LATTICE_ERROR in case of failure, LATTICE_DONE otherwise.
+ */
+
 lattice_return_t lattice_walk(lattice_t * lattice, lattice_return_t (*visitor)(lattice_elt_t *, void *), void * data, lattice_walk_t walk);
 
 /**
@@ -107,12 +140,15 @@ bool lattice_connect(lattice_t * lattice, lattice_elt_t * u, lattice_elt_t * v);
  * \param predecessor The predecessor of this node in the lattice.
  *    You may pass NULL if there is no predecessor. In this case, the new
  *    nodes is stored in lattice->roots.
+ * \param data This address is stored in the newly allocated node.
+ * \return The newly allocated node if successful, NULL otherwise.
  */
 
-bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data);
+lattice_elt_t * lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data);
 
 /**
- * \brief Dump a lattice_t structure to the standard output.
+ * \brief Dump a lattice_t structure to the standard output. Each node
+ *    is dumped after its predecessors (see LATTICE_WALK_TOPOLOGICAL).
  * \param lattice A lattice_t instance.
  * \param element_dump A function that print lattice_elt->data. You may
  *    pass NULL if unused.
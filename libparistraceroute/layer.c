@@ -130,6 +130,14 @@ bool layer_set_field(layer_t * layer, const field_t * field) {
         goto ERR_LAYER_GET_PROTOCOL_FIELD;
     }
 
+    return layer_set_protocol_field(layer, protocol_field, field);
+
+ERR_LAYER_GET_PROTOCOL_FIELD:
+ERR_INVALID_FIELD:
+    return false;
+}
+
+bool layer_set_protocol_field(layer_t * layer, const protocol_field_t * protocol_field, const field_t * field) {
     if (protocol_field->type != field->type) {
         fprintf(stderr, "layer_set_field: '%s' field has not the right type (%s instead of %s) (layer %s)\n",
             field->key,
@@ -155,8 +163,6 @@ bool layer_set_field(layer_t * layer, const field_t * field) {
 
 ERR_PROTOCOL_FIELD_SET:
 ERR_INVALID_FIELD_TYPE:
-ERR_LAYER_GET_PROTOCOL_FIELD:
-ERR_INVALID_FIELD:
     return false;
 }
 
@@ -307,8 +313,6 @@ static bool value_htons(void * value, fieldtype_t type) {
 
 bool layer_extract(const layer_t * layer, const char * key, void * value) {
     const protocol_field_t * protocol_field;
-    field_t                * field;
-    bool                     ret;
 
     if (!(layer && layer->protocol)) {
         goto ERR_INVALID_LAYER;
@@ -318,6 +322,17 @@ bool layer_extract(const layer_t * layer, const char * key, void * value) {
         goto ERR_PROTOCOL_GET_FIELD;
     }
 
+    return layer_extract_protocol_field(layer, protocol_field, value);
+
+ERR_PROTOCOL_GET_FIELD:
+ERR_INVALID_LAYER:
+    return false;
+}
+
+bool layer_extract_protocol_field(const layer_t * layer, const protocol_field_t * protocol_field, void * value) {
+    field_t * field;
+    bool      ret;
+
     if (protocol_field->get) {
         if (!(field = protocol_field->get(layer->segment))) goto ERR_PROTOCOL_FIELD_GET;
         memcpy(value, &field->value, protocol_field_get_size(protocol_field));
@@ -330,8 +345,6 @@ bool layer_extract(const layer_t * layer, const char * key, void * value) {
     return ret;
 
 ERR_PROTOCOL_FIELD_GET:
-ERR_PROTOCOL_GET_FIELD:
-ERR_INVALID_LAYER:
     return false;
 }
 
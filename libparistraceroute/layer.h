@@ -97,6 +97,18 @@ void layer_set_protocol(layer_t * layer, const protocol_t * protocol);
 
 bool layer_set_field(layer_t * layer, const field_t * field);
 
+/**
+ * \brief Update the segment managed by layer according to a field
+ *    passed as a parameter. Unlike layer_set_field, the protocol
+ *    field is not searched by name.
+ * \param layer Pointer to the layer structure to update.
+ * \param protocol_field The protocol field of this layer we're updating.
+ * \param field Pointer to the field we assign in this layer.
+ * \return true iif successfull
+ */
+
+bool layer_set_protocol_field(layer_t * layer, const protocol_field_t * protocol_field, const field_t * field);
+
 const protocol_field_t * layer_get_protocol_field(const layer_t * layer, const char * key);
 uint8_t * layer_get_field_segment(const layer_t * layer, const char * key);
 bool layer_write_field(layer_t * layer, const char * key, const void * bytes, size_t num_bytes);
@@ -172,6 +184,17 @@ layer_t * layer_create_from_segment(const protocol_t * protocol, uint8_t * segme
 
 bool layer_extract(const layer_t * layer, const char * key, void * value);
 
+/**
+ * \brief Extract a value from a field involved in a layer. Unlike
+ *    layer_extract, the protocol field is not searched by name.
+ * \param layer The queried layer instance.
+ * \param protocol_field The protocol field of this layer we're reading.
+ * \param value A preallocated buffer which will contain the corresponding value.
+ * \return true if successful, false otherwise.
+ */
+
+bool layer_extract_protocol_field(const layer_t * layer, const protocol_field_t * protocol_field, void * value);
+
 /**
  * \brief Print the content of a layer.
  * \param layer A pointer to the layer instance to print.
@@ -8,6 +8,9 @@
 #include <unistd.h>         // close
 #include "os/sys/timerfd.h" // timerfd_create, timerfd_settime
 #include <arpa/inet.h>      // htons
+#include <netinet/in.h>     // IPPROTO_UDP, IPPROTO_TCP
+#include "os/netinet/ip_icmp.h" // ICMP_ECHO, ICMP_ECHOREPLY
+#include "os/netinet/icmp6.h"   // ICMP6_ECHO_REQUEST, ICMP6_ECHO_REPLY
 #include <limits.h>         // INT_MAX
 
 #include "protocol.h"       // struct probe_s
@@ -15,23 +18,51 @@
 #include "common.h"
 #include "packet.h"
 #include "queue.h"
+#include "dynarray.h"       // dynarray_t
 #include "options.h"        // option_t
 #include "probe.h"          // probe_extract_ext, probe_set_field_ext
 #include "algorithm.h"      // pt_algorithm_throw
+#include "address.h"        // address_t
+#include "timestamp.h"      // timestamp_now
 
-// TODO static variable as timeout. Control extra_delay and timeout values consistency
-#define EXTRA_DELAY 0.01 // this extra delay provokes a probe timeout event if a probe will expires in less than EXTRA_DELAY seconds. Must be less than network->timeout.
+// Probe timeouts are managed by a timer wheel ticking every NETWORK_TIMER_TICK
+// nano seconds while probes are in transit. A probe timeout is raised at most
+// NETWORK_TIMER_TICK nano seconds after its deadline.
+#define NETWORK_TIMER_TICK      (10 * TIMESTAMP_NSEC_PER_MSEC)
+#define NETWORK_TIMER_NUM_SLOTS 1024
+
+// The 16 lowest bits of a tag are stored in the transport checksum. If the
+// IP layer has an identification field (IPv4), it stores the highest bits,
+// which widens the tag space. A tag is never shared by two flying probes.
+#define NETWORK_NUM_TAGS        (1 << 16)
+#define NETWORK_NUM_WIDE_TAGS   (1 << 20)
+
+// ICMP echo requests and replies carry a 16-bit identifier (the "body" field)
+// followed by a 16-bit sequence number.
+#define ICMP_ECHO_IDENTIFIER_OFFSET 4
+#define ICMP_ECHO_SEQUENCE_OFFSET   6
+#define ICMP_ECHO_HEADER_SIZE       8
+
+// The ranges of source ports and of ICMP identifiers accepted by the sniffer
+// filter are widened by blocks of NETWORK_FILTER_PORT_BLOCK values (power of 2).
+#define NETWORK_FILTER_PORT_BLOCK 64
 
 
 //---------------------------------------------------------------------------
 // Network options
 //---------------------------------------------------------------------------
 
-static double timeout[3] = OPTIONS_NETWORK_WAIT;
+static double timeout[3]         = OPTIONS_NETWORK_WAIT;
+static int    send_batch_size[3] = OPTIONS_NETWORK_SEND_BATCH_SIZE;
+static int    max_pps[3]         = OPTIONS_NETWORK_MAX_PPS;
+static bool   is_timeout_adaptive = false;
 
 static option_t network_options[] = {
-    // action              short long          metavar         help    variable
-    {opt_store_double_lim, "w",  "--wait",     "TIMEOUT",      HELP_w, timeout},
+    // action              short      long            metavar         help             variable
+    {opt_store_double_lim, "w",       "--wait",       "TIMEOUT",      HELP_w,          timeout},
+    {opt_store_int_lim,    OPT_NO_SF, "--send-batch", "NUM_PROBES",   HELP_send_batch, send_batch_size},
+    {opt_store_int_lim,    OPT_NO_SF, "--max-pps",    "RATE",         HELP_max_pps,    max_pps},
+    {opt_store_1,          OPT_NO_SF, "--adaptive-wait", OPT_NO_METAVAR, HELP_adaptive_wait, &is_timeout_adaptive},
     END_OPT_SPECS
 };
 
@@ -48,6 +79,18 @@ double options_network_get_timeout() {
     return timeout[0];
 }
 
+size_t options_network_get_send_batch_size() {
+    return send_batch_size[0];
+}
+
+double options_network_get_max_pps() {
+    return max_pps[0];
+}
+
+bool options_network_get_is_timeout_adaptive() {
+    return is_timeout_adaptive;
+}
+
 void network_set_is_verbose(network_t * network, bool verbose) {
      network->is_verbose = verbose;
 }
@@ -56,6 +99,9 @@ void options_network_init(network_t * network, bool verbose)
 {
     network_set_is_verbose(network, verbose);
     network_set_timeout(network, options_network_get_timeout());
+    network_set_send_batch_size(network, options_network_get_send_batch_size());
+    network_set_max_pps(network, options_network_get_max_pps());
+    network_set_is_timeout_adaptive(network, options_network_get_is_timeout_adaptive());
 }
 
 //---------------------------------------------------------------------------
@@ -73,17 +119,6 @@ static inline bool probe_extract_tag(const probe_t * probe, uint16_t * ptag_prob
     return probe_extract_ext(probe, "checksum", 1, ptag_probe);
 }
 
-/**
- * \brief Extract the probe ID (tag) from a reply
- * \param reply The queried reply
- * \param ptag_reply Address of the uint16_t in which the tag is written
- * \return true iif successful
- */
-
-static inline bool reply_extract_tag(const probe_t * reply, uint16_t * ptag_reply) {
-    return probe_extract_ext(reply, "checksum", 3, ptag_reply);
-}
-
 /**
  * \brief Set the probe ID (tag) from a probe
  * \param probe The probe we want to update
@@ -104,66 +139,785 @@ static bool probe_set_tag(probe_t * probe, uint16_t tag_probe) {
 }
 
 /**
- * \brief Handler called by the sniffer to allow the network layer
- *    to process sniffed packets.
+ * \brief Check whether the IP layer of a probe can store the highest
+ *   bits of a tag (see NETWORK_NUM_WIDE_TAGS).
+ * \param ip_layer The IP layer of a probe.
+ * \return true iif this layer has an identification field.
+ */
+
+static inline bool layer_has_wide_tag(const layer_t * ip_layer) {
+    return ip_layer && ip_layer->protocol && layer_get_protocol_field(ip_layer, "identification");
+}
+
+/**
+ * \brief Check whether a layer is an ICMP echo request or reply. An echo
+ *   reply does not quote its probe, but echoes its ICMP identifier and
+ *   sequence number, which are thus used to match it.
+ * \param layer A layer of a probe or a reply (may be NULL).
+ * \param is_reply Pass a pointer to a boolean set to true iif this layer
+ *   is an echo reply, or NULL.
+ * \return true iif this layer is a (complete) ICMP echo request or reply.
+ */
+
+static bool layer_is_icmp_echo(const layer_t * layer, bool * is_reply) {
+    uint8_t type;
+    bool    is_echo_reply;
+
+    if (!(layer && layer->protocol && layer_get_segment_size(layer) >= ICMP_ECHO_HEADER_SIZE)) return false;
+    if (!layer_extract(layer, "type", &type)) return false;
+
+    switch (layer->protocol->protocol) {
+        case IPPROTO_ICMP:
+            if (type != ICMP_ECHO && type != ICMP_ECHOREPLY) return false;
+            is_echo_reply = (type == ICMP_ECHOREPLY);
+            break;
+        case IPPROTO_ICMPV6:
+            if (type != ICMP6_ECHO_REQUEST && type != ICMP6_ECHO_REPLY) return false;
+            is_echo_reply = (type == ICMP6_ECHO_REPLY);
+            break;
+        default:
+            return false;
+    }
+
+    if (is_reply) *is_reply = is_echo_reply;
+    return true;
+}
+
+/**
+ * \brief Check whether a probe (or the probe quoted by a reply) carries
+ *   a wide tag. ICMP echo probes do not: their echo reply does not quote
+ *   the IP identification.
+ * \param probe A probe or a reply.
+ * \param depth The index of the IP layer carrying the probe headers.
+ * \return true iif the tag of this probe is wide.
+ */
+
+static inline bool probe_has_wide_tag(const probe_t * probe, size_t depth) {
+    return layer_has_wide_tag(probe_get_layer(probe, depth))
+        && !layer_is_icmp_echo(probe_get_layer(probe, depth + 1), NULL);
+}
+
+/**
+ * \brief Write the highest bits of a tag in the IP identification
+ *   field of a probe. Since the kernel overwrites a null identification,
+ *   the identification is shifted by one.
+ * \param probe The probe we want to update
+ * \param tag The tag we're assigning to the probe
+ * \return true iif successful
+ */
+
+static bool probe_set_wide_tag(probe_t * probe, uint32_t tag) {
+    uint16_t identification = htons((tag >> 16) + 1);
+
+    // probe_write_field_ext updates the IPv4 checksum incrementally
+    return probe_write_field_ext(probe, 0, "identification", &identification, sizeof(uint16_t));
+}
+
+/**
+ * \brief Retrieve the tag allocator related to a probe.
  * \param network The network layer
- * \param packet The sniffed packet
+ * \param probe A probe
+ * \return The corresponding tag allocator
  */
 
-static bool network_sniffer_callback(packet_t * packet, void * recvq) {
-    return queue_push_element((queue_t *) recvq, packet);
+static inline tag_allocator_t * network_get_tag_allocator(network_t * network, const probe_t * probe) {
+    return probe_has_wide_tag(probe, 0) ? network->wide_tags : network->tags;
 }
 
+//---------------------------------------------------------------------------
+// Flying probes index
+//---------------------------------------------------------------------------
+
 /**
- * \brief Retrieve a tag (probe ID) not yet used.
- * \return An available tag
+ * \brief Key used to index flying probes in network->flying_probes.
+ *   A probe and its reply share the same key: the reply quotes the
+ *   IP and transport headers of the probe (IP / ICMP / IP / transport).
+ *   ICMP echo probes are keyed by their ICMP identifier and sequence
+ *   number instead of their tag, since their echo reply only echoes them.
+ *   This structure is memset to 0 before being filled since it is hashed
+ *   and compared bytewise.
  */
 
-static uint16_t network_get_available_tag(network_t * network) {
-    return ++network->last_tag;
+typedef struct {
+    address_t dst_ip;   /**< Destination of the probe */
+    uint32_t  tag;      /**< Probe ID, stored in the transport checksum (and the IP identification), 0 for ICMP echo probes */
+    uint16_t  src_port; /**< Source port, ICMP identifier for ICMP echo probes (0 if not relevant) */
+    uint16_t  dst_port; /**< Destination port, ICMP sequence number for ICMP echo probes (0 if not relevant) */
+    uint8_t   protocol; /**< Transport protocol */
+} flying_probe_key_t;
+
+/**
+ * \brief Bookkeeping related to a flying probe. key must be the first
+ *   member so that a flying_probe_key_t can be used for lookups in
+ *   network->flying_probes.
+ */
+
+typedef struct flying_probe_s {
+    flying_probe_key_t      key;        /**< The key identifying the probe */
+    probe_t               * probe;      /**< The corresponding flying probe */
+    bool                    is_indexed; /**< true iif stored in network->flying_probes */
+    timer_wheel_node_t      timeout;    /**< Deadline of the probe, stored in network->timeouts */
+    struct rtt_entry_s    * hop_rtt;    /**< RTTs observed towards the same destination and TTL (adaptive timeout only) */
+    struct rtt_entry_s    * path_rtt;   /**< RTTs observed towards the same destination (adaptive timeout only) */
+    struct {
+        int                 family;     /**< Address family of the probe */
+        uint32_t            tx_id;      /**< Identifier of the transmit timestamp of the probe (see socketpool.h) */
+    } tx_key;
+    bool                    is_tx_indexed; /**< true iif stored in network->tx_probes */
+    struct tcp_flow_s     * tcp_flow;   /**< TCP flow of the probe, stored in network->tcp_flows (NULL if none) */
+    struct flying_probe_s * tcp_prev;   /**< Previous (older) flying probe of tcp_flow */
+    struct flying_probe_s * tcp_next;   /**< Next (younger) flying probe of tcp_flow */
+    struct flying_probe_s * prev;       /**< Previous (older) flying probe */
+    struct flying_probe_s * next;       /**< Next (younger) flying probe */
+} flying_probe_t;
+
+static size_t flying_probe_hash(const flying_probe_t * flying_probe) {
+    return hash_bytes(&flying_probe->key, sizeof(flying_probe_key_t));
+}
+
+static int flying_probe_compare(const flying_probe_t * flying_probe1, const flying_probe_t * flying_probe2) {
+    return memcmp(&flying_probe1->key, &flying_probe2->key, sizeof(flying_probe_key_t));
 }
 
 /**
- * \brief Debug function. Dump tags of every flying probes
- * \param network The queried network layer
+ * \brief Flying TCP probes sharing a destination and a pair of ports.
+ *   A TCP reply (RST, SYN-ACK) sent by the destination does not quote
+ *   the probe, so it carries no tag: it is matched with the oldest flying
+ *   probe of its flow, as protocol->matches used to do.
  */
 
-static void network_flying_probes_dump(network_t * network) {
-    size_t     i, num_flying_probes = dynarray_get_size(network->probes);
-    uint16_t   tag_probe;
-    probe_t  * probe;
-
-    printf("\n%u flying probe(s) :\n", (unsigned int)num_flying_probes);
-    for (i = 0; i < num_flying_probes; i++) {
-        probe = dynarray_get_ith_element(network->probes, i);
-        probe_extract_tag(probe, &tag_probe) ?
-            printf(" 0x%x", tag_probe):
-            printf(" (invalid tag)");
-        printf("\n");
+typedef struct tcp_flow_s {
+    flying_probe_key_t      key;        /**< Destination, ports and protocol of the probes (tag = 0) */
+    struct flying_probe_s * oldest;     /**< Oldest flying probe of this flow */
+    struct flying_probe_s * youngest;   /**< Youngest flying probe of this flow */
+} tcp_flow_t;
+
+static size_t tcp_flow_hash(const tcp_flow_t * tcp_flow) {
+    return hash_bytes(&tcp_flow->key, sizeof(flying_probe_key_t));
+}
+
+static int tcp_flow_compare(const tcp_flow_t * tcp_flow1, const tcp_flow_t * tcp_flow2) {
+    return memcmp(&tcp_flow1->key, &tcp_flow2->key, sizeof(flying_probe_key_t));
+}
+
+static size_t flying_probe_tx_hash(const flying_probe_t * flying_probe) {
+    return hash_bytes(&flying_probe->tx_key, sizeof(flying_probe->tx_key));
+}
+
+static int flying_probe_tx_compare(const flying_probe_t * flying_probe1, const flying_probe_t * flying_probe2) {
+    return memcmp(&flying_probe1->tx_key, &flying_probe2->tx_key, sizeof(flying_probe1->tx_key));
+}
+
+/**
+ * \brief RTTs observed towards a destination (ttl = 0) or towards a
+ *   (destination, TTL) pair. key must be the first member so that an
+ *   entry can be used for lookups in network->rtt_estimators. This
+ *   structure is memset to 0 before being filled since its key is hashed
+ *   and compared bytewise. The entries no flying probe refers to are also
+ *   chained from the least recently used one to the most recently used one,
+ *   so that at most NETWORK_MAX_RTT_ESTIMATORS entries are kept.
+ */
+
+typedef struct rtt_entry_s {
+    struct {
+        address_t dst_ip;           /**< Destination of the probes */
+        uint8_t   ttl;              /**< TTL of the probes (0: any) */
+    } key;
+    rtt_estimator_t      estimator; /**< RTTs observed for this key */
+    size_t               num_users; /**< Number of flying probes referring to this entry */
+    struct rtt_entry_s * prev;      /**< Previous (less recently used) entry (only meaningful if num_users == 0) */
+    struct rtt_entry_s * next;      /**< Next (more recently used) entry (only meaningful if num_users == 0) */
+} rtt_entry_t;
+
+static size_t rtt_entry_hash(const rtt_entry_t * entry) {
+    return hash_bytes(&entry->key, sizeof(entry->key));
+}
+
+static int rtt_entry_compare(const rtt_entry_t * entry1, const rtt_entry_t * entry2) {
+    return memcmp(&entry1->key, &entry2->key, sizeof(entry1->key));
+}
+
+/**
+ * \brief Extract a field from a layer, provided it is not truncated.
+ *   Replies only quote the beginning of the probe (e.g. the TCP checksum
+ *   is missing if a router only quotes 8 bytes of the transport header).
+ * \param layer The queried layer.
+ * \param name The name of the queried field.
+ * \param value The place where the extracted value is written.
+ * \return true iif successful.
+ */
+
+static bool layer_extract_if_present(const layer_t * layer, const char * name, void * value) {
+    const protocol_field_t * protocol_field;
+
+    if (!(protocol_field = layer_get_protocol_field(layer, name))) return false;
+    if (protocol_field->offset + protocol_field_get_size(protocol_field) > layer_get_segment_size(layer)) return false;
+    return layer_extract(layer, name, value);
+}
+
+/**
+ * \brief Extract the tag of a probe, or of the probe quoted by a reply.
+ * \param probe A probe or a reply.
+ * \param depth The index of the IP layer carrying the probe headers:
+ *   0 for a probe, 2 for a reply (IP / ICMP / IP / transport).
+ * \param tag The place where the tag is written.
+ * \return true iif successful.
+ */
+
+static bool network_extract_tag(const probe_t * probe, size_t depth, uint32_t * tag) {
+    const layer_t * ip_layer,
+                  * transport_layer;
+    uint16_t        checksum,
+                    identification;
+
+    if (!(ip_layer        = probe_get_layer(probe, depth))
+    ||  !(transport_layer = probe_get_layer(probe, depth + 1))
+    ||  !(ip_layer->protocol && transport_layer->protocol)) {
+        return false;
     }
+
+    if (!layer_extract_if_present(transport_layer, "checksum", &checksum)) return false;
+    *tag = checksum;
+    if (probe_has_wide_tag(probe, depth)) {
+        if (!layer_extract_if_present(ip_layer, "identification", &identification)) return false;
+        *tag |= ((uint32_t) (uint16_t) (identification - 1)) << 16;
+    }
+    return true;
 }
 
 /**
- * \brief Get the oldest probe in network
- * \param network Pointer to network instance
- * \return A pointer to oldest probe if any, NULL otherwise
+ * \brief Compute the key identifying a probe or a reply.
+ * \param probe A probe or a reply.
+ * \param depth The index of the IP layer carrying the probe headers:
+ *   0 for a probe or an ICMP echo reply, 2 for a reply quoting its probe
+ *   (IP / ICMP / IP / transport).
+ * \param key The key we're filling.
+ * \return true iif successful.
  */
 
-static probe_t * network_get_oldest_probe(const network_t * network) {
-    return dynarray_get_ith_element(network->probes, 0);
+static bool network_extract_key(const probe_t * probe, size_t depth, flying_probe_key_t * key) {
+    const layer_t * ip_layer,
+                  * transport_layer;
+    bool            is_echo_reply;
+
+    memset(key, 0, sizeof(flying_probe_key_t));
+
+    if (!(ip_layer        = probe_get_layer(probe, depth))
+    ||  !(transport_layer = probe_get_layer(probe, depth + 1))
+    ||  !(ip_layer->protocol && transport_layer->protocol)) {
+        return false;
+    }
+    key->protocol = transport_layer->protocol->protocol;
+
+    // ICMP echo: the reply is sent by the destination of the probe
+    if (layer_is_icmp_echo(transport_layer, &is_echo_reply)) {
+        if (!probe_extract_ext(probe, is_echo_reply ? "src_ip" : "dst_ip", depth, &key->dst_ip)) return false;
+        // The "body" field spans both the identifier and the sequence number in ICMPv6
+        memcpy(&key->src_port, transport_layer->segment + ICMP_ECHO_IDENTIFIER_OFFSET, sizeof(uint16_t));
+        memcpy(&key->dst_port, transport_layer->segment + ICMP_ECHO_SEQUENCE_OFFSET,   sizeof(uint16_t));
+        return true;
+    }
+
+    if (!probe_extract_ext(probe, "dst_ip", depth, &key->dst_ip)) return false;
+    if (!network_extract_tag(probe, depth, &key->tag)) return false;
+
+    // Ports are optional (e.g. ICMP probes)
+    if (!layer_extract_if_present(transport_layer, "src_port", &key->src_port)) key->src_port = 0;
+    if (!layer_extract_if_present(transport_layer, "dst_port", &key->dst_port)) key->dst_port = 0;
+    return true;
 }
 
 /**
- * \brief Compute when a probe expires
- * \param network The network layer
- * \param probe A probe instance. Its sending time must be set.
- * \return The timeout of the probe. This value may be negative. If so,
- *    it means that this probe has already expired and a PROBE_TIMEOUT
- *    should be raised.
+ * \brief Compute the key identifying the probe which has provoked a reply.
+ * \param reply A sniffed reply.
+ * \param key The key we're filling.
+ * \return true iif successful.
+ */
+
+static bool network_extract_reply_key(const probe_t * reply, flying_probe_key_t * key) {
+    bool is_echo_reply;
+
+    // An ICMP error quotes the probe, an ICMP echo reply does not
+    if (layer_is_icmp_echo(probe_get_layer(reply, 1), &is_echo_reply) && is_echo_reply) {
+        return network_extract_key(reply, 0, key);
+    }
+    return network_extract_key(reply, 2, key);
+}
+
+/**
+ * \brief Compute the key identifying the TCP flow of a probe, or of the
+ *   TCP reply (RST, SYN-ACK) sent back by its destination.
+ * \param probe A probe or a reply.
+ * \param is_reply Pass true if probe is a reply. Its addresses and ports
+ *   are then swapped, so that it shares the key of its probe.
+ * \param key The key we're filling.
+ * \return true iif probe is a TCP packet and the key could be computed.
+ */
+
+static bool network_extract_tcp_key(const probe_t * probe, bool is_reply, flying_probe_key_t * key) {
+    const layer_t * transport_layer;
+
+    memset(key, 0, sizeof(flying_probe_key_t));
+
+    if (!(transport_layer = probe_get_layer(probe, 1))
+    ||  !transport_layer->protocol
+    ||  transport_layer->protocol->protocol != IPPROTO_TCP) {
+        return false;
+    }
+    key->protocol = IPPROTO_TCP;
+
+    return probe_extract_ext(probe, is_reply ? "src_ip" : "dst_ip", 0, &key->dst_ip)
+        && layer_extract(transport_layer, is_reply ? "dst_port" : "src_port", &key->src_port)
+        && layer_extract(transport_layer, is_reply ? "src_port" : "dst_port", &key->dst_port);
+}
+
+/**
+ * \brief Append a flying TCP probe to its flow (see tcp_flow_t).
+ * \param network The network layer.
+ * \param flying_probe The flying probe. Its tcp_flow member is set iif
+ *   it is successfully appended.
+ */
+
+static void network_tcp_flow_add(network_t * network, flying_probe_t * flying_probe)
+{
+    tcp_flow_t   query,
+               * tcp_flow;
+
+    flying_probe->tcp_flow = NULL;
+    if (!network_extract_tcp_key(flying_probe->probe, false, &query.key)) return;
+
+    if (!(tcp_flow = hashtable_find(network->tcp_flows, &query))) {
+        if (!(tcp_flow = malloc(sizeof(tcp_flow_t)))) return;
+        memcpy(&tcp_flow->key, &query.key, sizeof(flying_probe_key_t));
+        tcp_flow->oldest   = NULL;
+        tcp_flow->youngest = NULL;
+        if (!hashtable_insert(network->tcp_flows, tcp_flow)) {
+            free(tcp_flow);
+            return;
+        }
+    }
+
+    flying_probe->tcp_flow = tcp_flow;
+    flying_probe->tcp_prev = tcp_flow->youngest;
+    flying_probe->tcp_next = NULL;
+    if (tcp_flow->youngest) {
+        tcp_flow->youngest->tcp_next = flying_probe;
+    } else {
+        tcp_flow->oldest = flying_probe;
+    }
+    tcp_flow->youngest = flying_probe;
+}
+
+/**
+ * \brief Remove a flying TCP probe from its flow (if any). The flow is
+ *   released once it has no flying probe left.
+ * \param network The network layer.
+ * \param flying_probe The flying probe.
  */
 
-static double network_get_probe_timeout(const network_t * network, const probe_t * probe) {
-    return network_get_timeout(network) - (get_timestamp() - probe_get_sending_time(probe));
+static void network_tcp_flow_del(network_t * network, flying_probe_t * flying_probe)
+{
+    tcp_flow_t * tcp_flow = flying_probe->tcp_flow;
+
+    if (!tcp_flow) return;
+
+    if (flying_probe->tcp_prev) {
+        flying_probe->tcp_prev->tcp_next = flying_probe->tcp_next;
+    } else {
+        tcp_flow->oldest = flying_probe->tcp_next;
+    }
+    if (flying_probe->tcp_next) {
+        flying_probe->tcp_next->tcp_prev = flying_probe->tcp_prev;
+    } else {
+        tcp_flow->youngest = flying_probe->tcp_prev;
+    }
+    flying_probe->tcp_flow = NULL;
+
+    if (!tcp_flow->oldest) hashtable_erase(network->tcp_flows, tcp_flow);
+}
+
+/**
+ * \brief Update network->timerfd to make it tick periodically (or to disarm it).
+ * \param network The network layer.
+ * \param is_enabled Pass true to make network->timerfd tick, false to disarm it.
+ * \return true iif successful.
+ */
+
+static bool network_set_ticking(network_t * network, bool is_enabled) {
+    struct itimerspec tick;
+    timestamp_t       delay = is_enabled ? timer_wheel_get_tick(network->timeouts) : 0;
+
+    tick.it_value.tv_sec  = delay / TIMESTAMP_NSEC_PER_SEC;
+    tick.it_value.tv_nsec = delay % TIMESTAMP_NSEC_PER_SEC;
+    tick.it_interval      = tick.it_value;
+
+    return (timerfd_settime(network->timerfd, 0, &tick, NULL) != -1);
+}
+
+/**
+ * \brief Compute how long the network layer waits for the reply of a probe.
+ * \param network The network layer.
+ * \param probe A probe instance.
+ * \return The timeout of this probe (in seconds).
+ */
+
+static double network_get_probe_timeout(const network_t * network, const flying_probe_t * flying_probe) {
+    const rtt_estimator_t * estimator = NULL;
+
+    // Prefer the RTTs observed at this hop, then along this path
+    if (flying_probe->hop_rtt && rtt_estimator_has_samples(&flying_probe->hop_rtt->estimator)) {
+        estimator = &flying_probe->hop_rtt->estimator;
+    } else if (flying_probe->path_rtt && rtt_estimator_has_samples(&flying_probe->path_rtt->estimator)) {
+        estimator = &flying_probe->path_rtt->estimator;
+    }
+
+    return estimator ?
+        rtt_estimator_get_rto(estimator, NETWORK_MIN_ADAPTIVE_TIMEOUT, network_get_timeout(network)) :
+        network_get_timeout(network);
+}
+
+/**
+ * \brief Remove an entry from the chain of RTT estimators.
+ * \param network The network layer.
+ * \param entry The entry.
+ */
+
+static void network_rtt_entry_unlink(network_t * network, rtt_entry_t * entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        network->oldest_rtt_entry = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        network->youngest_rtt_entry = entry->prev;
+    }
+}
+
+/**
+ * \brief Append an entry to the chain of RTT estimators (it becomes the
+ *    most recently used one). Only the entries no flying probe refers
+ *    to are chained.
+ * \param network The network layer.
+ * \param entry The entry.
+ */
+
+static void network_rtt_entry_link(network_t * network, rtt_entry_t * entry)
+{
+    entry->prev = network->youngest_rtt_entry;
+    entry->next = NULL;
+    if (network->youngest_rtt_entry) {
+        network->youngest_rtt_entry->next = entry;
+    } else {
+        network->oldest_rtt_entry = entry;
+    }
+    network->youngest_rtt_entry = entry;
+}
+
+/**
+ * \brief Forget the least recently used RTT estimators until at most
+ *    NETWORK_MAX_RTT_ESTIMATORS are kept. The estimators still referred
+ *    by a flying probe are kept, since they are not chained.
+ * \param network The network layer.
+ */
+
+static void network_evict_rtt_estimators(network_t * network)
+{
+    rtt_entry_t * entry;
+
+    while ((entry = network->oldest_rtt_entry)
+        && hashtable_get_size(network->rtt_estimators) > NETWORK_MAX_RTT_ESTIMATORS
+    ) {
+        network_rtt_entry_unlink(network, entry);
+        hashtable_erase(network->rtt_estimators, entry);
+    }
+}
+
+/**
+ * \brief Retrieve the RTT estimator related to a destination and a TTL.
+ *    It is created if needed, and is kept until network_release_rtt_estimator
+ *    is called.
+ * \param network The network layer.
+ * \param dst_ip The destination of the probes.
+ * \param ttl The TTL of the probes (0: any).
+ * \return The corresponding entry, NULL in case of failure.
+ */
+
+static rtt_entry_t * network_get_rtt_estimator(network_t * network, const address_t * dst_ip, uint8_t ttl)
+{
+    rtt_entry_t   query,
+                * entry;
+
+    memset(&query, 0, sizeof(rtt_entry_t));
+    query.key.dst_ip.family = dst_ip->family;
+    memcpy(&query.key.dst_ip.ip, &dst_ip->ip, address_get_size(dst_ip));
+    query.key.ttl = ttl;
+
+    if ((entry = hashtable_find(network->rtt_estimators, &query))) {
+        // This entry cannot be evicted until it is released
+        if (!entry->num_users) network_rtt_entry_unlink(network, entry);
+    } else {
+        if (!(entry = malloc(sizeof(rtt_entry_t)))) goto ERR_MALLOC;
+        memcpy(entry, &query, sizeof(rtt_entry_t));
+        rtt_estimator_init(&entry->estimator);
+        if (!hashtable_insert(network->rtt_estimators, entry)) goto ERR_HASHTABLE_INSERT;
+        network_evict_rtt_estimators(network);
+    }
+    entry->num_users++;
+    return entry;
+
+ERR_HASHTABLE_INSERT:
+    free(entry);
+ERR_MALLOC:
+    return NULL;
+}
+
+/**
+ * \brief Release an RTT estimator retrieved by network_get_rtt_estimator.
+ *    Once no flying probe refers to it, it becomes the most recently used
+ *    estimator that can be evicted.
+ * \param network The network layer.
+ * \param entry The entry returned by network_get_rtt_estimator, or NULL.
+ */
+
+static void network_release_rtt_estimator(network_t * network, rtt_entry_t * entry)
+{
+    if (entry && --entry->num_users == 0) {
+        network_rtt_entry_link(network, entry);
+        network_evict_rtt_estimators(network);
+    }
+}
+
+/**
+ * \brief Release the tag of a probe, which is no more in transit.
+ * \param network The network layer.
+ * \param probe A probe tagged by network_tag_probe.
+ */
+
+static void network_release_tag(network_t * network, const probe_t * probe) {
+    uint32_t tag;
+
+    if (network_extract_tag(probe, 0, &tag)) {
+        tag_allocator_release(network_get_tag_allocator(network, probe), tag);
+    }
+}
+
+/**
+ * \brief Index a flying probe by the identifier of its transmit timestamp
+ *    (see network_tx_timestamp_callback).
+ * \param network The network layer.
+ * \param flying_probe The flying probe. Its tx_key must be set.
+ */
+
+static void network_tx_index(network_t * network, flying_probe_t * flying_probe) {
+    flying_probe_t * older_probe;
+
+    // The identifiers are reset whenever a packet cannot be sent, so an
+    // older probe may still wait for a timestamp carrying the same
+    // identifier. It cannot be told apart anymore: it keeps the sending
+    // time set by the socket pool.
+    if ((older_probe = hashtable_take(network->tx_probes, flying_probe))) {
+        older_probe->is_tx_indexed = false;
+        if (network->is_verbose) {
+            fprintf(stderr, "network_tx_index: transmit timestamp %u already in use\n", flying_probe->tx_key.tx_id);
+        }
+    }
+    flying_probe->is_tx_indexed = hashtable_insert(network->tx_probes, flying_probe);
+}
+
+/**
+ * \brief Register a (tagged) probe which has just been sent in the list
+ *    of flying probes. It is indexed to match its reply in O(1), and its
+ *    deadline is stored in network->timeouts.
+ * \param network The network layer.
+ * \param probe The probe which has been sent. Its sending time must be set.
+ * \return The corresponding flying_probe_t instance, NULL in case of failure.
+ */
+
+static flying_probe_t * network_flying_probe_create(network_t * network, probe_t * probe) {
+    flying_probe_t * flying_probe;
+    bool             has_key;
+    uint8_t          ttl;
+
+    if (!(flying_probe = malloc(sizeof(flying_probe_t)))) goto ERR_MALLOC;
+
+    flying_probe->probe = probe;
+
+    // Tags are unique among flying probes, so a probe should never share its
+    // key with another one. Otherwise, it is not indexed, and its reply is
+    // discarded (the probe then times out).
+    has_key = network_extract_key(probe, 0, &flying_probe->key);
+    flying_probe->is_indexed = has_key
+        && hashtable_insert(network->flying_probes, flying_probe);
+
+    // Adaptive timeout: retrieve the RTTs observed towards this destination
+    flying_probe->hop_rtt  = NULL;
+    flying_probe->path_rtt = NULL;
+    if (network->is_timeout_adaptive && has_key
+    &&  probe_accessor_extract(&network->ttl_accessor, probe, &ttl)) {
+        flying_probe->hop_rtt  = network_get_rtt_estimator(network, &flying_probe->key.dst_ip, ttl);
+        flying_probe->path_rtt = network_get_rtt_estimator(network, &flying_probe->key.dst_ip, 0);
+    }
+
+    // TCP replies sent by the destination: see tcp_flow_t
+    network_tcp_flow_add(network, flying_probe);
+
+    // Kernel transmit timestamps: see network_tx_timestamp_callback
+    flying_probe->is_tx_indexed = false;
+    if (network->tx_probes && socketpool_has_tx_timestamps(network->socketpool)) {
+        memset(&flying_probe->tx_key, 0, sizeof(flying_probe->tx_key));
+        flying_probe->tx_key.family = probe->packet->dst_ip->family;
+        flying_probe->tx_key.tx_id  = probe->packet->tx_id;
+        network_tx_index(network, flying_probe);
+    }
+
+    // Append this probe to the list of flying probes
+    flying_probe->prev = network->youngest_probe;
+    flying_probe->next = NULL;
+    if (network->youngest_probe) {
+        network->youngest_probe->next = flying_probe;
+    } else {
+        network->oldest_probe = flying_probe;
+    }
+    network->youngest_probe = flying_probe;
+    network->num_flying_probes++;
+
+    // Schedule its timeout. network->timerfd only ticks while there are
+    // flying probes.
+    timer_wheel_node_init(&flying_probe->timeout, flying_probe);
+    timer_wheel_add(
+        network->timeouts,
+        &flying_probe->timeout,
+        probe_get_sending_timestamp(probe) + timestamp_from_seconds(network_get_probe_timeout(network, flying_probe))
+    );
+    if (timer_wheel_get_size(network->timeouts) == 1) {
+        if (!network_set_ticking(network, true)) {
+            fprintf(stderr, "Can't set timerfd\n");
+        }
+    }
+
+    return flying_probe;
+
+ERR_MALLOC:
+    return NULL;
+}
+
+/**
+ * \brief Remove a probe from the flying probes. Its timeout is cancelled.
+ *    The probe itself is not freed.
+ * \param network The network layer.
+ * \param flying_probe The flying_probe_t instance we're releasing.
+ */
+
+static void network_flying_probe_free(network_t * network, flying_probe_t * flying_probe) {
+    timer_wheel_del(network->timeouts, &flying_probe->timeout);
+    network_release_tag(network, flying_probe->probe);
+    network_release_rtt_estimator(network, flying_probe->hop_rtt);
+    network_release_rtt_estimator(network, flying_probe->path_rtt);
+
+    if (flying_probe->is_indexed) {
+        hashtable_take(network->flying_probes, flying_probe);
+    }
+
+    if (flying_probe->is_tx_indexed) {
+        hashtable_take(network->tx_probes, flying_probe);
+    }
+    network_tcp_flow_del(network, flying_probe);
+
+    if (flying_probe->prev) {
+        flying_probe->prev->next = flying_probe->next;
+    } else {
+        network->oldest_probe = flying_probe->next;
+    }
+    if (flying_probe->next) {
+        flying_probe->next->prev = flying_probe->prev;
+    } else {
+        network->youngest_probe = flying_probe->prev;
+    }
+    network->num_flying_probes--;
+
+    free(flying_probe);
+}
+
+/**
+ * \brief Handler called for each transmit timestamp reported by the kernel.
+ *    The sending time of the corresponding flying probe (if any) is
+ *    replaced by this timestamp, which is not delayed by the socket pool.
+ * \param family The address family of the sent packet.
+ * \param tx_id The identifier of the transmit timestamp.
+ * \param timestamp The time at which the kernel has sent the packet.
+ * \param network The network layer.
+ */
+
+static void network_tx_timestamp_callback(int family, uint32_t tx_id, timestamp_t timestamp, network_t * network) {
+    flying_probe_t   search,
+                   * flying_probe;
+
+    memset(&search.tx_key, 0, sizeof(search.tx_key));
+    search.tx_key.family = family;
+    search.tx_key.tx_id  = tx_id;
+    if (!(flying_probe = hashtable_find(network->tx_probes, &search))) return;
+
+    // The identifiers are reset whenever a packet cannot be sent, so a late
+    // timestamp may be related to an older packet sharing this identifier.
+    // Such a timestamp predates the queueing of the probe.
+    if (timestamp >= probe_get_queueing_timestamp(flying_probe->probe)) {
+        probe_set_sending_timestamp(flying_probe->probe, timestamp);
+        hashtable_take(network->tx_probes, flying_probe);
+        flying_probe->is_tx_indexed = false;
+    }
+}
+
+/**
+ * \brief Fetch the transmit timestamps reported so far by the kernel.
+ *    This must be done before matching a reply so that its RTT relies
+ *    on the timestamp of the kernel. Both timestamps are then converted
+ *    with almost the same offset between CLOCK_REALTIME and the
+ *    timestamps (see timestamp_from_realtime), so the RTT is as accurate
+ *    as the wall clock between the sending and the reception.
+ * \param network The network layer.
+ */
+
+static void network_process_tx_timestamps(network_t * network) {
+    if (network->tx_probes) {
+        socketpool_process_tx_timestamps(
+            network->socketpool,
+            (void (*)(int, uint32_t, timestamp_t, void *)) network_tx_timestamp_callback,
+            network
+        );
+    }
+}
+
+/**
+ * \brief Handler called by the sniffer to allow the network layer
+ *    to process sniffed packets.
+ * \param packets The sniffed packets
+ * \param num_packets The number of sniffed packets
+ * \param recvq The receive queue of the network layer
+ */
+
+static bool network_sniffer_callback(packet_t ** packets, size_t num_packets, void * recvq) {
+    return queue_push_elements((queue_t *) recvq, (void **) packets, num_packets);
+}
+
+/**
+ * \brief Debug function. Dump tags of every flying probes
+ * \param network The queried network layer
+ */
+
+static void network_flying_probes_dump(network_t * network) {
+    flying_probe_t * flying_probe;
+    uint32_t         tag;
+
+    printf("\n%u flying probe(s) :\n", (unsigned int) network->num_flying_probes);
+    for (flying_probe = network->oldest_probe; flying_probe; flying_probe = flying_probe->next) {
+        network_extract_tag(flying_probe->probe, 0, &tag) ?
+            printf(" 0x%x", tag):
+            printf(" (invalid tag)");
+        printf("\n");
+    }
 }
 
 /**
@@ -173,10 +927,10 @@ static double network_get_probe_timeout(const network_t * network, const probe_t
  */
 
 static void itimerspec_set_delay(struct itimerspec * timer, double delay) {
-    time_t delay_sec = (time_t) delay;
+    timestamp_t ns = timestamp_from_seconds(delay);
 
-    timer->it_value.tv_sec     = delay_sec;
-    timer->it_value.tv_nsec    = 1000000 * (delay - delay_sec);
+    timer->it_value.tv_sec     = ns / TIMESTAMP_NSEC_PER_SEC;
+    timer->it_value.tv_nsec    = ns % TIMESTAMP_NSEC_PER_SEC;
     timer->it_interval.tv_sec  = 0;
     timer->it_interval.tv_nsec = 0;
 }
@@ -205,27 +959,6 @@ ERR_INVALID_DELAY:
     return false;
 }
 
-/**
- * \brief Update network->timerfd file descriptor to make it activated
- *   if a timeout occurs for oldest probe.
- * \param network The updated network layer.
- * \return true iif successful
- */
-
-static bool network_update_next_timeout(network_t * network)
-{
-    probe_t * probe;
-    double    next_timeout;
-
-    if ((probe = network_get_oldest_probe(network))) {
-        next_timeout = network_get_probe_timeout(network, probe);
-    } else {
-        // The timer will be disarmed since there is no more flying probes
-        next_timeout = 0;
-    }
-    return update_timer(network->timerfd, next_timeout);
-}
-
 /**
  * \brief Matches a reply with a probe.
  * \param network The queried network layer
@@ -271,77 +1004,58 @@ static probe_t * network_get_matching_probe(network_t * network, const probe_t *
 {
 
     // Suppose we perform a traceroute measurement thanks to IPv4/UDP packet
-    // We encode in the IPv4 checksum the ID of the probe.
+    // We encode in the transport checksum the ID of the probe.
     // Then, we should sniff an IPv4/ICMP/IPv4/UDP packet.
     // The ICMP message carries the begining of our probe packet, so we can
     // retrieve the checksum (= our probe ID) of the second IP layer, which
     // corresponds to the 3rd checksum field of our probe.
-
-    uint16_t   tag_probe, tag_reply;
-    probe_t  * probe;
-    size_t     i, num_flying_probes;
-
-    // XXX
-    /*
-    // Fetch the tag from the reply. Its the 3rd checksum field.
-    if (!(reply_extract_tag(reply, &tag_reply))) {
-        // This is not an IP / ICMP / IP / * reply :(
-        if (network->is_verbose) fprintf(stderr, "Can't retrieve tag from reply\n");
-        return NULL;
-    }
-
-    num_flying_probes = dynarray_get_size(network->probes);
-    for (i = 0; i < num_flying_probes; i++) {
-        probe = dynarray_get_ith_element(network->probes, i);
-
-        // Reply / probe comparison. In our probe packet, the probe ID
-        // is stored in the checksum of the (first) IP layer.
-        if (probe_extract_tag(probe, &tag_probe)) {
-            if (tag_reply == tag_probe) break;
+    //
+    // The reply is looked up in network->flying_probes using this tag,
+    // the quoted destination and the quoted flow. An ICMP echo reply is
+    // looked up using its source and its ICMP identifier and sequence
+    // number. A TCP reply sent by the destination is matched with the
+    // oldest flying probe of its flow (see tcp_flow_t).
+    // protocol->matches is only used to check the candidate.
+
+    flying_probe_t   query;
+    flying_probe_t * flying_probe = NULL;
+    tcp_flow_t       tcp_query,
+                   * tcp_flow;
+    probe_t        * probe;
+    double           rtt;
+
+    memset(&query.key, 0, sizeof(flying_probe_key_t));
+    if (network_extract_tcp_key(reply, true, &tcp_query.key)) {
+        if ((tcp_flow = hashtable_find(network->tcp_flows, &tcp_query))) {
+            flying_probe = tcp_flow->oldest;
         }
+    } else if (network_extract_reply_key(reply, &query.key)) {
+        flying_probe = hashtable_find(network->flying_probes, &query);
     }
-    */
-
-    // XXX BEGIN Harcoded ICMP response (JA 17/07/2014)
-    tag_reply = 0; tag_probe = 0; tag_probe++; tag_reply++;
-
-    num_flying_probes = dynarray_get_size(network->probes);
-    for (i = 0; i < num_flying_probes; i++) {
-        probe = dynarray_get_ith_element(network->probes, i);
-
-        // Reply / probe comparison. In our probe packet, the probe ID
-        // is stored in the checksum of the (first) IP layer.
-        if (probe_match((const struct probe_s *)probe, (const struct probe_s *)reply))
-            break;
-    }
-    // XXX END Hardcoded ICMP response
 
-    // No match found if we reached the end of the array
-    if (i == num_flying_probes) {
+    if (!flying_probe
+    || !probe_match((const struct probe_s *) flying_probe->probe, (const struct probe_s *) reply)) {
         if (network->is_verbose) {
-            fprintf(stderr, "network_get_matching_probe: This reply has been discarded: tag = 0x%x.\n", tag_reply);
+            fprintf(stderr, "network_get_matching_probe: This reply has been discarded: tag = 0x%x.\n", query.key.tag);
             network_flying_probes_dump(network);
         }
         return NULL;
     }
 
-    // We delete the corresponding probe
+    // We delete the corresponding probe. Its timeout is cancelled in O(1).
 
     // TODO: ... but it should be kept, for archive purposes, and to match for duplicates...
-    // But we cannot reenable it until we set the probe ID into the
-    // checksum, since probes with same flow_id and different TTL have the
-    // same checksum
+    probe = flying_probe->probe;
 
-    dynarray_del_ith_element(network->probes, i, NULL);
-
-    // The matching probe is the oldest one and there are other probes, update
-    // the timer according to the next unexpired probe timeout.
-    if (i == 0) {
-        if (!(network_update_next_timeout(network))) {
-            fprintf(stderr, "Error while updating timeout\n");
-        }
+    // Adaptive timeout: take this RTT into account
+    if (flying_probe->hop_rtt) {
+        rtt = probe_get_rtt(probe, reply);
+        rtt_estimator_add_sample(&flying_probe->hop_rtt->estimator, rtt);
+        if (flying_probe->path_rtt) rtt_estimator_add_sample(&flying_probe->path_rtt->estimator, rtt);
     }
 
+    network_flying_probe_free(network, flying_probe);
+
     return probe;
 }
 
@@ -352,18 +1066,23 @@ static probe_t * network_get_matching_probe(network_t * network, const probe_t *
 network_t * network_create()
 {
     network_t * network;
+    uint32_t    i;
 
     if (!(network = malloc(sizeof(network_t))))          goto ERR_NETWORK;
     if (!(network->socketpool   = socketpool_create()))  goto ERR_SOCKETPOOL;
     if (!(network->sendq        = queue_create()))       goto ERR_SENDQ;
     if (!(network->recvq        = queue_create()))       goto ERR_RECVQ;
 
-    if ((network->timerfd = timerfd_create(CLOCK_REALTIME, 0)) == -1) {
+    if ((network->timerfd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
         goto ERR_TIMERFD;
     }
 
+    if ((network->pacing_timerfd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
+        goto ERR_PACING_TIMERFD;
+    }
+
 #ifdef USE_SCHEDULING
-    if ((network->scheduled_timerfd = timerfd_create(CLOCK_REALTIME, 0)) == -1) {
+    if ((network->scheduled_timerfd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
         goto ERR_GROUP_TIMERFD;
     }
     if (!(network->scheduled_probes = probe_group_create(network->scheduled_timerfd))) {
@@ -374,14 +1093,79 @@ network_t * network_create()
         goto ERR_SNIFFER;
     }
 
-    if (!(network->probes = dynarray_create())) goto ERR_PROBES;
+    if (!(network->flying_probes = hashtable_create(flying_probe_hash, NULL, flying_probe_compare))) {
+        goto ERR_FLYING_PROBES;
+    }
+    if (!(network->tcp_flows = hashtable_create(tcp_flow_hash, free, tcp_flow_compare))) {
+        goto ERR_TCP_FLOWS;
+    }
+    if (!(network->timeouts = timer_wheel_create(NETWORK_TIMER_TICK, NETWORK_TIMER_NUM_SLOTS, timestamp_now()))) {
+        goto ERR_TIMEOUTS;
+    }
+    if (!(network->rtt_estimators = hashtable_create(rtt_entry_hash, free, rtt_entry_compare))) {
+        goto ERR_RTT_ESTIMATORS;
+    }
+    network->oldest_rtt_entry   = NULL;
+    network->youngest_rtt_entry = NULL;
+
+    if (!(network->tags = tag_allocator_create(NETWORK_NUM_TAGS)))           goto ERR_TAGS;
+    if (!(network->wide_tags = tag_allocator_create(NETWORK_NUM_WIDE_TAGS))) goto ERR_WIDE_TAGS;
+
+    // Index the flying probes by transmit timestamp (if supported)
+    network->tx_probes = NULL;
+    if (socketpool_has_tx_timestamps(network->socketpool)) {
+        if (!(network->tx_probes = hashtable_create(flying_probe_tx_hash, NULL, flying_probe_tx_compare))) {
+            goto ERR_TX_PROBES;
+        }
+    }
+
+    // A null transport checksum means "no checksum" for UDP: forbid the tags
+    // leading to a null checksum.
+    for (i = 0; i < NETWORK_NUM_WIDE_TAGS; i += (1 << 16)) {
+        if (i < NETWORK_NUM_TAGS) tag_allocator_reserve(network->tags, i);
+        tag_allocator_reserve(network->wide_tags, i);
+    }
+
+    network->oldest_probe = NULL;
+    network->youngest_probe = NULL;
+    network->num_flying_probes = 0;
 
-    network->last_tag = 0;
     network->timeout = NETWORK_DEFAULT_TIMEOUT;
+    network->send_batch_size = NETWORK_DEFAULT_SEND_BATCH_SIZE;
+    network->is_sendq_paced = false;
+    network_set_max_pps(network, NETWORK_DEFAULT_MAX_PPS);
+    network->is_timeout_adaptive = false;
+    probe_accessor_init(&network->ttl_accessor, "ttl");
+    probe_accessor_init(&network->src_port_accessor, "src_port");
+
+    // Only keep the ICMP packets that may be replies to our probes. No
+    // probe has been sent so far.
+    network->min_src_port = UINT16_MAX;
+    network->max_src_port = 0;
+    network->min_icmp_id  = UINT16_MAX;
+    network->max_icmp_id  = 0;
+    network->is_filtered  = sniffer_set_filter(
+        network->sniffer,
+        network->min_src_port, network->max_src_port,
+        network->min_icmp_id,  network->max_icmp_id
+    );
+
     network->is_verbose = false;
     return network;
 
-ERR_PROBES:
+ERR_TX_PROBES:
+    tag_allocator_free(network->wide_tags);
+ERR_WIDE_TAGS:
+    tag_allocator_free(network->tags);
+ERR_TAGS:
+    hashtable_free(network->rtt_estimators);
+ERR_RTT_ESTIMATORS:
+    timer_wheel_free(network->timeouts);
+ERR_TIMEOUTS:
+    hashtable_free(network->tcp_flows);
+ERR_TCP_FLOWS:
+    hashtable_free(network->flying_probes);
+ERR_FLYING_PROBES:
     sniffer_free(network->sniffer);
 ERR_SNIFFER:
 #ifdef USE_SCHEDULING
@@ -390,6 +1174,8 @@ ERR_GROUP :
     close(network->scheduled_timerfd);
 ERR_GROUP_TIMERFD :
 #endif
+    close(network->pacing_timerfd);
+ERR_PACING_TIMERFD:
     close(network->timerfd);
 ERR_TIMERFD:
     queue_free(network->recvq, (ELEMENT_FREE) packet_free);
@@ -406,11 +1192,22 @@ ERR_NETWORK:
 void network_free(network_t * network)
 {
     if (network) {
-        dynarray_free(network->probes, (ELEMENT_FREE) probe_free);
+        while (network->oldest_probe) {
+            probe_free(network->oldest_probe->probe);
+            network_flying_probe_free(network, network->oldest_probe);
+        }
+        hashtable_free(network->tx_probes);
+        tag_allocator_free(network->wide_tags);
+        tag_allocator_free(network->tags);
+        timer_wheel_free(network->timeouts);
+        hashtable_free(network->rtt_estimators);
+        hashtable_free(network->tcp_flows);
+        hashtable_free(network->flying_probes);
         close(network->timerfd);
+        close(network->pacing_timerfd);
         sniffer_free(network->sniffer);
         queue_free(network->sendq, (ELEMENT_FREE) probe_free);
-        queue_free(network->recvq, (ELEMENT_FREE) probe_free);
+        queue_free(network->recvq, (ELEMENT_FREE) packet_free);
         socketpool_free(network->socketpool);
 #ifdef USE_SCHEDULING
         probe_group_free(network->scheduled_probes);
@@ -423,6 +1220,20 @@ void network_set_timeout(network_t * network, double new_timeout) {
     network->timeout = new_timeout;
 }
 
+void network_set_is_timeout_adaptive(network_t * network, bool is_timeout_adaptive) {
+    network->is_timeout_adaptive = is_timeout_adaptive;
+}
+
+void network_set_send_batch_size(network_t * network, size_t send_batch_size) {
+    network->send_batch_size = send_batch_size > 0 ? send_batch_size : 1;
+}
+
+void network_set_max_pps(network_t * network, double max_pps) {
+    network->max_pps          = max_pps > 0 ? max_pps : 0;
+    network->send_credit      = 1;
+    network->send_credit_time = timestamp_now();
+}
+
 double network_get_timeout(const network_t * network) {
     return network->timeout;
 }
@@ -435,6 +1246,12 @@ inline int network_get_recvq_fd(network_t * network) {
     return queue_get_fd(network->recvq);
 }
 
+#ifdef USE_PACKET_RING
+inline int network_get_ring_sockfd(network_t * network) {
+    return sniffer_get_ring_sockfd(network->sniffer);
+}
+#else
+
 #ifdef USE_IPV4
 inline int network_get_icmpv4_sockfd(network_t * network) {
     return sniffer_get_icmpv4_sockfd(network->sniffer);
@@ -447,10 +1264,81 @@ inline int network_get_icmpv6_sockfd(network_t * network) {
 }
 #endif
 
+#endif // USE_PACKET_RING
+
 inline int network_get_timerfd(network_t * network) {
     return network->timerfd;
 }
 
+inline int network_get_pacing_timerfd(network_t * network) {
+    return network->pacing_timerfd;
+}
+
+inline bool network_is_sendq_paced(const network_t * network) {
+    return network->is_sendq_paced;
+}
+
+bool network_process_pacing_timer(network_t * network)
+{
+    uint64_t num_expirations;
+
+    network->is_sendq_paced = false;
+    if (read(network->pacing_timerfd, &num_expirations, sizeof(num_expirations)) == -1) {
+        perror("network_process_pacing_timer: Can't read pacing_timerfd");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Update the probes-per-second budget of a network_t instance
+ *    according to the time elapsed since its last update. At most one
+ *    batch of probes can be sent in a row.
+ * \param network The network layer.
+ * \return The number of probes that can be sent right now.
+ */
+
+static size_t network_refill_send_credit(network_t * network)
+{
+    timestamp_t now = timestamp_now();
+
+    network->send_credit += timestamp_diff(network->send_credit_time, now) * network->max_pps;
+    network->send_credit_time = now;
+    if (network->send_credit > network->send_batch_size) {
+        network->send_credit = network->send_batch_size;
+    }
+    return network->send_credit > 0 ? (size_t) network->send_credit : 0;
+}
+
+/**
+ * \brief Pace the sendq until the probes-per-second budget allows
+ *    sending one more probe.
+ * \param network The network layer.
+ * \return true iif successful.
+ */
+
+static bool network_pace_sendq(network_t * network)
+{
+    struct itimerspec timer;
+    double            delay = (1 - network->send_credit) / network->max_pps;
+
+    memset(&timer, 0, sizeof(struct itimerspec));
+    timer.it_value.tv_sec  = (time_t) delay;
+    timer.it_value.tv_nsec = 1000000000 * (delay - timer.it_value.tv_sec);
+
+    // A null it_value would disarm the timer
+    if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0) {
+        timer.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(network->pacing_timerfd, 0, &timer, NULL) == -1) {
+        perror("network_pace_sendq: Can't set pacing_timerfd");
+        return false;
+    }
+    network->is_sendq_paced = true;
+    return true;
+}
+
 #ifdef USE_SCHEDULING
 inline int network_get_group_timerfd(network_t * network) {
     return network->scheduled_timerfd;
@@ -463,6 +1351,7 @@ probe_group_t * network_get_scheduled_probes(network_t * network) {
 
 bool network_tag_probe(network_t * network, probe_t * probe)
 {
+    uint32_t   wide_tag;    // Host-side endianness
     uint16_t   tag,         // Network-side endianness
                checksum;    // Host-side endianness
     size_t     payload_size = probe_get_payload_size(probe);
@@ -472,6 +1361,7 @@ bool network_tag_probe(network_t * network, probe_t * probe)
     // For probes having a payload of size 0 and a "body" field (like icmp)
     layer_t  * last_layer;
     bool       tag_in_body = false;
+    tag_allocator_t * tags;
 
     /* The probe gets assigned a unique tag. Currently we encode it in the UDP
      * checksum, but I guess the tag will be protocol dependent. Also, since the
@@ -483,10 +1373,10 @@ bool network_tag_probe(network_t * network, probe_t * probe)
 
     /* 1) Set payload = tag : this is only possible if both the payload and the
      * checksum have not been set by the user.
-     * We need a list of used tags = in flight... + an efficient way to get a
-     * free one... Also, we need to share tags between several instances ?
-     * randomized tags ? Also, we need to determine how much size we have to
-     * encode information. */
+     * Tags in flight are tracked by network->tags and network->wide_tags, and
+     * released once the probe is answered or has expired. The payload only
+     * compensates the checksum: routers may quote no more than 8 bytes of
+     * the transport header, so it cannot carry the tag. */
 
     if (num_layers < 2 || !(last_layer = probe_get_layer(probe, num_layers - 2))) {
         fprintf(stderr, "network_tag_probe: not enough layer (num_layers = %d)\n", (unsigned int)num_layers);
@@ -500,7 +1390,19 @@ bool network_tag_probe(network_t * network, probe_t * probe)
         tag_in_body = true;
     }
 
-    tag = htons(network_get_available_tag(network));
+    // Allocate a tag not used by any flying probe
+    tags = network_get_tag_allocator(network, probe);
+    if (!tag_allocator_get(tags, &wide_tag)) {
+        fprintf(stderr, "network_tag_probe: too many probes in flight\n");
+        goto ERR_GET_TAG;
+    }
+
+    if (tags == network->wide_tags && !probe_set_wide_tag(probe, wide_tag)) {
+        fprintf(stderr, "Can't set identification\n");
+        goto ERR_PROBE_SET_WIDE_TAG;
+    }
+
+    tag = htons((uint16_t) wide_tag);
 
     // Write the tag at offset zero of the payload
     if (tag_in_body) {
@@ -516,8 +1418,10 @@ bool network_tag_probe(network_t * network, probe_t * probe)
         }
     }
 
-    // Fix checksum to get a well-formed packet
-    if (!(probe_update_checksum(probe))) {
+    // Fix checksum to get a well-formed packet. The tag has been written
+    // by probe_write_*, which update the checksums incrementally whenever
+    // they were up to date (e.g. probes cloned from a finalized skeleton).
+    if (!probe->has_valid_checksum && !(probe_update_checksum(probe))) {
         fprintf(stderr, "Can't update fields\n");
         goto ERR_PROBE_UPDATE_FIELDS;
     }
@@ -557,6 +1461,9 @@ ERR_PROBE_EXTRACT_CHECKSUM:
 ERR_PROBE_UPDATE_FIELDS:
 ERR_PROBE_WRITE_PAYLOAD:
 ERR_INVALID_PAYLOAD:
+ERR_PROBE_SET_WIDE_TAG:
+    tag_allocator_release(tags, wide_tag);
+ERR_GET_TAG:
 ERR_GET_LAYER:
     return false;
 }
@@ -570,7 +1477,7 @@ bool network_send_probe(network_t * network, probe_t * probe)
 #ifdef USE_SCHEDULING
     if (probe_get_delay(probe) == DELAY_BEST_EFFORT) {
 #endif
-        probe_set_queueing_time(probe, get_timestamp());
+        probe_set_queueing_timestamp(probe, timestamp_now());
         return queue_push_element(network->sendq, probe);
 #ifdef USE_SCHEDULING
     } else {
@@ -579,23 +1486,143 @@ bool network_send_probe(network_t * network, probe_t * probe)
 #endif
 }
 
-// TODO This could be replaced by watchers: FD -> action
-bool network_process_sendq(network_t * network)
+/**
+ * \brief Probes cancelled by network_cancel_probes.
+ */
+
+typedef struct {
+    const void * caller; /**< The instance whose probes are cancelled */
+    dynarray_t * probes; /**< The cancelled probes, each of them stored once (NULL if they are not freed) */
+} network_cancel_t;
+
+/**
+ * \brief Check whether a probe must be cancelled, and if so, store it
+ *    in cancel->probes.
+ * \param probe The probe.
+ * \param cancel The network_cancel_t instance.
+ * \return true iif the probe must be cancelled.
+ */
+
+static bool network_cancel_probe(probe_t * probe, network_cancel_t * cancel) {
+    size_t i, num_probes;
+
+    if (probe->caller != cancel->caller) return false;
+
+    // A scheduled probe may also be queued or flying
+    if (cancel->probes) {
+        num_probes = dynarray_get_size(cancel->probes);
+        for (i = 0; i < num_probes; i++) {
+            if (dynarray_get_ith_element(cancel->probes, i) == probe) return true;
+        }
+        dynarray_push_element(cancel->probes, probe);
+    }
+    return true;
+}
+
+size_t network_cancel_probes(network_t * network, const void * caller)
 {
-    probe_t           * probe;
-    packet_t          * packet;
-    size_t              num_flying_probes;
-    struct itimerspec   new_timeout;
+    network_cancel_t   cancel;
+    flying_probe_t   * flying_probe,
+                     * next;
+    size_t             num_probes = 0;
 
-    // Probe skeleton when entering the network layer.
-    // We have to duplicate the probe since the same address of skeleton
-    // may have been passed to pt_send_probe.
-    // => We duplicate this probe in the
-    // network layer registry (network->probes) and then tagged.
+    // If cancel.probes cannot be allocated, the probes are leaked
+    cancel.caller = caller;
+    cancel.probes = dynarray_create();
+
+#ifdef USE_SCHEDULING
+    probe_group_del_probes(network->scheduled_probes, (bool (*)(probe_t *, void *)) network_cancel_probe, &cancel);
+#endif
+    queue_remove_elements(network->sendq, (bool (*)(void *, void *)) network_cancel_probe, &cancel);
+
+    for (flying_probe = network->oldest_probe; flying_probe; flying_probe = next) {
+        next = flying_probe->next;
+        if (network_cancel_probe(flying_probe->probe, &cancel)) {
+            network_flying_probe_free(network, flying_probe);
+        }
+    }
+
+    // Stop ticking once there is no more flying probe
+    if (timer_wheel_get_size(network->timeouts) == 0) {
+        network_set_ticking(network, false);
+    }
+
+    if (cancel.probes) {
+        num_probes = dynarray_get_size(cancel.probes);
+        dynarray_free(cancel.probes, (ELEMENT_FREE) probe_free);
+    }
+    return num_probes;
+}
+
+/**
+ * \brief Make sure that the sniffer filter (see sniffer_set_filter) keeps
+ *    the replies of a probe about to be sent. If needed, the range of
+ *    source ports (UDP, TCP) or of identifiers (ICMP echo) it accepts
+ *    is widened. The identifier of an ICMP echo probe compensates its
+ *    tag (see network_tag_probe), so the probes built from a given
+ *    skeleton carry close identifiers.
+ * \param network The network layer.
+ * \param probe The probe, already tagged.
+ */
+
+static void network_update_filter(network_t * network, const probe_t * probe)
+{
+    const layer_t * transport_layer;
+    uint16_t        value,
+                    min_src_port = network->min_src_port,
+                    max_src_port = network->max_src_port,
+                    min_icmp_id  = network->min_icmp_id,
+                    max_icmp_id  = network->max_icmp_id;
+
+    if (!network->is_filtered) return;
+
+    // Only the errors quoting a UDP or TCP packet are filtered by port,
+    // the echo replies and the errors quoting an ICMP echo by identifier
+    if (!(transport_layer = probe_get_layer(probe, 1)) || !transport_layer->protocol) return;
+    switch (transport_layer->protocol->protocol) {
+        case IPPROTO_UDP:
+        case IPPROTO_TCP:
+            if (!probe_accessor_extract(&network->src_port_accessor, probe, &value)) return;
+            if (min_src_port <= value && value <= max_src_port) return;
+            min_src_port = MIN(min_src_port, value & ~(NETWORK_FILTER_PORT_BLOCK - 1));
+            max_src_port = MAX(max_src_port, value |  (NETWORK_FILTER_PORT_BLOCK - 1));
+            break;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:
+            if (!layer_is_icmp_echo(transport_layer, NULL)) return;
+            memcpy(&value, transport_layer->segment + ICMP_ECHO_IDENTIFIER_OFFSET, sizeof(uint16_t));
+            value = ntohs(value);
+            if (min_icmp_id <= value && value <= max_icmp_id) return;
+            min_icmp_id = MIN(min_icmp_id, value & ~(NETWORK_FILTER_PORT_BLOCK - 1));
+            max_icmp_id = MAX(max_icmp_id, value |  (NETWORK_FILTER_PORT_BLOCK - 1));
+            break;
+        default:
+            return;
+    }
 
-    // Do not free probe at the end of this function.
-    // Its address will be saved in network->probes and freed later.
-    probe = queue_pop_element(network->sendq, NULL);
+    if (!sniffer_set_filter(network->sniffer, min_src_port, max_src_port, min_icmp_id, max_icmp_id)) {
+        // Keep every reply rather than dropping those of this probe
+        min_src_port = min_icmp_id = 0;
+        max_src_port = max_icmp_id = UINT16_MAX;
+        network->is_filtered = sniffer_set_filter(network->sniffer, min_src_port, max_src_port, min_icmp_id, max_icmp_id);
+    }
+    network->min_src_port = min_src_port;
+    network->max_src_port = max_src_port;
+    network->min_icmp_id  = min_icmp_id;
+    network->max_icmp_id  = max_icmp_id;
+}
+
+/**
+ * \brief Tag a probe popped from network->sendq and build the
+ *    corresponding packet.
+ * \param network The network layer
+ * \param probe The probe we're about to send
+ * \return The packet to send, NULL in case of failure
+ */
+
+static packet_t * network_prepare_probe(network_t * network, probe_t * probe)
+{
+    packet_t * packet;
 
     // Tag the probe
     if (!network_tag_probe(network, probe)) {
@@ -614,40 +1641,106 @@ bool network_process_sendq(network_t * network)
     	goto ERR_CREATE_PACKET;
     }
 
-    // Send the packet
-    if (!(socketpool_send_packet(network->socketpool, packet))) {
-        fprintf(stderr, "Can't send packet\n");
-        goto ERR_SEND_PACKET;
+    // The sniffer must keep its replies
+    network_update_filter(network, probe);
+    return packet;
+
+ERR_CREATE_PACKET:
+    network_release_tag(network, probe);
+ERR_TAG_PROBE:
+    return NULL;
+}
+
+/**
+ * \brief Report a probe which could not be sent (or registered) to its
+ *    caller as if it had expired, so that the algorithm does not wait
+ *    for its reply forever. Its tag must have been released.
+ * \param probe The probe.
+ */
+
+static void network_drop_probe(probe_t * probe) {
+    pt_throw(NULL, probe->caller, event_create(PROBE_TIMEOUT, probe, NULL, NULL));
+}
+
+// TODO This could be replaced by watchers: FD -> action
+bool network_process_sendq(network_t * network)
+{
+    probe_t     * probes[SOCKETPOOL_BATCH_SIZE];
+    packet_t    * packets[SOCKETPOOL_BATCH_SIZE];
+    bool          is_sent[SOCKETPOOL_BATCH_SIZE];
+    size_t        i, num_probes, num_packets, num_left = network->send_batch_size, num_popped = 0;
+    timestamp_t   sending_time;
+    bool          ret = true;
+
+    // Enforce the probes-per-second budget (if any)
+    if (network->max_pps > 0) {
+        num_left = MIN(num_left, network_refill_send_credit(network));
     }
 
-    // Update the sending time
-    probe_set_sending_time(probe, get_timestamp());
+    // Probe skeleton when entering the network layer.
+    // We have to duplicate the probe since the same address of skeleton
+    // may have been passed to pt_send_probe.
+    // => We duplicate this probe in the
+    // network layer registry (flying probes) and then tagged.
+
+    // Do not free probes at the end of this function.
+    // Their addresses will be saved in the flying probes and freed later.
+
+    // Pop up to send_batch_size probes, and send them by chunks of
+    // SOCKETPOOL_BATCH_SIZE packets.
+    while (num_left > 0) {
+        num_probes = queue_pop_elements(network->sendq, (void **) probes, MIN(num_left, SOCKETPOOL_BATCH_SIZE));
+        num_left -= num_probes;
+        num_popped += num_probes;
+
+        // Tag the probes and build the corresponding packets. Probes that
+        // cannot be prepared are dropped.
+        for (i = 0, num_packets = 0; i < num_probes; i++) {
+            if ((packets[num_packets] = network_prepare_probe(network, probes[i]))) {
+                probes[num_packets++] = probes[i];
+            } else {
+                network_drop_probe(probes[i]);
+                ret = false;
+            }
+        }
+
+        // Send the packets
+        socketpool_send_packets(network->socketpool, packets, num_packets, is_sent);
+        sending_time = timestamp_now();
+
+        for (i = 0; i < num_packets; i++) {
+            if (!is_sent[i]) {
+                fprintf(stderr, "Can't send packet\n");
+                network_release_tag(network, probes[i]);
+                network_drop_probe(probes[i]);
+                ret = false;
+            } else {
+                // Register this probe in the list of flying probes
+                probe_set_sending_timestamp(probes[i], sending_time);
+                if (!network_flying_probe_create(network, probes[i])) {
+                    fprintf(stderr, "Can't register probe\n");
+                    network_release_tag(network, probes[i]);
+                    network_drop_probe(probes[i]);
+                    ret = false;
+                }
+            }
+        }
 
-    // Register this probe in the list of flying probes
-    if (!(dynarray_push_element(network->probes, probe))) {
-        fprintf(stderr, "Can't register probe\n");
-        goto ERR_PUSH_PROBE;
+        if (num_probes < SOCKETPOOL_BATCH_SIZE) break;
     }
 
-    // We've just sent a probe and currently, this is the only one in transit.
-    // So currently, there is no running timer, prepare timerfd.
-    num_flying_probes = dynarray_get_size(network->probes);
-    if (num_flying_probes == 1) {
-        itimerspec_set_delay(&new_timeout, network_get_timeout(network));
-        if (timerfd_settime(network->timerfd, 0, &new_timeout, NULL) == -1) {
-            fprintf(stderr, "Can't set timerfd\n");
-            goto ERR_TIMERFD;
+    // Wait for the budget to allow the next probe (if any)
+    if (network->max_pps > 0) {
+        network->send_credit -= num_popped;
+        if (network->send_credit < 1
+        &&  queue_get_size(network->sendq) > 0
+        && !network_pace_sendq(network)
+        ) {
+            ret = false;
         }
     }
-    return true;
 
-ERR_TIMERFD:
-ERR_PUSH_PROBE:
-ERR_SEND_PACKET:
-    packet_free(packet);
-ERR_CREATE_PACKET:
-ERR_TAG_PROBE:
-    return false;
+    return ret;
 }
 
 bool network_process_recvq(network_t * network)
@@ -656,17 +1749,22 @@ bool network_process_recvq(network_t * network)
                   * reply;
     packet_t      * packet;
     probe_reply_t * probe_reply;
+    timestamp_t     recv_time;
 
     // Pop the packet from the queue
     if (!(packet = queue_pop_element(network->recvq, NULL))) {
         goto ERR_PACKET_POP;
     }
 
+    // Prefer the reception time reported by the kernel (if any), which
+    // is not delayed by the sniffer and the recvq.
+    recv_time = packet->timestamp ? packet->timestamp : timestamp_now();
+
     // Transform the reply into a probe_t instance
     if(!(reply = probe_wrap_packet(packet))) {
         goto ERR_PROBE_WRAP_PACKET;
     }
-    probe_set_recv_time(reply, get_timestamp());
+    probe_set_recv_timestamp(reply, recv_time);
 
     if (network->is_verbose) {
         printf("Got reply:\n");
@@ -674,7 +1772,8 @@ bool network_process_recvq(network_t * network)
     }
 
     // Find the probe corresponding to this reply
-    // The corresponding pointer (if any) is removed from network->probes
+    // The corresponding pointer (if any) is removed from the flying probes
+    network_process_tx_timestamps(network);
     if (!(probe = network_get_matching_probe(network, reply))) {
         goto ERR_PROBE_DISCARDED;
     }
@@ -710,38 +1809,51 @@ void network_process_sniffer(network_t * network, uint8_t protocol_id) {
     sniffer_process_packets(network->sniffer, protocol_id);
 }
 
-bool network_drop_expired_flying_probe(network_t * network)
-{
-    // Drop every expired probes
-    size_t    i, num_flying_probes = dynarray_get_size(network->probes);
-    bool      ret = false;
-    probe_t * probe;
+/**
+ * \brief Callback called for each flying probe which has expired.
+ * \param node The timer related to the expired probe.
+ * \param network The network layer.
+ */
 
-    // Is there flying probe(s) ?
-    if (num_flying_probes > 0) {
+static void network_flying_probe_expired(timer_wheel_node_t * node, network_t * network) {
+    flying_probe_t * flying_probe = node->element;
+    probe_t        * probe = flying_probe->probe;
 
-        // Iterate on each expired probes (at least the oldest one has expired)
-        for (i = 0 ;i < num_flying_probes; i++) {
-            probe = dynarray_get_ith_element(network->probes, i);
+    // Adaptive timeout: back off (RFC 6298, section 5.5)
+    if (flying_probe->hop_rtt)  rtt_estimator_add_timeout(&flying_probe->hop_rtt->estimator);
+    if (flying_probe->path_rtt) rtt_estimator_add_timeout(&flying_probe->path_rtt->estimator);
 
-            // Some probe may expires very soon and may expire before the next probe timeout
-            // update. If so, the timer will be disarmed and libparistraceroute may freeze.
-            // To avoid this kind of deadlock, we provoke a probe timeout for each probe
-            // expiring in less that EXTRA_DELAY seconds.
-            if (network_get_probe_timeout(network, probe) - EXTRA_DELAY > 0) break;
+    network_flying_probe_free(network, flying_probe);
 
-            // This probe has expired, raise a PROBE_TIMEOUT event.
-            pt_throw(NULL, probe->caller, event_create(PROBE_TIMEOUT, probe, NULL, NULL)); //(ELEMENT_FREE) probe_free));
-        }
+    // This probe has expired, raise a PROBE_TIMEOUT event.
+    pt_throw(NULL, probe->caller, event_create(PROBE_TIMEOUT, probe, NULL, NULL)); //(ELEMENT_FREE) probe_free));
+}
 
-        // Delete the i oldest probes, which have expired.
-        if (i != 0) {
-            dynarray_del_n_elements(network->probes, 0, i, NULL);
-        }
+bool network_drop_expired_flying_probe(network_t * network)
+{
+    uint64_t num_ticks;
+    bool     ret = true;
 
-        ret = network_update_next_timeout(network);
-    } else {
-        fprintf(stderr, "network_drop_expired_flying_probe: a probe has expired, but there are no more flying probes!\n");
+    // Acknowledge the ticks of network->timerfd
+    if (read(network->timerfd, &num_ticks, sizeof(num_ticks)) == -1) {
+        perror("network_drop_expired_flying_probe: Can't read timerfd");
+        ret = false;
+    }
+
+    // Keep the error queues of the socket pool short
+    network_process_tx_timestamps(network);
+
+    // Drop every expired probes
+    timer_wheel_advance(
+        network->timeouts,
+        timestamp_now(),
+        (void (*)(timer_wheel_node_t *, void *)) network_flying_probe_expired,
+        network
+    );
+
+    // Stop ticking once there is no more flying probe
+    if (timer_wheel_get_size(network->timeouts) == 0) {
+        ret &= network_set_ticking(network, false);
     }
 
     return ret;
@@ -762,7 +1874,7 @@ static bool network_process_probe_node(network_t * network, tree_node_t * node,
     probe = (probe_t *) (tree_node_probe->data.probe);
     //TODO packet_from_probe must manage generator
 
-    probe_set_queueing_time(probe, get_timestamp());
+    probe_set_queueing_timestamp(probe, timestamp_now());
     if (!(queue_push_element(network->sendq, probe)))                   goto ERR_QUEUE_PUSH;
     /*
     probe_set_left_to_send(probe, probe_get_left_to_send(probe) - 1);
@@ -23,8 +23,13 @@
 #include "socketpool.h"  // socketpool_t
 #include "sniffer.h"     // sniffer_t
 #include "dynarray.h"    // dynarray_t
+#include "containers/hashtable.h" // hashtable_t
+#include "timer_wheel.h" // timer_wheel_t
+#include "tag_allocator.h" // tag_allocator_t
 #include "options.h"     // option_t
 #include "probe_group.h" // probe_group_t
+#include "probe_accessor.h" // probe_accessor_t
+#include "rtt_estimator.h" // rtt_estimator_t
 
 // If no matching reply has been sniffed in the next 3 sec, we
 // consider that we won't never sniff such a reply. The
@@ -35,6 +40,33 @@
 #define OPTIONS_NETWORK_WAIT {NETWORK_DEFAULT_TIMEOUT, 0, INT_MAX}
 #define HELP_w "Set the number of seconds to wait for response to a probe (default is 5.0)"
 
+// In adaptive mode, the timeout of each probe is derived from the RTTs
+// observed towards the same destination and TTL (RFC 6298), and is
+// bounded by NETWORK_MIN_ADAPTIVE_TIMEOUT and network->timeout.
+
+#define NETWORK_MIN_ADAPTIVE_TIMEOUT 0.2
+
+// Maximum number of RTT estimators kept in adaptive mode. Beyond this
+// bound, the least recently used estimators are forgotten (unless a
+// flying probe refers to them).
+
+#define NETWORK_MAX_RTT_ESTIMATORS 4096
+#define HELP_adaptive_wait "Derive the timeout of each probe from the RTTs previously observed towards the same destination and TTL (the --wait timeout remains the upper bound)"
+
+// Maximum number of probes popped from the sendq and sent in a row
+// (using sendmmsg if available) whenever the sendq is activated.
+
+#define NETWORK_DEFAULT_SEND_BATCH_SIZE 32
+#define OPTIONS_NETWORK_SEND_BATCH_SIZE {NETWORK_DEFAULT_SEND_BATCH_SIZE, 1, 1024}
+#define HELP_send_batch "Set the maximum number of probes sent in a row (default is 32)"
+
+// Maximum number of probes sent per second by a network_t instance, shared
+// by every algorithm instance running in the same pt_loop_t (0: unlimited).
+
+#define NETWORK_DEFAULT_MAX_PPS 0
+#define OPTIONS_NETWORK_MAX_PPS {NETWORK_DEFAULT_MAX_PPS, 0, INT_MAX}
+#define HELP_max_pps "Set the maximum number of probes sent per second (default is 0: unlimited)"
+
 /**
  * \struct network_t
  * \brief Structure describing a network
@@ -97,8 +129,8 @@
 //
 // The network layer..has to free its probe_t and packet_t by itself in
 // network_free().  Each probe_t instance is only referenced once (either in
-// network->sendq if it is not yet sent, or either in network->probes if it is
-// in flight).
+// network->sendq if it is not yet sent, or either in the flying probes if it
+// is in flight).
 //
 // Matching probes (see network_get_matching_probe) must be freed once
 // duplicated and raised to the upper layers, or move in a dedicated
@@ -109,10 +141,34 @@ typedef struct network_s {
     queue_t       * sendq;             /**< Queue containing packet to send  (probe_t instances) */
     queue_t       * recvq;             /**< Queue containing received packet (packet_t instances) */
     sniffer_t     * sniffer;           /**< Sniffer to use on this network */
-    dynarray_t    * probes;            /**< Probes in transit, from the oldest probe_t instance to the youngest one. */
-    int             timerfd;           /**< Used for probe timeouts. Linux specific. Activated when a probe timeout occurs */
-    uint16_t        last_tag;          /**< Last probe ID used */
+    struct flying_probe_s * oldest_probe;   /**< Probes in transit, from the oldest probe_t instance to the youngest one. */
+    struct flying_probe_s * youngest_probe; /**< Last probe in transit */
+    size_t          num_flying_probes; /**< Number of probes in transit */
+    hashtable_t   * flying_probes;     /**< Probes in transit, indexed by (tag, destination, flow) to match replies in O(1) */
+    hashtable_t   * tcp_flows;         /**< Flows of the TCP probes in transit, to match the TCP replies of the destination in O(1) */
+    timer_wheel_t * timeouts;          /**< Deadlines of the probes in transit */
+    int             timerfd;           /**< Used for probe timeouts. Linux specific. Ticks periodically while probes are in transit */
+    tag_allocator_t * tags;            /**< Probe IDs in use, encoded in the transport checksum */
+    tag_allocator_t * wide_tags;       /**< Probe IDs in use, encoded in the transport checksum and the IP identification (IPv4) */
     double          timeout;           /**< The timeout value used by this network (in seconds) */
+    size_t          send_batch_size;   /**< Maximum number of probes sent per network_process_sendq call */
+    double          max_pps;           /**< Maximum number of probes sent per second (0: unlimited) */
+    double          send_credit;       /**< Number of probes that can be sent right now (if max_pps > 0) */
+    timestamp_t     send_credit_time;  /**< Last time send_credit has been updated */
+    int             pacing_timerfd;    /**< Armed when the sendq waits for send_credit. Linux specific */
+    bool            is_sendq_paced;    /**< true iif the sendq must not be processed until pacing_timerfd expires */
+    bool            is_timeout_adaptive; /**< true iif the timeout of each probe is derived from the observed RTTs */
+    hashtable_t   * rtt_estimators;    /**< RTTs observed per destination and per (destination, TTL) (see network_get_probe_timeout) */
+    struct rtt_entry_s * oldest_rtt_entry;   /**< Entries of rtt_estimators unused by the flying probes, from the least recently used one... */
+    struct rtt_entry_s * youngest_rtt_entry; /**< ... to the most recently used one */
+    probe_accessor_t ttl_accessor;     /**< Precompiled "ttl" field of the probes */
+    probe_accessor_t src_port_accessor; /**< Precompiled "src_port" field of the probes */
+    bool            is_filtered;       /**< true iif the sniffer drops the ICMP packets unrelated to our probes (see sniffer_set_filter) */
+    uint16_t        min_src_port;      /**< Lowest source port accepted by the sniffer filter */
+    uint16_t        max_src_port;      /**< Highest source port accepted by the sniffer filter */
+    uint16_t        min_icmp_id;       /**< Lowest ICMP echo identifier accepted by the sniffer filter */
+    uint16_t        max_icmp_id;       /**< Highest ICMP echo identifier accepted by the sniffer filter */
+    hashtable_t   * tx_probes;         /**< Flying probes awaiting their transmit timestamp, indexed by (family, tx_id) (NULL if the kernel does not report them) */
 #ifdef USE_SCHEDULING
     int             scheduled_timerfd; /**< Used for probe delays. Activated when a probe delay occurs */
     probe_group_t * scheduled_probes;  /**< Scheduled probes */
@@ -128,6 +184,27 @@ typedef struct network_s {
 
 double options_network_get_timeout();
 
+/**
+ * \brief Retrieve the send batch size passed in the command-line.
+ * \return The maximum number of probes sent in a row.
+ */
+
+size_t options_network_get_send_batch_size();
+
+/**
+ * \brief Retrieve the probes-per-second budget passed in the command-line.
+ * \return The maximum number of probes sent per second (0: unlimited).
+ */
+
+double options_network_get_max_pps();
+
+/**
+ * \brief Retrieve whether the adaptive timeout has been enabled in the command-line.
+ * \return true iif the timeout of each probe is derived from the observed RTTs.
+ */
+
+bool options_network_get_is_timeout_adaptive();
+
 /**
  * \brief Get the commandline options related to the layer network
  * \returna pointer to a tructure containing the options
@@ -181,6 +258,36 @@ void network_set_is_verbose(network_t * network, bool verbose);
 
 void network_set_timeout(network_t * network, double new_timeout);
 
+/**
+ * \brief Enable or disable the adaptive timeout. If enabled, the network
+ *    layer keeps RFC 6298 estimators of the RTTs observed per destination
+ *    and per (destination, TTL), and waits for the reply of a probe during
+ *    the corresponding RTO. The timeout set by network_set_timeout() is
+ *    used if no RTT has been observed yet, and always bounds the RTO.
+ * \param network The network layer.
+ * \param is_timeout_adaptive Pass true to enable the adaptive timeout.
+ */
+
+void network_set_is_timeout_adaptive(network_t * network, bool is_timeout_adaptive);
+
+/**
+ * \brief Set the maximum number of probes sent in a row whenever
+ *    the sendq is activated.
+ * \param network The network layer.
+ * \param send_batch_size The new batch size (must be greater than 0).
+ */
+
+void network_set_send_batch_size(network_t * network, size_t send_batch_size);
+
+/**
+ * \brief Set the maximum number of probes sent per second. This budget
+ *    is shared by every algorithm instance using this network layer.
+ * \param network The network layer.
+ * \param max_pps The new budget. Pass 0 to disable pacing.
+ */
+
+void network_set_max_pps(network_t * network, double max_pps);
+
 /**
  * \brief Retrieve the file descriptor activated whenever a
  *   packet is ready to be sent.
@@ -226,6 +333,34 @@ int network_get_timerfd(network_t * network);
 
 int network_get_group_timerfd(network_t * network);
 
+/**
+ * \brief Retrieve the file descriptor activated whenever the sendq
+ *    can be processed again (see network_is_sendq_paced).
+ * \param network The network layer.
+ * \return The corresponding file descriptor
+ */
+
+int network_get_pacing_timerfd(network_t * network);
+
+/**
+ * \brief Test whether the probes-per-second budget is exhausted while
+ *    probes are waiting in the sendq. In this case, the sendq must not be
+ *    processed until network_process_pacing_timer() is called.
+ * \param network The network layer.
+ * \return true iif the sendq is paced.
+ */
+
+bool network_is_sendq_paced(const network_t * network);
+
+/**
+ * \brief Acknowledge the expiration of network->pacing_timerfd. This
+ *    function must be called whenever this file descriptor is activated.
+ * \param network The network layer.
+ * \return true iif successful.
+ */
+
+bool network_process_pacing_timer(network_t * network);
+
 /**
  * \brief Retrieve the tree of probes handled by this
  *   network instance
@@ -236,7 +371,8 @@ int network_get_group_timerfd(network_t * network);
 probe_group_t * network_get_group_probes(network_t * network);
 
 /**
- * \brief Send the next packet stored network->sendq
+ * \brief Send the next packets stored network->sendq (at most
+ *    network->send_batch_size packets).
  * \param network The network layer..
  * \return true iif successfull
  */
@@ -256,16 +392,17 @@ bool network_process_recvq(network_t * network);
  * \brief Make the network layer..query its embedded sniffer instance in order
  *   to fetch a received packet.
  * \param network The network layer..
- * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6).
+ *   It is ignored if USE_PACKET_RING is defined (see sniffer_process_packets).
  */
 
 void network_process_sniffer(network_t * network, uint8_t protocol_id);
 
 /**
- * \brief Drop the oldest flying probe (if any) attached to a network_t
- *    instance. The oldest probe is removed from network->probes
- *    and network->timerfd is refreshed to manage the next timeout
- *    if there is still at least one flying probe.
+ * \brief Drop every expired flying probe (if any) attached to a network_t
+ *    instance. This function must be called whenever network->timerfd
+ *    ticks. A PROBE_TIMEOUT event is raised for each expired probe, and
+ *    network->timerfd is disarmed once there is no more flying probe.
  * \param network The network layer.
  * \return true iif successful
  */
@@ -279,6 +416,18 @@ bool network_drop_expired_flying_probe(network_t * network);
 
 bool network_send_probe(network_t * network, probe_t * probe);
 
+/**
+ * \brief Cancel the probes sent by an algorithm instance: they are
+ *    removed from the scheduled probes, the sendq and the flying probes,
+ *    and then freed. No event is raised to this instance anymore, so it
+ *    can be safely released.
+ * \param network The network layer.
+ * \param caller The algorithm instance (see probe_get_caller).
+ * \return The number of cancelled probes.
+ */
+
+size_t network_cancel_probes(network_t * network, const void * caller);
+
 #ifdef USE_SCHEDULING
 
 /**
@@ -317,6 +466,17 @@ bool network_update_scheduled_timer(network_t * network, double delay);
 // TODO move this outside network
 bool update_timer(int timerfd, double delay);
 
+#ifdef USE_PACKET_RING
+/**
+ * \brief Retrieve the socket file descriptor related to the AF_PACKET
+ *    socket managed by network->sniffer.
+ * \param network The network layer..
+ * \return The corresponding socket file descriptor.
+ */
+
+int network_get_ring_sockfd(network_t * network);
+#else
+
 #ifdef USE_IPV4
 /**
  * \brief Retrieve the socket file descriptor related to the ICMPv4
@@ -339,4 +499,6 @@ int network_get_icmpv4_sockfd(network_t * network);
 int network_get_icmpv6_sockfd(network_t * network);
 #endif
 
+#endif // USE_PACKET_RING
+
 #endif
@@ -184,6 +184,14 @@ bool options_add_common(options_t * options, char * version)
 
 int options_parse(options_t * options, const char * usage, char ** args)
 {
+    option_t end_opt_specs = END_OPT_SPECS;
+    int      ret;
+
+    // opt_parse expects an array terminated by END_OPT_SPECS, which is not
+    // guaranteed if the vector is full.
+    if (!vector_push_element(options->optspecs, &end_opt_specs)) return 0;
     opt_options1st();
-    return opt_parse(usage, (struct opt_spec *)(options->optspecs->cells), args);
+    ret = opt_parse(usage, (struct opt_spec *)(options->optspecs->cells), args);
+    vector_del_ith_element(options->optspecs, vector_get_num_cells(options->optspecs) - 1);
+    return ret;
 }
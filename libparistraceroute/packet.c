@@ -50,6 +50,8 @@ packet_t * packet_dup(const packet_t * packet) {
         if (packet->dst_ip) {
             if (!(ret->dst_ip = address_dup(packet->dst_ip))) goto ERR_DST_IP_DUP;
         } else ret->dst_ip = NULL;
+        ret->timestamp = packet->timestamp;
+        ret->tx_id     = packet->tx_id;
     }
 
     return ret;
@@ -8,6 +8,7 @@
 
 #include "buffer.h"    // buffer_t
 #include "address.h"   // address_t
+#include "timestamp.h" // timestamp_t
 
 /**
  * \struct packet_t
@@ -21,6 +22,9 @@ typedef struct packet_s {
     // to send the packet.
 
     address_t * dst_ip;   /**< Destination address (mandatory) */
+
+    timestamp_t timestamp; /**< Sniffed packets: reception time reported by the kernel (0 if unknown) */
+    uint32_t    tx_id;     /**< Sent packets: identifier of its transmit timestamp (see socketpool_process_tx_timestamps) */
 } packet_t;
 
 /**
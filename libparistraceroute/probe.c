@@ -9,6 +9,7 @@
 #include <sys/socket.h>     // AF_INET*
 
 #include "probe.h"          // probe_t
+#include "probe_pool.h"     // probe_pool_recycle
 #include "buffer.h"         // buffer_t
 #include "protocol.h"       // protocol_t
 #include "common.h"         // ELEMENT_FREE
@@ -176,6 +177,8 @@ bool probe_update_checksum(probe_t * probe)
              * layer_prev;
     buffer_t * pseudo_header;
 
+    probe->has_valid_checksum = false;
+
     // Update each layers from the (last - 1) one to the first one.
     for (j = 0; j < num_layers; j++) {
         i = num_layers - j - 1;
@@ -220,9 +223,74 @@ bool probe_update_checksum(probe_t * probe)
             if (pseudo_header) buffer_free(pseudo_header);
         }
     }
+    probe->has_valid_checksum = true;
     return true;
 }
 
+#ifdef USE_CHECKSUM_VERIFICATION
+/**
+ * \brief Compare the checksums of a probe with a full computation.
+ * \param probe The probe we're checking
+ * \return true iif the checksums are correct.
+ */
+
+static bool probe_verify_checksum(probe_t * probe) {
+    size_t    size = probe_get_size(probe);
+    uint8_t * bytes;
+    bool      ret;
+
+    if (!(bytes = malloc(size))) return false;
+    memcpy(bytes, packet_get_bytes(probe->packet), size);
+    probe_update_checksum(probe);
+    if (!(ret = (memcmp(bytes, packet_get_bytes(probe->packet), size) == 0))) {
+        fprintf(stderr, "probe_verify_checksum: incremental checksum mismatch\n");
+    }
+    free(bytes);
+    return ret;
+}
+#endif
+
+bool probe_update_checksum_incremental(probe_t * probe, size_t depth, size_t offset, const void * old_bytes, size_t num_bytes)
+{
+    size_t          i, j;
+    const layer_t * altered_layer;
+    layer_t       * layer;
+    const uint8_t * altered_bytes;
+
+    if (!probe->has_valid_checksum) goto ERR_INVALID_CHECKSUM;
+    if (depth >= probe_get_num_layers(probe)) goto ERR_INVALID_DEPTH;
+
+    altered_layer = probe_get_layer(probe, depth);
+    altered_bytes = altered_layer->segment + offset;
+    if (memcmp(old_bytes, altered_bytes, num_bytes) == 0) return true;
+
+    // Update each layer covering the altered bytes from the innermost one.
+    for (j = 0; j <= depth; j++) {
+        i = depth - j;
+        layer = probe_get_layer(probe, i);
+        if (!layer->protocol) continue;
+
+        if (layer->protocol->update_checksum) {
+            if (!layer->protocol->update_checksum(layer->segment, altered_bytes - layer->segment, old_bytes, num_bytes)) {
+                goto ERR_UPDATE_CHECKSUM;
+            }
+        } else if (layer->protocol->write_checksum) {
+            goto ERR_UPDATE_CHECKSUM;
+        }
+    }
+
+#ifdef USE_CHECKSUM_VERIFICATION
+    probe_verify_checksum(probe);
+#endif
+    return true;
+
+ERR_UPDATE_CHECKSUM:
+ERR_INVALID_DEPTH:
+    probe->has_valid_checksum = false;
+ERR_INVALID_CHECKSUM:
+    return false;
+}
+
 layer_t * probe_get_layer(const probe_t * probe, size_t i) {
     return dynarray_get_ith_element(probe->layers, i);
 }
@@ -317,6 +385,7 @@ static bool probe_packet_resize(probe_t * probe, size_t size)
     }
 
     // TODO update bitfield
+    probe->has_valid_checksum = false;
 
     // Update each layer's segment
     for (i = 0; i < num_layers; i++) {
@@ -379,6 +448,7 @@ probe_t * probe_dup(const probe_t * probe)
     ret->queueing_time = probe->queueing_time;
     ret->recv_time     = probe->recv_time;
     ret->caller        = probe->caller;
+    ret->has_valid_checksum = probe->has_valid_checksum;
 #ifdef USE_SCHEDULING
     ret->delay         = probe->delay ? field_dup(probe->delay): NULL;
 #endif
@@ -398,6 +468,7 @@ ERR_PACKET_DUP:
 void probe_free(probe_t * probe)
 {
     if (probe) {
+        if (probe->pool && probe_pool_recycle(probe->pool, probe)) return;
 //        bitfield_free(probe->bitfield);
         probe_layers_free(probe);
         if (probe->packet) {
@@ -583,6 +654,7 @@ bool probe_set_protocols(probe_t * probe, const char * name1, ...)
 
     // Remove the former layer structure
     probe_layers_clear(probe);
+    probe->has_valid_checksum = false;
 
     // Set up the new layer structure
     va_start(args, name1);
@@ -701,6 +773,7 @@ bool probe_write_payload(probe_t * probe, const void * bytes, size_t num_bytes)
 bool probe_write_payload_ext(probe_t * probe, const void * bytes, size_t num_bytes, size_t offset)
 {
     layer_t * payload_layer;
+    uint8_t   old_bytes[PROBE_MAX_INCREMENTAL_SIZE];
 
     if (!(payload_layer = probe_get_layer_payload(probe))) {
         goto ERR_PROBE_GET_LAYER_PAYLOAD;
@@ -712,10 +785,20 @@ bool probe_write_payload_ext(probe_t * probe, const void * bytes, size_t num_byt
         }
     }
 
+    if (num_bytes > sizeof(old_bytes) || offset + num_bytes > payload_layer->segment_size) {
+        probe->has_valid_checksum = false;
+    } else {
+        memcpy(old_bytes, payload_layer->segment + offset, num_bytes);
+    }
+
     if (!layer_write_payload_ext(payload_layer, bytes, num_bytes, offset)) {
         goto ERR_LAYER_WRITE_PAYLOAD_EXT;
     }
 
+    if (probe->has_valid_checksum) {
+        probe_update_checksum_incremental(probe, probe_get_num_layers(probe) - 1, offset, old_bytes, num_bytes);
+    }
+
     return true;
 
 ERR_LAYER_WRITE_PAYLOAD_EXT:
@@ -735,15 +818,47 @@ bool probe_update_fields(probe_t * probe)
         && probe_update_checksum(probe);
 }
 
+/**
+ * \brief Retrieve the number of bytes overwritten when a field is set.
+ * \param protocol_field The field.
+ * \return The number of bytes written from protocol_field->offset, 0 if
+ *    unknown (i.e. the field has its own setter).
+ */
+
+static size_t protocol_field_get_written_size(const protocol_field_t * protocol_field) {
+    if (protocol_field->set) return 0;
+#ifdef USE_BITS
+    if (protocol_field->size_in_bits) {
+        return (protocol_field->offset_in_bits + protocol_field->size_in_bits + 7) / 8;
+    }
+#endif
+    return protocol_field_get_size(protocol_field);
+}
+
 bool probe_set_field_ext(probe_t * probe, size_t depth, const field_t * field)
 {
-    bool      ret = false;
-    size_t    i, num_layers = probe_get_num_layers(probe);
-    layer_t * layer;
+    bool                     ret = false;
+    size_t                   i, size, num_layers = probe_get_num_layers(probe);
+    layer_t                * layer;
+    const protocol_field_t * protocol_field;
+    uint8_t                  old_bytes[PROBE_MAX_INCREMENTAL_SIZE];
 
     for (i = depth; i < num_layers; i++) {
         layer = probe_get_layer(probe, i);
+        if (!(protocol_field = layer_get_protocol_field(layer, field->key))) continue;
+
+        // Save the bytes we're overwriting to update the checksums
+        size = protocol_field_get_written_size(protocol_field);
+        if (!size || size > sizeof(old_bytes) || protocol_field->offset + size > layer->segment_size) {
+            probe->has_valid_checksum = false;
+        } else {
+            memcpy(old_bytes, layer->segment + protocol_field->offset, size);
+        }
+
         if (layer_set_field(layer, field)) {
+            if (probe->has_valid_checksum) {
+                probe_update_checksum_incremental(probe, i, protocol_field->offset, old_bytes, size);
+            }
             ret = true;
             break;
         }
@@ -756,13 +871,28 @@ bool probe_set_field(probe_t * probe, const field_t * field) {
 }
 
 bool probe_write_field_ext(probe_t * probe, size_t depth, const char * name, void * bytes, size_t num_bytes) {
-    bool      ret = false;
-    size_t    i, num_layers = probe_get_num_layers(probe);
-    layer_t * layer;
+    bool                     ret = false;
+    size_t                   i, size, num_layers = probe_get_num_layers(probe);
+    layer_t                * layer;
+    const protocol_field_t * protocol_field;
+    uint8_t                  old_bytes[PROBE_MAX_INCREMENTAL_SIZE];
 
     for (i = depth; i < num_layers; i++) {
         layer = probe_get_layer(probe, i);
+        if (!(protocol_field = layer_get_protocol_field(layer, name))) continue;
+
+        // Save the bytes we're overwriting to update the checksums
+        size = protocol_field_get_size(protocol_field);
+        if (size > sizeof(old_bytes) || protocol_field->offset + size > layer->segment_size) {
+            probe->has_valid_checksum = false;
+        } else {
+            memcpy(old_bytes, layer->segment + protocol_field->offset, size);
+        }
+
         if (layer_write_field(layer, name, bytes, num_bytes)) {
+            if (probe->has_valid_checksum) {
+                probe_update_checksum_incremental(probe, i, protocol_field->offset, old_bytes, size);
+            }
             ret = true;
             break;
         }
@@ -786,7 +916,7 @@ bool probe_set_metafield_ext(probe_t * probe, size_t depth, field_t * field)
     }
 
     // We add 24000 to use port to increase chances to traverse firewalls
-    if ((hacked_field = I16("src_port", 24000 + field->value.int16))) {
+    if ((hacked_field = I16("src_port", PROBE_FLOW_ID_OFFSET + field->value.int16))) {
         ret = probe_set_field(probe, hacked_field);
         field_free(hacked_field);
     }
@@ -818,7 +948,7 @@ static field_t * probe_create_metafield_ext(const probe_t * probe, const char *
     // In IPv6, flow_id should be set thanks to probe_set_field
     // We substract 24000 to the port (see probe_set_metafield_ext)
     return probe_extract(probe, "src_port", &src_port) ?
-        IMAX("flow_id", src_port - 24000) :
+        IMAX("flow_id", src_port - PROBE_FLOW_ID_OFFSET) :
         NULL;
 }
 
@@ -857,29 +987,57 @@ void * probe_get_caller(const probe_t * probe) {
 }
 
 void probe_set_sending_time(probe_t * probe, double time) {
-    probe->sending_time = time;
+    probe->sending_time = timestamp_from_seconds(time);
 }
 
 double probe_get_sending_time(const probe_t * probe) {
-    return probe->sending_time;
+    return timestamp_to_seconds(probe->sending_time);
 }
 
 void probe_set_queueing_time(probe_t * probe, double time) {
-    probe->queueing_time = time;
+    probe->queueing_time = timestamp_from_seconds(time);
 }
 
 double probe_get_queueing_time(const probe_t * probe) {
-    return probe->queueing_time;
+    return timestamp_to_seconds(probe->queueing_time);
 }
 
 void probe_set_recv_time(probe_t * probe, double time) {
-    probe->recv_time = time;
+    probe->recv_time = timestamp_from_seconds(time);
 }
 
 double probe_get_recv_time(const probe_t * probe) {
+    return timestamp_to_seconds(probe->recv_time);
+}
+
+inline void probe_set_sending_timestamp(probe_t * probe, timestamp_t timestamp) {
+    probe->sending_time = timestamp;
+}
+
+inline timestamp_t probe_get_sending_timestamp(const probe_t * probe) {
+    return probe->sending_time;
+}
+
+inline void probe_set_queueing_timestamp(probe_t * probe, timestamp_t timestamp) {
+    probe->queueing_time = timestamp;
+}
+
+inline timestamp_t probe_get_queueing_timestamp(const probe_t * probe) {
+    return probe->queueing_time;
+}
+
+inline void probe_set_recv_timestamp(probe_t * probe, timestamp_t timestamp) {
+    probe->recv_time = timestamp;
+}
+
+inline timestamp_t probe_get_recv_timestamp(const probe_t * probe) {
     return probe->recv_time;
 }
 
+double probe_get_rtt(const probe_t * probe, const probe_t * reply) {
+    return timestamp_diff(probe->sending_time, reply->recv_time);
+}
+
 #ifdef USE_SCHEDULING
 bool probe_set_delay(probe_t * probe, field_t * delay)
 {
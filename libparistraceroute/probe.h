@@ -16,8 +16,15 @@
 //#include "bitfield.h"
 #include "dynarray.h"  // dynarray_t
 #include "packet.h"    // packet_t
+#include "timestamp.h" // timestamp_t
 
 #define DELAY_BEST_EFFORT -1 // This MUST be < 0, see network_send_probe
+
+// The flow_id metafield is encoded in src_port (with this offset)
+#define PROBE_FLOW_ID_OFFSET 24000
+
+// Maximum number of altered bytes for which checksums are updated incrementally
+#define PROBE_MAX_INCREMENTAL_SIZE 16
 /**
  * \struct probe_t
  * \brief Structure representing a probe
@@ -32,13 +39,15 @@ typedef struct {
     packet_t   * packet;        /**< The packet we're crafting */
 //    bitfield_t * bitfield;      /**< Bitfield to keep track of modified fields (bits set to 1) vs. default ones (bits set to 0) */
     void       * caller;        /**< Algorithm instance which has created this probe */
-    double       sending_time;  /**< Timestamp set by network layer just after sending the packet (0 if not set) (in micro seconds) */
-    double       queueing_time; /**< Timestamp set by pt_loop just before sending the packet (0 if not set) (in micro seconds) */
-    double       recv_time;     /**< Only set if this instance is related to a reply. Timestamp set by network layer just after sniffing the reply */
+    timestamp_t  sending_time;  /**< Timestamp set by network layer just after sending the packet (0 if not set) (in nano seconds) */
+    timestamp_t  queueing_time; /**< Timestamp set by pt_loop just before sending the packet (0 if not set) (in nano seconds) */
+    timestamp_t  recv_time;     /**< Only set if this instance is related to a reply. Timestamp set by network layer just after sniffing the reply (in nano seconds) */
 #ifdef USE_SCHEDULING
     field_t    * delay;         /**< The time to send this probe */
 #endif
     size_t       left_to_send;  /**< Number of times left to use this probe instance to send packets */
+    struct probe_pool_s * pool; /**< Pool which has allocated this probe (NULL if none), see probe_pool.h */
+    bool         has_valid_checksum; /**< true iif the checksum of every layer is up to date (see probe_update_checksum_incremental) */
 } probe_t;
 
 /**
@@ -56,7 +65,8 @@ probe_t * probe_create();
 probe_t * probe_dup(const probe_t * probe_skel);
 
 /**
- * \brief Free a probe
+ * \brief Free a probe. A probe allocated by a probe pool is given
+ *    back to its pool.
  * \param probe A pointer to a probe_t structure containing the probe
  */
 
@@ -130,6 +140,22 @@ bool probe_write_field(probe_t * probe, const char * name, void * bytes, size_t
 
 bool probe_update_checksum(probe_t * probe);
 
+/**
+ * \brief Update the checksums of a probe once some of its bytes have
+ *   been altered, without recomputing them from scratch (RFC 1624).
+ *   This is only possible if the checksums were up to date before
+ *   these bytes were altered.
+ * \param probe The probe we're updating
+ * \param depth The index of the layer carrying the altered bytes.
+ * \param offset The offset of the altered bytes in this layer.
+ * \param old_bytes The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful. Otherwise, the checksums must be
+ *   updated using probe_update_checksum().
+ */
+
+bool probe_update_checksum_incremental(probe_t * probe, size_t depth, size_t offset, const void * old_bytes, size_t num_bytes);
+
 /**
  * \brief Update 'length', 'checksum' and 'protocol' fields for each
  *   network protocol layer making the probe.
@@ -304,6 +330,9 @@ void probe_set_caller(probe_t * probe, void * caller);
 
 void * probe_get_caller(const probe_t * probe);
 
+// The *_time accessors handle seconds, the *_timestamp ones handle
+// timestamp_t values (see timestamp.h).
+
 void probe_set_sending_time(probe_t * probe, double time);
 
 double probe_get_sending_time(const probe_t * probe);
@@ -316,6 +345,27 @@ void probe_set_recv_time(probe_t * probe, double time);
 
 double probe_get_recv_time(const probe_t * probe);
 
+void probe_set_sending_timestamp(probe_t * probe, timestamp_t timestamp);
+
+timestamp_t probe_get_sending_timestamp(const probe_t * probe);
+
+void probe_set_queueing_timestamp(probe_t * probe, timestamp_t timestamp);
+
+timestamp_t probe_get_queueing_timestamp(const probe_t * probe);
+
+void probe_set_recv_timestamp(probe_t * probe, timestamp_t timestamp);
+
+timestamp_t probe_get_recv_timestamp(const probe_t * probe);
+
+/**
+ * \brief Compute the round-trip time of a probe.
+ * \param probe The probe (its sending timestamp must be set).
+ * \param reply The corresponding reply (its receiving timestamp must be set).
+ * \return The RTT (in seconds).
+ */
+
+double probe_get_rtt(const probe_t * probe, const probe_t * reply);
+
 bool probe_set_delay(probe_t * probe, field_t * delay);
 
 /**
@@ -0,0 +1,168 @@
+#include "use.h"
+#include "config.h"
+
+#include <string.h>         // memset, memcpy, strcmp
+
+#include "probe_accessor.h"
+#include "address.h"        // address_t
+#include "protocol.h"       // protocol_get_field
+
+void probe_accessor_init(probe_accessor_t * accessor, const char * name) {
+    memset(accessor, 0, sizeof(probe_accessor_t));
+    accessor->name = name;
+
+    // TODO: TEMP HACK flow id is encoded in src_port (see probe_set_metafield_ext)
+    if (strcmp(name, "flow_id") == 0) {
+        accessor->key  = "src_port";
+        accessor->bias = PROBE_FLOW_ID_OFFSET;
+    } else {
+        accessor->key  = name;
+    }
+}
+
+bool probe_accessor_compile(probe_accessor_t * accessor, const probe_t * probe) {
+    size_t                   i, num_layers = probe_get_num_layers(probe);
+    const layer_t          * layer;
+    const protocol_field_t * protocol_field;
+
+    accessor->is_compiled = false;
+
+    for (i = 0; i < num_layers && i < PROBE_ACCESSOR_MAX_DEPTH; i++) {
+        layer = probe_get_layer(probe, i);
+        accessor->protocols[i] = layer->protocol;
+        if (!layer->protocol) continue;
+
+        if ((protocol_field = protocol_get_field(layer->protocol, accessor->key))) {
+            // The field must lie in the segment of this layer
+            if (protocol_field->offset + protocol_field_get_size(protocol_field) > layer->segment_size) break;
+
+            accessor->depth          = i;
+            accessor->protocol_field = protocol_field;
+            accessor->is_compiled    = true;
+            break;
+        }
+    }
+
+    return accessor->is_compiled;
+}
+
+/**
+ * \brief Retrieve the layer carrying the field of an accessor, and
+ *    compile it again if the layout of the probe has changed.
+ * \param accessor An initialized accessor.
+ * \param probe A probe.
+ * \return The corresponding layer, NULL if the probe does not carry
+ *    this field.
+ */
+
+static layer_t * probe_accessor_get_layer(probe_accessor_t * accessor, const probe_t * probe) {
+    size_t    i, num_layers = probe_get_num_layers(probe);
+    layer_t * layer;
+
+    if (accessor->is_compiled && accessor->depth < num_layers) {
+        for (i = 0; i <= accessor->depth; i++) {
+            if (probe_get_layer(probe, i)->protocol != accessor->protocols[i]) break;
+        }
+
+        if (i > accessor->depth) {
+            layer = probe_get_layer(probe, accessor->depth);
+            if (accessor->protocol_field->offset + protocol_field_get_size(accessor->protocol_field) <= layer->segment_size) {
+                return layer;
+            }
+        }
+    }
+
+    return probe_accessor_compile(accessor, probe) ?
+        probe_get_layer(probe, accessor->depth) :
+        NULL;
+}
+
+bool probe_accessor_extract(probe_accessor_t * accessor, const probe_t * probe, void * value) {
+    const layer_t * layer;
+    uint16_t        int16;
+
+    if (!(layer = probe_accessor_get_layer(accessor, probe))) goto ERR_GET_LAYER;
+
+    // Hack to convert ipv*_t extracted into address_t value (see probe_extract_ext).
+    switch (accessor->protocol_field->type) {
+#ifdef USE_IPV4
+        case TYPE_IPV4:
+            memset(value, 0, sizeof(address_t));
+            ((address_t *) value)->family = AF_INET;
+            value = &((address_t *) value)->ip.ipv4;
+            break;
+#endif
+#ifdef USE_IPV6
+        case TYPE_IPV6:
+            memset(value, 0, sizeof(address_t));
+            ((address_t *) value)->family = AF_INET6;
+            value = &((address_t *) value)->ip.ipv6;
+            break;
+#endif
+        case TYPE_UINT16:
+            if (accessor->bias) {
+                if (!layer_extract_protocol_field(layer, accessor->protocol_field, &int16)) goto ERR_EXTRACT;
+                int16 -= accessor->bias;
+                memcpy(value, &int16, sizeof(uint16_t));
+                return true;
+            }
+            break;
+        default: break;
+    }
+
+    if (!layer_extract_protocol_field(layer, accessor->protocol_field, value)) goto ERR_EXTRACT;
+    return true;
+
+ERR_EXTRACT:
+ERR_GET_LAYER:
+    return false;
+}
+
+bool probe_accessor_write(probe_accessor_t * accessor, probe_t * probe, const void * value) {
+    layer_t * layer;
+    field_t   field;
+    size_t    offset, size;
+    uint8_t   old_bytes[PROBE_MAX_INCREMENTAL_SIZE];
+
+    if (!(layer = probe_accessor_get_layer(accessor, probe))) goto ERR_GET_LAYER;
+
+    memset(&field, 0, sizeof(field_t));
+    field.key  = accessor->key;
+    field.type = accessor->protocol_field->type;
+
+    switch (field.type) {
+#ifdef USE_IPV4
+        case TYPE_IPV4:
+            field.value.ipv4 = ((const address_t *) value)->ip.ipv4;
+            break;
+#endif
+#ifdef USE_IPV6
+        case TYPE_IPV6:
+            field.value.ipv6 = ((const address_t *) value)->ip.ipv6;
+            break;
+#endif
+        case TYPE_UINT16:
+            memcpy(&field.value.int16, value, sizeof(uint16_t));
+            field.value.int16 += accessor->bias;
+            break;
+        default:
+            memcpy(&field.value, value, field_get_type_size(field.type));
+            break;
+    }
+
+    // Save the bytes we're overwriting to update the checksums
+    offset = accessor->protocol_field->offset;
+    size   = protocol_field_get_size(accessor->protocol_field);
+    if (size > sizeof(old_bytes)) goto ERR_FIELD_TOO_LARGE;
+    memcpy(old_bytes, layer->segment + offset, size);
+
+    if (!layer_set_protocol_field(layer, accessor->protocol_field, &field)) goto ERR_SET_PROTOCOL_FIELD;
+    probe_update_checksum_incremental(probe, accessor->depth, offset, old_bytes, size);
+    return true;
+
+ERR_SET_PROTOCOL_FIELD:
+    probe->has_valid_checksum = false;
+ERR_FIELD_TOO_LARGE:
+ERR_GET_LAYER:
+    return false;
+}
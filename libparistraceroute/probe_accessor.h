@@ -0,0 +1,91 @@
+#ifndef PROBE_ACCESSOR_H
+#define PROBE_ACCESSOR_H
+
+/**
+ * \file probe_accessor.h
+ * \brief Precompiled access to a field of a probe.
+ *
+ * probe_extract() and probe_set_fields() search a field by name in
+ * every layer of the probe, and compare its name with every field of
+ * each protocol. A probe_accessor_t resolves a field name once (index
+ * of the layer and protocol field) and caches it, so that reading or
+ * writing this field in a probe having the same layout is O(1) and
+ * involves no string comparison.
+ *
+ * An accessor is resolved again whenever it is used on a probe whose
+ * layout (the protocols of its layers) differs, so the same accessor
+ * can be used on any probe or reply. It is intended to be stored in
+ * the data of an algorithm instance.
+ */
+
+#include <stdbool.h>        // bool
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint16_t
+
+#include "probe.h"          // probe_t
+#include "protocol_field.h" // protocol_field_t
+
+// Maximum index of the layer carrying a precompiled field
+#define PROBE_ACCESSOR_MAX_DEPTH 8
+
+/**
+ * \struct probe_accessor_t
+ * \brief Structure describing a precompiled field.
+ */
+
+typedef struct {
+    const char             * name;           /**< Name of the field (or metafield, e.g. "flow_id") */
+    const char             * key;            /**< Name of the field actually accessed (e.g. "src_port" for "flow_id") */
+    uint16_t                 bias;           /**< Value added to the accessed field when written (metafields) */
+    bool                     is_compiled;    /**< true iif the following members are set */
+    size_t                   depth;          /**< Index of the layer carrying this field */
+    const protocol_t       * protocols[PROBE_ACCESSOR_MAX_DEPTH]; /**< Protocols of layers 0 to depth (layout for which the accessor is compiled) */
+    const protocol_field_t * protocol_field; /**< The corresponding protocol field (offset, type...) */
+} probe_accessor_t;
+
+/**
+ * \brief Initialize an accessor. It is compiled on its first use.
+ * \param accessor The accessor we're initializing.
+ * \param name The name of the field (e.g. "ttl", "src_ip", "flow_id").
+ *    The string must remain valid while the accessor is used.
+ */
+
+void probe_accessor_init(probe_accessor_t * accessor, const char * name);
+
+/**
+ * \brief Resolve an accessor according to the layout of a probe.
+ * \param accessor An initialized accessor.
+ * \param probe A probe (typically a probe skeleton).
+ * \return true iif this probe carries the field.
+ */
+
+bool probe_accessor_compile(probe_accessor_t * accessor, const probe_t * probe);
+
+/**
+ * \brief Extract the value of a field. This is the counterpart
+ *    of probe_extract().
+ * \param accessor An initialized accessor.
+ * \param probe The queried probe.
+ * \param value A preallocated buffer in which the value is written
+ *    (host-side endianness). IP addresses are extracted in an address_t.
+ * \return true iif successful.
+ */
+
+bool probe_accessor_extract(probe_accessor_t * accessor, const probe_t * probe, void * value);
+
+/**
+ * \brief Write the value of a field. Unlike probe_set_fields(), the
+ *    other fields ("length"...) are not updated. The checksums are
+ *    updated incrementally if they were up to date (see
+ *    probe_update_checksum_incremental), otherwise the network layer
+ *    recomputes them when it tags the probe.
+ * \param accessor An initialized accessor.
+ * \param probe The probe we're updating.
+ * \param value The value we're writing (host-side endianness). IP
+ *    addresses are passed through an address_t.
+ * \return true iif successful.
+ */
+
+bool probe_accessor_write(probe_accessor_t * accessor, probe_t * probe, const void * value);
+
+#endif
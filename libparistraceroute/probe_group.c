@@ -231,6 +231,34 @@ ERR_CHILD_NOT_FOUND:
     return false;
 }
 
+size_t probe_group_del_probes(probe_group_t * probe_group, bool (*match)(probe_t * probe, void * data), void * data) {
+    tree_node_t * root = probe_group_get_root(probe_group),
+                * child;
+    size_t        i, num_children = tree_node_get_num_children(root), num_deleted = 0;
+    double        delay = DBL_MAX;
+
+    // The scheduled probes are the children of the root (see probe_group_add)
+    for (i = num_children; i-- > 0; ) {
+        child = tree_node_get_ith_child(root, i);
+        if (is_probe(child) && match(get_node_data(child)->data.probe, data)) {
+            tree_node_del_ith_child(root, i);
+            free(get_node_data(child));
+            tree_node_free(child, NULL);
+            num_deleted++;
+        }
+    }
+
+    if (num_deleted) {
+        num_children = tree_node_get_num_children(root);
+        for (i = 0; i < num_children; ++i) {
+            delay = MIN(delay, get_node_delay(tree_node_get_ith_child(root, i)));
+        }
+        set_node_delay(root, delay);
+        probe_group_update_delay(probe_group, root);
+    }
+    return num_deleted;
+}
+
 void probe_group_iter_next_scheduled_probes(
     tree_node_t * node,
     void (* callback)(void * param_callback, tree_node_t * node, size_t index),
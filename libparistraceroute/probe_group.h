@@ -72,6 +72,17 @@ bool probe_group_add(probe_group_t * probe_group, probe_t * probe);
 
 bool probe_group_del(probe_group_t * probe_group, tree_node_t * node_caller, size_t index);
 
+/**
+ * \brief Remove the scheduled probes matching a predicate.
+ * \param probe_group A probe_group_t instance.
+ * \param match Function returning true iif a probe must be removed.
+ *    It becomes responsible for the probes it matches (they are not freed).
+ * \param data Data passed to match.
+ * \return The number of removed probes.
+ */
+
+size_t probe_group_del_probes(probe_group_t * probe_group, bool (*match)(probe_t * probe, void * data), void * data);
+
 /**
  * \brief Iterate on scheduled probes of probe_group_t structure.
  * \param node Node to explore.
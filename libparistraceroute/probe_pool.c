@@ -0,0 +1,266 @@
+#include "config.h"
+
+#include <stddef.h>  // ptrdiff_t
+#include <stdlib.h>  // calloc, malloc, realloc, free
+#include <string.h>  // memcpy
+
+#include "probe_pool.h"
+#include "common.h"  // MAX
+
+/**
+ * \brief Test whether the layer table of a probe pool still describes
+ *    its skeleton. The protocol stack of the skeleton may have been
+ *    replaced by another one having the same number of layers and the
+ *    same size, so each layer is compared.
+ * \param probe_pool A probe_pool_t instance.
+ * \return true iif the layer table is up to date.
+ */
+
+static bool probe_pool_has_valid_layers(const probe_pool_t * probe_pool) {
+    const probe_t            * skeleton = probe_pool->skeleton;
+    const uint8_t            * bytes    = packet_get_bytes(skeleton->packet);
+    const layer_t            * layer;
+    const probe_pool_layer_t * cached;
+    size_t                     i;
+
+    if (!probe_pool->layers
+    ||  probe_get_num_layers(skeleton) != probe_pool->num_layers
+    ||  probe_get_size(skeleton)       != probe_pool->packet_size) {
+        return false;
+    }
+
+    for (i = 0; i < probe_pool->num_layers; i++) {
+        layer  = probe_get_layer(skeleton, i);
+        cached = &probe_pool->layers[i];
+        if (layer->protocol        != cached->protocol
+        ||  layer->segment - bytes != (ptrdiff_t) cached->offset
+        ||  layer->segment_size    != cached->segment_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Update the layer table of a probe pool if the structure of its
+ *    skeleton has changed.
+ * \param probe_pool A probe_pool_t instance.
+ * \return true iif successful.
+ */
+
+static bool probe_pool_update_layers(probe_pool_t * probe_pool) {
+    const probe_t      * skeleton    = probe_pool->skeleton;
+    size_t               i,
+                         num_layers  = probe_get_num_layers(skeleton),
+                         packet_size = probe_get_size(skeleton);
+    const uint8_t      * bytes       = packet_get_bytes(skeleton->packet);
+    const layer_t      * layer;
+    probe_pool_layer_t * layers;
+
+    if (probe_pool_has_valid_layers(probe_pool)) {
+        return true;
+    }
+
+    if (!(layers = realloc(probe_pool->layers, num_layers * sizeof(probe_pool_layer_t)))) goto ERR_REALLOC;
+    probe_pool->layers = layers;
+
+    for (i = 0; i < num_layers; i++) {
+        layer = probe_get_layer(skeleton, i);
+        layers[i].protocol     = layer->protocol;
+        layers[i].offset       = layer->segment - bytes;
+        layers[i].segment_size = layer->segment_size;
+    }
+
+    probe_pool->num_layers  = num_layers;
+    probe_pool->packet_size = packet_size;
+    return true;
+
+ERR_REALLOC:
+    return false;
+}
+
+/**
+ * \brief Reset a probe so that it becomes a copy of the skeleton.
+ * \param probe_pool A probe_pool_t instance.
+ * \param probe A probe having the same layers than the skeleton.
+ * \return true iif successful.
+ */
+
+static bool probe_pool_reset_probe(probe_pool_t * probe_pool, probe_t * probe) {
+    const probe_t * skeleton = probe_pool->skeleton;
+    uint8_t       * bytes;
+    layer_t       * layer;
+    size_t          i;
+
+    if (probe_get_num_layers(probe) != probe_pool->num_layers)  goto ERR_NUM_LAYERS;
+    if (!packet_resize(probe->packet, probe_pool->packet_size)) goto ERR_PACKET_RESIZE;
+
+    bytes = packet_get_bytes(probe->packet);
+    memcpy(bytes, packet_get_bytes(skeleton->packet), probe_pool->packet_size);
+
+    for (i = 0; i < probe_pool->num_layers; i++) {
+        layer = probe_get_layer(probe, i);
+        layer->protocol     = probe_pool->layers[i].protocol;
+        layer->segment      = bytes + probe_pool->layers[i].offset;
+        layer->segment_size = probe_pool->layers[i].segment_size;
+    }
+
+    if (probe->packet->dst_ip && skeleton->packet->dst_ip) {
+        memcpy(probe->packet->dst_ip, skeleton->packet->dst_ip, sizeof(address_t));
+    }
+
+    probe->caller        = skeleton->caller;
+    probe->sending_time  = skeleton->sending_time;
+    probe->queueing_time = skeleton->queueing_time;
+    probe->recv_time     = skeleton->recv_time;
+    probe->left_to_send  = 1;
+    probe->has_valid_checksum = skeleton->has_valid_checksum;
+#ifdef USE_SCHEDULING
+    if (probe->delay) field_free(probe->delay);
+    probe->delay = skeleton->delay ? field_dup(skeleton->delay) : NULL;
+#endif
+    return true;
+
+ERR_PACKET_RESIZE:
+ERR_NUM_LAYERS:
+    return false;
+}
+
+/**
+ * \brief Allocate a probe having the same layers than the skeleton.
+ *    Unlike probe_dup, the packet is not parsed.
+ * \param probe_pool A probe_pool_t instance.
+ * \return The newly allocated probe, NULL in case of failure.
+ */
+
+static probe_t * probe_pool_create_probe(probe_pool_t * probe_pool) {
+    probe_t * probe;
+    layer_t * layer;
+    size_t    i;
+
+    if (!(probe = probe_create())) goto ERR_PROBE_CREATE;
+
+    for (i = 0; i < probe_pool->num_layers; i++) {
+        if (!(layer = layer_create())) goto ERR_LAYER_CREATE;
+        if (!dynarray_push_element(probe->layers, layer)) {
+            layer_free(layer);
+            goto ERR_PUSH_LAYER;
+        }
+    }
+
+    return probe;
+
+ERR_PUSH_LAYER:
+ERR_LAYER_CREATE:
+    probe_free(probe);
+ERR_PROBE_CREATE:
+    return NULL;
+}
+
+/**
+ * \brief Release the recycled probes of a probe pool.
+ * \param probe_pool A probe_pool_t instance.
+ */
+
+static void probe_pool_clear(probe_pool_t * probe_pool) {
+    probe_t * probe;
+
+    while (probe_pool->num_probes > 0) {
+        probe = probe_pool->probes[--probe_pool->num_probes];
+        probe->pool = NULL;
+        probe_free(probe);
+    }
+}
+
+/**
+ * \brief Release a probe pool and its recycled probes from the memory.
+ * \param probe_pool A probe_pool_t instance.
+ */
+
+static void probe_pool_destroy(probe_pool_t * probe_pool) {
+    probe_pool_clear(probe_pool);
+    free(probe_pool->probes);
+    free(probe_pool->layers);
+    free(probe_pool);
+}
+
+probe_pool_t * probe_pool_create(const probe_t * skeleton, size_t max_probes) {
+    probe_pool_t * probe_pool;
+
+    if (!(probe_pool = calloc(1, sizeof(probe_pool_t))))                        goto ERR_CALLOC;
+    if (!(probe_pool->probes = malloc(MAX(max_probes, 1) * sizeof(probe_t *)))) goto ERR_PROBES;
+
+    probe_pool->skeleton   = skeleton;
+    probe_pool->max_probes = max_probes;
+    if (!probe_pool_update_layers(probe_pool)) goto ERR_UPDATE_LAYERS;
+    return probe_pool;
+
+ERR_UPDATE_LAYERS:
+    free(probe_pool->probes);
+ERR_PROBES:
+    free(probe_pool);
+ERR_CALLOC:
+    return NULL;
+}
+
+void probe_pool_free(probe_pool_t * probe_pool) {
+    if (probe_pool) {
+        // The skeleton may be released by the owner of the pool
+        probe_pool->is_released = true;
+        probe_pool->skeleton = NULL;
+        probe_pool_clear(probe_pool);
+        if (probe_pool->num_in_use == 0) {
+            probe_pool_destroy(probe_pool);
+        }
+    }
+}
+
+probe_t * probe_pool_get(probe_pool_t * probe_pool) {
+    probe_t * probe = NULL;
+
+    if (!probe_pool_update_layers(probe_pool)) goto ERR_UPDATE_LAYERS;
+
+    // Reuse a recycled probe if any
+    while (!probe && probe_pool->num_probes > 0) {
+        probe = probe_pool->probes[--probe_pool->num_probes];
+        if (!probe_pool_reset_probe(probe_pool, probe)) {
+            probe->pool = NULL;
+            probe_free(probe);
+            probe = NULL;
+        }
+    }
+
+    if (!probe) {
+        if (!(probe = probe_pool_create_probe(probe_pool))) goto ERR_CREATE_PROBE;
+        if (!probe_pool_reset_probe(probe_pool, probe))     goto ERR_RESET_PROBE;
+    }
+
+    probe->pool = probe_pool;
+    probe_pool->num_in_use++;
+    return probe;
+
+ERR_RESET_PROBE:
+    probe_free(probe);
+ERR_CREATE_PROBE:
+ERR_UPDATE_LAYERS:
+    return NULL;
+}
+
+bool probe_pool_recycle(probe_pool_t * probe_pool, probe_t * probe) {
+    probe_pool->num_in_use--;
+    probe->pool = NULL;
+
+    if (probe_pool->is_released) {
+        if (probe_pool->num_in_use == 0) {
+            probe_pool_destroy(probe_pool);
+        }
+        return false;
+    }
+
+    if (probe_pool->num_probes == probe_pool->max_probes) {
+        return false;
+    }
+
+    probe_pool->probes[probe_pool->num_probes++] = probe;
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef PROBE_POOL_H
+#define PROBE_POOL_H
+
+/**
+ * \file probe_pool.h
+ * \brief A probe_pool_t clones a probe skeleton without parsing its
+ *   headers again, and recycles the probes once they are freed.
+ *
+ * probe_dup() duplicates the packet and then parses it again to rebuild
+ * its layers. A probe pool computes once the layer table (protocol,
+ * offset and size of each layer) of its skeleton. Cloning a recycled
+ * probe then only consists in copying the bytes of the skeleton and
+ * resetting the layers from this table.
+ *
+ * A probe returned by probe_pool_get() is released as usual with
+ * probe_free(), which gives it back to its pool. The pool is kept alive
+ * until its owner has called probe_pool_free() and every probe it has
+ * returned has been freed.
+ */
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+
+#include "probe.h"   // probe_t
+
+#define PROBE_POOL_DEFAULT_SIZE 64
+
+/**
+ * \struct probe_pool_layer_t
+ * \brief Describe a layer of the skeleton.
+ */
+
+typedef struct {
+    const protocol_t * protocol;     /**< Protocol of this layer (NULL for the payload) */
+    size_t             offset;       /**< Offset of the segment in the packet */
+    size_t             segment_size; /**< Size of the segment */
+} probe_pool_layer_t;
+
+/**
+ * \struct probe_pool_t
+ * \brief Structure describing a probe pool.
+ */
+
+typedef struct probe_pool_s {
+    const probe_t      * skeleton;    /**< The probe cloned by this pool */
+    probe_pool_layer_t * layers;      /**< Layer table of the skeleton */
+    size_t               num_layers;  /**< Number of layers of the skeleton */
+    size_t               packet_size; /**< Size of the skeleton packet */
+    probe_t           ** probes;      /**< Recycled probes */
+    size_t               num_probes;  /**< Number of recycled probes */
+    size_t               max_probes;  /**< Maximum number of recycled probes */
+    size_t               num_in_use;  /**< Number of probes returned by probe_pool_get() and not yet freed */
+    bool                 is_released; /**< true iif probe_pool_free() has been called */
+} probe_pool_t;
+
+/**
+ * \brief Create a probe pool.
+ * \param skeleton The probe skeleton. It must remain valid until the
+ *    pool is released. Its fields may be altered (each clone copies the
+ *    current bytes of the skeleton).
+ * \param max_probes The maximum number of recycled probes kept by the pool.
+ * \return The newly allocated probe pool, NULL in case of failure.
+ */
+
+probe_pool_t * probe_pool_create(const probe_t * skeleton, size_t max_probes);
+
+/**
+ * \brief Release a probe pool. Probes still in use remain valid, and the
+ *    pool is freed once the last one is freed.
+ * \param probe_pool A probe_pool_t instance.
+ */
+
+void probe_pool_free(probe_pool_t * probe_pool);
+
+/**
+ * \brief Clone the skeleton of a probe pool.
+ * \param probe_pool A probe_pool_t instance.
+ * \return A probe identical to the skeleton, NULL in case of failure.
+ *    It must be released using probe_free().
+ */
+
+probe_t * probe_pool_get(probe_pool_t * probe_pool);
+
+/**
+ * \brief Give back a probe to its pool. This function is called by
+ *    probe_free() and should not be called directly.
+ * \param probe_pool The pool which has returned this probe.
+ * \param probe The probe we're releasing.
+ * \return true iif the probe has been recycled. Otherwise the caller
+ *    must free the probe.
+ */
+
+bool probe_pool_recycle(probe_pool_t * probe_pool, probe_t * probe);
+
+#endif
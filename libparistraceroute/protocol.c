@@ -3,6 +3,7 @@
 #include <string.h>         // strcmp(), ...
 #include "os/search.h"      // tfind(), tdestroy(), twalk(), preorder...
 #include <stdio.h>          // perror()
+#include <arpa/inet.h>      // htons(), ntohs()
 
 #include "protocol.h"
 
@@ -104,6 +105,24 @@ uint16_t csum(const uint16_t * bytes, size_t size) {
     return (uint16_t) ~sum;
 }
 
+uint16_t csum_update(uint16_t checksum, size_t offset, const uint8_t * old_bytes, const uint8_t * new_bytes, size_t num_bytes) {
+    // HC' = ~(~HC + ~m + m'), computed using the network-side endianness.
+    // Each byte is the high (even offset) or low (odd offset) half of a word.
+    uint32_t sum = (uint16_t) ~ntohs(checksum);
+    size_t   i;
+    unsigned shift;
+
+    for (i = 0; i < num_bytes; i++) {
+        shift = ((offset + i) % 2) ? 0 : 8;
+        sum  += (uint16_t) ~(old_bytes[i] << shift);
+        sum  += (uint16_t) (new_bytes[i] << shift);
+        if (sum >> 16) sum = (sum >> 16) + (sum & 0xffff);
+    }
+    sum  = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+    return htons((uint16_t) ~sum);
+}
+
 static inline void callback_protocol_field_dump(const protocol_field_t * protocol_field, void * data) {
     protocol_field_dump(protocol_field);
 }
@@ -58,6 +58,22 @@ typedef struct protocol_s {
 
     buffer_t * (*create_pseudo_header)(const uint8_t * segment);
 
+    /**
+     * \brief Points to a callback which updates the checksum of the segment
+     *    related to this protocol once some of its bytes have been altered,
+     *    without recomputing it from scratch (RFC 1624).
+     * \param segment The address of the segment. The altered bytes are
+     *    already written.
+     * \param offset The offset of the altered bytes in this segment. It may
+     *    exceed the header size if the nested content has been altered.
+     * \param old_bytes The previous value of the altered bytes.
+     * \param num_bytes The number of altered bytes.
+     * \return true if success, false if the checksums must be recomputed
+     *    (e.g. the altered bytes are involved in a pseudo header).
+     */
+
+    bool (*update_checksum)(uint8_t * segment, size_t offset, const uint8_t * old_bytes, size_t num_bytes);
+
     /**
      * Pointer to a protocol_field_t structure holding the header fields
      */
@@ -170,6 +186,33 @@ const protocol_field_t * protocol_get_field(const protocol_t * protocol, const c
 
 uint16_t csum(const uint16_t * buf, size_t size);
 
+/**
+ * \brief Update an Internet checksum once some of the bytes it covers
+ *    have been altered (RFC 1624, eqn. 3).
+ * \param checksum The checksum, as stored in the packet.
+ * \param offset The offset of the altered bytes from the beginning of the
+ *    checksummed bytes (only its parity matters).
+ * \param old_bytes The previous value of the altered bytes.
+ * \param new_bytes The new value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return The updated checksum, as stored in the packet.
+ */
+
+uint16_t csum_update(uint16_t checksum, size_t offset, const uint8_t * old_bytes, const uint8_t * new_bytes, size_t num_bytes);
+
+/**
+ * \brief Check whether altered bytes overlap a field of a header.
+ * \param offset The offset of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \param field_offset The offset of the field.
+ * \param field_size The size of the field.
+ * \return true iif at least one byte of this field is altered.
+ */
+
+static inline bool csum_overlap(size_t offset, size_t num_bytes, size_t field_offset, size_t field_size) {
+    return offset < field_offset + field_size && field_offset < offset + num_bytes;
+}
+
 /**
  * \brief Print information stored in a protocol instance
  * \param protocol A protocol_t instance
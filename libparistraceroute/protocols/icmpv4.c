@@ -123,6 +123,30 @@ bool icmpv4_write_checksum(uint8_t * icmpv4_segment, buffer_t * ipv4_psh)
     return true;
 }
 
+/**
+ * \brief Update the checksum of an ICMP header once some of its bytes
+ *    have been altered (see protocol_t::update_checksum).
+ * \param icmpv4_segment An ICMP header having a valid checksum (regarding the
+ *    previous value of the altered bytes).
+ * \param offset The offset of the altered bytes.
+ * \param old_bytes The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful
+ */
+
+bool icmpv4_update_checksum(uint8_t * icmpv4_segment, size_t offset, const uint8_t * old_bytes, size_t num_bytes)
+{
+    struct icmphdr * icmpv4_header = (struct icmphdr *) icmpv4_segment;
+
+    // See icmpv4_write_checksum: the ICMPv4 checksum only covers the ICMPv4 header
+    if (offset >= sizeof(struct icmphdr)) return true;
+    if (offset + num_bytes > sizeof(struct icmphdr)) return false;
+    if (csum_overlap(offset, num_bytes, offsetof(struct icmphdr, ICMPV4_CHECKSUM), sizeof(icmpv4_header->ICMPV4_CHECKSUM))) return false;
+
+    icmpv4_header->ICMPV4_CHECKSUM = csum_update(icmpv4_header->ICMPV4_CHECKSUM, offset, old_bytes, icmpv4_segment + offset, num_bytes);
+    return true;
+}
+
 const protocol_t * icmpv4_get_next_protocol(const layer_t * icmpv4_layer) {
     const protocol_t * next_protocol = NULL;
     uint8_t            icmpv4_type;
@@ -183,6 +207,7 @@ static protocol_t icmpv4 = {
     .name                 = "icmpv4",
     .protocol             = IPPROTO_ICMP,
     .write_checksum       = icmpv4_write_checksum,
+    .update_checksum      = icmpv4_update_checksum,
     .fields               = icmpv4_fields,
     .write_default_header = icmpv4_write_default_header, // TODO generic
     .get_header_size      = icmpv4_get_header_size,
@@ -123,6 +123,30 @@ bool icmpv6_write_checksum(uint8_t * icmpv6_segment, buffer_t * ipv6_psh)
     return true;
 }
 
+/**
+ * \brief Update the checksum of an ICMPv6 header once some of its bytes
+ *    have been altered (see protocol_t::update_checksum).
+ * \param icmpv6_segment An ICMPv6 header having a valid checksum (regarding the
+ *    previous value of the altered bytes).
+ * \param offset The offset of the altered bytes.
+ * \param old_bytes The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful
+ */
+
+bool icmpv6_update_checksum(uint8_t * icmpv6_segment, size_t offset, const uint8_t * old_bytes, size_t num_bytes)
+{
+    struct icmp6_hdr * icmpv6_header = (struct icmp6_hdr *) icmpv6_segment;
+
+    // See icmpv6_write_checksum: the ICMPv6 checksum only covers the ICMPv6 header
+    if (offset >= sizeof(struct icmp6_hdr)) return true;
+    if (offset + num_bytes > sizeof(struct icmp6_hdr)) return false;
+    if (csum_overlap(offset, num_bytes, offsetof(struct icmp6_hdr, icmp6_cksum), sizeof(icmpv6_header->icmp6_cksum))) return false;
+
+    icmpv6_header->icmp6_cksum = csum_update(icmpv6_header->icmp6_cksum, offset, old_bytes, icmpv6_segment + offset, num_bytes);
+    return true;
+}
+
 const protocol_t * icmpv6_get_next_protocol(const layer_t * icmpv6_layer) {
     const protocol_t * next_protocol = NULL;
     uint8_t            icmpv6_type;
@@ -181,6 +205,7 @@ static protocol_t icmpv6 = {
     .protocol             = IPPROTO_ICMPV6,
     .write_checksum       = icmpv6_write_checksum,
     .create_pseudo_header = ipv6_pseudo_header_create,
+    .update_checksum      = icmpv6_update_checksum,
     .fields               = icmpv6_fields,
     .write_default_header = icmpv6_write_default_header, // TODO generic memcpy + header size
     .get_header_size      = icmpv6_get_header_size,
@@ -154,6 +154,37 @@ bool ipv4_write_checksum(uint8_t * ipv4_header, buffer_t * psh) {
     return true;
 }
 
+/**
+ * \brief Update the checksum of an IP header once some of its bytes
+ *    have been altered (see protocol_t::update_checksum).
+ * \param ipv4_header An IPv4 header having a valid checksum (regarding
+ *    the previous value of the altered bytes).
+ * \param offset The offset of the altered bytes.
+ * \param old_bytes The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful
+ */
+
+bool ipv4_update_checksum(uint8_t * ipv4_header, size_t offset, const uint8_t * old_bytes, size_t num_bytes) {
+	struct iphdr * iph = (struct iphdr *) ipv4_header;
+
+    // The IPv4 checksum only covers the IPv4 header
+    if (offset >= sizeof(struct iphdr)) return true;
+    if (offset + num_bytes > sizeof(struct iphdr)) return false;
+
+    // Those fields are involved in the pseudo header of the nested layer
+    if (csum_overlap(offset, num_bytes, offsetof(struct iphdr, tot_len),  sizeof(iph->tot_len))
+    ||  csum_overlap(offset, num_bytes, offsetof(struct iphdr, protocol), sizeof(iph->protocol))
+    ||  csum_overlap(offset, num_bytes, offsetof(struct iphdr, check),    sizeof(iph->check))
+    ||  csum_overlap(offset, num_bytes, offsetof(struct iphdr, saddr),    sizeof(iph->saddr) + sizeof(iph->daddr))
+    ) {
+        return false;
+    }
+
+    iph->check = csum_update(iph->check, offset, old_bytes, ipv4_header + offset, num_bytes);
+    return true;
+}
+
 //-----------------------------------------------------------
 // IPv4 fields
 //-----------------------------------------------------------
@@ -300,6 +331,7 @@ static protocol_t ipv4 = {
     .protocol             = IPPROTO_IPIP, // XXX only IP over IP (encapsulation). Beware probe.c, icmpv4_get_next_protocol_id
     .write_checksum       = ipv4_write_checksum,
     .create_pseudo_header = NULL,
+    .update_checksum      = ipv4_update_checksum,
     .fields               = ipv4_fields,
     .write_default_header = ipv4_write_default_header, // TODO generic
     .get_header_size      = ipv4_get_header_size,
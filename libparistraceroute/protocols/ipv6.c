@@ -317,11 +317,38 @@ bool ipv6_matches(const struct probe_s * _probe, const struct probe_s * _reply)
     return false;
 }
 
+/**
+ * \brief Check whether an IPv6 header can be altered without recomputing
+ *    the checksum of the nested layer (see protocol_t::update_checksum).
+ *    IPv6 has no checksum, but some of its fields are involved in the
+ *    pseudo header of the nested layer. If one of them is altered,
+ *    false is returned so that the checksum of the nested layer is fully
+ *    recomputed. The previous value of the altered bytes is thus not needed.
+ * \param ipv6_header The IPv6 header.
+ * \param offset The offset of the altered bytes.
+ * \param old_bytes (unused) The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful
+ */
+
+bool ipv6_update_checksum(uint8_t * ipv6_header, size_t offset, const uint8_t * old_bytes __attribute__((__unused__)), size_t num_bytes) {
+    const struct ip6_hdr * iph = (const struct ip6_hdr *) ipv6_header;
+
+    if (offset >= sizeof(struct ip6_hdr)) return true;
+
+    return !(
+        csum_overlap(offset, num_bytes, offsetof(struct ip6_hdr, ip6_plen), sizeof(iph->ip6_plen))
+     || csum_overlap(offset, num_bytes, offsetof(struct ip6_hdr, ip6_nxt),  sizeof(iph->ip6_nxt))
+     || csum_overlap(offset, num_bytes, offsetof(struct ip6_hdr, ip6_src),  sizeof(iph->ip6_src) + sizeof(iph->ip6_dst))
+    );
+}
+
 static protocol_t ipv6 = {
     .name                 = "ipv6",
     .protocol             = IPPROTO_IPV6,
     .write_checksum       = NULL,
     .create_pseudo_header = NULL,
+    .update_checksum      = ipv6_update_checksum,
     .fields               = ipv6_fields,
     .write_default_header = ipv6_write_default_header, // TODO generic with ipv4
     .get_header_size      = ipv6_get_header_size,
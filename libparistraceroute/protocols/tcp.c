@@ -318,6 +318,29 @@ bool tcp_write_checksum(uint8_t * tcp_segment, buffer_t * ip_psh)
     return true;
 }
 
+/**
+ * \brief Update the checksum of a TCP segment once some of its bytes
+ *    have been altered (see protocol_t::update_checksum).
+ * \param tcp_segment A TCP segment having a valid checksum (regarding the
+ *    previous value of the altered bytes).
+ * \param offset The offset of the altered bytes.
+ * \param old_bytes The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful
+ */
+
+bool tcp_update_checksum(uint8_t * tcp_segment, size_t offset, const uint8_t * old_bytes, size_t num_bytes)
+{
+    struct tcphdr * tcp_header = (struct tcphdr *) tcp_segment;
+
+    // See tcp_write_checksum: the TCP checksum covers the TCP header and 2 bytes of payload
+    if (offset >= tcp_get_header_size(tcp_segment) + 2) return true;
+    if (csum_overlap(offset, num_bytes, offsetof(struct tcphdr, CHECKSUM), sizeof(tcp_header->CHECKSUM))) return false;
+
+    tcp_header->CHECKSUM = csum_update(tcp_header->CHECKSUM, offset, old_bytes, tcp_segment + offset, num_bytes);
+    return true;
+}
+
 buffer_t * tcp_create_pseudo_header(const uint8_t * ip_segment)
 {
     buffer_t * buffer = NULL;
@@ -385,6 +408,7 @@ static protocol_t tcp = {
     .protocol             = IPPROTO_TCP,
     .write_checksum       = tcp_write_checksum,
     .create_pseudo_header = tcp_create_pseudo_header,
+    .update_checksum      = tcp_update_checksum,
     .fields               = tcp_fields,
   //.defaults             = tcp_defaults,             // XXX used when generic
     .write_default_header = tcp_write_default_header, // TODO generic
@@ -154,6 +154,33 @@ bool udp_write_checksum(uint8_t * udp_segment, buffer_t * ip_psh)
     return true;
 }
 
+/**
+ * \brief Update the checksum of an UDP segment once some of its bytes
+ *    have been altered (see protocol_t::update_checksum).
+ * \param udp_segment An UDP segment having a valid checksum (regarding the
+ *    previous value of the altered bytes).
+ * \param offset The offset of the altered bytes.
+ * \param old_bytes The previous value of the altered bytes.
+ * \param num_bytes The number of altered bytes.
+ * \return true iif successful
+ */
+
+bool udp_update_checksum(uint8_t * udp_segment, size_t offset, const uint8_t * old_bytes, size_t num_bytes)
+{
+    struct udphdr * udp_header = (struct udphdr *) udp_segment;
+
+    // The UDP checksum covers the UDP header and its content
+    if (offset >= ntohs(udp_header->LENGTH)) return true;
+    if (csum_overlap(offset, num_bytes, offsetof(struct udphdr, CHECKSUM), sizeof(udp_header->CHECKSUM))
+    ||  csum_overlap(offset, num_bytes, offsetof(struct udphdr, LENGTH),   sizeof(udp_header->LENGTH))
+    ) {
+        return false;
+    }
+
+    udp_header->CHECKSUM = csum_update(udp_header->CHECKSUM, offset, old_bytes, udp_segment + offset, num_bytes);
+    return true;
+}
+
 buffer_t * udp_create_pseudo_header(const uint8_t * ip_segment)
 {
     buffer_t * buffer = NULL;
@@ -222,6 +249,7 @@ static protocol_t udp = {
     .protocol             = IPPROTO_UDP,
     .write_checksum       = udp_write_checksum,
     .create_pseudo_header = udp_create_pseudo_header,
+    .update_checksum      = udp_update_checksum,
     .fields               = udp_fields,
   //.defaults             = udp_defaults,             // XXX used when generic
     .write_default_header = udp_write_default_header, // TODO generic
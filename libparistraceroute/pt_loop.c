@@ -20,25 +20,10 @@
 
 #define MAXEVENTS 100
 
-static pt_loop_t * s_loop = NULL; // Needed while we use twalk.
-
 //----------------------------------------------------------------
 // Static functions
 //----------------------------------------------------------------
 
-/**
- * \brief process algorithm events (internal usage, see visitor for twalk)
- * \param node Current instance
- * \param visit Unused
- * \param level Unused
- */
-
-static void pt_process_instance(
-    const void * node,
-    VISIT        visit,
-    int          level
-);
-
 /**
  * \brief Free algorithm instances (internal usage, see visitor for twalk)
  * \param node Current instance
@@ -105,14 +90,39 @@ ERR_FD:
 }
 
 /**
- * \brief Prepare a EFD_SEMAPHORE event_fd.
+ * \brief Enable or disable the notifications of a file descriptor
+ *    registered in Paris Traceroute loop.
+ * \param loop The main loop.
+ * \param fd A file descriptor previously passed to register_efd.
+ * \param is_enabled Pass false to ignore this file descriptor until
+ *    it is enabled again.
+ * \return true iif successful.
+ */
+
+static bool enable_efd(pt_loop_t * loop, int fd, bool is_enabled) {
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.data.fd = fd;
+    event.events = is_enabled ? EPOLLIN : 0;
+
+    if (epoll_ctl(loop->efd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        perror("Error epoll_ctl");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Prepare an event_fd.
+ * \param flags Flags passed to eventfd (e.g. EFD_SEMAPHORE).
  * \return The corresponding file descriptor, -1 in case of failure.
  */
 
-static inline int make_event_fd() {
+static inline int make_event_fd(int flags) {
     int fd;
 
-    if ((fd = eventfd(0, EFD_SEMAPHORE)) == -1) {
+    if ((fd = eventfd(0, flags)) == -1) {
         perror("Error eventfd");
     }
     return fd;
@@ -212,6 +222,23 @@ static void pt_process_algorithms_terminate(const void * node, VISIT visit, int
     pt_throw(NULL, instance, event_create(ALGORITHM_TERM, NULL, NULL, NULL));
 }
 
+#ifdef USE_CACHE
+/**
+ * \brief Called by loop->resolver whenever a reverse lookup completes.
+ *    Raises the corresponding NAME_RESOLVED event to the user handler.
+ * \param address The resolved address.
+ * \param loop The main loop.
+ */
+
+static void pt_loop_name_resolved(const address_t * address, void * loop) {
+    address_t * resolved;
+
+    if ((resolved = address_dup(address))) {
+        pt_throw(loop, NULL, event_create(NAME_RESOLVED, resolved, NULL, (ELEMENT_FREE) address_free));
+    }
+}
+#endif
+
 //----------------------------------------------------------------
 // Non static functions
 //----------------------------------------------------------------
@@ -230,11 +257,12 @@ pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *),
     }
 
     // Prepare algorithm events fd and register it in loop->efd
-    if ((loop->eventfd_algorithm = make_event_fd()) == -1) goto ERR_MAKE_EVENTFD_ALGORITHM;
+    // A single read resets this counter, see pt_process_ready_instances()
+    if ((loop->eventfd_algorithm = make_event_fd(0)) == -1) goto ERR_MAKE_EVENTFD_ALGORITHM;
     if (!register_efd(loop, loop->eventfd_algorithm))      goto ERR_EVENTFD_ALGORITHM;
 
     // Prepare user events fd and register it in loop->efd
-    if ((loop->eventfd_user = make_event_fd()) == -1)      goto ERR_MAKE_EVENTFD_USER;
+    if ((loop->eventfd_user = make_event_fd(EFD_SEMAPHORE)) == -1) goto ERR_MAKE_EVENTFD_USER;
     if (!register_efd(loop, loop->eventfd_user))           goto ERR_EVENTFD_USER;
 
     // Signal processing
@@ -245,14 +273,26 @@ pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *),
     if (!(loop->network = network_create()))                           goto ERR_NETWORK_CREATE;
     if (!register_efd(loop, network_get_sendq_fd(loop->network)))      goto ERR_EVENTFD_SENDQ;
     if (!register_efd(loop, network_get_recvq_fd(loop->network)))      goto ERR_EVENTFD_RECVQ;
+#ifdef USE_PACKET_RING
+    if (!register_efd(loop, network_get_ring_sockfd(loop->network)))   goto ERR_EVENTFD_SNIFFER_RING;
+#else
 #ifdef USE_IPV4
     if (!register_efd(loop, network_get_icmpv4_sockfd(loop->network))) goto ERR_EVENTFD_SNIFFER_ICMPV4;
 #endif
 #ifdef USE_IPV6
     if (!register_efd(loop, network_get_icmpv6_sockfd(loop->network))) goto ERR_EVENTFD_SNIFFER_ICMPV6;
+#endif
 #endif
     if (!register_efd(loop, network_get_timerfd(loop->network)))       goto ERR_EVENTFD_TIMEOUT;
     if (!register_efd(loop, network_get_group_timerfd(loop->network))) goto ERR_EVENTFD_GROUP;
+    if (!register_efd(loop, network_get_pacing_timerfd(loop->network))) goto ERR_EVENTFD_PACING;
+
+#ifdef USE_CACHE
+    // Prepare the resolver and register it in pt_loop
+    if (!(loop->resolver = resolver_create(pt_loop_name_resolved, loop)))  goto ERR_RESOLVER_CREATE;
+    if (!register_efd(loop, resolver_get_sockfd(loop->resolver)))       goto ERR_EVENTFD_RESOLVER;
+    if (!register_efd(loop, resolver_get_timerfd(loop->resolver)))      goto ERR_EVENTFD_RESOLVER_TIMER;
+#endif
 
     // Buffer where pending events are stored
     if (!(loop->epoll_events = calloc(MAXEVENTS, sizeof(struct epoll_event)))) {
@@ -263,25 +303,44 @@ pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *),
         goto ERR_EVENTS_USER;
     }
 
+    if (!(loop->stop_set = stop_set_create(STOP_SET_PREFIX_LEN_IPV4_DEFAULT, STOP_SET_PREFIX_LEN_IPV6_DEFAULT))) {
+        goto ERR_STOP_SET;
+    }
+
     loop->user_data = user_data;
     loop->status = PT_LOOP_CONTINUE;
     loop->next_algorithm_id = 1; // 0 means unaffected ?
     loop->cur_instance = NULL;
     loop->algorithm_instances_root = NULL;
+    loop->ready_head = NULL;
+    loop->ready_tail = NULL;
 
     return loop;
 
+ERR_STOP_SET:
+    dynarray_free(loop->events_user, NULL);
 ERR_EVENTS_USER:
     free(loop->epoll_events);
 ERR_EVENTS:
+#ifdef USE_CACHE
+ERR_EVENTFD_RESOLVER_TIMER:
+ERR_EVENTFD_RESOLVER:
+    resolver_free(loop->resolver);
+ERR_RESOLVER_CREATE:
+#endif
+ERR_EVENTFD_PACING:
 ERR_EVENTFD_GROUP:
 ERR_EVENTFD_TIMEOUT:
+#ifdef USE_PACKET_RING
+ERR_EVENTFD_SNIFFER_RING:
+#else
 #ifdef USE_IPV4
 ERR_EVENTFD_SNIFFER_ICMPV4:
 #endif
 #ifdef USE_IPV6
 ERR_EVENTFD_SNIFFER_ICMPV6:
 #endif
+#endif
 ERR_EVENTFD_RECVQ:
 ERR_EVENTFD_SENDQ:
     network_free(loop->network);
@@ -307,6 +366,10 @@ void pt_loop_free(pt_loop_t * loop)
     if (loop) {
         if (loop->events_user)  dynarray_free(loop->events_user, (ELEMENT_FREE) event_free);
         if (loop->epoll_events) free(loop->epoll_events);
+        stop_set_free(loop->stop_set);
+#ifdef USE_CACHE
+        resolver_free(loop->resolver);
+#endif
         network_free(loop->network);
         close(loop->sfd);
         close(loop->eventfd_user);
@@ -338,27 +401,61 @@ inline void pt_instance_iter(
     twalk(loop->algorithm_instances_root, action);
 }
 
-void pt_process_instance(const void * node, VISIT visit, int level)
+void pt_loop_ready_push(pt_loop_t * loop, algorithm_instance_t * instance) {
+    if (instance->is_ready) return;
+
+    instance->is_ready   = true;
+    instance->ready_next = NULL;
+    instance->ready_prev = loop->ready_tail;
+
+    if (loop->ready_tail) {
+        loop->ready_tail->ready_next = instance;
+    } else {
+        // The ready list was empty, wake up the loop
+        loop->ready_head = instance;
+        eventfd_write(loop->eventfd_algorithm, 1);
+    }
+    loop->ready_tail = instance;
+}
+
+void pt_loop_ready_remove(pt_loop_t * loop, algorithm_instance_t * instance) {
+    if (!instance->is_ready) return;
+
+    if (instance->ready_prev) instance->ready_prev->ready_next = instance->ready_next;
+    else                      loop->ready_head = instance->ready_next;
+
+    if (instance->ready_next) instance->ready_next->ready_prev = instance->ready_prev;
+    else                      loop->ready_tail = instance->ready_prev;
+
+    instance->is_ready   = false;
+    instance->ready_prev = NULL;
+    instance->ready_next = NULL;
+}
+
+/**
+ * \brief Process the events pending for an algorithm instance.
+ *    Events raised for this instance by its own handler are not
+ *    processed now: they re-insert the instance at the end of the
+ *    ready list.
+ * \param loop The libparistraceroute loop.
+ * \param instance An instance removed from the ready list.
+ */
+
+static void pt_process_instance(pt_loop_t * loop, algorithm_instance_t * instance)
 {
-    algorithm_instance_t * instance = *((algorithm_instance_t * const *) node);
-    size_t                 i, num_events;
-    uint64_t               ret;
-    ssize_t                count;
+    size_t    i, num_events;
+    event_t * event;
+    bool      terminated = false;
 
     // Save temporarily this algorithm context.
-    instance->loop->cur_instance = instance;
+    loop->cur_instance = instance;
 
     // Execute algorithm handler for each events.
     num_events = dynarray_get_size(instance->events);
     for (i = 0; i < num_events; i++) {
-        event_t * event;
-
-        count = read(instance->loop->eventfd_algorithm, &ret, sizeof(ret));
-        if (count == -1) return;
-
         event = dynarray_get_ith_element(instance->events, i);
         instance->algorithm->handler(
-            instance->loop, event,
+            loop, event,
             &instance->data,
             instance->probe_skel,
             instance->options
@@ -366,15 +463,61 @@ void pt_process_instance(const void * node, VISIT visit, int level)
 
         // Next events for this instance are ignored.
         if (event->type == ALGORITHM_TERM) {
+            terminated = true;
             break;
         }
     }
 
     // Restore the algorithm context
-    instance->loop->cur_instance = NULL;
+    loop->cur_instance = NULL;
 
     // Flush events queue
-    algorithm_instance_clear_events(instance);
+    if (terminated) {
+        pt_loop_ready_remove(loop, instance);
+        algorithm_instance_clear_events(instance);
+    } else {
+        dynarray_del_n_elements(instance->events, 0, num_events, (ELEMENT_FREE) event_free);
+    }
+}
+
+/**
+ * \brief Dispatch the pending algorithm events. Instances are processed
+ *    in the order they have received their first pending event, so only
+ *    the instances having events are visited. A pass only processes the
+ *    instances which were ready when it started: the instances made
+ *    ready in the meantime (e.g. by their own handler) are processed by
+ *    the next pass, so that the sockets and the timers are polled in
+ *    between.
+ * \param loop The libparistraceroute loop.
+ * \return true iif successful.
+ */
+
+static bool pt_process_ready_instances(pt_loop_t * loop)
+{
+    algorithm_instance_t * instance;
+    size_t                 num_ready = 0;
+    uint64_t               ret;
+
+    // Reset the eventfd counter. It is signaled again once the ready
+    // list becomes non-empty.
+    if (read(loop->eventfd_algorithm, &ret, sizeof(ret)) == -1) {
+        return false;
+    }
+
+    for (instance = loop->ready_head; instance; instance = instance->ready_next) {
+        num_ready++;
+    }
+
+    while (num_ready-- > 0 && (instance = loop->ready_head)) {
+        pt_loop_ready_remove(loop, instance);
+        pt_process_instance(loop, instance);
+    }
+
+    // Some instances are still ready: come back once epoll_wait returns
+    if (loop->ready_head) {
+        eventfd_write(loop->eventfd_algorithm, 1);
+    }
+    return true;
 }
 
 // Notify the called algorithm that it can start
@@ -397,18 +540,31 @@ int pt_loop(pt_loop_t *loop, unsigned int timeout)
 
     int network_sendq_fd      = network_get_sendq_fd(loop->network);
     int network_recvq_fd      = network_get_recvq_fd(loop->network);
+#ifdef USE_PACKET_RING
+    int network_ring_sockfd   = network_get_ring_sockfd(loop->network);
+#else
 #ifdef USE_IPV4
     int network_icmpv4_sockfd = network_get_icmpv4_sockfd(loop->network);
 #endif
 #ifdef USE_IPV6
     int network_icmpv6_sockfd = network_get_icmpv6_sockfd(loop->network);
+#endif
 #endif
     int network_timerfd       = network_get_timerfd(loop->network);
     int network_group_timerfd = network_get_group_timerfd(loop->network);
+    int network_pacing_timerfd = network_get_pacing_timerfd(loop->network);
+#ifdef USE_CACHE
+    int resolver_sockfd       = resolver_get_sockfd(loop->resolver);
+    int resolver_timerfd      = resolver_get_timerfd(loop->resolver);
+#else
+    int resolver_sockfd       = -1;
+#endif
     ssize_t s;
     struct signalfd_siginfo fdsi;
 
-    do {
+    // The loop may have been terminated before being run (e.g. a
+    // campaign without destination), in which case nothing is awaited.
+    while (loop->status == PT_LOOP_CONTINUE || loop->status == PT_LOOP_INTERRUPTED) {
         /* Wait for events */
         n = epoll_wait(loop->efd, loop->epoll_events, MAXEVENTS, -1);
 
@@ -423,11 +579,13 @@ int pt_loop(pt_loop_t *loop, unsigned int timeout)
             // the corresponding event.
             cur_fd = loop->epoll_events[i].data.fd;
 
-            // Handle errors on fds
-            if ((loop->epoll_events[i].events & EPOLLERR)
+            // Handle errors on fds. The errors of the resolver socket
+            // (ICMP unreachable) are reported by resolver_process_replies.
+            if (cur_fd != resolver_sockfd && (
+                (loop->epoll_events[i].events & EPOLLERR)
             ||  (loop->epoll_events[i].events & EPOLLHUP)
             || !(loop->epoll_events[i].events & EPOLLIN)
-            ) {
+            )) {
                 // An error has occured on this fd
                 perror("epoll error");
                 close(cur_fd);
@@ -438,6 +596,15 @@ int pt_loop(pt_loop_t *loop, unsigned int timeout)
                 if (!network_process_sendq(loop->network)) {
                     if (loop->network->is_verbose) fprintf(stderr, "pt_loop: Can't send packet\n");
                 }
+
+                // The probes-per-second budget is exhausted: ignore the
+                // sendq until network_pacing_timerfd expires.
+                if (network_is_sendq_paced(loop->network)) {
+                    enable_efd(loop, network_sendq_fd, false);
+                }
+            } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_pacing_timerfd) {
+                network_process_pacing_timer(loop->network);
+                enable_efd(loop, network_sendq_fd, true);
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_recvq_fd) {
                 if (!network_process_recvq(loop->network)) {
                     if (loop->network->is_verbose) fprintf(stderr, "pt_loop: Cannot fetch packet\n");
@@ -445,6 +612,10 @@ int pt_loop(pt_loop_t *loop, unsigned int timeout)
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_group_timerfd) {
                  //printf("pt_loop processing scheduled probes\n");
                 network_process_scheduled_probe(loop->network);
+#ifdef USE_PACKET_RING
+            } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_ring_sockfd) {
+                network_process_sniffer(loop->network, IPPROTO_IP);
+#else
 #ifdef USE_IPV4
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_icmpv4_sockfd) {
                 network_process_sniffer(loop->network, IPPROTO_ICMP);
@@ -452,19 +623,22 @@ int pt_loop(pt_loop_t *loop, unsigned int timeout)
 #ifdef USE_IPV6
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_icmpv6_sockfd) {
                 network_process_sniffer(loop->network, IPPROTO_ICMPV6);
+#endif
+#endif
+#ifdef USE_CACHE
+            } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == resolver_sockfd) {
+                resolver_process_replies(loop->resolver);
+            } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == resolver_timerfd) {
+                resolver_process_timeout(loop->resolver);
 #endif
             } else if (cur_fd == loop->eventfd_algorithm) {
 
                 // There is one common queue shared by every instancied algorithms.
-                // We call pt_process_algorithms_iter() to find for which instance
-                // the event has been raised. Then we process this event thanks
-                // to pt_process_algorithms_instance() that calls the handler.
-
-                // << This must be thread safe!!
-                s_loop = loop;
-                pt_instance_iter(loop, pt_process_instance);
-                s_loop = NULL;
-                // >> This must be thread safe!!
+                // pt_throw() appends the instances having pending events to the
+                // ready list, so we directly process them in FIFO order.
+                if (!pt_process_ready_instances(loop)) {
+                    perror("pt_loop: Cannot process algorithm events");
+                }
 
             } else if (cur_fd == loop->eventfd_user) {
 
@@ -500,7 +674,7 @@ int pt_loop(pt_loop_t *loop, unsigned int timeout)
                 }
             }
         }
-    } while (loop->status == PT_LOOP_CONTINUE || loop->status == PT_LOOP_INTERRUPTED);
+    }
 
     // Process internal events
     return loop->status == PT_LOOP_TERMINATE ? 0 : -1;
@@ -529,3 +703,12 @@ bool pt_raise_error(pt_loop_t * loop) {
 bool pt_raise_terminated(pt_loop_t * loop) {
     return pt_raise_impl(loop, ALGORITHM_HAS_TERMINATED, NULL);
 }
+
+bool pt_resolve(pt_loop_t * loop, const address_t * address) {
+#ifdef USE_CACHE
+    return resolver_resolve(loop->resolver, address);
+#else
+    // Without the DNS cache, the resolved names could not be retrieved
+    return false;
+#endif
+}
@@ -19,6 +19,10 @@
 #include "probe.h"
 #include "network.h"
 #include "event.h"
+#include "stop_set.h"
+#ifdef USE_CACHE
+#  include "resolver.h"
+#endif
 
 typedef enum pt_loop_status_e {
     PT_LOOP_CONTINUE,    /**< Process and wait for next events */
@@ -33,7 +37,13 @@ typedef struct pt_loop_s {
     // Algorithms
     void                        * algorithm_instances_root;
     unsigned int                  next_algorithm_id;
-    int                           eventfd_algorithm;
+    int                           eventfd_algorithm;        /**< Signaled while the ready list is non-empty */
+    struct algorithm_instance_s * ready_head;               /**< First instance having pending events (FIFO) */
+    struct algorithm_instance_s * ready_tail;               /**< Last instance having pending events (FIFO) */
+    stop_set_t                  * stop_set;                 /**< Doubletree stop set shared by the instances (see stop_set.h) */
+#ifdef USE_CACHE
+    resolver_t                  * resolver;                 /**< Asynchronous reverse DNS resolver (see pt_resolve) */
+#endif
 
     // User
     int                           eventfd_user;             /**< User notification */
@@ -125,6 +135,25 @@ event_t ** pt_loop_get_user_events(pt_loop_t * loop);
 
 size_t pt_loop_get_num_user_events(pt_loop_t * loop);
 
+/**
+ * \brief (Internal usage) Append an instance having pending events to
+ *    the ready list of the loop. The loop is notified if this list was
+ *    empty. Nothing happens if the instance is already in the list.
+ * \param loop The libparistraceroute loop.
+ * \param instance The instance which has pending events.
+ */
+
+void pt_loop_ready_push(pt_loop_t * loop, struct algorithm_instance_s * instance);
+
+/**
+ * \brief (Internal usage) Remove an instance from the ready list of
+ *    the loop (if it belongs to this list).
+ * \param loop The libparistraceroute loop.
+ * \param instance The instance we're removing.
+ */
+
+void pt_loop_ready_remove(pt_loop_t * loop, struct algorithm_instance_s * instance);
+
 /**
  * \brief Send a probe packet across a network
  * \param network Pointer to the network to use
@@ -168,4 +197,18 @@ bool pt_raise_error(pt_loop_t * loop);
 
 bool pt_raise_terminated(pt_loop_t * loop);
 
+/**
+ * \brief Resolve an address without blocking the loop. Once the lookup
+ *    has completed, the hostname is stored in the DNS cache (see
+ *    address_get_cached_hostname) and a NAME_RESOLVED event carrying the
+ *    address (address_t *) is raised to the user handler.
+ *    The names are only resolved if USE_CACHE is defined, since the
+ *    resolver stores them in the DNS cache.
+ * \param loop The main loop.
+ * \param address The address to resolve.
+ * \return true iif a NAME_RESOLVED event will be raised for this address.
+ */
+
+bool pt_resolve(pt_loop_t * loop, const address_t * address);
+
 #endif
@@ -1,11 +1,64 @@
 #include "config.h"
 
 #include <stdlib.h>         // malloc, free
+#include <string.h>         // memcpy
 #include <unistd.h>         // read
 #include "os/sys/eventfd.h" // event_fd
 
 #include "queue.h"
 
+/**
+ * \brief Double the capacity of a queue.
+ * \param queue The queue we're enlarging.
+ * \return true iif successful.
+ */
+
+static bool queue_grow(queue_t * queue)
+{
+    size_t   capacity = 2 * queue->capacity,
+             num_tail = queue->capacity - queue->head;
+    void  ** elements;
+
+    if (!(elements = realloc(queue->elements, capacity * sizeof(void *)))) {
+        return false;
+    }
+
+    // The queue is full, so its elements wrap around the end of the
+    // buffer unless head == 0. Move the first part of the ring (from head
+    // to the former end of the buffer) at the end of the new buffer.
+    if (queue->head) {
+        memcpy(elements + capacity - num_tail, elements + queue->head, num_tail * sizeof(void *));
+        queue->head = capacity - num_tail;
+    }
+
+    queue->elements = elements;
+    queue->capacity = capacity;
+    return true;
+}
+
+/**
+ * \brief Notify the consumer that the queue is no more empty.
+ * \param queue A queue which was empty before the current push.
+ * \return true iif successful.
+ */
+
+static inline bool queue_notify(queue_t * queue)
+{
+    return eventfd_write(queue->eventfd, 1) != -1;
+}
+
+/**
+ * \brief Reset the file descriptor of a queue which becomes empty.
+ * \param queue A queue which has been emptied.
+ * \return true iif successful.
+ */
+
+static inline bool queue_acknowledge(queue_t * queue)
+{
+    eventfd_t value;
+    return read(queue->eventfd, &value, sizeof(value)) != -1;
+}
+
 queue_t * queue_create()
 {
     queue_t * queue;
@@ -15,15 +68,18 @@ queue_t * queue_create()
         goto ERR_QUEUE;
     }
 
-    // Create an eventfd
-    if ((queue->eventfd = eventfd(0, EFD_SEMAPHORE)) == -1) {
+    // Create an eventfd. A single read resets its counter.
+    if ((queue->eventfd = eventfd(0, 0)) == -1) {
         goto ERR_EVENTFD;
     }
 
-    // Create the list that will contain the elements
-    if (!(queue->elements = list_create())) {
+    // Create the ring buffer that will contain the elements
+    if (!(queue->elements = malloc(QUEUE_DEFAULT_CAPACITY * sizeof(void *)))) {
         goto ERR_ELEMENTS;
     }
+    queue->capacity = QUEUE_DEFAULT_CAPACITY;
+    queue->head     = 0;
+    queue->size     = 0;
     return queue;
 
 ERR_ELEMENTS:
@@ -36,31 +92,101 @@ ERR_QUEUE:
 
 void queue_free(queue_t * queue, void (*element_free) (void * element))
 {
+    size_t i;
+
     if (queue) {
-        if (queue->elements) list_free(queue->elements, element_free);
+        if (element_free) {
+            for (i = 0; i < queue->size; i++) {
+                element_free(queue->elements[(queue->head + i) & (queue->capacity - 1)]);
+            }
+        }
+        free(queue->elements);
         close(queue->eventfd);
         free(queue);
     }
 }
 
-inline bool queue_push_element(queue_t *queue, void * element)
+bool queue_push_element(queue_t * queue, void * element)
 {
-    // Push an element in the queue
-    // If successfull, write 1 in the file descriptor.
-    return list_push_element(queue->elements, element)
-        && (eventfd_write(queue->eventfd, 1) != -1);
+    return queue_push_elements(queue, &element, 1);
 }
 
-void * queue_pop_element(queue_t *queue, void (*element_free)(void * element))
+bool queue_push_elements(queue_t * queue, void ** elements, size_t num_elements)
 {
-    eventfd_t value;
-    return (read(queue->eventfd, &value, sizeof(value)) != -1) ?
-        list_pop_element(queue->elements, element_free) :
-        NULL;
+    size_t i;
+    bool   was_empty = (queue->size == 0);
+
+    for (i = 0; i < num_elements; i++) {
+        if (queue->size == queue->capacity && !queue_grow(queue)) break;
+        queue->elements[(queue->head + queue->size) & (queue->capacity - 1)] = elements[i];
+        queue->size++;
+    }
+
+    // Notify the whole batch at once
+    if (was_empty && i > 0 && !queue_notify(queue)) return false;
+    return i == num_elements;
+}
+
+void * queue_pop_element(queue_t * queue, void (*element_free)(void * element))
+{
+    void * element;
+
+    if (queue_pop_elements(queue, &element, 1) != 1) return NULL;
+    if (element_free) {
+        element_free(element);
+        return NULL;
+    }
+    return element;
+}
+
+size_t queue_pop_elements(queue_t * queue, void ** elements, size_t max_elements)
+{
+    size_t i;
+
+    for (i = 0; i < max_elements && queue->size > 0; i++) {
+        elements[i] = queue->elements[queue->head];
+        queue->head = (queue->head + 1) & (queue->capacity - 1);
+        queue->size--;
+    }
+
+    // The queue is now empty, its file descriptor is no more readable
+    if (i > 0 && queue->size == 0) {
+        queue->head = 0;
+        queue_acknowledge(queue);
+    }
+    return i;
+}
+
+size_t queue_remove_elements(queue_t * queue, bool (*match)(void * element, void * data), void * data)
+{
+    size_t i, num_kept = 0;
+    void * element;
+
+    // Compact the ring buffer in place
+    for (i = 0; i < queue->size; i++) {
+        element = queue->elements[(queue->head + i) & (queue->capacity - 1)];
+        if (!match(element, data)) {
+            queue->elements[(queue->head + num_kept++) & (queue->capacity - 1)] = element;
+        }
+    }
+
+    // The queue is now empty, its file descriptor is no more readable
+    if (num_kept < queue->size && num_kept == 0) {
+        queue->head = 0;
+        queue_acknowledge(queue);
+    }
+
+    i = queue->size - num_kept;
+    queue->size = num_kept;
+    return i;
+}
+
+inline size_t queue_get_size(const queue_t * queue)
+{
+    return queue->size;
 }
 
 inline int queue_get_fd(const queue_t * queue)
 {
     return queue->eventfd;
 }
-
@@ -1,13 +1,33 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
+/**
+ * \file queue.h
+ * \brief FIFO queue associated to a file descriptor that can be
+ *    registered in an epoll set.
+ *
+ * Elements are stored in a ring buffer, which is enlarged when full,
+ * so pushing and popping an element does not allocate memory.
+ *
+ * The file descriptor is readable iif the queue is not empty: it is
+ * only written when the queue becomes non-empty, and only read when it
+ * becomes empty. Thus, a batch of elements costs at most two system
+ * calls, whatever the number of elements and producers. As every
+ * producer and consumer runs in the pt_loop thread, no lock is needed.
+ */
+
 #include <stdbool.h>
+#include <stddef.h> // size_t
 
-#include "list.h"
+// Initial number of elements that can be stored in a queue
+#define QUEUE_DEFAULT_CAPACITY 64
 
 typedef struct {
-    list_t * elements; /**< Elements stored in the queue */
-    int      eventfd;  /**< File descriptor notifying an update in the queue */
+    void  ** elements; /**< Ring buffer storing the elements */
+    size_t   capacity; /**< Number of cells in elements (power of 2) */
+    size_t   head;     /**< Index of the first element */
+    size_t   size;     /**< Number of elements stored in the queue */
+    int      eventfd;  /**< File descriptor, readable iif the queue is not empty */
 } queue_t;
 
 /**
@@ -33,6 +53,17 @@ void queue_free(queue_t * queue, void (*element_free) (void * element));
 
 bool queue_push_element(queue_t * queue, void * element);
 
+/**
+ * \brief Push several elements in the queue. The queue file
+ *    descriptor is updated at most once for the whole batch.
+ * \param queue Points to the impacted queue instance
+ * \param elements Points to the array of pushed elements
+ * \param num_elements The number of elements stored in elements
+ * \return true iif successfull
+ */
+
+bool queue_push_elements(queue_t * queue, void ** elements, size_t num_elements);
+
 /**
  * \brief Pop an element from the queue.
  * \param queue The queue from which we pop an element.
@@ -42,6 +73,37 @@ bool queue_push_element(queue_t * queue, void * element);
 
 void * queue_pop_element(queue_t * queue, void (*element_free)(void * element));
 
+/**
+ * \brief Pop several elements from the queue.
+ * \param queue The queue from which we pop the elements.
+ * \param elements A preallocated array of at least max_elements
+ *    pointers in which the poped elements are written.
+ * \param max_elements The maximum number of elements to pop.
+ * \return The number of poped elements.
+ */
+
+size_t queue_pop_elements(queue_t * queue, void ** elements, size_t max_elements);
+
+/**
+ * \brief Remove the elements matching a predicate from a queue. The
+ *    remaining elements keep their order.
+ * \param queue The queue.
+ * \param match Function returning true iif an element must be removed.
+ *    It is responsible for the elements it matches (e.g. it may free them).
+ * \param data Data passed to match.
+ * \return The number of removed elements.
+ */
+
+size_t queue_remove_elements(queue_t * queue, bool (*match)(void * element, void * data), void * data);
+
+/**
+ * \brief Retrieve the number of elements stored in a queue.
+ * \param queue A pointer to a queue instance.
+ * \return The number of elements.
+ */
+
+size_t queue_get_size(const queue_t * queue);
+
 /**
  * \brief Retrieve the file descriptor stored in a queue_t instance.
  * \param queue A pointer to a queue instance.
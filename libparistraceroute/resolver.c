@@ -0,0 +1,581 @@
+#include "use.h"
+#include "config.h"
+
+#include <errno.h>              // errno, EAGAIN, EWOULDBLOCK
+#include <stdio.h>              // fopen, fgets, perror
+#include <stdlib.h>             // malloc, free
+#include <string.h>             // memset, memcpy, memcmp
+#include <unistd.h>             // close
+#include <arpa/inet.h>          // inet_pton, htons
+#include <netinet/in.h>         // sockaddr_in, sockaddr_in6
+#include <sys/socket.h>         // socket, connect, send, recv
+#include "os/sys/timerfd.h"     // timerfd_create, timerfd_settime
+
+#include "resolver.h"
+#include "common.h"             // get_timestamp
+
+// Wire format of the DNS messages (RFC 1035)
+#define DNS_HEADER_SIZE   12
+#define DNS_MAX_NAME_LEN  255
+#define DNS_MAX_JUMPS     16    // Protects name decompression against loops
+#define DNS_FLAG_QR       0x8000
+#define DNS_FLAG_RD       0x0100
+#define DNS_RCODE_MASK    0x000f
+#define DNS_TYPE_PTR      12
+#define DNS_CLASS_IN      1
+
+// Header and question of a PTR query for an IPv6 address (".ip6.arpa" and 32 nibbles)
+#define RESOLVER_QUERY_MAX_SIZE (DNS_HEADER_SIZE + 2 * 32 + 10 + 4)
+#define RESOLVER_REPLY_MAX_SIZE 1500
+
+//---------------------------------------------------------------------------
+// Resolver options
+//---------------------------------------------------------------------------
+
+static struct opt_str dns_server     = {NULL, 0};
+static int            dns_port[3]    = OPTIONS_RESOLVER_DNS_PORT;
+
+static option_t resolver_options[] = {
+    // action           short      long           metavar    help             variable
+    {opt_store_str,     OPT_NO_SF, "--dns-server", "ADDRESS", HELP_dns_server, &dns_server},
+    {opt_store_int_lim, OPT_NO_SF, "--dns-port",   "PORT",    HELP_dns_port,   dns_port},
+    END_OPT_SPECS
+};
+
+const option_t * resolver_get_options() {
+    return resolver_options;
+}
+
+bool options_resolver_init(resolver_t * resolver) {
+    if (!dns_server.s && dns_port[0] == RESOLVER_DEFAULT_PORT) return true;
+    return resolver_set_nameserver(resolver, dns_server.s ? dns_server.s : RESOLVER_DEFAULT_NAMESERVER, dns_port[0]);
+}
+
+//---------------------------------------------------------------------------
+// Pending queries
+//---------------------------------------------------------------------------
+
+typedef struct {
+    uint16_t  id;                              /**< Identifier of the DNS query */
+    address_t address;                         /**< Address being resolved */
+    double    deadline;                        /**< Expiration of the last attempt */
+    unsigned  num_attempts;                    /**< Number of times the query has been sent */
+    size_t    size;                            /**< Size of the DNS query (in bytes) */
+    uint8_t   bytes[RESOLVER_QUERY_MAX_SIZE];  /**< DNS query */
+} resolver_query_t;
+
+static inline void write_uint16(uint8_t * bytes, uint16_t value) {
+    bytes[0] = value >> 8;
+    bytes[1] = value & 0xff;
+}
+
+static inline uint16_t read_uint16(const uint8_t * bytes) {
+    return (bytes[0] << 8) | bytes[1];
+}
+
+/**
+ * \brief Append a label to a DNS name.
+ * \param bytes The buffer where the label is written.
+ * \param label The label.
+ * \return The number of bytes written.
+ */
+
+static size_t write_label(uint8_t * bytes, const char * label) {
+    size_t len = strlen(label);
+
+    bytes[0] = len;
+    memcpy(bytes + 1, label, len);
+    return len + 1;
+}
+
+/**
+ * \brief Prepare the PTR query of an address
+ *    (e.g. 4.3.2.1.in-addr.arpa for 1.2.3.4).
+ * \param query The query we're initializing. Its id and address must be set.
+ */
+
+static void resolver_query_build(resolver_query_t * query)
+{
+    uint8_t       * bytes = query->bytes;
+    const uint8_t * ip = (const uint8_t *) &query->address.ip;
+    size_t          i, offset = DNS_HEADER_SIZE;
+    char            label[4];
+
+    // Header: a single question, recursion desired
+    memset(bytes, 0, DNS_HEADER_SIZE);
+    write_uint16(bytes,     query->id);
+    write_uint16(bytes + 2, DNS_FLAG_RD);
+    write_uint16(bytes + 4, 1);
+
+    // Question
+    switch (query->address.family) {
+        case AF_INET6:
+            for (i = sizeof(ipv6_t); i > 0; i--) {
+                snprintf(label, sizeof(label), "%x", ip[i - 1] & 0x0f);
+                offset += write_label(bytes + offset, label);
+                snprintf(label, sizeof(label), "%x", ip[i - 1] >> 4);
+                offset += write_label(bytes + offset, label);
+            }
+            offset += write_label(bytes + offset, "ip6");
+            break;
+        default:
+            for (i = sizeof(ipv4_t); i > 0; i--) {
+                snprintf(label, sizeof(label), "%u", ip[i - 1]);
+                offset += write_label(bytes + offset, label);
+            }
+            offset += write_label(bytes + offset, "in-addr");
+            break;
+    }
+    offset += write_label(bytes + offset, "arpa");
+    bytes[offset++] = 0;
+    write_uint16(bytes + offset,     DNS_TYPE_PTR);
+    write_uint16(bytes + offset + 2, DNS_CLASS_IN);
+    query->size = offset + 4;
+}
+
+/**
+ * \brief Skip a (possibly compressed) DNS name.
+ * \param bytes The DNS message.
+ * \param size The size of the DNS message.
+ * \param offset The offset of the name.
+ * \return The offset following the name, 0 if the message is malformed.
+ */
+
+static size_t dns_skip_name(const uint8_t * bytes, size_t size, size_t offset)
+{
+    while (offset < size) {
+        if ((bytes[offset] & 0xc0) == 0xc0) return offset + 2;
+        if (bytes[offset] == 0)             return offset + 1;
+        offset += bytes[offset] + 1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Check whether a label may appear in a hostname, as res_hnok(3)
+ *    does: only letters, digits, '-' and '_' are allowed, so that a
+ *    hostile reverse zone cannot print control characters or escape
+ *    sequences on the terminal.
+ * \param label The label.
+ * \param len The length of the label.
+ * \param is_first Pass true if this is the first label of the name,
+ *    which must not start with '-'.
+ * \return true iif the label is valid.
+ */
+
+static bool dns_label_is_valid(const uint8_t * label, size_t len, bool is_first)
+{
+    size_t i;
+
+    if (is_first && label[0] == '-') return false;
+    for (i = 0; i < len; i++) {
+        if (!((label[i] >= '0' && label[i] <= '9')
+           || (label[i] >= 'A' && label[i] <= 'Z')
+           || (label[i] >= 'a' && label[i] <= 'z')
+           ||  label[i] == '-' || label[i] == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Decode a (possibly compressed) DNS name.
+ * \param bytes The DNS message.
+ * \param size The size of the DNS message.
+ * \param offset The offset of the name.
+ * \param name The buffer receiving the dotted name (DNS_MAX_NAME_LEN + 1 bytes).
+ * \return true iif successful and if the name is a valid hostname.
+ */
+
+static bool dns_read_name(const uint8_t * bytes, size_t size, size_t offset, char * name)
+{
+    size_t   len, name_len = 0;
+    unsigned num_jumps = 0;
+
+    while (offset < size) {
+        len = bytes[offset];
+        if ((len & 0xc0) == 0xc0) {
+            if (offset + 1 >= size || ++num_jumps > DNS_MAX_JUMPS) break;
+            offset = ((len & 0x3f) << 8) | bytes[offset + 1];
+            continue;
+        }
+        if (len == 0) {
+            name[name_len] = '\0';
+            return name_len > 0;
+        }
+        if (offset + 1 + len > size || name_len + len + 1 > DNS_MAX_NAME_LEN) break;
+        if (!dns_label_is_valid(bytes + offset + 1, len, name_len == 0)) break;
+        if (name_len) name[name_len++] = '.';
+        memcpy(name + name_len, bytes + offset + 1, len);
+        name_len += len;
+        offset += len + 1;
+    }
+    return false;
+}
+
+/**
+ * \brief Extract the first PTR record of a DNS reply.
+ * \param query The corresponding query.
+ * \param bytes The DNS reply.
+ * \param size The size of the DNS reply.
+ * \param hostname The buffer receiving the hostname (DNS_MAX_NAME_LEN + 1 bytes).
+ * \return true iif a PTR record has been found.
+ */
+
+static bool dns_read_ptr(const resolver_query_t * query, const uint8_t * bytes, size_t size, char * hostname)
+{
+    size_t   i, num_answers, offset = query->size;
+    uint16_t type, class, rdata_size;
+
+    if (read_uint16(bytes + 2) & DNS_RCODE_MASK) return false;
+
+    num_answers = read_uint16(bytes + 6);
+    for (i = 0; i < num_answers; i++) {
+        if (!(offset = dns_skip_name(bytes, size, offset)) || offset + 10 > size) break;
+        type       = read_uint16(bytes + offset);
+        class      = read_uint16(bytes + offset + 2);
+        rdata_size = read_uint16(bytes + offset + 8);
+        offset += 10;
+        if (offset + rdata_size > size) break;
+        if (type == DNS_TYPE_PTR && class == DNS_CLASS_IN) {
+            return dns_read_name(bytes, size, offset, hostname);
+        }
+        offset += rdata_size;
+    }
+    return false;
+}
+
+//---------------------------------------------------------------------------
+// Internal functions
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Arm resolver->timerfd according to the earliest deadline of the
+ *    pending queries (or disarm it).
+ * \param resolver A resolver_t instance.
+ */
+
+static void resolver_update_timer(resolver_t * resolver)
+{
+    struct itimerspec   timer;
+    resolver_query_t  * query;
+    size_t              i, num_queries = dynarray_get_size(resolver->queries);
+    double              deadline = 0, delay;
+
+    for (i = 0; i < num_queries; i++) {
+        query = dynarray_get_ith_element(resolver->queries, i);
+        if (!deadline || query->deadline < deadline) deadline = query->deadline;
+    }
+
+    memset(&timer, 0, sizeof(struct itimerspec));
+    if (deadline) {
+        // A null it_value would disarm the timer
+        delay = deadline - get_timestamp();
+        if (delay < 1e-6) delay = 1e-6;
+        timer.it_value.tv_sec  = (time_t) delay;
+        timer.it_value.tv_nsec = 1000000000 * (delay - (time_t) delay);
+    }
+
+    if (timerfd_settime(resolver->timerfd, 0, &timer, NULL) == -1) {
+        perror("resolver_update_timer: timerfd_settime");
+    }
+}
+
+/**
+ * \brief Send (again) a query.
+ * \param resolver A resolver_t instance.
+ * \param query The query.
+ * \return true iif successful.
+ */
+
+static bool resolver_query_send(resolver_t * resolver, resolver_query_t * query)
+{
+    query->num_attempts++;
+    query->deadline = get_timestamp() + RESOLVER_TIMEOUT;
+    return send(resolver->sockfd, query->bytes, query->size, 0) != -1;
+}
+
+/**
+ * \brief Complete a query: cache the resulting hostname, notify the
+ *    callback, and release the query.
+ * \param resolver A resolver_t instance.
+ * \param i The index of the query in resolver->queries.
+ * \param hostname The resolved hostname, NULL if the address has no name.
+ */
+
+static void resolver_query_complete(resolver_t * resolver, size_t i, const char * hostname)
+{
+    resolver_query_t * query = dynarray_get_ith_element(resolver->queries, i);
+    address_t          address = query->address;
+    char             * numeric = NULL;
+
+    dynarray_del_ith_element(resolver->queries, i, free);
+
+    if (hostname) {
+        address_set_cached_hostname(&address, hostname);
+    } else if (address_to_string(&address, &numeric) == 0) {
+        address_set_cached_hostname(&address, numeric);
+        free(numeric);
+    }
+
+    if (resolver->callback) resolver->callback(&address, resolver->callback_data);
+}
+
+/**
+ * \brief Connect a UDP socket to a name server.
+ * \param sockfd The socket. It must be an AF_INET6 dual-stack socket
+ *    unless nameserver is an IPv4 address.
+ * \param family The family of sockfd.
+ * \param nameserver The address of the name server.
+ * \param port The port of the name server.
+ * \return true iif successful.
+ */
+
+static bool resolver_connect(int sockfd, int family, const char * nameserver, uint16_t port)
+{
+    struct sockaddr_in  sa4;
+    struct sockaddr_in6 sa6;
+    struct in_addr      ipv4;
+
+    memset(&sa4, 0, sizeof(struct sockaddr_in));
+    memset(&sa6, 0, sizeof(struct sockaddr_in6));
+    sa6.sin6_family = AF_INET6;
+    sa6.sin6_port   = htons(port);
+
+    if (inet_pton(AF_INET6, nameserver, &sa6.sin6_addr) == 1) {
+        if (family != AF_INET6) goto ERR_FAMILY;
+    } else if (inet_pton(AF_INET, nameserver, &ipv4) == 1) {
+        if (family == AF_INET) {
+            sa4.sin_family = AF_INET;
+            sa4.sin_port   = htons(port);
+            sa4.sin_addr   = ipv4;
+            return connect(sockfd, (struct sockaddr *) &sa4, sizeof(struct sockaddr_in)) != -1;
+        }
+
+        // IPv4-mapped IPv6 address (::ffff:a.b.c.d)
+        sa6.sin6_addr.s6_addr[10] = 0xff;
+        sa6.sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&sa6.sin6_addr.s6_addr[12], &ipv4, sizeof(struct in_addr));
+    } else {
+        goto ERR_INVALID_ADDRESS;
+    }
+    return connect(sockfd, (struct sockaddr *) &sa6, sizeof(struct sockaddr_in6)) != -1;
+
+ERR_FAMILY:
+ERR_INVALID_ADDRESS:
+    fprintf(stderr, "resolver: invalid name server address (%s)\n", nameserver);
+    return false;
+}
+
+/**
+ * \brief Retrieve the first name server of RESOLVER_RESOLV_CONF.
+ * \param nameserver The buffer receiving the address of the name server.
+ * \param size The size of the buffer.
+ * \return true iif successful.
+ */
+
+static bool resolv_conf_get_nameserver(char * nameserver, size_t size)
+{
+    FILE * file;
+    char   line[256];
+    bool   found = false;
+
+    if (!(file = fopen(RESOLVER_RESOLV_CONF, "r"))) return false;
+    while (!found && fgets(line, sizeof(line), file)) {
+        found = sscanf(line, " nameserver %63s", nameserver) == 1;
+    }
+    fclose(file);
+
+    // Strip the scope of link-local addresses (e.g. fe80::1%eth0)
+    if (found) nameserver[strcspn(nameserver, "%")] = '\0';
+    return found && strlen(nameserver) < size;
+}
+
+//---------------------------------------------------------------------------
+// Public functions
+//---------------------------------------------------------------------------
+
+resolver_t * resolver_create(void (*callback)(const address_t *, void *), void * callback_data)
+{
+    resolver_t * resolver;
+    int          family = AF_INET6,
+                 v6only = 0;
+    char         nameserver[64];
+
+    if (!(resolver = malloc(sizeof(resolver_t)))) goto ERR_MALLOC;
+
+    // A dual-stack socket allows to switch to a name server of either
+    // family without replacing the socket registered in the pt_loop.
+    if ((resolver->sockfd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1
+    ||  setsockopt(resolver->sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) == -1
+    ) {
+        if (resolver->sockfd != -1) close(resolver->sockfd);
+        family = AF_INET;
+        if ((resolver->sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+            perror("resolver_create: socket");
+            goto ERR_SOCKET;
+        }
+    }
+
+    if (!resolv_conf_get_nameserver(nameserver, sizeof(nameserver))
+    ||  !resolver_connect(resolver->sockfd, family, nameserver, RESOLVER_DEFAULT_PORT)
+    ) {
+        if (!resolver_connect(resolver->sockfd, family, RESOLVER_DEFAULT_NAMESERVER, RESOLVER_DEFAULT_PORT)) {
+            goto ERR_CONNECT;
+        }
+    }
+
+    if ((resolver->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {
+        perror("resolver_create: timerfd_create");
+        goto ERR_TIMERFD;
+    }
+
+    if (!(resolver->queries = dynarray_create())) goto ERR_QUERIES;
+
+    resolver->next_id       = (uint64_t) (get_timestamp() * 1000000);
+    resolver->callback      = callback;
+    resolver->callback_data = callback_data;
+    return resolver;
+
+ERR_QUERIES:
+    close(resolver->timerfd);
+ERR_TIMERFD:
+ERR_CONNECT:
+    close(resolver->sockfd);
+ERR_SOCKET:
+    free(resolver);
+ERR_MALLOC:
+    return NULL;
+}
+
+void resolver_free(resolver_t * resolver)
+{
+    if (resolver) {
+        dynarray_free(resolver->queries, free);
+        close(resolver->timerfd);
+        close(resolver->sockfd);
+        free(resolver);
+    }
+}
+
+bool resolver_set_nameserver(resolver_t * resolver, const char * nameserver, uint16_t port)
+{
+    struct sockaddr_storage ss;
+    socklen_t               ss_len = sizeof(ss);
+
+    if (getsockname(resolver->sockfd, (struct sockaddr *) &ss, &ss_len) == -1) return false;
+    return resolver_connect(resolver->sockfd, ss.ss_family, nameserver, port);
+}
+
+bool resolver_resolve(resolver_t * resolver, const address_t * address)
+{
+    resolver_query_t * query;
+    size_t             i, num_queries = dynarray_get_size(resolver->queries);
+
+    // This address is already being resolved
+    for (i = 0; i < num_queries; i++) {
+        query = dynarray_get_ith_element(resolver->queries, i);
+        if (address_compare(&query->address, address) == 0) return true;
+    }
+
+    if (!(query = malloc(sizeof(resolver_query_t)))) goto ERR_MALLOC;
+    memset(query, 0, sizeof(resolver_query_t));
+    query->id = resolver->next_id++;
+    query->address.family = address->family;
+    memcpy(&query->address.ip, &address->ip, address_get_size(address));
+    resolver_query_build(query);
+
+    if (!resolver_query_send(resolver, query)) {
+        perror("resolver_resolve: send");
+        goto ERR_SEND;
+    }
+    if (!dynarray_push_element(resolver->queries, query)) goto ERR_PUSH_ELEMENT;
+    resolver_update_timer(resolver);
+    return true;
+
+ERR_PUSH_ELEMENT:
+ERR_SEND:
+    free(query);
+ERR_MALLOC:
+    return false;
+}
+
+inline size_t resolver_get_num_queries(const resolver_t * resolver) {
+    return dynarray_get_size(resolver->queries);
+}
+
+inline int resolver_get_sockfd(const resolver_t * resolver) {
+    return resolver->sockfd;
+}
+
+inline int resolver_get_timerfd(const resolver_t * resolver) {
+    return resolver->timerfd;
+}
+
+void resolver_process_replies(resolver_t * resolver)
+{
+    uint8_t            bytes[RESOLVER_REPLY_MAX_SIZE];
+    char               hostname[DNS_MAX_NAME_LEN + 1];
+    ssize_t            size;
+    size_t             i, num_queries;
+    resolver_query_t * query;
+
+    while ((size = recv(resolver->sockfd, bytes, sizeof(bytes), 0)) != -1) {
+        if (size < DNS_HEADER_SIZE || !(read_uint16(bytes + 2) & DNS_FLAG_QR)) continue;
+
+        // The reply must repeat the question of a pending query
+        num_queries = dynarray_get_size(resolver->queries);
+        for (i = 0; i < num_queries; i++) {
+            query = dynarray_get_ith_element(resolver->queries, i);
+            if (query->id == read_uint16(bytes)
+            &&  (size_t) size >= query->size
+            &&  memcmp(bytes + DNS_HEADER_SIZE, query->bytes + DNS_HEADER_SIZE, query->size - DNS_HEADER_SIZE) == 0
+            ) {
+                resolver_query_complete(
+                    resolver, i,
+                    dns_read_ptr(query, bytes, size, hostname) ? hostname : NULL
+                );
+                break;
+            }
+        }
+    }
+
+    if (errno == ECONNREFUSED) {
+        // The name server is unreachable: give up the pending queries
+        while (dynarray_get_size(resolver->queries)) {
+            resolver_query_complete(resolver, 0, NULL);
+        }
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("resolver_process_replies: recv");
+    }
+
+    // This is to avoid to get errno set to EAGAIN once the socket is drained.
+    errno = 0;
+    resolver_update_timer(resolver);
+}
+
+void resolver_process_timeout(resolver_t * resolver)
+{
+    uint64_t           num_ticks;
+    size_t             i;
+    double             now = get_timestamp();
+    resolver_query_t * query;
+
+    if (read(resolver->timerfd, &num_ticks, sizeof(num_ticks)) == -1) {
+        perror("resolver_process_timeout: read");
+    }
+
+    for (i = 0; i < dynarray_get_size(resolver->queries); ) {
+        query = dynarray_get_ith_element(resolver->queries, i);
+        if (query->deadline > now) {
+            i++;
+        } else if (query->num_attempts < RESOLVER_NUM_ATTEMPTS && resolver_query_send(resolver, query)) {
+            i++;
+        } else {
+            // The name server does not answer: give up
+            resolver_query_complete(resolver, i, NULL);
+        }
+    }
+    resolver_update_timer(resolver);
+}
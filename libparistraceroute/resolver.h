@@ -0,0 +1,133 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+/**
+ * \file resolver.h
+ * \brief Asynchronous reverse DNS resolution.
+ *
+ * A resolver_t sends PTR queries to a name server through a non-blocking
+ * UDP socket. Its socket and its timer are registered in the pt_loop_t
+ * epoll set (see pt_loop_create), so that a reverse lookup never stalls
+ * the measurements.
+ *
+ * Once a query is answered (or has definitely failed), the hostname is
+ * stored in the cache of address.c (see address_set_cached_hostname) and
+ * the callback passed to resolver_create is called. If the address has
+ * no name, its numeric form is cached, as gethostbyaddr-based callers
+ * print it in this case. Hence pt_loop_t only uses a resolver if
+ * USE_CACHE is defined.
+ *
+ * The names which are not valid hostnames (see res_hnok(3)) are ignored.
+ */
+
+#include <stdbool.h>        // bool
+#include <stdint.h>         // uint16_t
+
+#include "address.h"        // address_t
+#include "dynarray.h"       // dynarray_t
+#include "options.h"        // option_t
+
+#define RESOLVER_RESOLV_CONF        "/etc/resolv.conf"
+#define RESOLVER_DEFAULT_NAMESERVER "127.0.0.1"
+#define RESOLVER_DEFAULT_PORT       53
+#define RESOLVER_TIMEOUT            2.0 // Delay before sending a query again (in seconds)
+#define RESOLVER_NUM_ATTEMPTS       2   // Number of times a query is sent
+
+// Command-line options
+
+#define OPTIONS_RESOLVER_DNS_PORT {RESOLVER_DEFAULT_PORT, 1, 65535}
+#define HELP_dns_server "Send the reverse DNS queries to this name server (default is the first one of " RESOLVER_RESOLV_CONF ")"
+#define HELP_dns_port   "Set the port of the name server (default is 53)"
+
+typedef struct {
+    int           sockfd;        /**< UDP socket connected to the name server */
+    int           timerfd;       /**< Ticks when the next pending query expires */
+    dynarray_t  * queries;       /**< Pending queries (resolver_query_t) */
+    uint16_t      next_id;       /**< Identifier of the next DNS query */
+    void       (* callback)(const address_t *, void *); /**< Called whenever a query completes */
+    void        * callback_data; /**< Passed to callback */
+} resolver_t;
+
+/**
+ * \brief Retrieve the command-line options related to the resolver.
+ * \return A pointer to the corresponding option_t array.
+ */
+
+const option_t * resolver_get_options();
+
+/**
+ * \brief Apply the options passed in the command-line to a resolver.
+ * \param resolver A resolver_t instance.
+ * \return true iif successful.
+ */
+
+bool options_resolver_init(resolver_t * resolver);
+
+/**
+ * \brief Create a resolver. It uses the first name server listed in
+ *    RESOLVER_RESOLV_CONF (RESOLVER_DEFAULT_NAMESERVER otherwise).
+ * \param callback Function called whenever a query completes. It receives
+ *    the resolved address and callback_data. The hostname can then be
+ *    retrieved thanks to address_get_cached_hostname.
+ * \param callback_data Data passed to callback.
+ * \return The newly created resolver, NULL otherwise.
+ */
+
+resolver_t * resolver_create(void (*callback)(const address_t *, void *), void * callback_data);
+
+/**
+ * \brief Release a resolver from the memory. Pending queries are dropped.
+ * \param resolver A resolver_t instance.
+ */
+
+void resolver_free(resolver_t * resolver);
+
+/**
+ * \brief Change the name server used by a resolver.
+ * \param resolver A resolver_t instance.
+ * \param nameserver The IPv4 or IPv6 address of the name server.
+ * \param port The UDP port of the name server.
+ * \return true iif successful.
+ */
+
+bool resolver_set_nameserver(resolver_t * resolver, const char * nameserver, uint16_t port);
+
+/**
+ * \brief Start the reverse lookup of an address. Nothing is sent if this
+ *    address is already being resolved.
+ * \param resolver A resolver_t instance.
+ * \param address The address to resolve.
+ * \return true iif the callback will be called for this address.
+ */
+
+bool resolver_resolve(resolver_t * resolver, const address_t * address);
+
+/**
+ * \brief Retrieve the number of pending queries.
+ * \param resolver A resolver_t instance.
+ * \return The number of addresses being resolved.
+ */
+
+size_t resolver_get_num_queries(const resolver_t * resolver);
+
+int resolver_get_sockfd(const resolver_t * resolver);
+int resolver_get_timerfd(const resolver_t * resolver);
+
+/**
+ * \brief Process the replies received on resolver->sockfd.
+ *    Should be called whenever resolver->sockfd is readable or reports
+ *    an error (e.g. the name server is unreachable).
+ * \param resolver A resolver_t instance.
+ */
+
+void resolver_process_replies(resolver_t * resolver);
+
+/**
+ * \brief Send again or drop the expired queries.
+ *    Should be called whenever resolver->timerfd ticks.
+ * \param resolver A resolver_t instance.
+ */
+
+void resolver_process_timeout(resolver_t * resolver);
+
+#endif
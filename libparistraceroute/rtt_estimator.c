@@ -0,0 +1,46 @@
+#include "config.h"
+
+#include <math.h>           // fabs
+
+#include "rtt_estimator.h"
+#include "common.h"         // MAX
+
+void rtt_estimator_init(rtt_estimator_t * estimator) {
+    estimator->srtt        = 0;
+    estimator->rttvar      = 0;
+    estimator->num_samples = 0;
+    estimator->backoff     = 0;
+}
+
+void rtt_estimator_add_sample(rtt_estimator_t * estimator, double rtt)
+{
+    if (estimator->num_samples == 0) {
+        estimator->srtt   = rtt;
+        estimator->rttvar = rtt / 2;
+    } else {
+        // RTTVAR must be updated first since it relies on the previous SRTT
+        estimator->rttvar = (1 - RTT_ESTIMATOR_BETA)  * estimator->rttvar + RTT_ESTIMATOR_BETA * fabs(estimator->srtt - rtt);
+        estimator->srtt   = (1 - RTT_ESTIMATOR_ALPHA) * estimator->srtt   + RTT_ESTIMATOR_ALPHA * rtt;
+    }
+    estimator->num_samples++;
+    estimator->backoff = 0;
+}
+
+void rtt_estimator_add_timeout(rtt_estimator_t * estimator) {
+    if (estimator->backoff < RTT_ESTIMATOR_MAX_BACKOFF) {
+        estimator->backoff++;
+    }
+}
+
+inline bool rtt_estimator_has_samples(const rtt_estimator_t * estimator) {
+    return estimator->num_samples > 0;
+}
+
+double rtt_estimator_get_rto(const rtt_estimator_t * estimator, double min_rto, double max_rto)
+{
+    double rto = estimator->srtt + MAX(RTT_ESTIMATOR_GRANULARITY, RTT_ESTIMATOR_K * estimator->rttvar);
+
+    if (rto < min_rto) rto = min_rto;
+    rto *= (1 << estimator->backoff);
+    return rto < max_rto ? rto : max_rto;
+}
@@ -0,0 +1,84 @@
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+/**
+ * \file rtt_estimator.h
+ * \brief Retransmission timeout estimator (RFC 6298).
+ *
+ * An rtt_estimator_t smoothes the RTTs measured along a given path
+ * (SRTT) and their variation (RTTVAR), and derives from them how long
+ * a reply may reasonably be awaited:
+ *
+ *    RTO = SRTT + max(G, K * RTTVAR)
+ *
+ * Each timeout doubles the RTO until the next RTT sample (exponential
+ * backoff, see RFC 6298 section 5.5).
+ */
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+
+// Constants of RFC 6298 (section 2)
+#define RTT_ESTIMATOR_ALPHA       0.125 // Gain of SRTT
+#define RTT_ESTIMATOR_BETA        0.25  // Gain of RTTVAR
+#define RTT_ESTIMATOR_K           4
+#define RTT_ESTIMATOR_GRANULARITY 0.01  // Clock granularity G (in seconds)
+
+// Maximum number of consecutive doublings of the RTO
+#define RTT_ESTIMATOR_MAX_BACKOFF 6
+
+/**
+ * \struct rtt_estimator_t
+ * \brief Structure describing the RTTs observed along a path.
+ */
+
+typedef struct {
+    double   srtt;        /**< Smoothed RTT (in seconds) */
+    double   rttvar;      /**< RTT variation (in seconds) */
+    size_t   num_samples; /**< Number of RTTs measured so far */
+    unsigned backoff;     /**< Number of timeouts since the last RTT sample */
+} rtt_estimator_t;
+
+/**
+ * \brief Initialize an estimator having no sample.
+ * \param estimator The estimator we're initializing.
+ */
+
+void rtt_estimator_init(rtt_estimator_t * estimator);
+
+/**
+ * \brief Update an estimator according to a measured RTT.
+ *    The backoff is reset.
+ * \param estimator An estimator.
+ * \param rtt The measured RTT (in seconds).
+ */
+
+void rtt_estimator_add_sample(rtt_estimator_t * estimator, double rtt);
+
+/**
+ * \brief Notify an estimator that a reply has not been received in time.
+ *    The RTO is doubled (up to RTT_ESTIMATOR_MAX_BACKOFF times).
+ * \param estimator An estimator.
+ */
+
+void rtt_estimator_add_timeout(rtt_estimator_t * estimator);
+
+/**
+ * \brief Test whether an estimator has measured at least one RTT.
+ * \param estimator An estimator.
+ * \return true iif the estimator can compute a RTO.
+ */
+
+bool rtt_estimator_has_samples(const rtt_estimator_t * estimator);
+
+/**
+ * \brief Compute the retransmission timeout of an estimator.
+ * \param estimator An estimator having at least one sample.
+ * \param min_rto The lower bound of the RTO (in seconds).
+ * \param max_rto The upper bound of the RTO (in seconds).
+ * \return The RTO (in seconds), between min_rto and max_rto.
+ */
+
+double rtt_estimator_get_rto(const rtt_estimator_t * estimator, double min_rto, double max_rto);
+
+#endif
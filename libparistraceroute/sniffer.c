@@ -3,6 +3,7 @@
 
 #include <stdlib.h>      // malloc
 #include <stdio.h>       // perror
+#include <errno.h>       // errno, EAGAIN
 #include <string.h>      // memcpy, memset
 #include <unistd.h>      // fnctl
 #include <fcntl.h>       // fnctl
@@ -15,9 +16,38 @@
 #  include <netinet/ip6.h> // ip6_hdr
 #endif
 
+#include "os/os.h"
+#include "os/netinet/ip_icmp.h" // ICMP_*
+#include "os/netinet/icmp6.h"   // ICMP6_*
+#ifdef LINUX
+#  include <linux/filter.h>     // struct sock_filter, struct sock_fprog, BPF_*
+#endif
+
+#ifdef USE_PACKET_RING
+#  ifndef LINUX
+#    error "USE_PACKET_RING requires Linux"
+#  endif
+#  include <sys/mman.h>         // mmap, munmap
+#  include <netinet/tcp.h>      // TH_SYN, TH_RST
+#  include <linux/if_ether.h>   // ETH_P_*
+#  include <linux/if_packet.h>  // sockaddr_ll, tpacket_req3, tpacket3_hdr, TP_STATUS_*
+#endif
+
 #include "sniffer.h"
+#include "timestamp.h"   // timestamp_from_realtime
 
 #define BUFLEN 4096
+#define CMSG_BUFLEN 512 // Ancillary data related to a single packet
+
+/**
+ * \brief Buffer receiving the ancillary data of a packet. CMSG_FIRSTHDR
+ *    and CMSG_NXTHDR require it to be aligned like a struct cmsghdr.
+ */
+
+typedef union {
+    struct cmsghdr header;              /**< Only used for its alignment */
+    uint8_t        bytes[CMSG_BUFLEN];  /**< Ancillary data */
+} cmsg_buffer_t;
 
 // Solaris/Sun
 // http://livre.g6.asso.fr/index.php/L%27exemple_%C2%AB_mini-ping_%C2%BB_revisit%C3%A9
@@ -39,6 +69,56 @@
 #  define IPV6_RECVPKTINFO IPV6_PKTINFO
 #endif
 
+#ifndef USE_PACKET_RING
+
+#ifdef HAVE_RECVMMSG
+/**
+ * \brief Buffers allocated once and reused by each call to recvmmsg.
+ *    The i-th message is received in the i-th buffer.
+ */
+
+typedef struct sniffer_batch_s {
+    struct mmsghdr      msgs[SNIFFER_BATCH_SIZE];                /**< Messages passed to recvmmsg */
+    cmsg_buffer_t       cmsgs[SNIFFER_BATCH_SIZE];               /**< Ancillary data of each message */
+    struct iovec        iovecs[SNIFFER_BATCH_SIZE];              /**< Data related to each message */
+    struct sockaddr_in6 froms[SNIFFER_BATCH_SIZE];               /**< Sender of each message (IPv6 only) */
+    uint8_t             buffers[SNIFFER_BATCH_SIZE][BUFLEN];     /**< Bytes of each message */
+    packet_t          * packets[SNIFFER_BATCH_SIZE];             /**< Packets passed to recv_callback */
+} sniffer_batch_t;
+#endif
+
+/**
+ * \brief Ask the kernel to timestamp the packets received on a socket
+ *    (see sniffer_get_timestamp). This is optional, so errors are ignored.
+ * \param sockfd A raw socket.
+ */
+
+static void sniffer_enable_timestamps(int sockfd) {
+#if defined(USE_KERNEL_TIMESTAMPS) && defined(SO_TIMESTAMPNS)
+    int on = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#endif
+}
+
+/**
+ * \brief Retrieve the time at which the kernel has received a packet.
+ * \param msg The msghdr instance filled by recvmsg or recvmmsg.
+ * \return The corresponding timestamp, 0 if the kernel has not
+ *    timestamped the packet.
+ */
+
+static timestamp_t sniffer_get_timestamp(struct msghdr * msg) {
+#if defined(USE_KERNEL_TIMESTAMPS) && defined(SO_TIMESTAMPNS)
+    struct cmsghdr * cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            return timestamp_from_realtime((const struct timespec *) CMSG_DATA(cmsg));
+        }
+    }
+#endif
+    return 0;
+}
 
 /**
  * \brief Initialize an ICMPv4 raw socket in a sniffer_t instance
@@ -62,6 +142,8 @@ static bool create_icmpv4_socket(sniffer_t * sniffer, uint16_t port)
         goto ERR_FCNTL;
     }
 
+    sniffer_enable_timestamps(sniffer->icmpv4_sockfd);
+
 	// Bind it to 0.0.0.0
 	memset(&saddr, 0, sizeof(struct sockaddr_in));
 	saddr.sin_family      = AF_INET;
@@ -107,6 +189,8 @@ static bool create_icmpv6_socket(sniffer_t * sniffer, uint16_t port)
         goto ERR_FCNTL;
     }
 
+    sniffer_enable_timestamps(sniffer->icmpv6_sockfd);
+
     // IPV6 socket options we actually need this for reconstruction of an IPv6 Packet lateron
     // - dst_ip + arriving interface
     // - TCL
@@ -147,7 +231,118 @@ ERR_SOCKET:
 }
 #endif
 
-sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t *, void *))
+#else // USE_PACKET_RING
+
+/**
+ * \brief TPACKET_V3 ring shared with the kernel. The kernel writes the
+ *    packets in the current block, and hands it over to the sniffer by
+ *    setting TP_STATUS_USER in its header. The sniffer gives it back by
+ *    setting TP_STATUS_KERNEL once its packets have been copied.
+ */
+
+typedef struct sniffer_ring_s {
+    uint8_t  * blocks;                       /**< Blocks mapped in our address space */
+    size_t     num_blocks;                   /**< Number of blocks */
+    size_t     block_size;                   /**< Size of a block (in bytes) */
+    size_t     cur_block;                    /**< Index of the next block handed over by the kernel */
+    packet_t * packets[SNIFFER_BATCH_SIZE];  /**< Packets passed to recv_callback */
+} sniffer_ring_t;
+
+/**
+ * \brief Initialize the AF_PACKET socket and its ring in a sniffer_t instance.
+ *    The socket only starts sniffing once the BPF program (see
+ *    sniffer_set_filter) is attached, so that the ring never holds
+ *    unrelated packets.
+ * \param sniffer A pointer to a sniffer_t instance
+ * \return true iif successful
+ */
+
+static bool create_ring_socket(sniffer_t * sniffer)
+{
+    sniffer_ring_t    * ring;
+    struct tpacket_req3 req;
+    struct sockaddr_ll  saddr;
+    int                 version = TPACKET_V3;
+
+    if (!(ring = malloc(sizeof(sniffer_ring_t)))) goto ERR_MALLOC;
+    ring->num_blocks = SNIFFER_RING_NUM_BLOCKS;
+    ring->block_size = SNIFFER_RING_BLOCK_SIZE;
+    ring->cur_block  = 0;
+    sniffer->ring    = ring;
+
+    // SOCK_DGRAM: the packets are passed from their network header.
+    // Protocol 0: nothing is sniffed until the socket is bound.
+    if ((sniffer->ring_sockfd = socket(AF_PACKET, SOCK_DGRAM, 0)) == -1) {
+        perror("create_ring_socket: error while creating socket");
+        goto ERR_SOCKET;
+    }
+
+    memset(&req, 0, sizeof(struct tpacket_req3));
+    req.tp_block_size     = SNIFFER_RING_BLOCK_SIZE;
+    req.tp_block_nr       = SNIFFER_RING_NUM_BLOCKS;
+    req.tp_frame_size     = SNIFFER_RING_FRAME_SIZE;
+    req.tp_frame_nr       = SNIFFER_RING_BLOCK_SIZE / SNIFFER_RING_FRAME_SIZE * SNIFFER_RING_NUM_BLOCKS;
+    req.tp_retire_blk_tov = SNIFFER_RING_TIMEOUT;
+
+    if ((setsockopt(sniffer->ring_sockfd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1)
+    ||  (setsockopt(sniffer->ring_sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1)
+    ) {
+        perror("create_ring_socket: error in setsockopt");
+        goto ERR_SETSOCKOPT;
+    }
+
+    ring->blocks = mmap(
+        NULL, ring->num_blocks * ring->block_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED, sniffer->ring_sockfd, 0
+    );
+    if (ring->blocks == MAP_FAILED) {
+        perror("create_ring_socket: error while mapping the ring");
+        goto ERR_MMAP;
+    }
+
+    // Keep every reply until the network layer narrows the filter
+    if (!sniffer_set_filter(sniffer, 0, UINT16_MAX, 0, UINT16_MAX)) goto ERR_SET_FILTER;
+
+    // Sniff the IPv4 and IPv6 packets of every interface
+    memset(&saddr, 0, sizeof(struct sockaddr_ll));
+    saddr.sll_family   = AF_PACKET;
+    saddr.sll_protocol = htons(ETH_P_ALL);
+    saddr.sll_ifindex  = 0;
+
+    if (bind(sniffer->ring_sockfd, (struct sockaddr *) &saddr, sizeof(struct sockaddr_ll)) == -1) {
+        perror("create_ring_socket: error while binding the socket");
+        goto ERR_BIND;
+    }
+
+    return true;
+
+ERR_BIND:
+ERR_SET_FILTER:
+    munmap(ring->blocks, ring->num_blocks * ring->block_size);
+ERR_MMAP:
+ERR_SETSOCKOPT:
+    close(sniffer->ring_sockfd);
+ERR_SOCKET:
+    free(ring);
+ERR_MALLOC:
+    return false;
+}
+
+/**
+ * \brief Release the AF_PACKET socket and its ring.
+ * \param sniffer A pointer to a sniffer_t instance
+ */
+
+static void free_ring_socket(sniffer_t * sniffer)
+{
+    munmap(sniffer->ring->blocks, sniffer->ring->num_blocks * sniffer->ring->block_size);
+    close(sniffer->ring_sockfd);
+    free(sniffer->ring);
+}
+
+#endif // USE_PACKET_RING
+
+sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t **, size_t, void *))
 {
     sniffer_t * sniffer;
 
@@ -155,15 +350,28 @@ sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t *,
     // requires root privileges
 	// Can we set port to 0 to capture all packets wheter ICMP, UDP or TCP?
     if (!(sniffer = malloc(sizeof(sniffer_t)))) goto ERR_MALLOC;
+#ifdef USE_PACKET_RING
+    sniffer->batch = NULL;
+    if (!create_ring_socket(sniffer))           goto ERR_CREATE_RING_SOCKET;
+#else
+#ifdef HAVE_RECVMMSG
+    if (!(sniffer->batch = malloc(sizeof(sniffer_batch_t)))) goto ERR_BATCH;
+#else
+    sniffer->batch = NULL;
+#endif
 #ifdef USE_IPV4
     if (!create_icmpv4_socket(sniffer, 0))      goto ERR_CREATE_ICMPV4_SOCKET;
 #endif
 #ifdef USE_IPV6
     if (!create_icmpv6_socket(sniffer, 0))      goto ERR_CREATE_ICMPV6_SOCKET;
 #endif
+#endif // USE_PACKET_RING
     sniffer->recv_param = recv_param;
     sniffer->recv_callback = recv_callback;
     return sniffer;
+#ifdef USE_PACKET_RING
+ERR_CREATE_RING_SOCKET:
+#else
 #ifdef USE_IPV6
 ERR_CREATE_ICMPV6_SOCKET:
 #ifdef USE_IPV4
@@ -173,6 +381,11 @@ ERR_CREATE_ICMPV6_SOCKET:
 #ifdef USE_IPV4
 ERR_CREATE_ICMPV4_SOCKET:
 #endif
+    free(sniffer->batch);
+#ifdef HAVE_RECVMMSG
+ERR_BATCH:
+#endif
+#endif // USE_PACKET_RING
     free(sniffer);
 ERR_MALLOC:
     return NULL;
@@ -181,16 +394,306 @@ ERR_MALLOC:
 void sniffer_free(sniffer_t * sniffer)
 {
     if (sniffer) {
+#ifdef USE_PACKET_RING
+        free_ring_socket(sniffer);
+#else
 #ifdef USE_IPV4
         close(sniffer->icmpv4_sockfd);
 #endif
 #ifdef USE_IPV6
         close(sniffer->icmpv6_sockfd);
 #endif
+#endif
+        free(sniffer->batch);
         free(sniffer);
     }
 }
 
+#ifdef LINUX
+
+// Verdicts of the BPF programs (number of bytes kept)
+#define SNIFFER_BPF_ACCEPT 0xffff
+#define SNIFFER_BPF_DROP   0
+
+/**
+ * \brief Attach a BPF program to a socket. It replaces the one previously
+ *    attached (if any).
+ * \param sockfd The socket.
+ * \param code The instructions of the program.
+ * \param num_instructions The number of instructions.
+ * \return true iif successful.
+ */
+
+static bool sniffer_attach_filter(int sockfd, struct sock_filter * code, size_t num_instructions) {
+    struct sock_fprog program;
+
+    program.len    = num_instructions;
+    program.filter = code;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == -1) {
+        perror("sniffer_attach_filter: Can't attach BPF program");
+        return false;
+    }
+    return true;
+}
+
+#ifndef USE_PACKET_RING
+
+#ifdef USE_IPV4
+/**
+ * \brief Attach a BPF program to the ICMPv4 socket (see sniffer_set_filter).
+ *    The packets are passed to the program from their IPv4 header.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param min_src_port See sniffer_set_filter.
+ * \param max_src_port See sniffer_set_filter.
+ * \param min_icmp_id See sniffer_set_filter.
+ * \param max_icmp_id See sniffer_set_filter.
+ * \return true iif successful.
+ */
+
+static bool sniffer_set_icmpv4_filter(
+    sniffer_t * sniffer,
+    uint16_t    min_src_port,
+    uint16_t    max_src_port,
+    uint16_t    min_icmp_id,
+    uint16_t    max_icmp_id
+) {
+    struct sock_filter code[] = {
+        // X = offset of the ICMP header, A = ICMP type
+        /*  0 */ BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 0),
+        /*  1 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 0),
+        /*  2 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 20, 0), // -> 23
+        /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_UNREACH,    4, 0),  // -> 8
+        /*  4 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIMXCEED,   3, 0),  // -> 8
+        /*  5 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_PARAMPROB,  2, 0),  // -> 8
+        /*  6 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_REDIRECT,   1, 0),  // -> 8
+        /*  7 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_DROP),
+
+        // ICMP error: M[0] = protocol of the quoted IPv4 packet,
+        // X = offset of the quoted transport header
+        /*  8 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 8 + 9),
+        /*  9 */ BPF_STMT(BPF_ST, 0),
+        /* 10 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 8),
+        /* 11 */ BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0f),
+        /* 12 */ BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2),
+        /* 13 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+        /* 14 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 8),
+        /* 15 */ BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        /* 16 */ BPF_STMT(BPF_LD  | BPF_MEM, 0),
+        /* 17 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, 5, 0),     // -> 23
+        /* 18 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP,  1, 0),     // -> 20
+        /* 19 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP,  0, 6),     // -> 20, 26
+
+        // A = quoted source port
+        /* 20 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 0),
+        /* 21 */ BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, min_src_port, 0, 5),     // -> 22, 27
+        /* 22 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, max_src_port, 4, 3),     // -> 27, 26
+
+        // A = ICMP identifier (echo reply or quoted echo request)
+        /* 23 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 4),
+        /* 24 */ BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, min_icmp_id, 0, 2),      // -> 25, 27
+        /* 25 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, max_icmp_id, 1, 0),      // -> 27, 26
+
+        /* 26 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_ACCEPT),
+        /* 27 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_DROP)
+    };
+
+    return sniffer_attach_filter(sniffer->icmpv4_sockfd, code, sizeof(code) / sizeof(struct sock_filter));
+}
+#endif
+
+#ifdef USE_IPV6
+/**
+ * \brief Attach a BPF program to the ICMPv6 socket (see sniffer_set_filter).
+ *    The packets are passed to the program from their ICMPv6 header.
+ *    Quoted packets carrying extension headers are always kept.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param min_src_port See sniffer_set_filter.
+ * \param max_src_port See sniffer_set_filter.
+ * \param min_icmp_id See sniffer_set_filter.
+ * \param max_icmp_id See sniffer_set_filter.
+ * \return true iif successful.
+ */
+
+static bool sniffer_set_icmpv6_filter(
+    sniffer_t * sniffer,
+    uint16_t    min_src_port,
+    uint16_t    max_src_port,
+    uint16_t    min_icmp_id,
+    uint16_t    max_icmp_id
+) {
+    struct sock_filter code[] = {
+        // A = ICMPv6 type
+        /*  0 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 0),
+        /*  1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_ECHO_REPLY,    14, 0), // -> 16
+        /*  2 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_DST_UNREACH,    4, 0), // -> 7
+        /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_PACKET_TOO_BIG, 3, 0), // -> 7
+        /*  4 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_TIME_EXCEEDED,  2, 0), // -> 7
+        /*  5 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_PARAM_PROB,     1, 0), // -> 7
+        /*  6 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_DROP),
+
+        // ICMPv6 error: A = next header of the quoted IPv6 packet
+        /*  7 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 8 + 6),
+        /*  8 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMPV6, 5, 0),      // -> 14
+        /*  9 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP,    1, 0),      // -> 11
+        /* 10 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP,    0, 8),      // -> 11, 19
+
+        // A = quoted source port
+        /* 11 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 8 + sizeof(struct ip6_hdr)),
+        /* 12 */ BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, min_src_port, 0, 7),        // -> 13, 20
+        /* 13 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, max_src_port, 6, 5),        // -> 20, 19
+
+        // A = ICMPv6 identifier (quoted echo request or echo reply)
+        /* 14 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 8 + sizeof(struct ip6_hdr) + 4),
+        /* 15 */ BPF_STMT(BPF_JMP | BPF_JA, 1),                                  // -> 17
+        /* 16 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 4),
+        /* 17 */ BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, min_icmp_id, 0, 2),         // -> 18, 20
+        /* 18 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, max_icmp_id, 1, 0),         // -> 20, 19
+
+        /* 19 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_ACCEPT),
+        /* 20 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_DROP)
+    };
+
+    return sniffer_attach_filter(sniffer->icmpv6_sockfd, code, sizeof(code) / sizeof(struct sock_filter));
+}
+#endif
+
+#else // USE_PACKET_RING
+
+/**
+ * \brief Attach a BPF program to the AF_PACKET socket (see sniffer_set_filter).
+ *    The packets are passed to the program from their network header.
+ *    It drops the packets we send, and the IPv6 packets carrying
+ *    extension headers.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param min_src_port See sniffer_set_filter.
+ * \param max_src_port See sniffer_set_filter.
+ * \param min_icmp_id See sniffer_set_filter.
+ * \param max_icmp_id See sniffer_set_filter.
+ * \return true iif successful.
+ */
+
+static bool sniffer_set_ring_filter(
+    sniffer_t * sniffer,
+    uint16_t    min_src_port,
+    uint16_t    max_src_port,
+    uint16_t    min_icmp_id,
+    uint16_t    max_icmp_id
+) {
+    struct sock_filter code[] = {
+        /*  0 */ BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        /*  1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 50, 0),   // -> 52
+        /*  2 */ BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+        /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 21, 0),        // -> 25
+        /*  4 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP,    0, 47),       // -> 5, 52
+
+        // IPv4: X = offset of the transport header
+        /*  5 */ BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 0),
+        /*  6 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 9),
+        /*  7 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP,  35, 0),      // -> 43
+        /*  8 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP,  0, 43),     // -> 9, 52
+        /*  9 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 0),
+        /* 10 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 37, 0),    // -> 48
+        /* 11 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_UNREACH,    3, 0),    // -> 15
+        /* 12 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIMXCEED,   2, 0),    // -> 15
+        /* 13 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_PARAMPROB,  1, 0),    // -> 15
+        /* 14 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_REDIRECT,   0, 37),   // -> 15, 52
+
+        // ICMPv4 error: M[0] = protocol of the quoted IPv4 packet,
+        // X = offset of the quoted transport header
+        /* 15 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 8 + 9),
+        /* 16 */ BPF_STMT(BPF_ST, 0),
+        /* 17 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 8),
+        /* 18 */ BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0f),
+        /* 19 */ BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2),
+        /* 20 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+        /* 21 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 8),
+        /* 22 */ BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        /* 23 */ BPF_STMT(BPF_LD  | BPF_MEM, 0),
+        /* 24 */ BPF_STMT(BPF_JMP | BPF_JA, 12),                                // -> 37
+
+        // IPv6: X = offset of the transport header
+        /* 25 */ BPF_STMT(BPF_LDX | BPF_W   | BPF_IMM, sizeof(struct ip6_hdr)),
+        /* 26 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 6),
+        /* 27 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP,    15, 0),    // -> 43
+        /* 28 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMPV6,  0, 23),   // -> 29, 52
+        /* 29 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 0),
+        /* 30 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_ECHO_REPLY,    17, 0), // -> 48
+        /* 31 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_DST_UNREACH,    3, 0), // -> 35
+        /* 32 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_PACKET_TOO_BIG, 2, 0), // -> 35
+        /* 33 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_TIME_EXCEEDED,  1, 0), // -> 35
+        /* 34 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_PARAM_PROB,     0, 17), // -> 35, 52
+
+        // ICMPv6 error: A = next header of the quoted IPv6 packet,
+        // X = offset of the quoted transport header
+        /* 35 */ BPF_STMT(BPF_LDX | BPF_W   | BPF_IMM, 2 * sizeof(struct ip6_hdr) + 8),
+        /* 36 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, sizeof(struct ip6_hdr) + 8 + 6),
+
+        // ICMP error: A = quoted source port or ICMP identifier (if any)
+        /* 37 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP,   10, 0),    // -> 48
+        /* 38 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMPV6,  9, 0),    // -> 48
+        /* 39 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP,     1, 0),    // -> 41
+        /* 40 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP,     0, 10),   // -> 41, 51
+        /* 41 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 0),
+        /* 42 */ BPF_STMT(BPF_JMP | BPF_JA, 3),                                 // -> 46
+
+        // TCP reply (RST, SYN-ACK): A = destination port
+        /* 43 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 13),
+        /* 44 */ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, TH_SYN | TH_RST, 0, 7),  // -> 45, 52
+        /* 45 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 2),
+
+        // A = one of our source ports?
+        /* 46 */ BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, min_src_port, 0, 5),       // -> 47, 52
+        /* 47 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, max_src_port, 4, 3),       // -> 52, 51
+
+        // A = one of our ICMP identifiers? (echo reply or quoted echo request)
+        /* 48 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 4),
+        /* 49 */ BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, min_icmp_id, 0, 2),        // -> 50, 52
+        /* 50 */ BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, max_icmp_id, 1, 0),        // -> 52, 51
+
+        /* 51 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_ACCEPT),
+        /* 52 */ BPF_STMT(BPF_RET | BPF_K, SNIFFER_BPF_DROP)
+    };
+
+    return sniffer_attach_filter(sniffer->ring_sockfd, code, sizeof(code) / sizeof(struct sock_filter));
+}
+
+#endif // USE_PACKET_RING
+
+#endif // LINUX
+
+bool sniffer_set_filter(
+    sniffer_t * sniffer,
+    uint16_t    min_src_port,
+    uint16_t    max_src_port,
+    uint16_t    min_icmp_id,
+    uint16_t    max_icmp_id
+) {
+    bool ret = true;
+
+#if defined(USE_PACKET_RING)
+    ret = sniffer_set_ring_filter(sniffer, min_src_port, max_src_port, min_icmp_id, max_icmp_id);
+#elif defined(LINUX)
+#  ifdef USE_IPV4
+    ret &= sniffer_set_icmpv4_filter(sniffer, min_src_port, max_src_port, min_icmp_id, max_icmp_id);
+#  endif
+#  ifdef USE_IPV6
+    ret &= sniffer_set_icmpv6_filter(sniffer, min_src_port, max_src_port, min_icmp_id, max_icmp_id);
+#  endif
+#else
+    ret = false;
+#endif
+    return ret;
+}
+
+#ifdef USE_PACKET_RING
+
+int sniffer_get_ring_sockfd(sniffer_t * sniffer) {
+    return sniffer->ring_sockfd;
+}
+
+#else // USE_PACKET_RING
+
 #ifdef USE_IPV4
 int sniffer_get_icmpv4_sockfd(sniffer_t *sniffer) {
     return sniffer->icmpv4_sockfd;
@@ -263,7 +766,7 @@ static bool rebuild_ipv6_header(
                     ret = false;
                     break;
             }
-        } else {
+        } else if (cmsg->cmsg_level != SOL_SOCKET) { // SOL_SOCKET: see sniffer_get_timestamp
             // This should never occur
             fprintf(stderr, "Ignoring msg (level = %d)\n", cmsg->cmsg_level);
             ret = false;
@@ -274,111 +777,352 @@ static bool rebuild_ipv6_header(
 }
 
 /**
- * \brief Fetch an IPv6/ICMPv6 packet from an IPv6 socket
- * \param ipv6_sockfd An IPv6 socket which is sniffing an ICMPv6 packet
+ * \brief Prepare a msghdr instance to fetch an IPv6/ICMPv6 packet.
+ *   The bytes nested in the IPv6 packet are written right after the
+ *   room left for the IPv6 header, which is rebuilt by
+ *   recv_icmpv6_finalize.
+ * \param msg The msghdr instance we're preparing.
+ * \param iov The iovec instance related to msg.
+ * \param from The sockaddr_in6 instance in which the sender is written.
+ * \param cmsg_buf The buffer in which ancillary data is written.
+ * \param cmsg_len The size of cmsg_buf.
  * \param bytes A preallocated buffer in which we write the full IPv6 packet.
  * \param len The size of the preallocated buffer
- * \param flags
  */
 
-static ssize_t recv_icmpv6(int ipv6_sockfd, void * bytes, size_t len, int flags) {
-    ssize_t               num_bytes;
-    char                  cmsg_buf[BUFLEN];
-    struct sockaddr_in6   from;
-    struct ip6_hdr      * ip6_header = (struct ip6_hdr *) bytes;
+static void recv_icmpv6_prepare(
+    struct msghdr       * msg,
+    struct iovec        * iov,
+    struct sockaddr_in6 * from,
+    void                * cmsg_buf,
+    size_t                cmsg_len,
+    void                * bytes,
+    size_t                len
+) {
+    iov->iov_base = ((uint8_t *) bytes) + sizeof(struct ip6_hdr);
+    iov->iov_len  = len - sizeof(struct ip6_hdr);
 
-    struct iovec iov = {
-        .iov_base = ((uint8_t *) bytes) + sizeof(struct ip6_hdr),
-        .iov_len  = len - sizeof(struct ip6_hdr)
-    };
+    msg->msg_name       = from;             // socket address
+    msg->msg_namelen    = sizeof(*from);    // sizeof socket
+    msg->msg_iov        = iov;              // buffer (scather/gather array)
+    msg->msg_iovlen     = 1;                // number of msg_iov elements
+    msg->msg_control    = cmsg_buf;         // ancillary data
+    msg->msg_controllen = cmsg_len;         // sizeof ancillary data
+    msg->msg_flags      = 0;                // flags related to recv messages
+}
 
-    struct msghdr msg = {
-        .msg_name       = &from,            // socket address
-        .msg_namelen    = sizeof(from),     // sizeof socket
-        .msg_iov        = &iov,             // buffer (scather/gather array)
-        .msg_iovlen     = 1,                // number of msg_iov elements
-        .msg_control    = cmsg_buf,         // ancillary data
-        .msg_controllen = sizeof(cmsg_buf), // sizeof ancillary data
-        .msg_flags      = flags             // flags related to recv messages
-    };
+/**
+ * \brief Complete an IPv6/ICMPv6 packet fetched thanks to a msghdr
+ *    instance prepared by recv_icmpv6_prepare.
+ * \param msg The msghdr instance filled by recvmsg or recvmmsg.
+ * \param bytes The buffer passed to recv_icmpv6_prepare.
+ * \param num_bytes The number of bytes received.
+ * \return The size of the full IPv6 packet, 0 in case of failure.
+ */
+
+static ssize_t recv_icmpv6_finalize(struct msghdr * msg, void * bytes, ssize_t num_bytes) {
+    struct ip6_hdr * ip6_header = (struct ip6_hdr *) bytes;
 
     // We do not need memset since we will explicitely set each bit of
     // the IPv6 header. Uncomment to debug.
     //memset(bytes, 0, sizeof(struct ip6_hdr));
 
-    // Fetch the bytes nested in the IPv6 packet (in the case of traceroute,
-    // we fetch ICMPv6/UDP/payload layers).
-    if ((num_bytes = recvmsg(ipv6_sockfd, &msg, flags)) == -1) {
-        fprintf(stderr, "recv_ipv6_header: Can't fetch data\n");
-        goto ERR_RECVMSG;
-    }
-
-    if (msg.msg_flags & MSG_TRUNC) {
+    if (msg->msg_flags & MSG_TRUNC) {
         fprintf(stderr, "recv_ipv6_header: data truncated\n");
         goto ERR_MSG_TRUNC;
     }
 
-    if (msg.msg_flags & MSG_CTRUNC) {
+    if (msg->msg_flags & MSG_CTRUNC) {
         fprintf(stderr, "recv_ipv6_header: ancillary data truncated\n");
         goto ERR_MSG_CTRUNK;
     }
 
-    if(!rebuild_ipv6_header(ip6_header, &msg, &from, num_bytes)) {
+    if(!rebuild_ipv6_header(ip6_header, msg, msg->msg_name, num_bytes)) {
         fprintf(stderr, "recv_ipv6_header: error in rebuild_ipv6_header\n");
         goto ERR_REBUILD_IPV6_HEADER;
     }
 
     return num_bytes + sizeof(struct ip6_hdr);
+
 ERR_REBUILD_IPV6_HEADER:
 ERR_MSG_CTRUNK:
 ERR_MSG_TRUNC:
-ERR_RECVMSG:
     return 0;
 }
 
+#ifndef HAVE_RECVMMSG
+/**
+ * \brief Fetch an IPv6/ICMPv6 packet from an IPv6 socket
+ * \param ipv6_sockfd An IPv6 socket which is sniffing an ICMPv6 packet
+ * \param bytes A preallocated buffer in which we write the full IPv6 packet.
+ * \param len The size of the preallocated buffer
+ * \param flags
+ * \param timestamp Address of a timestamp_t in which the reception time
+ *    reported by the kernel is written (0 if unknown).
+ */
+
+static ssize_t recv_icmpv6(int ipv6_sockfd, void * bytes, size_t len, int flags, timestamp_t * timestamp) {
+    ssize_t               num_bytes;
+    cmsg_buffer_t         cmsg_buf;
+    struct sockaddr_in6   from;
+    struct iovec          iov;
+    struct msghdr         msg;
+
+    recv_icmpv6_prepare(&msg, &iov, &from, cmsg_buf.bytes, sizeof(cmsg_buf.bytes), bytes, len);
+
+    // Fetch the bytes nested in the IPv6 packet (in the case of traceroute,
+    // we fetch ICMPv6/UDP/payload layers).
+    if ((num_bytes = recvmsg(ipv6_sockfd, &msg, flags)) == -1) {
+        fprintf(stderr, "recv_ipv6_header: Can't fetch data\n");
+        return 0;
+    }
+
+    *timestamp = sniffer_get_timestamp(&msg);
+    return recv_icmpv6_finalize(&msg, bytes, num_bytes);
+}
+#endif // HAVE_RECVMMSG
+
 #endif // USE_IPV6
 
+#if defined(USE_IPV4) && !defined(HAVE_RECVMMSG)
+/**
+ * \brief Fetch an IPv4/ICMPv4 packet from an IPv4 socket
+ * \param ipv4_sockfd An IPv4 socket which is sniffing an ICMPv4 packet
+ * \param bytes A preallocated buffer in which we write the IPv4 packet.
+ * \param len The size of the preallocated buffer
+ * \param flags
+ * \param timestamp Address of a timestamp_t in which the reception time
+ *    reported by the kernel is written (0 if unknown).
+ */
+
+static ssize_t recv_icmpv4(int ipv4_sockfd, void * bytes, size_t len, int flags, timestamp_t * timestamp) {
+    ssize_t               num_bytes;
+    cmsg_buffer_t         cmsg_buf;
+    struct iovec          iov;
+    struct msghdr         msg;
+
+    iov.iov_base = bytes;
+    iov.iov_len  = len;
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cmsg_buf.bytes;
+    msg.msg_controllen = sizeof(cmsg_buf.bytes);
+
+    if ((num_bytes = recvmsg(ipv4_sockfd, &msg, flags)) == -1) {
+        fprintf(stderr, "recv_icmpv4: Can't fetch data\n");
+        return 0;
+    }
+
+    *timestamp = sniffer_get_timestamp(&msg);
+    return num_bytes;
+}
+#endif
+
+#endif // USE_PACKET_RING
+
+/**
+ * \brief Make a packet_t instance from bytes fetched from a raw socket.
+ * \param bytes The fetched bytes.
+ * \param num_bytes The number of fetched bytes.
+ * \param timestamp The reception time reported by the kernel (0 if unknown).
+ * \return The corresponding packet, NULL if these bytes are irrelevant
+ *    or in case of failure.
+ */
+
+static packet_t * sniffer_create_packet(uint8_t * bytes, ssize_t num_bytes, timestamp_t timestamp) {
+    packet_t * packet;
+
+	if (num_bytes < 4) return NULL;
+
+    // We have to make some modifications on the datagram
+    // received because the raw format varies between
+    // OSes:
+    //  - Linux: the whole packet is in network endianess
+    //  - NetBSD: the packet is in network endianess except
+    //  IP total length and frag ofs(?) are in host-endian
+    //  - FreeBSD: same as NetBSD?
+    //  - Apple: same as NetBSD?
+    //  Bug? On NetBSD, the IP length seems incorrect
+#if defined __APPLE__ || __NetBSD__ || __FreeBSD__
+    //uint16_t ip_len = read16(bytes, 2);
+    //writebe16(bytes, 2, ip_len);
+    printf("sniffer_process_packets: something unclear here\n");
+#endif
+    if ((packet = packet_create_from_bytes(bytes, num_bytes))) {
+        packet->timestamp = timestamp;
+    }
+    return packet;
+}
+
+#if defined(USE_PACKET_RING)
+
+/**
+ * \brief Pass the packets copied from the ring to recv_callback.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param num_packets The number of packets stored in sniffer->ring->packets.
+ */
+
+static void sniffer_ring_flush(sniffer_t * sniffer, size_t num_packets)
+{
+    if (num_packets > 0 && sniffer->recv_callback != NULL) {
+        if (!(sniffer->recv_callback(sniffer->ring->packets, num_packets, sniffer->recv_param))) {
+            fprintf(stderr, "Error in sniffer's callback\n");
+        }
+    }
+}
+
 void sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id)
 {
-    uint8_t    recv_bytes[BUFLEN];
-    ssize_t    num_bytes = 0;
-    packet_t * packet;
+    sniffer_ring_t            * ring = sniffer->ring;
+    struct tpacket_block_desc * block;
+    struct tpacket3_hdr       * header;
+    uint32_t                    i;
+    size_t                      num_packets = 0;
+    timestamp_t                 timestamp = 0;
+#ifdef USE_KERNEL_TIMESTAMPS
+    struct timespec             date;
+#endif
+    packet_t                  * packet;
+
+    // Process the blocks handed over by the kernel, in the order they have
+    // been filled. The packets are copied right from the ring.
+    for (;;) {
+        block = (struct tpacket_block_desc *) (ring->blocks + ring->cur_block * ring->block_size);
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) break;
+
+        header = (struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+        for (i = 0; i < block->hdr.bh1.num_pkts; i++) {
+#ifdef USE_KERNEL_TIMESTAMPS
+            date.tv_sec  = header->tp_sec;
+            date.tv_nsec = header->tp_nsec;
+            timestamp = timestamp_from_realtime(&date);
+#endif
+            if ((packet = sniffer_create_packet((uint8_t *) header + header->tp_net, header->tp_snaplen, timestamp))) {
+                ring->packets[num_packets++] = packet;
+                if (num_packets == SNIFFER_BATCH_SIZE) {
+                    sniffer_ring_flush(sniffer, num_packets);
+                    num_packets = 0;
+                }
+            }
+            header = (struct tpacket3_hdr *) ((uint8_t *) header + header->tp_next_offset);
+        }
+
+        // Give the block back to the kernel
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        ring->cur_block = (ring->cur_block + 1) % ring->num_blocks;
+    }
+
+    sniffer_ring_flush(sniffer, num_packets);
+}
+
+#elif defined(HAVE_RECVMMSG)
+
+void sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id)
+{
+    sniffer_batch_t * batch = sniffer->batch;
+    int               sockfd;
+    bool              is_icmpv6 = false;
+    int               i, num_msgs;
+    size_t            num_packets = 0;
+    ssize_t           num_bytes;
+    timestamp_t       timestamp;
+    packet_t        * packet;
 
     switch (protocol_id) {
 #ifdef USE_IPV4
         case IPPROTO_ICMP:
-            num_bytes = recv(sniffer->icmpv4_sockfd, recv_bytes, BUFLEN, 0);
+            sockfd = sniffer->icmpv4_sockfd;
             break;
 #endif
 #ifdef USE_IPV6
         case IPPROTO_ICMPV6:
-            num_bytes = recv_icmpv6(sniffer->icmpv6_sockfd, recv_bytes, BUFLEN, 0);
+            sockfd = sniffer->icmpv6_sockfd;
+            is_icmpv6 = true;
             break;
 #endif
+        default:
+            return;
     }
 
-	if (num_bytes >= 4) {
-		// We have to make some modifications on the datagram
-		// received because the raw format varies between
-		// OSes:
-		//  - Linux: the whole packet is in network endianess
-		//  - NetBSD: the packet is in network endianess except
-		//  IP total length and frag ofs(?) are in host-endian
-		//  - FreeBSD: same as NetBSD?
-		//  - Apple: same as NetBSD?
-		//  Bug? On NetBSD, the IP length seems incorrect
-#if defined __APPLE__ || __NetBSD__ || __FreeBSD__
-		//uint16_t ip_len = read16(recv_bytes, 2);
-		//writebe16(recv_bytes, 2, ip_len);
-        printf("sniffer_process_packets: something unclear here\n");
+    // Prepare the messages. IPv6 packets are received without their
+    // IPv6 header, which is rebuilt thanks to ancillary data.
+    for (i = 0; i < SNIFFER_BATCH_SIZE; i++) {
+#ifdef USE_IPV6
+        if (is_icmpv6) {
+            recv_icmpv6_prepare(
+                &batch->msgs[i].msg_hdr, &batch->iovecs[i], &batch->froms[i],
+                batch->cmsgs[i].bytes, CMSG_BUFLEN, batch->buffers[i], BUFLEN
+            );
+            continue;
+        }
+#endif
+        batch->iovecs[i].iov_base = batch->buffers[i];
+        batch->iovecs[i].iov_len  = BUFLEN;
+        memset(&batch->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+        batch->msgs[i].msg_hdr.msg_iov        = &batch->iovecs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen     = 1;
+        batch->msgs[i].msg_hdr.msg_control    = batch->cmsgs[i].bytes;
+        batch->msgs[i].msg_hdr.msg_controllen = CMSG_BUFLEN;
+    }
+
+    // Fetch every pending packet (up to SNIFFER_BATCH_SIZE) in a row.
+    if ((num_msgs = recvmmsg(sockfd, batch->msgs, SNIFFER_BATCH_SIZE, MSG_DONTWAIT, NULL)) == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("sniffer_process_packets: recvmmsg");
+        }
+        return;
+    }
+
+    for (i = 0; i < num_msgs; i++) {
+        num_bytes = batch->msgs[i].msg_len;
+#ifdef USE_IPV6
+        if (is_icmpv6) {
+            num_bytes = recv_icmpv6_finalize(&batch->msgs[i].msg_hdr, batch->buffers[i], num_bytes);
+        }
+#endif
+        timestamp = sniffer_get_timestamp(&batch->msgs[i].msg_hdr);
+        if ((packet = sniffer_create_packet(batch->buffers[i], num_bytes, timestamp))) {
+            batch->packets[num_packets++] = packet;
+        }
+    }
+
+    if (num_packets > 0 && sniffer->recv_callback != NULL) {
+        if (!(sniffer->recv_callback(batch->packets, num_packets, sniffer->recv_param))) {
+            fprintf(stderr, "Error in sniffer's callback\n");
+        }
+    }
+}
+
+#else // HAVE_RECVMMSG
+
+void sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id)
+{
+    uint8_t     recv_bytes[BUFLEN];
+    ssize_t     num_bytes = 0;
+    timestamp_t timestamp = 0;
+    packet_t  * packet;
+
+    switch (protocol_id) {
+#ifdef USE_IPV4
+        case IPPROTO_ICMP:
+            num_bytes = recv_icmpv4(sniffer->icmpv4_sockfd, recv_bytes, BUFLEN, 0, &timestamp);
+            break;
+#endif
+#ifdef USE_IPV6
+        case IPPROTO_ICMPV6:
+            num_bytes = recv_icmpv6(sniffer->icmpv6_sockfd, recv_bytes, BUFLEN, 0, &timestamp);
+            break;
 #endif
-		if (sniffer->recv_callback != NULL) {
-            packet = packet_create_from_bytes(recv_bytes, num_bytes);
+    }
 
-			if (!(sniffer->recv_callback(packet, sniffer->recv_param))) {
+    if (sniffer->recv_callback != NULL) {
+        if ((packet = sniffer_create_packet(recv_bytes, num_bytes, timestamp))) {
+            if (!(sniffer->recv_callback(&packet, 1, sniffer->recv_param))) {
                 fprintf(stderr, "Error in sniffer's callback\n");
             }
         }
-	}
+    }
 }
 
+#endif // HAVE_RECVMMSG
@@ -7,40 +7,72 @@
  * \file sniffer.h
  * \brief Header file : packet sniffer
  *
- * The current implementation is based on raw sockets, but we could envisage a
- * libpcap implementation too
+ * The default implementation is based on raw ICMP sockets. If USE_PACKET_RING
+ * is defined (see use.h), the replies are read from a memory-mapped ring
+ * shared with the kernel (see packet_mmap.txt in the Linux documentation),
+ * so that bursts of replies are fetched without any system call. This
+ * backend also captures the TCP replies (RST, SYN-ACK) of TCP probes.
  */
 
 #include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint16_t
 #include "packet.h"  // packet_t
 
+// Maximum number of packets fetched by a single call to
+// sniffer_process_packets (if recvmmsg is available).
+#define SNIFFER_BATCH_SIZE 32
+
+#ifdef USE_PACKET_RING
+// Geometry of the TPACKET_V3 ring. The kernel fills the blocks one by one
+// and hands a block over to the sniffer once it is full, or once it has
+// been open for SNIFFER_RING_TIMEOUT milliseconds.
+#  define SNIFFER_RING_BLOCK_SIZE  (1 << 18)
+#  define SNIFFER_RING_NUM_BLOCKS  16
+#  define SNIFFER_RING_FRAME_SIZE  2048
+#  define SNIFFER_RING_TIMEOUT     1
+#endif
+
+struct sniffer_batch_s;
+struct sniffer_ring_s;
+
 /**
  * \struct sniffer_t
  * \brief Structure representing a packet sniffer. The sniffer calls
  *    a function whenever a packet is sniffed. For instance
  *    sniffer->recv_param may point to a queue_t instance and
  *    sniffer->recv_callback may be used to feed this queue whenever
- *    a packet is sniffed.
+ *    packets are sniffed. Packets are passed by batch to recv_callback.
  */
 
 typedef struct {
+#ifdef USE_PACKET_RING
+    int     ring_sockfd;    /**< AF_PACKET socket sniffing IPv4 and IPv6 packets */
+    struct sniffer_ring_s * ring; /**< Ring shared with the kernel */
+#else
 #ifdef USE_IPV4
     int     icmpv4_sockfd;  /**< Raw socket for sniffing ICMPv4 packets */
 #endif
 #ifdef USE_IPV6
     int     icmpv6_sockfd;  /**< Raw socket for sniffing ICMPv6 packets */
+#endif
 #endif
     void  * recv_param;     /**< This pointer is passed whenever recv_callback is called */
-    bool (* recv_callback)(packet_t * packet, void * recv_param); /**< Callback for received packets */
+    bool (* recv_callback)(packet_t ** packets, size_t num_packets, void * recv_param); /**< Callback for received packets */
+    struct sniffer_batch_s * batch; /**< Preallocated buffers used to fetch packets with recvmmsg (NULL if not supported) */
 } sniffer_t;
 
 /**
  * \brief Creates a new sniffer.
- * \param callback This function is called whenever a packet is sniffed.
+ * \param recv_param This pointer is passed whenever recv_callback is called.
+ * \param recv_callback This function is called whenever packets are sniffed.
+ *    It receives an array of num_packets packets. Packets are not freed
+ *    by the sniffer, the array is. Their reception time reported by
+ *    the kernel (if any) is stored in packet->timestamp.
  * \return Pointer to a sniffer_t structure representing a packet sniffer
  */
 
-sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t *, void *));
+sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t **, size_t, void *));
 
 /**
  * \brief Free a sniffer_t structure.
@@ -49,6 +81,18 @@ sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t *,
 
 void sniffer_free(sniffer_t * sniffer);
 
+#ifdef USE_PACKET_RING
+/**
+ * \brief Return the file descriptor related to the AF_PACKET socket
+ *    managed by the sniffer. It becomes readable whenever the kernel
+ *    hands a block of the ring over to the sniffer.
+ * \param sniffer Points to a sniffer_t instance.
+ * \return The corresponding socket file descriptor.
+ */
+
+int sniffer_get_ring_sockfd(sniffer_t * sniffer);
+#else
+
 #ifdef USE_IPV4
 /**
  * \brief Return the file descriptor related to the ICMPv4 raw socket
@@ -71,13 +115,54 @@ int sniffer_get_icmpv4_sockfd(sniffer_t * sniffer);
 int sniffer_get_icmpv6_sockfd(sniffer_t * sniffer);
 #endif
 
+#endif // USE_PACKET_RING
+
+/**
+ * \brief Make the kernel drop the ICMP packets which cannot be related
+ *    to our probes, so that they are never copied to the user space.
+ *    A BPF program (see SO_ATTACH_FILTER in socket(7)) is attached to
+ *    each raw socket. It keeps:
+ *    - the echo replies whose identifier is in [min_icmp_id, max_icmp_id];
+ *    - the ICMP errors (destination unreachable, time exceeded...),
+ *    provided the quoted packet is not a UDP or TCP packet whose source
+ *    port is outside [min_src_port, max_src_port], nor an ICMP packet
+ *    whose identifier is outside [min_icmp_id, max_icmp_id].
+ *    Without any filter (default), every ICMP packet is delivered.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param min_src_port The lowest source port of our UDP and TCP probes.
+ * \param max_src_port The highest source port of our UDP and TCP probes.
+ *    If max_src_port < min_src_port, every ICMP error quoting a UDP or a
+ *    TCP packet is dropped.
+ *    If USE_PACKET_RING is defined, the program also keeps the TCP RST
+ *    and SYN-ACK whose destination port is in [min_src_port, max_src_port].
+ * \param min_icmp_id The lowest identifier of our ICMP echo probes.
+ * \param max_icmp_id The highest identifier of our ICMP echo probes.
+ *    If max_icmp_id < min_icmp_id, every echo reply and every ICMP error
+ *    quoting an ICMP packet is dropped.
+ * \return true iif successful.
+ */
+
+bool sniffer_set_filter(
+    sniffer_t * sniffer,
+    uint16_t    min_src_port,
+    uint16_t    max_src_port,
+    uint16_t    min_icmp_id,
+    uint16_t    max_icmp_id
+);
+
 /**
- * \brief Fetch a packet from the listening socket. The sniffer then
- *   call recv_callback and pass to this function this packet and
- *   eventual data stored in sniffer->recv_packet. If this callback
- *   returns false, a message is printed. 
+ * \brief Fetch packets from the listening socket. If recvmmsg is
+ *   available, up to SNIFFER_BATCH_SIZE packets are fetched at once.
+ *   The sniffer then call recv_callback once and pass to this function
+ *   these packets and eventual data stored in sniffer->recv_param.
+ *   If this callback returns false, a message is printed.
+ *   If USE_PACKET_RING is defined, every block handed over by the kernel
+ *   is processed, and recv_callback is called once per SNIFFER_BATCH_SIZE
+ *   packets.
  * \param sniffer Points to a sniffer_t instance.
- * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6).
+ *   It is ignored if USE_PACKET_RING is defined, since the ring holds
+ *   the packets of both families.
  */
 
 void sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id);
@@ -3,13 +3,21 @@
 
 #include <stdlib.h>             // malloc
 #include <stdio.h>              // perror
+#include <errno.h>              // errno
 #include <unistd.h>             // close
 #include <sys/socket.h>         // socket, getaddrinfo
 #include <sys/types.h>          // getaddrinfo
 #include <netdb.h>              // getaddrinfo
+#include <netinet/in.h>         // IPPROTO_IP, IPPROTO_IPV6
 #include <arpa/inet.h>          // inet_pton
 #include <string.h>             // memset
 
+#ifdef USE_KERNEL_TIMESTAMPS
+#  include <time.h>               // struct timespec
+#  include <linux/net_tstamp.h>   // SOF_TIMESTAMPING_*
+#  include <linux/errqueue.h>     // struct sock_extended_err, struct scm_timestamping
+#endif
+
 #include "socketpool.h"
 
 #include "address.h"            // address_guess_family
@@ -34,6 +42,116 @@ union sockaddr_union {
 
 typedef union sockaddr_union sockaddr_u;
 
+#ifdef USE_KERNEL_TIMESTAMPS
+
+// Each sent packet is timestamped (in software) when it is handed to the
+// device. Only the timestamps are reported (not the packets), along with
+// an identifier incremented for each packet.
+#define SOCKETPOOL_TIMESTAMPING_FLAGS ( \
+    SOF_TIMESTAMPING_TX_SOFTWARE | \
+    SOF_TIMESTAMPING_SOFTWARE    | \
+    SOF_TIMESTAMPING_OPT_ID      | \
+    SOF_TIMESTAMPING_OPT_TSONLY    \
+)
+
+#define SOCKETPOOL_CMSG_BUFLEN 256
+
+/**
+ * \brief Enable (or disable) the transmit timestamps of a socket.
+ *    Enabling them resets the identifiers of the packets to 0.
+ * \param sockfd The socket.
+ * \param is_enabled Pass true to enable the timestamps.
+ * \return true iif successful.
+ */
+
+static bool socket_set_tx_timestamps(int sockfd, bool is_enabled) {
+    int flags = 0;
+
+    // The identifiers are only reset if SOF_TIMESTAMPING_OPT_ID was unset.
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1) {
+        return false;
+    }
+
+    flags = SOCKETPOOL_TIMESTAMPING_FLAGS;
+    return !is_enabled || setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != -1;
+}
+
+/**
+ * \brief Enable the transmit timestamps of every socket of a pool.
+ *    If a socket does not support them, they are disabled on every socket.
+ * \param socketpool The socketpool.
+ * \return true iif successful.
+ */
+
+static bool socketpool_enable_tx_timestamps(socketpool_t * socketpool) {
+    bool ret = true;
+
+#ifdef USE_IPV4
+    ret &= socket_set_tx_timestamps(socketpool->ipv4_sockfd, true);
+#endif
+#ifdef USE_IPV6
+    ret &= socket_set_tx_timestamps(socketpool->ipv6_sockfd, true);
+#endif
+
+    if (!ret) {
+#ifdef USE_IPV4
+        socket_set_tx_timestamps(socketpool->ipv4_sockfd, false);
+#endif
+#ifdef USE_IPV6
+        socket_set_tx_timestamps(socketpool->ipv6_sockfd, false);
+#endif
+    }
+
+    socketpool->tx_ids[0] = 0;
+    socketpool->tx_ids[1] = 0;
+    return ret;
+}
+
+static inline uint32_t * socketpool_get_tx_id(socketpool_t * socketpool, int sockfd) {
+#ifdef USE_IPV6
+    if (sockfd == socketpool->ipv6_sockfd) return &socketpool->tx_ids[1];
+#endif
+    return &socketpool->tx_ids[0];
+}
+
+#endif // USE_KERNEL_TIMESTAMPS
+
+/**
+ * \brief Assign to a packet which has just been sent the identifier of
+ *    its transmit timestamp.
+ * \param socketpool The socketpool.
+ * \param sockfd The socket used to send the packet.
+ * \param packet The sent packet.
+ */
+
+static inline void socketpool_packet_sent(socketpool_t * socketpool, int sockfd, packet_t * packet) {
+#ifdef USE_KERNEL_TIMESTAMPS
+    if (socketpool->has_tx_timestamps) {
+        packet->tx_id = (*socketpool_get_tx_id(socketpool, sockfd))++;
+    }
+#endif
+}
+
+/**
+ * \brief Handle a packet which could not be sent. The kernel may have
+ *    allocated an identifier for this packet, so the identifiers of the
+ *    socket are reset.
+ * \param socketpool The socketpool.
+ * \param sockfd The socket used to send the packet.
+ */
+
+static inline void socketpool_packet_not_sent(socketpool_t * socketpool, int sockfd) {
+#ifdef USE_KERNEL_TIMESTAMPS
+    if (socketpool->has_tx_timestamps) {
+        if (socket_set_tx_timestamps(sockfd, true)) {
+            *socketpool_get_tx_id(socketpool, sockfd) = 0;
+        } else {
+            socketpool->has_tx_timestamps = false;
+        }
+    }
+#endif
+}
+
 /**
  * \brief Create a raw socket.
  * \param family Internet address family (AF_INET, AF_INET6).
@@ -66,6 +184,10 @@ socketpool_t * socketpool_create() {
 #endif
 #ifdef USE_IPV6
     if (!(create_raw_socket(AF_INET6, &socketpool->ipv6_sockfd))) goto ERR_CREATE_RAW_SOCKET_IPV6;
+#endif
+#ifdef USE_KERNEL_TIMESTAMPS
+    // Transmit timestamps are optional
+    socketpool->has_tx_timestamps = socketpool_enable_tx_timestamps(socketpool);
 #endif
     return socketpool;
 
@@ -99,50 +221,279 @@ void socketpool_free(socketpool_t * socketpool) {
     }
 }
 
-bool socketpool_send_packet(const socketpool_t * socketpool, const packet_t * packet)
-{
-	sockaddr_u              sock;
-    int                     sockfd;
-    socklen_t               socklen;
-    const struct sockaddr * dst_addr;
-    
-    memset(&sock, 0, sizeof(sockaddr_u));
+/**
+ * \brief Retrieve the socket and the destination address needed to
+ *    send a packet.
+ * \param socketpool The socketpool to use
+ * \param packet The packet to send
+ * \param sock The sockaddr_u instance in which the destination is written
+ * \param psockfd Address of an integer in which the socket is written
+ * \param psocklen Address of a socklen_t in which the size of the
+ *    destination address is written
+ * \return true iif successful
+ */
+
+static bool socketpool_prepare_packet(
+    const socketpool_t * socketpool,
+    const packet_t     * packet,
+    sockaddr_u         * sock,
+    int                * psockfd,
+    socklen_t          * psocklen
+) {
+    memset(sock, 0, sizeof(sockaddr_u));
 
-    // Prepare socket 
+    // Prepare socket
     // We don't care about the dst_port set in the packet
     switch (packet->dst_ip->family) {
 #ifdef USE_IPV4
         case AF_INET:
-            sock.sin.sin_family = AF_INET;
-            sock.sin.sin_addr   = packet->dst_ip->ip.ipv4;
-            sockfd = socketpool->ipv4_sockfd;
-            socklen = sizeof(struct sockaddr_in);
-            dst_addr = (struct sockaddr *) &sock.sin;
+            sock->sin.sin_family = AF_INET;
+            sock->sin.sin_addr   = packet->dst_ip->ip.ipv4;
+            *psockfd  = socketpool->ipv4_sockfd;
+            *psocklen = sizeof(struct sockaddr_in);
             break;
 #endif
 #ifdef USE_IPV6
         case AF_INET6:
-            sock.sin6.sin6_family = AF_INET6;
-            memcpy(&sock.sin6.sin6_addr, &packet->dst_ip->ip.ipv6, sizeof(ipv6_t));
-            sockfd = socketpool->ipv6_sockfd;
-            socklen = sizeof(struct sockaddr_in6);
-            dst_addr = (struct sockaddr *) &sock.sin6;
+            sock->sin6.sin6_family = AF_INET6;
+            memcpy(&sock->sin6.sin6_addr, &packet->dst_ip->ip.ipv6, sizeof(ipv6_t));
+            *psockfd  = socketpool->ipv6_sockfd;
+            *psocklen = sizeof(struct sockaddr_in6);
             break;
 #endif
         default:
             fprintf(stderr, "socketpool_send_packet: Address family not supported\n");
-            goto ERR_INVALID_FAMILY;
+            return false;
+    }
+
+    return true;
+}
+
+bool socketpool_send_packet(socketpool_t * socketpool, packet_t * packet)
+{
+	sockaddr_u              sock;
+    int                     sockfd;
+    socklen_t               socklen;
+
+    if (!socketpool_prepare_packet(socketpool, packet, &sock, &sockfd, &socklen)) {
+        goto ERR_INVALID_FAMILY;
     }
 
     // Send the packet
-    if (sendto(sockfd, packet_get_bytes(packet), packet_get_size(packet), 0, dst_addr, socklen) == -1) {
+    if (sendto(sockfd, packet_get_bytes(packet), packet_get_size(packet), 0, &sock.sa, socklen) == -1) {
         perror("send_data: Sending error in queue");
+        socketpool_packet_not_sent(socketpool, sockfd);
         goto ERR_SEND_TO;
     }
 
+    socketpool_packet_sent(socketpool, sockfd, packet);
     return true;
 
 ERR_SEND_TO:
 ERR_INVALID_FAMILY:
     return false;
 }
+
+#ifdef HAVE_SENDMMSG
+
+/**
+ * \brief Send packets sharing the same socket with a minimal number
+ *    of sendmmsg() calls.
+ * \param socketpool The socketpool to use
+ * \param sockfd The socket used to send the packets
+ * \param msgs The messages to send
+ * \param packets The packets passed to socketpool_send_packets
+ * \param indexes indexes[j] is the index (in packets and is_sent) of
+ *    the packet related to msgs[j]
+ * \param num_msgs The number of messages
+ * \param is_sent The array updated for each sent packet
+ * \return The number of packets successfully sent
+ */
+
+static size_t socketpool_sendmmsg(
+    socketpool_t   * socketpool,
+    int              sockfd,
+    struct mmsghdr * msgs,
+    packet_t      ** packets,
+    const size_t   * indexes,
+    size_t           num_msgs,
+    bool           * is_sent
+) {
+    size_t j = 0, num_sent = 0;
+    int    n, k;
+
+    while (j < num_msgs) {
+        if ((n = sendmmsg(sockfd, msgs + j, num_msgs - j, 0)) <= 0) {
+            // The j-th packet cannot be sent, skip it
+            perror("send_data: Sending error in queue");
+            socketpool_packet_not_sent(socketpool, sockfd);
+            j++;
+            continue;
+        }
+        for (k = 0; k < n; k++) {
+            is_sent[indexes[j + k]] = true;
+            socketpool_packet_sent(socketpool, sockfd, packets[indexes[j + k]]);
+        }
+        num_sent += n;
+        j += n;
+    }
+
+    return num_sent;
+}
+
+size_t socketpool_send_packets(socketpool_t * socketpool, packet_t ** packets, size_t num_packets, bool * is_sent)
+{
+    struct mmsghdr msgs[SOCKETPOOL_BATCH_SIZE];
+    struct iovec   iovecs[SOCKETPOOL_BATCH_SIZE];
+    sockaddr_u     socks[SOCKETPOOL_BATCH_SIZE];
+    size_t         indexes[SOCKETPOOL_BATCH_SIZE];
+    size_t         i, j = 0, num_sent = 0;
+    int            sockfd, batch_sockfd = -1;
+    socklen_t      socklen;
+
+    memset(is_sent, 0, num_packets * sizeof(bool));
+    memset(msgs, 0, sizeof(msgs));
+
+    // Consecutive packets sharing the same socket are sent using
+    // a single sendmmsg() call.
+    for (i = 0; i < num_packets; i++) {
+        if (!socketpool_prepare_packet(socketpool, packets[i], &socks[j], &sockfd, &socklen)) continue;
+
+        if (j > 0 && sockfd != batch_sockfd) {
+            // Flush the pending packets sent through the other socket.
+            // The destination of the current packet is then moved in
+            // the first slot.
+            num_sent += socketpool_sendmmsg(socketpool, batch_sockfd, msgs, packets, indexes, j, is_sent);
+            memcpy(&socks[0], &socks[j], sizeof(sockaddr_u));
+            j = 0;
+        }
+
+        batch_sockfd = sockfd;
+        iovecs[j].iov_base = packet_get_bytes(packets[i]);
+        iovecs[j].iov_len  = packet_get_size(packets[i]);
+        msgs[j].msg_hdr.msg_name    = &socks[j];
+        msgs[j].msg_hdr.msg_namelen = socklen;
+        msgs[j].msg_hdr.msg_iov     = &iovecs[j];
+        msgs[j].msg_hdr.msg_iovlen  = 1;
+        indexes[j] = i;
+
+        if (++j == SOCKETPOOL_BATCH_SIZE) {
+            num_sent += socketpool_sendmmsg(socketpool, batch_sockfd, msgs, packets, indexes, j, is_sent);
+            j = 0;
+        }
+    }
+
+    if (j > 0) {
+        num_sent += socketpool_sendmmsg(socketpool, batch_sockfd, msgs, packets, indexes, j, is_sent);
+    }
+
+    return num_sent;
+}
+
+#else // HAVE_SENDMMSG
+
+size_t socketpool_send_packets(socketpool_t * socketpool, packet_t ** packets, size_t num_packets, bool * is_sent)
+{
+    size_t i, num_sent = 0;
+
+    for (i = 0; i < num_packets; i++) {
+        if ((is_sent[i] = socketpool_send_packet(socketpool, packets[i]))) num_sent++;
+    }
+    return num_sent;
+}
+
+#endif // HAVE_SENDMMSG
+
+bool socketpool_has_tx_timestamps(const socketpool_t * socketpool) {
+#ifdef USE_KERNEL_TIMESTAMPS
+    return socketpool->has_tx_timestamps;
+#else
+    return false;
+#endif
+}
+
+#ifdef USE_KERNEL_TIMESTAMPS
+
+/**
+ * \brief Fetch the transmit timestamps queued in the error queue of a socket.
+ * \param sockfd The socket.
+ * \param family The address family of the packets sent through this socket.
+ * \param callback See socketpool_process_tx_timestamps.
+ * \param data See socketpool_process_tx_timestamps.
+ * \return The number of fetched timestamps.
+ */
+
+static size_t socket_process_tx_timestamps(
+    int     sockfd,
+    int     family,
+    void (* callback)(int, uint32_t, timestamp_t, void *),
+    void  * data
+) {
+    union {
+        struct cmsghdr         header;  // Aligns the ancillary data
+        uint8_t                bytes[SOCKETPOOL_CMSG_BUFLEN];
+    }                          cmsg_buf;
+    struct msghdr              msg;
+    struct cmsghdr           * cmsg;
+    struct scm_timestamping  * timestamps;
+    struct sock_extended_err * err;
+    size_t                     num_timestamps = 0;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_control    = cmsg_buf.bytes;
+        msg.msg_controllen = sizeof(cmsg_buf.bytes);
+
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            // EAGAIN: the error queue is empty
+            errno = 0;
+            break;
+        }
+
+        timestamps = NULL;
+        err = NULL;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                timestamps = (struct scm_timestamping *) CMSG_DATA(cmsg);
+            } else if ((cmsg->cmsg_level == IPPROTO_IP   && cmsg->cmsg_type == IP_RECVERR)
+                   ||  (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                err = (struct sock_extended_err *) CMSG_DATA(cmsg);
+            }
+        }
+
+        // timestamps->ts[0] is the software timestamp
+        if (timestamps && err && err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+            callback(family, err->ee_data, timestamp_from_realtime(&timestamps->ts[0]), data);
+            num_timestamps++;
+        }
+    }
+
+    return num_timestamps;
+}
+
+#endif // USE_KERNEL_TIMESTAMPS
+
+size_t socketpool_process_tx_timestamps(
+    socketpool_t * socketpool,
+    void        (* callback)(int family, uint32_t tx_id, timestamp_t timestamp, void * data),
+    void         * data
+) {
+    size_t num_timestamps = 0;
+
+#ifdef USE_KERNEL_TIMESTAMPS
+    // Skip the sockets which have sent nothing (since their last reset)
+    if (socketpool->has_tx_timestamps) {
+#  ifdef USE_IPV4
+        if (socketpool->tx_ids[0]) {
+            num_timestamps += socket_process_tx_timestamps(socketpool->ipv4_sockfd, AF_INET, callback, data);
+        }
+#  endif
+#  ifdef USE_IPV6
+        if (socketpool->tx_ids[1]) {
+            num_timestamps += socket_process_tx_timestamps(socketpool->ipv6_sockfd, AF_INET6, callback, data);
+        }
+#  endif
+    }
+#endif
+    return num_timestamps;
+}
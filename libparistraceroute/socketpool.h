@@ -3,7 +3,14 @@
 #ifndef SOCKETPOOL_H
 #define SOCKETPOOl_H
 
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t
 #include "packet.h"
+#include "timestamp.h" // timestamp_t
+
+// Maximum number of packets submitted by a single sendmmsg() call.
+#define SOCKETPOOL_BATCH_SIZE 64
 
 typedef struct {
 #ifdef USE_IPV4
@@ -12,6 +19,10 @@ typedef struct {
 #ifdef USE_IPV6
     int ipv6_sockfd; /**< File descriptor of the IPv6 raw socket */
 #endif
+#ifdef USE_KERNEL_TIMESTAMPS
+    bool     has_tx_timestamps; /**< true iif the kernel reports when each packet is sent */
+    uint32_t tx_ids[2];         /**< Identifier of the next transmit timestamp of each socket (IPv4, IPv6) */
+#endif
 } socketpool_t;
 
 /**
@@ -37,6 +48,50 @@ void socketpool_free(socketpool_t * socketpool);
  * \return true iif successful
  */
 
-bool socketpool_send_packet(const socketpool_t * socketpool, const packet_t * packet);
+bool socketpool_send_packet(socketpool_t * socketpool, packet_t * packet);
+
+/**
+ * \brief Sends several packets on the network. If sendmmsg is
+ *    available, packets sharing the same address family are
+ *    sent using a single system call (per SOCKETPOOL_BATCH_SIZE
+ *    packets).
+ * \param socketpool The socketpool to use
+ * \param packets The packets to send
+ * \param num_packets The number of packets to send
+ * \param is_sent A preallocated array of num_packets booleans.
+ *    is_sent[i] is set to true iif packets[i] has been sent.
+ * \return The number of packets successfully sent
+ */
+
+size_t socketpool_send_packets(socketpool_t * socketpool, packet_t ** packets, size_t num_packets, bool * is_sent);
+
+/**
+ * \brief Check whether the kernel reports when the packets are sent.
+ * \param socketpool The socketpool to use
+ * \return true iif socketpool_process_tx_timestamps may report timestamps.
+ */
+
+bool socketpool_has_tx_timestamps(const socketpool_t * socketpool);
+
+/**
+ * \brief Fetch the transmit timestamps reported by the kernel
+ *    (SO_TIMESTAMPING) for the packets sent so far. Each packet
+ *    successfully sent gets an identifier (see packet->tx_id), which
+ *    is unique among the packets sharing its address family, until
+ *    2^32 packets have been sent.
+ *    A single timestamp is reported per packet, when it is handed to
+ *    the device.
+ * \param socketpool The socketpool to use
+ * \param callback Function called for each timestamp. It receives the
+ *    address family of the packet, its identifier, its timestamp and data.
+ * \param data Data passed to callback.
+ * \return The number of fetched timestamps.
+ */
+
+size_t socketpool_process_tx_timestamps(
+    socketpool_t * socketpool,
+    void        (* callback)(int family, uint32_t tx_id, timestamp_t timestamp, void * data),
+    void         * data
+);
 
 #endif
@@ -0,0 +1,119 @@
+#include "config.h"
+
+#include <stdlib.h>             // malloc, free
+#include <string.h>             // memset, memcpy, memcmp
+
+#include "stop_set.h"
+
+static size_t stop_set_entry_hash(const stop_set_entry_t * entry) {
+    return hash_bytes(entry, sizeof(stop_set_entry_t));
+}
+
+static int stop_set_entry_compare(const stop_set_entry_t * entry1, const stop_set_entry_t * entry2) {
+    return memcmp(entry1, entry2, sizeof(stop_set_entry_t));
+}
+
+/**
+ * \brief Copy the first bits of an address.
+ * \param prefix The address_t receiving the prefix. It must be
+ *    set to 0 beforehand.
+ * \param address The copied address.
+ * \param prefix_len The number of bits to copy.
+ */
+
+static void address_copy_prefix(address_t * prefix, const address_t * address, uint8_t prefix_len)
+{
+    uint8_t       * dst = (uint8_t *) &prefix->ip;
+    const uint8_t * src = (const uint8_t *) &address->ip;
+    size_t          size = address_get_size(address),
+                    num_bytes = prefix_len / 8;
+
+    if (num_bytes >= size) {
+        num_bytes = size;
+        prefix_len = 0;
+    }
+
+    prefix->family = address->family;
+    memcpy(dst, src, num_bytes);
+    if (prefix_len % 8) {
+        dst[num_bytes] = src[num_bytes] & (0xff << (8 - prefix_len % 8));
+    }
+}
+
+/**
+ * \brief Prepare a stop_set_entry_t.
+ * \param stop_set A stop_set_t instance.
+ * \param entry The entry we're initializing.
+ * \param interface The address of the interface.
+ * \param destination The destination, or NULL.
+ */
+
+static void stop_set_entry_init(const stop_set_t * stop_set, stop_set_entry_t * entry, const address_t * interface, const address_t * destination)
+{
+    memset(entry, 0, sizeof(stop_set_entry_t));
+    entry->interface.family = interface->family;
+    memcpy(&entry->interface.ip, &interface->ip, address_get_size(interface));
+
+    if (destination) {
+        address_copy_prefix(
+            &entry->prefix,
+            destination,
+            destination->family == AF_INET6 ? stop_set->prefix_len_ipv6 : stop_set->prefix_len_ipv4
+        );
+    }
+}
+
+stop_set_t * stop_set_create(uint8_t prefix_len_ipv4, uint8_t prefix_len_ipv6)
+{
+    stop_set_t * stop_set;
+
+    if (!(stop_set = malloc(sizeof(stop_set_t)))) goto ERR_MALLOC;
+    if (!(stop_set->entries = hashtable_create(stop_set_entry_hash, free, stop_set_entry_compare))) {
+        goto ERR_HASHTABLE_CREATE;
+    }
+    stop_set->prefix_len_ipv4 = prefix_len_ipv4;
+    stop_set->prefix_len_ipv6 = prefix_len_ipv6;
+    return stop_set;
+
+ERR_HASHTABLE_CREATE:
+    free(stop_set);
+ERR_MALLOC:
+    return NULL;
+}
+
+void stop_set_free(stop_set_t * stop_set)
+{
+    if (stop_set) {
+        hashtable_free(stop_set->entries);
+        free(stop_set);
+    }
+}
+
+bool stop_set_insert(stop_set_t * stop_set, const address_t * interface, const address_t * destination)
+{
+    stop_set_entry_t * entry;
+
+    if (stop_set_contains(stop_set, interface, destination)) return true;
+
+    if (!(entry = malloc(sizeof(stop_set_entry_t))))  goto ERR_MALLOC;
+    stop_set_entry_init(stop_set, entry, interface, destination);
+    if (!hashtable_insert(stop_set->entries, entry)) goto ERR_HASHTABLE_INSERT;
+    return true;
+
+ERR_HASHTABLE_INSERT:
+    free(entry);
+ERR_MALLOC:
+    return false;
+}
+
+bool stop_set_contains(const stop_set_t * stop_set, const address_t * interface, const address_t * destination)
+{
+    stop_set_entry_t entry;
+
+    stop_set_entry_init(stop_set, &entry, interface, destination);
+    return hashtable_find(stop_set->entries, &entry) != NULL;
+}
+
+inline size_t stop_set_get_size(const stop_set_t * stop_set) {
+    return hashtable_get_size(stop_set->entries);
+}
@@ -0,0 +1,94 @@
+#ifndef STOP_SET_H
+#define STOP_SET_H
+
+/**
+ * \file stop_set.h
+ * \brief Doubletree stop sets.
+ *
+ * Doubletree probes each destination forward and backward from a
+ * middle hop, and stops as soon as it reaches a part of the topology
+ * which is already known:
+ * - backward probing stops at an interface already discovered from
+ *   this source (local stop set, made of interfaces);
+ * - forward probing stops at an interface already discovered on the
+ *   way to the same destination prefix (global stop set, made of
+ *   (interface, destination prefix) pairs).
+ *
+ * A stop_set_t stores both kinds of entries. It is typically shared by
+ * every instance of a pt_loop_t (see pt_loop_t.stop_set).
+ */
+
+#include <stdbool.h>        // bool
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint8_t
+
+#include "address.h"        // address_t
+#include "containers/hashtable.h" // hashtable_t
+
+// Length of the destination prefixes of the global stop set
+#define STOP_SET_PREFIX_LEN_IPV4_DEFAULT 24
+#define STOP_SET_PREFIX_LEN_IPV6_DEFAULT 64
+
+/**
+ * \brief Entry of a stop_set_t. This structure is memset to 0 before
+ *    being filled since it is hashed and compared bytewise.
+ */
+
+typedef struct {
+    address_t interface;       /**< Interface discovered */
+    address_t prefix;          /**< Destination prefix (family set to 0 for local entries) */
+} stop_set_entry_t;
+
+typedef struct {
+    hashtable_t * entries;         /**< Stored pairs (stop_set_entry_t) */
+    uint8_t       prefix_len_ipv4; /**< Length of the IPv4 destination prefixes */
+    uint8_t       prefix_len_ipv6; /**< Length of the IPv6 destination prefixes */
+} stop_set_t;
+
+/**
+ * \brief Create a stop set.
+ * \param prefix_len_ipv4 The length of the IPv4 destination prefixes.
+ * \param prefix_len_ipv6 The length of the IPv6 destination prefixes.
+ * \return The newly created stop set, NULL otherwise.
+ */
+
+stop_set_t * stop_set_create(uint8_t prefix_len_ipv4, uint8_t prefix_len_ipv6);
+
+/**
+ * \brief Release a stop set from the memory.
+ * \param stop_set A stop_set_t instance.
+ */
+
+void stop_set_free(stop_set_t * stop_set);
+
+/**
+ * \brief Insert an interface in a stop set.
+ * \param stop_set A stop_set_t instance.
+ * \param interface The address of the interface.
+ * \param destination The destination towards which the interface has
+ *    been discovered (global stop set), or NULL (local stop set).
+ * \return true iif successful.
+ */
+
+bool stop_set_insert(stop_set_t * stop_set, const address_t * interface, const address_t * destination);
+
+/**
+ * \brief Test whether a stop set contains an interface.
+ * \param stop_set A stop_set_t instance.
+ * \param interface The address of the interface.
+ * \param destination The destination (global stop set), or NULL
+ *    (local stop set).
+ * \return true iif the interface belongs to the stop set.
+ */
+
+bool stop_set_contains(const stop_set_t * stop_set, const address_t * interface, const address_t * destination);
+
+/**
+ * \brief Retrieve the number of entries of a stop set.
+ * \param stop_set A stop_set_t instance.
+ * \return The number of (interface, destination prefix) pairs.
+ */
+
+size_t stop_set_get_size(const stop_set_t * stop_set);
+
+#endif
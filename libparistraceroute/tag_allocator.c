@@ -0,0 +1,95 @@
+#include "config.h"
+
+#include <stdlib.h>      // calloc, malloc, free
+
+#include "tag_allocator.h"
+
+#define BITS_PER_WORD 64
+
+static inline size_t tag_get_word(uint32_t tag) {
+    return tag / BITS_PER_WORD;
+}
+
+static inline uint64_t tag_get_mask(uint32_t tag) {
+    return ((uint64_t) 1) << (tag % BITS_PER_WORD);
+}
+
+tag_allocator_t * tag_allocator_create(size_t num_tags) {
+    tag_allocator_t * tag_allocator;
+    size_t            num_words = (num_tags + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+    if (num_words == 0) goto ERR_INVALID_NUM_TAGS;
+    if (!(tag_allocator = malloc(sizeof(tag_allocator_t))))              goto ERR_MALLOC;
+    if (!(tag_allocator->words = calloc(num_words, sizeof(uint64_t)))) goto ERR_CALLOC;
+
+    tag_allocator->num_words = num_words;
+    tag_allocator->num_tags  = num_words * BITS_PER_WORD;
+    tag_allocator->num_used  = 0;
+    tag_allocator->cursor    = 0;
+    return tag_allocator;
+
+ERR_CALLOC:
+    free(tag_allocator);
+ERR_MALLOC:
+ERR_INVALID_NUM_TAGS:
+    return NULL;
+}
+
+void tag_allocator_free(tag_allocator_t * tag_allocator) {
+    if (tag_allocator) {
+        free(tag_allocator->words);
+        free(tag_allocator);
+    }
+}
+
+bool tag_allocator_reserve(tag_allocator_t * tag_allocator, uint32_t tag) {
+    if (tag >= tag_allocator->num_tags || tag_allocator_is_used(tag_allocator, tag)) {
+        return false;
+    }
+
+    tag_allocator->words[tag_get_word(tag)] |= tag_get_mask(tag);
+    tag_allocator->num_used++;
+    return true;
+}
+
+bool tag_allocator_get(tag_allocator_t * tag_allocator, uint32_t * ptag) {
+    size_t   i, j,
+             first = tag_get_word(tag_allocator->cursor);
+    uint64_t free_bits;
+
+    if (tag_allocator->num_used == tag_allocator->num_tags) return false;
+
+    // Find the next free tag, starting from the cursor. The first word is
+    // visited twice: its tags preceding the cursor are considered last.
+    for (i = 0; i <= tag_allocator->num_words; i++) {
+        j = (first + i) % tag_allocator->num_words;
+        free_bits = ~tag_allocator->words[j];
+        if (i == 0) free_bits &= ~((uint64_t) 0) << (tag_allocator->cursor % BITS_PER_WORD);
+
+        if (free_bits) {
+            *ptag = j * BITS_PER_WORD + __builtin_ctzll(free_bits);
+            tag_allocator->words[j] |= tag_get_mask(*ptag);
+            tag_allocator->num_used++;
+            tag_allocator->cursor = (*ptag + 1) % tag_allocator->num_tags;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void tag_allocator_release(tag_allocator_t * tag_allocator, uint32_t tag) {
+    if (tag < tag_allocator->num_tags && tag_allocator_is_used(tag_allocator, tag)) {
+        tag_allocator->words[tag_get_word(tag)] &= ~tag_get_mask(tag);
+        tag_allocator->num_used--;
+    }
+}
+
+bool tag_allocator_is_used(const tag_allocator_t * tag_allocator, uint32_t tag) {
+    return tag < tag_allocator->num_tags
+        && (tag_allocator->words[tag_get_word(tag)] & tag_get_mask(tag)) != 0;
+}
+
+size_t tag_allocator_get_num_used(const tag_allocator_t * tag_allocator) {
+    return tag_allocator->num_used;
+}
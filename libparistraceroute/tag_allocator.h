@@ -0,0 +1,97 @@
+#ifndef TAG_ALLOCATOR_H
+#define TAG_ALLOCATOR_H
+
+/**
+ * \file tag_allocator.h
+ * \brief Allocator of probe IDs (tags).
+ *
+ * A tag allocator tracks which tags are in use in a bitmap, so that
+ * two flying probes never share the same tag. Tags are released once
+ * the probe is answered or has expired.
+ *
+ * Tags are allocated in a round-robin fashion (next fit): a released
+ * tag is only recycled once every other free tag has been used. This
+ * way, a late reply to an expired probe is unlikely to match a more
+ * recent probe.
+ */
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint*_t
+
+/**
+ * \struct tag_allocator_t
+ * \brief Structure describing a tag allocator.
+ */
+
+typedef struct {
+    uint64_t * words;     /**< Bitmap of the used tags (1 bit per tag) */
+    size_t     num_words; /**< Number of words in the bitmap */
+    size_t     num_tags;  /**< Number of tags, multiple of 64 */
+    size_t     num_used;  /**< Number of used (or reserved) tags */
+    size_t     cursor;    /**< The tag from which the next search starts */
+} tag_allocator_t;
+
+/**
+ * \brief Create a tag allocator.
+ * \param num_tags The size of the tag space: allocated tags are in
+ *    [0, num_tags). It is rounded up to the next multiple of 64.
+ * \return The newly allocated tag allocator, NULL in case of failure.
+ */
+
+tag_allocator_t * tag_allocator_create(size_t num_tags);
+
+/**
+ * \brief Release a tag allocator from the memory.
+ * \param tag_allocator A tag_allocator_t instance.
+ */
+
+void tag_allocator_free(tag_allocator_t * tag_allocator);
+
+/**
+ * \brief Mark a tag as used without allocating it, e.g. because
+ *    its value cannot be encoded in a packet.
+ * \param tag_allocator A tag_allocator_t instance.
+ * \param tag The tag we're reserving.
+ * \return true iif successful, false if the tag is out of range
+ *    or already used.
+ */
+
+bool tag_allocator_reserve(tag_allocator_t * tag_allocator, uint32_t tag);
+
+/**
+ * \brief Allocate a tag.
+ * \param tag_allocator A tag_allocator_t instance.
+ * \param ptag The address where the allocated tag is written.
+ * \return true iif successful, false if every tag is in use.
+ */
+
+bool tag_allocator_get(tag_allocator_t * tag_allocator, uint32_t * ptag);
+
+/**
+ * \brief Release a tag so that it can be allocated again.
+ *    Releasing an unused tag is a no-op.
+ * \param tag_allocator A tag_allocator_t instance.
+ * \param tag The tag we're releasing.
+ */
+
+void tag_allocator_release(tag_allocator_t * tag_allocator, uint32_t tag);
+
+/**
+ * \brief Check whether a tag is in use.
+ * \param tag_allocator A tag_allocator_t instance.
+ * \param tag The queried tag.
+ * \return true iif this tag is allocated or reserved.
+ */
+
+bool tag_allocator_is_used(const tag_allocator_t * tag_allocator, uint32_t tag);
+
+/**
+ * \brief Retrieve the number of tags in use.
+ * \param tag_allocator A tag_allocator_t instance.
+ * \return The number of allocated and reserved tags.
+ */
+
+size_t tag_allocator_get_num_used(const tag_allocator_t * tag_allocator);
+
+#endif
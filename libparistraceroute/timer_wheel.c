@@ -0,0 +1,163 @@
+#include "config.h"
+
+#include <stdlib.h>      // malloc, free
+
+#include "timer_wheel.h"
+
+/**
+ * \brief Convert a timestamp into a tick.
+ * \param timer_wheel A timer_wheel_t instance.
+ * \param time A timestamp.
+ * \return The tick related to this timestamp.
+ */
+
+static inline uint64_t timer_wheel_get_tick_of(const timer_wheel_t * timer_wheel, timestamp_t time) {
+    return time > timer_wheel->start ?
+        (time - timer_wheel->start) / timer_wheel->tick :
+        0;
+}
+
+static inline timer_wheel_node_t * timer_wheel_get_slot(const timer_wheel_t * timer_wheel, uint64_t tick) {
+    return &timer_wheel->slots[tick & (timer_wheel->num_slots - 1)];
+}
+
+static inline void timer_wheel_node_link(timer_wheel_node_t * sentinel, timer_wheel_node_t * node) {
+    // Append node at the end of the list
+    node->prev = sentinel->prev;
+    node->next = sentinel;
+    sentinel->prev->next = node;
+    sentinel->prev = node;
+}
+
+static inline void timer_wheel_node_unlink(timer_wheel_node_t * node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+}
+
+timer_wheel_t * timer_wheel_create(timestamp_t tick, size_t num_slots, timestamp_t now) {
+    timer_wheel_t * timer_wheel;
+    size_t          i, n;
+
+    if (tick == 0) goto ERR_INVALID_TICK;
+
+    // Round num_slots up to the next power of 2
+    for (n = 1; n < num_slots; n <<= 1);
+
+    if (!(timer_wheel = malloc(sizeof(timer_wheel_t))))                goto ERR_MALLOC;
+    if (!(timer_wheel->slots = malloc(n * sizeof(timer_wheel_node_t)))) goto ERR_SLOTS;
+
+    for (i = 0; i < n; i++) {
+        timer_wheel->slots[i].prev    = &timer_wheel->slots[i];
+        timer_wheel->slots[i].next    = &timer_wheel->slots[i];
+        timer_wheel->slots[i].element = NULL;
+    }
+
+    timer_wheel->num_slots = n;
+    timer_wheel->tick      = tick;
+    timer_wheel->start     = now;
+    timer_wheel->current   = 0;
+    timer_wheel->size      = 0;
+    return timer_wheel;
+
+ERR_SLOTS:
+    free(timer_wheel);
+ERR_MALLOC:
+ERR_INVALID_TICK:
+    return NULL;
+}
+
+void timer_wheel_free(timer_wheel_t * timer_wheel) {
+    if (timer_wheel) {
+        free(timer_wheel->slots);
+        free(timer_wheel);
+    }
+}
+
+void timer_wheel_node_init(timer_wheel_node_t * node, void * element) {
+    node->prev    = NULL;
+    node->next    = NULL;
+    node->expiry  = 0;
+    node->element = element;
+}
+
+inline bool timer_wheel_node_is_scheduled(const timer_wheel_node_t * node) {
+    return node->next != NULL;
+}
+
+void timer_wheel_add(timer_wheel_t * timer_wheel, timer_wheel_node_t * node, timestamp_t deadline) {
+    uint64_t expiry;
+
+    timer_wheel_del(timer_wheel, node);
+
+    // A timer is fired once its whole tick has elapsed, so that it never
+    // fires before its deadline. Expired timers are fired at the next tick.
+    expiry = timer_wheel_get_tick_of(timer_wheel, deadline) + 1;
+    if (expiry <= timer_wheel->current) expiry = timer_wheel->current + 1;
+
+    node->expiry = expiry;
+    timer_wheel_node_link(timer_wheel_get_slot(timer_wheel, expiry), node);
+    timer_wheel->size++;
+}
+
+void timer_wheel_del(timer_wheel_t * timer_wheel, timer_wheel_node_t * node) {
+    if (timer_wheel_node_is_scheduled(node)) {
+        timer_wheel_node_unlink(node);
+        timer_wheel->size--;
+    }
+}
+
+size_t timer_wheel_advance(
+    timer_wheel_t * timer_wheel,
+    timestamp_t     now,
+    void         (* callback)(timer_wheel_node_t * node, void * data),
+    void          * data
+) {
+    uint64_t             tick, target = timer_wheel_get_tick_of(timer_wheel, now);
+    uint64_t             num_ticks;
+    timer_wheel_node_t   expired,
+                       * sentinel,
+                       * node,
+                       * next;
+    size_t               num_fired = 0;
+
+    if (target <= timer_wheel->current) return 0;
+
+    // Each slot has to be visited at most once, even if the wheel has not
+    // been advanced for more than a revolution.
+    num_ticks = target - timer_wheel->current;
+    if (num_ticks > timer_wheel->num_slots) num_ticks = timer_wheel->num_slots;
+
+    expired.prev = expired.next = &expired;
+
+    for (tick = target - num_ticks + 1; tick <= target; tick++) {
+        // Move the expired timers of this slot in the expired list. Firing
+        // them afterwards allows the callback to alter the wheel.
+        sentinel = timer_wheel_get_slot(timer_wheel, tick);
+        for (node = sentinel->next; node != sentinel; node = next) {
+            next = node->next;
+            if (node->expiry <= target) {
+                timer_wheel_node_unlink(node);
+                timer_wheel_node_link(&expired, node);
+            }
+        }
+    }
+    timer_wheel->current = target;
+
+    while ((node = expired.next) != &expired) {
+        timer_wheel_node_unlink(node);
+        timer_wheel->size--;
+        callback(node, data);
+        num_fired++;
+    }
+
+    return num_fired;
+}
+
+inline size_t timer_wheel_get_size(const timer_wheel_t * timer_wheel) {
+    return timer_wheel->size;
+}
+
+inline timestamp_t timer_wheel_get_tick(const timer_wheel_t * timer_wheel) {
+    return timer_wheel->tick;
+}
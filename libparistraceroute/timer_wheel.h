@@ -0,0 +1,144 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/**
+ * \file timer_wheel.h
+ * \brief Hashed timer wheel.
+ *
+ * A timer wheel stores a large number of timers (deadlines) and
+ * fires them as time goes by. Time is divided into ticks of fixed
+ * duration, and each timer is stored in the slot corresponding to
+ * the tick at which it expires (modulo the number of slots). Timers
+ * expiring after a whole revolution simply stay in their slot until
+ * their tick is reached.
+ *
+ * Adding and cancelling a timer is O(1), and advancing the wheel by
+ * one tick only visits the timers stored in the corresponding slot.
+ * Timers are fired at most one tick after their deadline, and never
+ * before.
+ *
+ * Timers are intrusive: the caller embeds a timer_wheel_node_t in its
+ * own structure, so the wheel never allocates memory once created.
+ */
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+
+#include "timestamp.h" // timestamp_t
+
+/**
+ * \struct timer_wheel_node_t
+ * \brief A timer stored in a timer_wheel_t instance.
+ */
+
+typedef struct timer_wheel_node_s {
+    struct timer_wheel_node_s * prev;    /**< Previous timer in the slot (NULL if not scheduled) */
+    struct timer_wheel_node_s * next;    /**< Next timer in the slot (NULL if not scheduled) */
+    uint64_t                    expiry;  /**< Tick at which this timer expires */
+    void                      * element; /**< User data attached to this timer */
+} timer_wheel_node_t;
+
+/**
+ * \struct timer_wheel_t
+ * \brief Structure describing a timer wheel.
+ */
+
+typedef struct {
+    timer_wheel_node_t * slots;     /**< Sentinel of each slot (circular doubly linked lists) */
+    size_t               num_slots; /**< Number of slots (power of 2) */
+    timestamp_t          tick;      /**< Duration of a tick (in nano seconds) */
+    timestamp_t          start;     /**< Timestamp corresponding to tick 0 */
+    uint64_t             current;   /**< Last processed tick */
+    size_t               size;      /**< Number of scheduled timers */
+} timer_wheel_t;
+
+/**
+ * \brief Create a timer wheel.
+ * \param tick The duration of a tick (in nano seconds). This is the
+ *    precision of the timers.
+ * \param num_slots The number of slots. It is rounded up to the next
+ *    power of 2. num_slots * tick should be greater than the usual
+ *    timer duration.
+ * \param now The current timestamp (see timestamp_now).
+ * \return The newly allocated timer wheel, NULL in case of failure.
+ */
+
+timer_wheel_t * timer_wheel_create(timestamp_t tick, size_t num_slots, timestamp_t now);
+
+/**
+ * \brief Release a timer wheel from the memory. Scheduled timers
+ *    are not fired.
+ * \param timer_wheel A timer_wheel_t instance.
+ */
+
+void timer_wheel_free(timer_wheel_t * timer_wheel);
+
+/**
+ * \brief Initialize a timer before its first use.
+ * \param node The timer we're initializing.
+ * \param element The user data attached to this timer.
+ */
+
+void timer_wheel_node_init(timer_wheel_node_t * node, void * element);
+
+/**
+ * \brief Check whether a timer is scheduled.
+ * \param node A timer.
+ * \return true iif this timer is stored in a timer wheel.
+ */
+
+bool timer_wheel_node_is_scheduled(const timer_wheel_node_t * node);
+
+/**
+ * \brief Schedule a timer. If this timer was already scheduled,
+ *    it is rescheduled.
+ * \param timer_wheel A timer_wheel_t instance.
+ * \param node The timer we're scheduling.
+ * \param deadline The timestamp at which this timer expires.
+ */
+
+void timer_wheel_add(timer_wheel_t * timer_wheel, timer_wheel_node_t * node, timestamp_t deadline);
+
+/**
+ * \brief Cancel a timer. This is a no-op if the timer is not scheduled.
+ * \param timer_wheel The timer_wheel_t instance storing this timer.
+ * \param node The timer we're cancelling.
+ */
+
+void timer_wheel_del(timer_wheel_t * timer_wheel, timer_wheel_node_t * node);
+
+/**
+ * \brief Fire every timer which has expired.
+ * \param timer_wheel A timer_wheel_t instance.
+ * \param now The current timestamp.
+ * \param callback Function called for each expired timer. The timer is
+ *    no more scheduled when it is called, and may be rescheduled.
+ * \param data User data passed to callback.
+ * \return The number of fired timers.
+ */
+
+size_t timer_wheel_advance(
+    timer_wheel_t * timer_wheel,
+    timestamp_t     now,
+    void         (* callback)(timer_wheel_node_t * node, void * data),
+    void          * data
+);
+
+/**
+ * \brief Retrieve the number of scheduled timers.
+ * \param timer_wheel A timer_wheel_t instance.
+ * \return The number of scheduled timers.
+ */
+
+size_t timer_wheel_get_size(const timer_wheel_t * timer_wheel);
+
+/**
+ * \brief Retrieve the duration of a tick.
+ * \param timer_wheel A timer_wheel_t instance.
+ * \return The duration of a tick (in nano seconds).
+ */
+
+timestamp_t timer_wheel_get_tick(const timer_wheel_t * timer_wheel);
+
+#endif
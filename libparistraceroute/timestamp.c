@@ -0,0 +1,110 @@
+#include "config.h"
+
+#include <stdbool.h>     // bool
+#include <time.h>        // clock_gettime, nanosleep
+
+#include "timestamp.h"
+
+#if defined(USE_TSC_CLOCK) && defined(__x86_64__)
+#  define TIMESTAMP_HAS_TSC
+#  include <cpuid.h>     // __get_cpuid
+#  include <x86intrin.h> // __rdtsc
+#endif
+
+static inline timestamp_t timestamp_monotonic_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (timestamp_t) ts.tv_sec * TIMESTAMP_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+#ifdef TIMESTAMP_HAS_TSC
+
+// Duration of the TSC calibration (in nanoseconds)
+#define TIMESTAMP_TSC_CALIBRATION 20000000
+
+// A TSC value is converted in nanoseconds as follows:
+//    ns = s_ns_origin + ((tsc - s_tsc_origin) * s_tsc_mult) >> TIMESTAMP_TSC_SHIFT
+#define TIMESTAMP_TSC_SHIFT 32
+
+static bool        s_use_tsc = false;
+static uint64_t    s_tsc_origin;
+static timestamp_t s_ns_origin;
+static uint64_t    s_tsc_mult;
+
+/**
+ * \brief Calibrate the TSC against CLOCK_MONOTONIC. The TSC is only
+ *    used if it is invariant (i.e. it ticks at a constant rate whatever
+ *    the power state of the core, see CPUID.80000007H:EDX[8]).
+ */
+
+static void __timestamp_tsc_calibrate() __attribute__((constructor));
+
+static void __timestamp_tsc_calibrate() {
+    unsigned int    eax, ebx, ecx, edx;
+    struct timespec delay = { 0, TIMESTAMP_TSC_CALIBRATION };
+    uint64_t        tsc0, tsc1;
+    timestamp_t     ns0, ns1;
+
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) return;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) return;
+
+    ns0  = timestamp_monotonic_now();
+    tsc0 = __rdtsc();
+    nanosleep(&delay, NULL);
+    ns1  = timestamp_monotonic_now();
+    tsc1 = __rdtsc();
+
+    if (tsc1 <= tsc0 || ns1 <= ns0) return;
+
+    s_tsc_mult   = ((ns1 - ns0) << TIMESTAMP_TSC_SHIFT) / (tsc1 - tsc0);
+    s_tsc_origin = tsc1;
+    s_ns_origin  = ns1;
+    s_use_tsc    = (s_tsc_mult > 0);
+}
+
+#endif
+
+timestamp_t timestamp_now() {
+#ifdef TIMESTAMP_HAS_TSC
+    if (s_use_tsc) {
+        return s_ns_origin + (timestamp_t) (((unsigned __int128) (__rdtsc() - s_tsc_origin) * s_tsc_mult) >> TIMESTAMP_TSC_SHIFT);
+    }
+#endif
+    return timestamp_monotonic_now();
+}
+
+const char * timestamp_get_clock_name() {
+#ifdef TIMESTAMP_HAS_TSC
+    if (s_use_tsc) return "tsc";
+#endif
+    return "monotonic";
+}
+
+double timestamp_to_seconds(timestamp_t timestamp) {
+    return (double) timestamp / TIMESTAMP_NSEC_PER_SEC;
+}
+
+timestamp_t timestamp_from_seconds(double seconds) {
+    return seconds > 0 ? (timestamp_t) (seconds * TIMESTAMP_NSEC_PER_SEC + 0.5) : 0;
+}
+
+timestamp_t timestamp_from_realtime(const struct timespec * date) {
+    struct timespec now_date;
+    timestamp_t     now = timestamp_now(),
+                    age;
+
+    clock_gettime(CLOCK_REALTIME, &now_date);
+    if (now_date.tv_sec < date->tv_sec
+    || (now_date.tv_sec == date->tv_sec && now_date.tv_nsec <= date->tv_nsec)) {
+        return now;
+    }
+
+    age = (timestamp_t) (now_date.tv_sec - date->tv_sec) * TIMESTAMP_NSEC_PER_SEC
+        + now_date.tv_nsec - date->tv_nsec;
+    return age < now ? now - age : 0;
+}
+
+double timestamp_diff(timestamp_t from, timestamp_t to) {
+    return to > from ? timestamp_to_seconds(to - from) : 0;
+}
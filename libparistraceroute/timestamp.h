@@ -0,0 +1,92 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+/**
+ * \file timestamp.h
+ * \brief Monotonic clock used to timestamp probes and to drive timers.
+ *
+ * A timestamp_t is a number of nanoseconds elapsed since an arbitrary
+ * (but fixed) origin. It is read from CLOCK_MONOTONIC, which is served
+ * by the vDSO (no system call) and is not affected by the adjustments
+ * of the wall clock (NTP, settimeofday), so the difference between two
+ * timestamps returned by timestamp_now is always a valid duration.
+ *
+ * If USE_KERNEL_TIMESTAMPS is defined (see use.h), the probes and the
+ * replies are timestamped by the kernel. These timestamps are CLOCK_REALTIME
+ * dates converted by timestamp_from_realtime. The difference between two
+ * such timestamps is a valid duration unless the wall clock is stepped in
+ * the meantime, in which case it is skewed by the size of the step. This
+ * is why USE_KERNEL_TIMESTAMPS is disabled by default.
+ *
+ * If USE_TSC_CLOCK is defined (see use.h) and the CPU has an invariant
+ * TSC, timestamps are derived from the TSC instead. Its frequency is
+ * calibrated against CLOCK_MONOTONIC when the library is loaded.
+ * Otherwise, CLOCK_MONOTONIC is used.
+ *
+ * Timestamps are only meaningful within a process: they must not be
+ * compared to wall-clock dates.
+ */
+
+#include <stdint.h> // uint64_t
+#include <time.h>   // struct timespec
+
+#include "use.h"
+
+#define TIMESTAMP_NSEC_PER_SEC  1000000000ULL
+#define TIMESTAMP_NSEC_PER_MSEC 1000000ULL
+
+typedef uint64_t timestamp_t;
+
+/**
+ * \brief Read the clock.
+ * \return The current timestamp (in nanoseconds).
+ */
+
+timestamp_t timestamp_now();
+
+/**
+ * \brief Retrieve the name of the clock source in use.
+ * \return "tsc" or "monotonic".
+ */
+
+const char * timestamp_get_clock_name();
+
+/**
+ * \brief Convert a timestamp (or a duration) in seconds.
+ * \param timestamp A timestamp (in nanoseconds).
+ * \return The corresponding number of seconds.
+ */
+
+double timestamp_to_seconds(timestamp_t timestamp);
+
+/**
+ * \brief Convert a number of seconds in a timestamp (or a duration).
+ * \param seconds A number of seconds. Negative values are rounded up to 0.
+ * \return The corresponding timestamp (in nanoseconds).
+ */
+
+timestamp_t timestamp_from_seconds(double seconds);
+
+/**
+ * \brief Convert a CLOCK_REALTIME date (e.g. a timestamp reported by the
+ *    kernel, see SO_TIMESTAMPNS) in a timestamp. The conversion relies on
+ *    the current offset between both clocks: if the wall clock has been
+ *    stepped since this date, the result is shifted by the size of the
+ *    step.
+ * \param date A date (CLOCK_REALTIME).
+ * \return The corresponding timestamp. Dates in the future are
+ *    converted in timestamp_now().
+ */
+
+timestamp_t timestamp_from_realtime(const struct timespec * date);
+
+/**
+ * \brief Compute the duration elapsed between two timestamps.
+ * \param from The oldest timestamp.
+ * \param to The newest timestamp.
+ * \return to - from (in seconds), 0 if to < from.
+ */
+
+double timestamp_diff(timestamp_t from, timestamp_t to);
+
+#endif
@@ -10,10 +10,30 @@
 // Enable bit-level fields and non-aligned fields management
 #define USE_BITS
 
-// Enable caches (for example, DNS caches) 
+// Enable caches (for example, DNS caches). Required to resolve the hop names
+// without blocking (see resolver.h).
 #define USE_CACHE
 
 // Enable scheduling of probes
 #define USE_SCHEDULING
 
+// Check each incremental checksum update against a full computation (slow)
+//#define USE_CHECKSUM_VERIFICATION
+
+// Timestamp the probes with the TSC (x86-64 only, if invariant) instead of CLOCK_MONOTONIC
+//#define USE_TSC_CLOCK
+
+// Timestamp the probes and the replies in the kernel (SO_TIMESTAMPING, SO_TIMESTAMPNS).
+// These are wall-clock dates: a step of the wall clock while a probe is flying
+// skews its RTT (see timestamp.h). Otherwise, only CLOCK_MONOTONIC is used.
+//#define USE_KERNEL_TIMESTAMPS
+
+// Sniff the replies (including TCP RST and SYN-ACK) from a memory-mapped TPACKET_V3
+// ring (Linux only) instead of reading them from raw ICMP sockets
+//#define USE_PACKET_RING
+
+// Load the MDA stopping points from BOUND_CACHE_FILENAME (see bound.h). They are
+// computed as usual if this file is missing (see ./configure --disable-mda-bound-file)
+#define USE_BOUND_CACHE_FILE
+
 #endif
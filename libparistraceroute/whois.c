@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "whois.h"
+#include "asn_table.h"  // asn_table_t
 
 #include <errno.h>      // errno
 #include <stdio.h>      // fprintf
@@ -36,6 +37,25 @@ static void __cache_ip_asn_free() {
 
 #endif
 
+// Prefix-to-AS table consulted before the whois servers
+static asn_table_t * s_asn_table = NULL;
+
+static void __asn_table_free() __attribute__((destructor));
+
+static void __asn_table_free() {
+    asn_table_free(s_asn_table);
+    s_asn_table = NULL;
+}
+
+bool whois_load_asn_table(const char * filename) {
+    asn_table_t * asn_table;
+
+    if (!(asn_table = asn_table_open(filename))) return false;
+    asn_table_free(s_asn_table);
+    s_asn_table = asn_table;
+    return true;
+}
+
 bool whois_callback_print(void * pdata, const char * line) {
     FILE * out = (FILE *) pdata;
     fprintf(out, "%s\n", line);
@@ -243,6 +263,11 @@ bool whois_get_asn(
 ) {
     bool ret = true;
 
+    // Offline lookup
+    if (s_asn_table && asn_table_lookup(s_asn_table, queried_address, asn)) {
+        return true;
+    }
+
 	// FIXME
 /*
 
@@ -76,7 +76,19 @@ bool whois(
 );
 
 /**
- * \brief Perform a whois query (whois_find_server + whois_query).
+ * \brief Load the prefix-to-AS table used by whois_get_asn (see asn_table.h).
+ *    It replaces the table previously loaded, if any.
+ * \param filename The path of a prefix-to-AS dump or of its compiled form.
+ * \return true iif successful.
+ */
+
+bool whois_load_asn_table(const char * filename);
+
+/**
+ * \brief Retrieve the origin AS of an IP address. It is looked up in the
+ *    table loaded by whois_load_asn_table, if any. The whois servers are
+ *    only queried (whois_find_server + whois_query) if this table does not
+ *    cover this address.
  * \example
     uint32_t asn;
     address_t address;
@@ -8,6 +8,7 @@
 #include <string.h>                  // strcmp
 #include <stdint.h>                  // UINT16_MAX
 #include <float.h>                   // DBL_MAX
+#include <limits.h>                  // INT_MAX
 #include <sys/types.h>               // gai_strerror
 #include <sys/socket.h>              // gai_strerror, AF_INET, AF_INET6
 #include <netdb.h>                   // gai_strerror
@@ -22,6 +23,8 @@
 #include "algorithms/traceroute.h"   // traceroute_options_t
 #include "address.h"                 // address_to_string
 #include "options.h"                 // options_*
+#include "campaign.h"                // campaign_*
+#include "dynarray.h"                // dynarray_*
 
 //---------------------------------------------------------------------------
 // Command line stuff
@@ -38,6 +41,8 @@
 #define TRACEROUTE_HELP_T  "Use TCP for tracerouting."
 #define TRACEROUTE_HELP_U  "Use UDP for tracerouting. The destination port is set by default to 53."
 #define TRACEROUTE_HELP_z  "Minimal time interval between probes (default 0).  If the value is more than 10, then it specifies a number in milliseconds, else it is a number of seconds (float point values allowed  too)"
+#define TRACEROUTE_HELP_destinations  "Trace every destination listed in FILE (one IP address or hostname per line) instead of a single host."
+#define TRACEROUTE_HELP_max_instances "Set the maximum number of destinations traced at the same time when using --destinations (default: 16)."
 #define TEXT               "paris-traceroute - print the IP-level path toward a given IP host."
 #define TEXT_OPTIONS       "Options:"
 
@@ -76,6 +81,9 @@ const char * protocol_names[] = {
 static int    dst_port[4]    = {33457,  0,   UINT16_MAX, 0};
 static int    src_port[4]    = {33456,  0,   UINT16_MAX, 0};
 static double send_time[4]   = {1,      1,   DBL_MAX,    0};
+static int    max_instances[3] = {16,   1,   INT_MAX};
+
+static struct opt_str destinations_file = {NULL, 0};
 
 struct opt_spec runnable_options[] = {
     // action                 sf          lf                   metavar             help          data
@@ -92,6 +100,8 @@ struct opt_spec runnable_options[] = {
     {opt_store_choice,        "P",        "--protocol",        "PROTOCOL",         TRACEROUTE_HELP_P,       protocol_names},
     {opt_store_1,             "T",        "--tcp",             OPT_NO_METAVAR,     TRACEROUTE_HELP_T,       &is_tcp},
     {opt_store_1,             "U",        "--udp",             OPT_NO_METAVAR,     TRACEROUTE_HELP_U,       &is_udp},
+    {opt_store_str,           OPT_NO_SF,  "--destinations",    "FILE",             TRACEROUTE_HELP_destinations,  &destinations_file},
+    {opt_store_int_lim,       OPT_NO_SF,  "--max-instances",   "NUM",              TRACEROUTE_HELP_max_instances, max_instances},
     END_OPT_SPECS
 };
 
@@ -112,6 +122,9 @@ static options_t * init_options(char * version) {
     options_add_optspecs(options, traceroute_get_options());
     options_add_optspecs(options, mda_get_options());
     options_add_optspecs(options, network_get_options());
+#ifdef USE_CACHE
+    options_add_optspecs(options, resolver_get_options());
+#endif
     options_add_common  (options, version);
     return options;
 
@@ -193,6 +206,120 @@ static bool check_options(
 // Command-line / libparistraceroute translation
 //---------------------------------------------------------------------------
 
+/**
+ * \brief Stop the algorithm instance run by paris-traceroute, and then
+ *    the main loop.
+ * \param loop The main loop.
+ * \param instance The terminated instance.
+ */
+
+static void loop_terminate(pt_loop_t * loop, algorithm_instance_t * instance)
+{
+    // Tell to the algorithm it can free its data
+    pt_stop_instance(loop, instance);
+
+    // Remove the application from the loop.
+    pt_del_instance(loop, instance);
+
+    pt_loop_terminate(loop);
+}
+
+//---------------------------------------------------------------------------
+// Campaign (--destinations)
+//---------------------------------------------------------------------------
+
+static campaign_t * campaign = NULL;               // Non-NULL iif paris-traceroute traces several destinations
+static dynarray_t * terminated_instances = NULL;   // Terminated traceroute instances whose hops are not printed yet
+static bool         is_printing_hops = false;      // true iif the hops of the first terminated instance are being printed
+
+/**
+ * \brief Print the header related to an algorithm instance.
+ * \param algorithm_name The name of the algorithm.
+ * \param traceroute_options The options of this instance.
+ * \param probe_skel The probe skeleton of this instance.
+ */
+
+static void header_print(const char * algorithm_name, const traceroute_options_t * traceroute_options, const probe_t * probe_skel)
+{
+    printf("%s to ", algorithm_name);
+    address_dump(traceroute_options->dst_addr);
+    printf(", %u hops max, %u bytes packets\n",
+        traceroute_options->max_ttl,
+        (unsigned int) packet_get_size(probe_skel->packet)
+    );
+}
+
+/**
+ * \brief Release the data of an instance of the campaign. Its pending
+ *    probes are cancelled, so that it receives no more replies once its
+ *    data is released.
+ * \param loop The main loop.
+ * \param instance An instance of the campaign.
+ */
+
+static void campaign_stop_instance(pt_loop_t * loop, algorithm_instance_t * instance)
+{
+    network_cancel_probes(loop->network, instance);
+    pt_stop_instance(loop, instance);
+}
+
+/**
+ * \brief Print the hops of the terminated traceroute instances of the
+ *    campaign, one instance after the other. Each instance is stopped
+ *    once all its hops are printed.
+ * \param loop The main loop.
+ */
+
+static void campaign_print_hops(pt_loop_t * loop)
+{
+    algorithm_instance_t * instance;
+
+    while (dynarray_get_size(terminated_instances) > 0) {
+        instance = dynarray_get_ith_element(terminated_instances, 0);
+        if (!is_printing_hops) {
+            header_print(instance->algorithm->name, instance->options, instance->probe_skel);
+            is_printing_hops = true;
+        }
+
+        // Wait for the hostnames of the remaining hops (see NAME_RESOLVED)
+        if (traceroute_handler_flush(instance->data, true) > 0) break;
+
+        is_printing_hops = false;
+        dynarray_del_ith_element(terminated_instances, 0, NULL);
+        campaign_stop_instance(loop, instance);
+    }
+}
+
+/**
+ * \brief Handle the termination of an instance of the campaign. Once an
+ *    instance is over, its results are printed and its data is released
+ *    (see campaign_stop_instance). The instance then raises again
+ *    ALGORITHM_HAS_TERMINATED, and the campaign starts the next destination.
+ * \param loop The main loop.
+ * \param instance The terminated instance.
+ */
+
+static void campaign_handle_instance_terminated(pt_loop_t * loop, algorithm_instance_t * instance)
+{
+    // The data of this instance has been released
+    if (!instance->data) {
+        campaign_handle_terminated(campaign, instance);
+        return;
+    }
+
+    if (strcmp(instance->algorithm->name, "mda") == 0) {
+        header_print(instance->algorithm->name, instance->options, instance->probe_skel);
+        printf("Lattice:\n");
+        lattice_dump(((mda_data_t *) instance->data)->lattice, (ELEMENT_DUMP) mda_lattice_elt_dump);
+        printf("\n");
+        campaign_stop_instance(loop, instance);
+    } else if (dynarray_push_element(terminated_instances, instance)) {
+        campaign_print_hops(loop);
+    } else {
+        campaign_stop_instance(loop, instance);
+    }
+}
+
 /**
  * \brief Handle events raised by libparistraceroute.
  * \param loop The main loop.
@@ -205,13 +332,20 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
 {
     traceroute_event_t         * traceroute_event;
     const traceroute_options_t * traceroute_options;
-    const traceroute_data_t    * traceroute_data;
+    traceroute_data_t          * traceroute_data;
     mda_event_t                * mda_event;
     mda_data_t                 * mda_data;
     const char                 * algorithm_name;
+    static algorithm_instance_t * traceroute_instance = NULL; // Instance whose hops are printed by traceroute_handler
+    static bool                  is_terminated = false;
 
     switch (event->type) {
         case ALGORITHM_HAS_TERMINATED:
+            if (campaign) {
+                campaign_handle_instance_terminated(loop, event->issuer);
+                break;
+            }
+
             algorithm_name = event->issuer->algorithm->name;
             if (strcmp(algorithm_name, "mda") == 0) {
                 mda_data = event->issuer->data;
@@ -221,14 +355,18 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
                 mda_data_free(mda_data);
             }
 
-            // Tell to the algorithm it can free its data
-            pt_stop_instance(loop, event->issuer);
-
-            // Remove the application from the loop.
-            pt_del_instance(loop, event->issuer);
-
-            // Kill the loop
-            pt_loop_terminate(loop);
+            // Kill the loop once every hop has been printed
+            is_terminated = true;
+            if (traceroute_instance && traceroute_handler_flush(traceroute_instance->data, true) > 0) break;
+            loop_terminate(loop, event->issuer);
+            break;
+        case NAME_RESOLVED:
+            // Print the hops which were waiting for this hostname
+            if (campaign) {
+                campaign_print_hops(loop);
+            } else if (traceroute_instance && traceroute_handler_flush(traceroute_instance->data, is_terminated) == 0 && is_terminated) {
+                loop_terminate(loop, traceroute_instance);
+            }
             break;
         case ALGORITHM_EVENT:
             algorithm_name = event->issuer->algorithm->name;
@@ -237,21 +375,36 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
                 traceroute_options = event->issuer->options; // mda_options inherits traceroute_options
                 switch (mda_event->type) {
                     case MDA_NEW_LINK:
-                        mda_link_dump(mda_event->data, traceroute_options->do_resolv);
+                        // Several lattices are discovered at once during a campaign:
+                        // they are dumped once complete.
+                        if (!campaign) mda_link_dump(mda_event->data, traceroute_options->do_resolv);
                         break;
                     default:
                         break;
                 }
             } else if (strcmp(algorithm_name, "traceroute") == 0) {
-                traceroute_event   = event->data;
-                traceroute_options = event->issuer->options;
-                traceroute_data    = event->issuer->data;
+                traceroute_event    = event->data;
+                traceroute_options  = event->issuer->options;
+                traceroute_data     = event->issuer->data;
+                traceroute_instance = event->issuer;
+
+                // Several instances run at once during a campaign: their
+                // hops are printed once they have terminated.
+                if (campaign) traceroute_data->defer_hop_lines = true;
 
                 // Forward this event to the default traceroute handler
                 // See libparistraceroute/algorithms/traceroute.c
                 traceroute_handler(loop, traceroute_event, traceroute_options, traceroute_data);
             }
             break;
+        case ALGORITHM_ERROR:
+            // Give up this destination
+            if (campaign) {
+                campaign_stop_instance(loop, event->issuer);
+            } else {
+                loop_terminate(loop, event->issuer);
+            }
+            break;
         default:
             break;
     }
@@ -300,8 +453,9 @@ int main(int argc, char ** argv)
 {
     int                       exit_code = EXIT_FAILURE;
     char                    * version = strdup("version 1.0");
-    const char              * usage = "usage: %s [options] host\n";
+    const char              * usage = "usage: %s [options] {host | --destinations FILE}\n";
     void                    * algorithm_options;
+    size_t                    algorithm_options_size;
     traceroute_options_t      traceroute_options;
     traceroute_options_t    * ptraceroute_options;
     mda_options_t             mda_options;
@@ -314,6 +468,7 @@ int main(int argc, char ** argv)
     const char              * algorithm_name;
     const char              * protocol_name;
     bool                      use_icmp, use_udp, use_tcp;
+    FILE                    * destinations;
 
     // Prepare the commande line options
     if (!(options = init_options(version))) {
@@ -321,14 +476,18 @@ int main(int argc, char ** argv)
         goto ERR_INIT_OPTIONS;
     }
 
-    // Retrieve values passed in the command-line
-    if (options_parse(options, usage, argv) != 1) {
-        fprintf(stderr, "%s: destination required\n", basename(argv[0]));
+    // Retrieve values passed in the command-line. The destinations are
+    // either listed in a file, or passed as the last argument.
+    if (options_parse(options, usage, argv) != (destinations_file.s ? 0 : 1)) {
+        fprintf(stderr, "%s: %s\n", basename(argv[0]), destinations_file.s ?
+            "a single destination source is allowed" :
+            "destination required"
+        );
         goto ERR_OPT_PARSE;
     }
 
     // We assume that the target IP address is always the last argument
-    dst_ip         = argv[argc - 1];
+    dst_ip         = destinations_file.s ? NULL : argv[argc - 1];
     algorithm_name = algorithm_names[0];
     protocol_name  = protocol_names[0];
 
@@ -347,13 +506,16 @@ int main(int argc, char ** argv)
         family = AF_INET;
     } else if (is_ipv6) {
         family = AF_INET6;
+    } else if (!dst_ip) {
+        // The destinations of a campaign must share the same family
+        family = AF_INET;
     } else {
         // Get address family if not defined by the user
         if (!address_guess_family(dst_ip, &family)) goto ERR_ADDRESS_GUESS_FAMILY;
     }
 
     // Translate the string IP / FQDN into an address_t * instance
-    if (address_from_string(family, dst_ip, &dst_addr) != 0) {
+    if (dst_ip && address_from_string(family, dst_ip, &dst_addr) != 0) {
         fprintf(stderr, "E: Invalid destination address %s\n", dst_ip);
         goto ERR_ADDRESS_IP_FROM_STRING;
     }
@@ -372,7 +534,8 @@ int main(int argc, char ** argv)
         NULL
     );
 
-    probe_set_field(probe, ADDRESS("dst_ip", &dst_addr));
+    // The campaign sets the destination of each instance
+    if (dst_ip) probe_set_field(probe, ADDRESS("dst_ip", &dst_addr));
 
     if (send_time[3]) {
         if(send_time[0] <= 10) { // seconds
@@ -414,11 +577,13 @@ int main(int argc, char ** argv)
         traceroute_options  = traceroute_get_default_options();
         ptraceroute_options = &traceroute_options;
         algorithm_options   = &traceroute_options;
+        algorithm_options_size = sizeof(traceroute_options_t);
         algorithm_name      = "traceroute";
     } else if ((strcmp(algorithm_name, "mda") == 0) || options_mda_get_is_set()) {
         mda_options         = mda_get_default_options();
         ptraceroute_options = &mda_options.traceroute_options;
         algorithm_options   = &mda_options;
+        algorithm_options_size = sizeof(mda_options_t);
         options_mda_init(&mda_options);
     } else {
         fprintf(stderr, "E: Unknown algorithm");
@@ -426,7 +591,7 @@ int main(int argc, char ** argv)
     }
 
     // Algorithm options (common options)
-    options_traceroute_init(ptraceroute_options, &dst_addr);
+    options_traceroute_init(ptraceroute_options, dst_ip ? &dst_addr : NULL);
 
     // Create libparistraceroute loop
     if (!(loop = pt_loop_create(loop_handler, NULL))) {
@@ -436,18 +601,37 @@ int main(int argc, char ** argv)
 
     // Set network options (network and verbose)
     options_network_init(loop->network, is_debug);
+#ifdef USE_CACHE
+    if (!options_resolver_init(loop->resolver)) goto ERR_RESOLVER_INIT;
+#endif
+
+    if (destinations_file.s) {
+        // Trace each destination listed in the file, sharing this loop
+        if (!(terminated_instances = dynarray_create())) goto ERR_TERMINATED_INSTANCES;
+        if (!(campaign = campaign_create(loop, algorithm_name, algorithm_options, algorithm_options_size, probe, max_instances[0]))) {
+            fprintf(stderr, "E: Cannot create the campaign");
+            goto ERR_CAMPAIGN_CREATE;
+        }
+        if (!(destinations = fopen(destinations_file.s, "r"))) {
+            perror(destinations_file.s);
+            goto ERR_FOPEN;
+        }
+        campaign_load_destinations(campaign, destinations, family);
+        fclose(destinations);
+        campaign_start(campaign);
+    } else {
+        printf("%s to %s (", algorithm_name, dst_ip);
+        address_dump(&dst_addr);
+        printf("), %u hops max, %u bytes packets\n",
+            ptraceroute_options->max_ttl,
+            (unsigned int)packet_get_size(probe->packet)
+        );
 
-    printf("%s to %s (", algorithm_name, dst_ip);
-    address_dump(&dst_addr);
-    printf("), %u hops max, %u bytes packets\n",
-        ptraceroute_options->max_ttl,
-        (unsigned int)packet_get_size(probe->packet)
-    );
-
-    // Add an algorithm instance in the main loop
-    if (!pt_add_instance(loop, algorithm_name, algorithm_options, probe)) {
-        fprintf(stderr, "E: Cannot add the chosen algorithm");
-        goto ERR_INSTANCE;
+        // Add an algorithm instance in the main loop
+        if (!pt_add_instance(loop, algorithm_name, algorithm_options, probe)) {
+            fprintf(stderr, "E: Cannot add the chosen algorithm");
+            goto ERR_INSTANCE;
+        }
     }
 
     // Wait for events. They will be catched by handler_user()
@@ -459,11 +643,20 @@ int main(int argc, char ** argv)
 
     // Leave the program
 ERR_PT_LOOP:
+ERR_FOPEN:
+ERR_CAMPAIGN_CREATE:
+ERR_TERMINATED_INSTANCES:
 ERR_INSTANCE:
+#ifdef USE_CACHE
+ERR_RESOLVER_INIT:
+#endif
     // pt_loop_free() automatically removes algorithms instances,
     // probe_replies and events from the memory.
-    // Options and probe must be manually removed.
+    // Options and probe must be manually removed, as well as the
+    // campaign (which owns the options and probe of its instances).
     pt_loop_free(loop);
+    campaign_free(campaign);
+    dynarray_free(terminated_instances, NULL);
 ERR_LOOP_CREATE:
 ERR_UNKNOWN_ALGORITHM:
     probe_free(probe);
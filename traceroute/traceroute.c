@@ -20,14 +20,28 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
 {
     traceroute_event_t         * traceroute_event;
     const traceroute_options_t * traceroute_options;
-    const traceroute_data_t    * traceroute_data;
+    traceroute_data_t          * traceroute_data;
     const char                 * algorithm_name;
+    static algorithm_instance_t * instance = NULL;
+    static bool                  is_terminated = false;
 
     switch (event->type) {
         case ALGORITHM_HAS_TERMINATED:
             printf("> ALGORITHM_TERMINATED\n");
-            pt_stop_instance(loop, event->issuer); // release traceroute's data from the memory
-            pt_loop_terminate(loop);               // we've only run one 'traceroute' algorithm, so we can break the main loop
+            instance = event->issuer;
+            is_terminated = true;
+
+            // we've only run one 'traceroute' algorithm, so we can break the main loop
+            // once the hops waiting for their hostname have been printed
+            if (traceroute_handler_flush(instance->data, true) > 0) break;
+            pt_stop_instance(loop, instance); // release traceroute's data from the memory
+            pt_loop_terminate(loop);
+            break;
+        case NAME_RESOLVED: // a hostname needed by traceroute_handler is available
+            if (instance && traceroute_handler_flush(instance->data, is_terminated) == 0 && is_terminated) {
+                pt_stop_instance(loop, instance);
+                pt_loop_terminate(loop);
+            }
             break;
         case ALGORITHM_EVENT: // a traceroute-specific event has been raised
             algorithm_name = event->issuer->algorithm->name;
@@ -35,6 +49,7 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
                 traceroute_event   = event->data;
                 traceroute_options = event->issuer->options;
                 traceroute_data    = event->issuer->data;
+                instance           = event->issuer;
                 traceroute_handler(loop, traceroute_event, traceroute_options, traceroute_data);
             }
             break;